@@ -30,6 +30,7 @@
 #include <utility>
 
 #ifdef __PLATFORM_HAS_BOOST__
+#include <boost/functional/hash.hpp>
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_io.hpp>
 #include <boost/system/error_code.hpp>
@@ -43,6 +44,7 @@
 #include "base/resource_status.h"
 #include "base/resource_desc.pb.h"
 #include "base/job_desc.pb.h"
+#include "misc/sharded_map.h"
 
 using std::map;
 using std::pair;
@@ -122,7 +124,8 @@ typedef boost::uuids::uuid JobID_t;
         boost::hash<boost::uuids::uuid> > ResourceMap_t;
 typedef unordered_map<JobID_t, JobDescriptor,
         boost::hash<boost::uuids::uuid> > JobMap_t; */
-typedef thread_safe::map<ResourceID_t, ResourceStatus*> ResourceMap_t;
+typedef ShardedMap<ResourceID_t, ResourceStatus*,
+                   boost::hash<boost::uuids::uuid>> ResourceMap_t;
 typedef thread_safe::map<JobID_t, JobDescriptor> JobMap_t;
 #else
 typedef uint64_t ResourceID_t;
@@ -132,9 +135,9 @@ typedef unordered_map<JobID_t, JobDescriptor> JobMap_t;
 #endif
 // N.B.: the type of the second element here is a pointer, since the
 // TaskDescriptor objects will be part of the JobDescriptor protobuf that is
-// already held in the job table.
+// already held in the job table, or of the scheduler service's task store.
 //typedef unordered_map<TaskID_t, TaskDescriptor*> TaskMap_t;
-typedef thread_safe::map<TaskID_t, TaskDescriptor*> TaskMap_t;
+typedef ShardedMap<TaskID_t, TaskDescriptor*> TaskMap_t;
 
 #ifdef __PLATFORM_HAS_BOOST__
 // Message handler callback type definition
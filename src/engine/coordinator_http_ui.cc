@@ -838,13 +838,12 @@ void CoordinatorHTTPUI::HandleStatisticsURI(
   // Check if we have any statistics for this resource
   if (!res_id_str.empty()) {
     ResourceID_t res_id = ResourceIDFromString(res_id_str);
-    const deque<ResourceStats> result =
-      coordinator_->scheduler()->knowledge_base()->GetStatsForMachine(res_id);
+    vector<ResourceStats> result;
+    coordinator_->scheduler()->knowledge_base()->GetStatsForMachine(
+        res_id, WEBUI_PERF_QUEUE_LEN, &result);
     if (coordinator_->GetResourceTreeNode(res_id)) {
-      int64_t length = static_cast<int64_t>(result.size());
       output += "[";
-      for (deque<ResourceStats>::const_iterator it =
-             result.begin() + max(0LL, length - WEBUI_PERF_QUEUE_LEN);
+      for (vector<ResourceStats>::const_iterator it = result.begin();
           it != result.end();
           ++it) {
         if (output != "[")
@@ -869,23 +868,17 @@ void CoordinatorHTTPUI::HandleStatisticsURI(
       return;
     }
     output += "{ \"samples\": [";
-    const deque<TaskStats>* samples_result =
-      coordinator_->scheduler()->knowledge_base()->GetStatsForTask(
-            TaskIDFromString(task_id_str));
-    if (samples_result) {
-      bool first = true;
-      int64_t length = static_cast<int64_t>(samples_result->size());
-      for (deque<TaskStats>::const_iterator it =
-             samples_result->begin() + max(0LL, length - WEBUI_PERF_QUEUE_LEN);
-          it != samples_result->end();
-          ++it) {
-        if (!first)
-          output += ", ";
-        string json;
-        CHECK(MessageToJsonString(*it, &json).ok());
-        output += json;
-        first = false;
-      }
+    vector<TaskStats> samples_result;
+    coordinator_->scheduler()->knowledge_base()->GetStatsForTask(
+        TaskIDFromString(task_id_str), WEBUI_PERF_QUEUE_LEN, &samples_result);
+    for (vector<TaskStats>::const_iterator it = samples_result.begin();
+        it != samples_result.end();
+        ++it) {
+      if (it != samples_result.begin())
+        output += ", ";
+      string json;
+      CHECK(MessageToJsonString(*it, &json).ok());
+      output += json;
     }
     output += "]";
     output += ", \"reports\": [";
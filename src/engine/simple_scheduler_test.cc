@@ -75,7 +75,7 @@ class SimpleSchedulerTest : public ::testing::Test {
                                      shared_ptr<KnowledgeBase>(),
                                      shared_ptr<TopologyManager>(), NULL, NULL,
                                      GenerateResourceID(), "test",
-                                     &wall_time, NULL));
+                                     &wall_time, NULL, NULL));
   }
 
   virtual void TearDown() {
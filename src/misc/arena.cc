@@ -0,0 +1,88 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "misc/arena.h"
+
+#include <cstring>
+
+namespace firmament {
+
+Arena::Arena(uint64_t block_size)
+  : block_size_(block_size), current_block_(0), offset_(0),
+    num_allocations_(0), bytes_used_(0) {
+  CHECK_GT(block_size_, 0);
+}
+
+Arena::~Arena() {
+  Reset();
+  for (auto& block : blocks_) {
+    delete[] block;
+  }
+}
+
+const char* Arena::CopyString(const char* str) {
+  CHECK_NOTNULL(str);
+  uint64_t size = strlen(str) + 1;
+  char* copy = static_cast<char*>(Allocate(size, 1));
+  memcpy(copy, str, size);
+  num_allocations_++;
+  return copy;
+}
+
+void* Arena::Allocate(uint64_t size, uint64_t alignment) {
+  bytes_used_ += size;
+  if (size > block_size_) {
+    // new[] returns memory that is suitably aligned for any object type.
+    char* block = new char[size];
+    large_blocks_.push_back(block);
+    return block;
+  }
+  uint64_t offset = (offset_ + alignment - 1) & ~(alignment - 1);
+  if (blocks_.empty() || offset + size > block_size_) {
+    // Move to the next block, allocating it if we haven't done so in a
+    // previous round.
+    if (!blocks_.empty()) {
+      current_block_++;
+    }
+    if (current_block_ == blocks_.size()) {
+      blocks_.push_back(new char[block_size_]);
+    }
+    offset = 0;
+  }
+  offset_ = offset + size;
+  return blocks_[current_block_] + offset;
+}
+
+void Arena::Reset() {
+  for (vector<Destructor>::reverse_iterator it = destructors_.rbegin();
+       it != destructors_.rend(); ++it) {
+    it->second(it->first);
+  }
+  destructors_.clear();
+  for (auto& block : large_blocks_) {
+    delete[] block;
+  }
+  large_blocks_.clear();
+  current_block_ = 0;
+  offset_ = 0;
+  bytes_used_ = 0;
+}
+
+}  // namespace firmament
@@ -0,0 +1,113 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Region allocator for objects that are all freed at the same time. Objects
+// of any type are constructed back-to-back in large blocks. Reset() destroys
+// all objects, in reverse order of construction, and keeps the blocks for
+// re-use. Hence, an arena that is reset periodically stops allocating memory
+// once it has grown to its working set size.
+
+#ifndef FIRMAMENT_MISC_ARENA_H
+#define FIRMAMENT_MISC_ARENA_H
+
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "base/common.h"
+#include "base/types.h"
+
+namespace firmament {
+
+class Arena {
+ public:
+  explicit Arena(uint64_t block_size = 64 * 1024);
+  ~Arena();
+
+  /**
+   * Constructs a new object in the arena. The object is destroyed when the
+   * arena is reset or destroyed; it must not be deleted by the caller.
+   * @param args the arguments to pass to the object's constructor
+   * @return a pointer to the object
+   */
+  template<typename T, typename... Args>
+  T* New(Args&&... args) {
+    void* memory = Allocate(sizeof(T), alignof(T));
+    T* object = new(memory) T(std::forward<Args>(args)...);
+    if (!std::is_trivially_destructible<T>::value) {
+      destructors_.push_back(Destructor(object, &Destroy<T>));
+    }
+    num_allocations_++;
+    return object;
+  }
+
+  /**
+   * Copies a NUL-terminated string into the arena. The copy is freed when the
+   * arena is reset or destroyed.
+   * @param str the string to copy
+   * @return a pointer to the copy
+   */
+  const char* CopyString(const char* str);
+
+  /**
+   * Destroys all the objects allocated since the last reset.
+   */
+  void Reset();
+
+  // Number of objects allocated since the arena was created.
+  inline uint64_t num_allocations() const {
+    return num_allocations_;
+  }
+  // Number of blocks that the arena holds.
+  inline uint64_t num_blocks() const {
+    return blocks_.size() + large_blocks_.size();
+  }
+  // Number of bytes allocated since the last reset.
+  inline uint64_t bytes_used() const {
+    return bytes_used_;
+  }
+
+ private:
+  typedef pair<void*, void (*)(void*)> Destructor;
+
+  template<typename T>
+  static void Destroy(void* object) {
+    static_cast<T*>(object)->~T();
+  }
+
+  void* Allocate(uint64_t size, uint64_t alignment);
+
+  uint64_t block_size_;
+  // Blocks of block_size_ bytes. Blocks up to current_block_ are in use.
+  vector<char*> blocks_;
+  uint64_t current_block_;
+  // Offset of the first free byte in the current block.
+  uint64_t offset_;
+  // Blocks for objects larger than block_size_. These are freed on reset.
+  vector<char*> large_blocks_;
+  vector<Destructor> destructors_;
+  uint64_t num_allocations_;
+  uint64_t bytes_used_;
+};
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_MISC_ARENA_H
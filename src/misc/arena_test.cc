@@ -0,0 +1,129 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Arena allocator unit tests.
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "base/common.h"
+#include "misc/arena.h"
+
+namespace firmament {
+
+namespace {
+
+// Records the order in which instances are destroyed.
+struct DestructionRecorder {
+  DestructionRecorder(uint64_t id, vector<uint64_t>* destroyed)
+    : id_(id), destroyed_(destroyed) {
+  }
+  ~DestructionRecorder() {
+    destroyed_->push_back(id_);
+  }
+  uint64_t id_;
+  vector<uint64_t>* destroyed_;
+};
+
+struct LargeObject {
+  char data_[1024];
+};
+
+}  // namespace
+
+class ArenaTest : public ::testing::Test {
+ protected:
+  ArenaTest() {
+    FLAGS_v = 2;
+  }
+};
+
+// Checks that objects are aligned and destroyed in reverse order on reset.
+TEST_F(ArenaTest, NewAndReset) {
+  Arena arena(256);
+  vector<uint64_t> destroyed;
+  for (uint64_t i = 0; i < 100; ++i) {
+    char* padding = arena.New<char>('x');
+    EXPECT_EQ(*padding, 'x');
+    DestructionRecorder* recorder =
+      arena.New<DestructionRecorder>(i, &destroyed);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(recorder) %
+              alignof(DestructionRecorder), 0);
+    EXPECT_EQ(recorder->id_, i);
+  }
+  string* str = arena.New<string>("a string that is too long for SSO");
+  EXPECT_EQ(*str, "a string that is too long for SSO");
+  EXPECT_EQ(arena.num_allocations(), 201);
+  EXPECT_GT(arena.num_blocks(), 1);
+  EXPECT_GT(arena.bytes_used(), 100 * sizeof(DestructionRecorder));
+  arena.Reset();
+  EXPECT_EQ(arena.bytes_used(), 0);
+  ASSERT_EQ(destroyed.size(), 100);
+  for (uint64_t i = 0; i < 100; ++i) {
+    EXPECT_EQ(destroyed[i], 99 - i);
+  }
+}
+
+// Checks that the blocks are re-used after a reset, and that objects larger
+// than a block get a block of their own.
+TEST_F(ArenaTest, ReusesBlocks) {
+  Arena arena(256);
+  uint64_t* first = arena.New<uint64_t>(0);
+  for (uint64_t i = 1; i < 100; ++i) {
+    arena.New<uint64_t>(i);
+  }
+  uint64_t num_blocks = arena.num_blocks();
+  arena.Reset();
+  EXPECT_EQ(arena.New<uint64_t>(0), first);
+  for (uint64_t i = 1; i < 100; ++i) {
+    arena.New<uint64_t>(i);
+  }
+  EXPECT_EQ(arena.num_blocks(), num_blocks);
+  LargeObject* large = arena.New<LargeObject>();
+  EXPECT_TRUE(large != NULL);
+  EXPECT_EQ(arena.num_blocks(), num_blocks + 1);
+  arena.Reset();
+  EXPECT_EQ(arena.num_blocks(), num_blocks);
+}
+
+// Checks that copied strings survive the source and are freed on reset.
+TEST_F(ArenaTest, CopyString) {
+  Arena arena(16);
+  string source = "a string that is longer than a block";
+  const char* copy = arena.CopyString(source.c_str());
+  const char* short_copy = arena.CopyString("short");
+  const char* empty_copy = arena.CopyString("");
+  source.clear();
+  EXPECT_STREQ(copy, "a string that is longer than a block");
+  EXPECT_STREQ(short_copy, "short");
+  EXPECT_STREQ(empty_copy, "");
+  EXPECT_EQ(arena.num_allocations(), 3);
+  EXPECT_EQ(arena.bytes_used(), 37 + 6 + 1);
+  arena.Reset();
+  EXPECT_EQ(arena.bytes_used(), 0);
+}
+
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,107 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// FIFO queue of unique items that supports removing any item and moving it
+// to the back in constant time.
+
+#ifndef FIRMAMENT_MISC_INDEXED_QUEUE_H
+#define FIRMAMENT_MISC_INDEXED_QUEUE_H
+
+#include <functional>
+#include <list>
+
+#include "base/common.h"
+#include "base/types.h"
+
+namespace firmament {
+
+template<typename T, typename Hash = std::hash<T>>
+class IndexedQueue {
+ public:
+  typedef typename std::list<T>::const_iterator const_iterator;
+
+  /**
+   * Appends an item to the queue.
+   * @return false if the item is already queued, in which case it keeps its
+   * position
+   */
+  bool PushBack(const T& item) {
+    if (positions_.find(item) != positions_.end()) {
+      return false;
+    }
+    positions_[item] = items_.insert(items_.end(), item);
+    return true;
+  }
+
+  /**
+   * Removes an item from the queue.
+   * @return false if the item is not queued
+   */
+  bool Erase(const T& item) {
+    auto it = positions_.find(item);
+    if (it == positions_.end()) {
+      return false;
+    }
+    items_.erase(it->second);
+    positions_.erase(it);
+    return true;
+  }
+
+  /**
+   * Moves a queued item to the back of the queue.
+   * @return false if the item is not queued
+   */
+  bool MoveToBack(const T& item) {
+    auto it = positions_.find(item);
+    if (it == positions_.end()) {
+      return false;
+    }
+    items_.splice(items_.end(), items_, it->second);
+    return true;
+  }
+
+  inline bool Contains(const T& item) const {
+    return positions_.find(item) != positions_.end();
+  }
+
+  inline const_iterator begin() const {
+    return items_.begin();
+  }
+
+  inline const_iterator end() const {
+    return items_.end();
+  }
+
+  inline bool empty() const {
+    return items_.empty();
+  }
+
+  inline uint64_t size() const {
+    return items_.size();
+  }
+
+ private:
+  std::list<T> items_;
+  unordered_map<T, typename std::list<T>::iterator, Hash> positions_;
+};
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_MISC_INDEXED_QUEUE_H
@@ -0,0 +1,76 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Indexed queue unit tests.
+
+#include <gtest/gtest.h>
+
+#include "base/common.h"
+#include "misc/indexed_queue.h"
+
+namespace firmament {
+
+class IndexedQueueTest : public ::testing::Test {
+ protected:
+  IndexedQueueTest() {
+    FLAGS_v = 2;
+  }
+
+  vector<uint64_t> Items(const IndexedQueue<uint64_t>& queue) {
+    return vector<uint64_t>(queue.begin(), queue.end());
+  }
+};
+
+TEST_F(IndexedQueueTest, PushBackErase) {
+  IndexedQueue<uint64_t> queue;
+  EXPECT_TRUE(queue.empty());
+  EXPECT_TRUE(queue.PushBack(1));
+  EXPECT_TRUE(queue.PushBack(2));
+  EXPECT_TRUE(queue.PushBack(3));
+  // Duplicates are ignored.
+  EXPECT_FALSE(queue.PushBack(1));
+  EXPECT_EQ(queue.size(), 3);
+  EXPECT_EQ(Items(queue), vector<uint64_t>({1, 2, 3}));
+  EXPECT_TRUE(queue.Erase(2));
+  EXPECT_FALSE(queue.Erase(2));
+  EXPECT_FALSE(queue.Contains(2));
+  EXPECT_TRUE(queue.Contains(3));
+  EXPECT_EQ(Items(queue), vector<uint64_t>({1, 3}));
+}
+
+TEST_F(IndexedQueueTest, MoveToBack) {
+  IndexedQueue<uint64_t> queue;
+  for (uint64_t i = 1; i <= 3; ++i) {
+    queue.PushBack(i);
+  }
+  EXPECT_TRUE(queue.MoveToBack(1));
+  EXPECT_FALSE(queue.MoveToBack(4));
+  EXPECT_EQ(Items(queue), vector<uint64_t>({2, 3, 1}));
+  // Items that were moved can still be erased.
+  EXPECT_TRUE(queue.Erase(1));
+  EXPECT_EQ(Items(queue), vector<uint64_t>({2, 3}));
+}
+
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,134 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Unbounded multi-producer, single-consumer FIFO queue. Push never blocks and
+// never takes a lock, so any number of threads can enqueue concurrently while
+// a single consumer dequeues. Items pushed by the same thread are popped in
+// the order in which they were pushed.
+
+#ifndef FIRMAMENT_MISC_MPSC_QUEUE_H
+#define FIRMAMENT_MISC_MPSC_QUEUE_H
+
+#include <atomic>
+#include <utility>
+
+#include "base/common.h"
+#include "base/types.h"
+
+namespace firmament {
+
+template<typename T>
+class MPSCQueue {
+ public:
+  MPSCQueue() : head_(&stub_), tail_(&stub_), size_(0) {
+  }
+
+  ~MPSCQueue() {
+    T value;
+    while (Pop(&value)) {
+    }
+  }
+
+  /**
+   * Appends an item to the queue. Safe to call from any thread.
+   * @param value the item to append
+   */
+  void Push(T value) {
+    size_.fetch_add(1, std::memory_order_relaxed);
+    PushNode(new Node(std::move(value)));
+  }
+
+  /**
+   * Removes the item at the front of the queue. Must only be called by one
+   * thread at a time.
+   * @param value set to the removed item
+   * @return false if the queue is empty, or if the item at the front is still
+   * being pushed by a producer; in the latter case, a later call returns it
+   */
+  bool Pop(T* value) {
+    Node* tail = tail_;
+    Node* next = tail->next_.load(std::memory_order_acquire);
+    if (tail == &stub_) {
+      if (!next) {
+        return false;
+      }
+      // Skip the stub.
+      tail_ = next;
+      tail = next;
+      next = next->next_.load(std::memory_order_acquire);
+    }
+    if (!next) {
+      if (tail != head_.load(std::memory_order_acquire)) {
+        // A producer has swapped in a new head, but not linked it yet.
+        return false;
+      }
+      // The tail is the last node. Put the stub behind it so that the tail
+      // can be removed without racing with the producers.
+      PushNode(&stub_);
+      next = tail->next_.load(std::memory_order_acquire);
+      if (!next) {
+        return false;
+      }
+    }
+    tail_ = next;
+    *value = std::move(tail->value_);
+    delete tail;
+    size_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  /**
+   * Returns the number of items in the queue. The count is approximate while
+   * items are pushed or popped concurrently.
+   */
+  inline uint64_t size() const {
+    return size_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Node {
+    Node() : next_(NULL) {
+    }
+    explicit Node(T&& value) : next_(NULL), value_(std::move(value)) {
+    }
+    std::atomic<Node*> next_;
+    T value_;
+  };
+
+  void PushNode(Node* node) {
+    node->next_.store(NULL, std::memory_order_relaxed);
+    Node* prev = head_.exchange(node, std::memory_order_acq_rel);
+    prev->next_.store(node, std::memory_order_release);
+  }
+
+  // Placeholder node that keeps the queue non-empty, so that producers and
+  // the consumer never touch the same node while more than one item is
+  // queued.
+  Node stub_;
+  // Most recently pushed node; written by the producers.
+  std::atomic<Node*> head_;
+  // Oldest node; only accessed by the consumer.
+  Node* tail_;
+  std::atomic<uint64_t> size_;
+};
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_MISC_MPSC_QUEUE_H
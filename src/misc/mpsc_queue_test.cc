@@ -0,0 +1,99 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// MPSC queue unit tests.
+
+#include <gtest/gtest.h>
+
+#include <boost/thread.hpp>
+
+#include "base/common.h"
+#include "misc/mpsc_queue.h"
+
+namespace firmament {
+
+class MPSCQueueTest : public ::testing::Test {
+ protected:
+  MPSCQueueTest() {
+    FLAGS_v = 2;
+  }
+};
+
+// Checks that a single thread gets the items back in FIFO order, and that
+// the queue can be drained and refilled.
+TEST_F(MPSCQueueTest, FIFO) {
+  MPSCQueue<uint64_t> queue;
+  uint64_t value;
+  EXPECT_FALSE(queue.Pop(&value));
+  for (uint64_t round = 0; round < 3; ++round) {
+    for (uint64_t i = 0; i < 10; ++i) {
+      queue.Push(i);
+    }
+    EXPECT_EQ(queue.size(), 10);
+    for (uint64_t i = 0; i < 10; ++i) {
+      ASSERT_TRUE(queue.Pop(&value));
+      EXPECT_EQ(value, i);
+    }
+    EXPECT_FALSE(queue.Pop(&value));
+    EXPECT_EQ(queue.size(), 0);
+  }
+}
+
+// Checks that the items pushed concurrently by several producers are all
+// popped exactly once, and in order for each producer.
+TEST_F(MPSCQueueTest, ConcurrentProducers) {
+  const uint64_t kNumProducers = 4;
+  const uint64_t kItemsPerProducer = 100000;
+  MPSCQueue<pair<uint64_t, uint64_t>> queue;
+  boost::thread_group producers;
+  for (uint64_t producer = 0; producer < kNumProducers; ++producer) {
+    producers.create_thread([&queue, producer, kItemsPerProducer]() {
+        for (uint64_t i = 0; i < kItemsPerProducer; ++i) {
+          queue.Push(pair<uint64_t, uint64_t>(producer, i));
+        }
+      });
+  }
+  vector<uint64_t> next_item(kNumProducers, 0);
+  uint64_t num_popped = 0;
+  while (num_popped < kNumProducers * kItemsPerProducer) {
+    pair<uint64_t, uint64_t> item;
+    if (!queue.Pop(&item)) {
+      boost::this_thread::yield();
+      continue;
+    }
+    ASSERT_LT(item.first, kNumProducers);
+    EXPECT_EQ(item.second, next_item[item.first]);
+    next_item[item.first] = item.second + 1;
+    num_popped++;
+  }
+  producers.join_all();
+  pair<uint64_t, uint64_t> item;
+  EXPECT_FALSE(queue.Pop(&item));
+  for (uint64_t producer = 0; producer < kNumProducers; ++producer) {
+    EXPECT_EQ(next_item[producer], kItemsPerProducer);
+  }
+}
+
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,134 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Slab allocator for objects of a single type. Objects are constructed in
+// slabs of slots, and the slots of deleted objects are kept on a free list
+// and re-used by the next allocation. Slabs are only released when the pool
+// is destroyed. This is intended for types that are allocated and freed at a
+// high rate, but whose addresses must remain stable (e.g., flow graph nodes
+// and arcs).
+
+#ifndef FIRMAMENT_MISC_OBJECT_POOL_H
+#define FIRMAMENT_MISC_OBJECT_POOL_H
+
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "base/common.h"
+#include "base/types.h"
+
+namespace firmament {
+
+template<typename T>
+class ObjectPool {
+ public:
+  explicit ObjectPool(uint64_t objects_per_slab = 1024)
+    : objects_per_slab_(objects_per_slab), free_list_(NULL),
+      num_allocations_(0), num_in_use_(0) {
+    CHECK_GT(objects_per_slab_, 0);
+  }
+
+  ~ObjectPool() {
+    // The owner must have deleted all objects; we can't run their destructors
+    // because we don't know which slots are in use.
+    DCHECK_EQ(num_in_use_, 0);
+    for (auto& slab : slabs_) {
+      delete[] slab;
+    }
+  }
+
+  /**
+   * Constructs a new object in a free slot.
+   * @param args the arguments to pass to the object's constructor
+   * @return a pointer to the object
+   */
+  template<typename... Args>
+  T* New(Args&&... args) {
+    if (!free_list_) {
+      AllocateSlab();
+    }
+    Slot* slot = free_list_;
+    free_list_ = slot->next;
+    T* object = new(&slot->storage) T(std::forward<Args>(args)...);
+    num_allocations_++;
+    num_in_use_++;
+    return object;
+  }
+
+  /**
+   * Destroys an object that was allocated from this pool, and returns its
+   * slot to the free list.
+   * @param object the object to delete
+   */
+  void Delete(T* object) {
+    if (!object) {
+      return;
+    }
+    object->~T();
+    Slot* slot = reinterpret_cast<Slot*>(object);
+    slot->next = free_list_;
+    free_list_ = slot;
+    DCHECK_GT(num_in_use_, 0);
+    num_in_use_--;
+  }
+
+  // Number of objects allocated since the pool was created.
+  inline uint64_t num_allocations() const {
+    return num_allocations_;
+  }
+  // Number of objects currently allocated.
+  inline uint64_t num_in_use() const {
+    return num_in_use_;
+  }
+  // Number of slabs that the pool holds.
+  inline uint64_t num_slabs() const {
+    return slabs_.size();
+  }
+
+ private:
+  union Slot {
+    Slot* next;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+  };
+
+  void AllocateSlab() {
+    Slot* slab = new Slot[objects_per_slab_];
+    // Chain the slots in address order, so that consecutive allocations
+    // return adjacent objects.
+    for (uint64_t i = 0; i + 1 < objects_per_slab_; ++i) {
+      slab[i].next = &slab[i + 1];
+    }
+    slab[objects_per_slab_ - 1].next = free_list_;
+    free_list_ = slab;
+    slabs_.push_back(slab);
+  }
+
+  uint64_t objects_per_slab_;
+  Slot* free_list_;
+  vector<Slot*> slabs_;
+  uint64_t num_allocations_;
+  uint64_t num_in_use_;
+};
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_MISC_OBJECT_POOL_H
@@ -0,0 +1,111 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Object pool unit tests.
+
+#include <gtest/gtest.h>
+
+#include <set>
+
+#include "base/common.h"
+#include "misc/object_pool.h"
+
+namespace firmament {
+
+namespace {
+
+// Counts the live instances.
+struct Counted {
+  Counted(uint64_t value, uint64_t* num_live)
+    : value_(value), num_live_(num_live) {
+    (*num_live_)++;
+  }
+  ~Counted() {
+    (*num_live_)--;
+  }
+  uint64_t value_;
+  uint64_t* num_live_;
+};
+
+}  // namespace
+
+class ObjectPoolTest : public ::testing::Test {
+ protected:
+  ObjectPoolTest() {
+    FLAGS_v = 2;
+  }
+};
+
+// Checks that objects are constructed and destroyed, and that the pool grows
+// by whole slabs.
+TEST_F(ObjectPoolTest, NewAndDelete) {
+  ObjectPool<Counted> pool(16);
+  uint64_t num_live = 0;
+  vector<Counted*> objects;
+  for (uint64_t i = 0; i < 40; ++i) {
+    objects.push_back(pool.New(i, &num_live));
+  }
+  EXPECT_EQ(num_live, 40);
+  EXPECT_EQ(pool.num_in_use(), 40);
+  EXPECT_EQ(pool.num_allocations(), 40);
+  EXPECT_EQ(pool.num_slabs(), 3);
+  set<Counted*> distinct(objects.begin(), objects.end());
+  EXPECT_EQ(distinct.size(), 40);
+  for (uint64_t i = 0; i < 40; ++i) {
+    EXPECT_EQ(objects[i]->value_, i);
+    pool.Delete(objects[i]);
+  }
+  EXPECT_EQ(num_live, 0);
+  EXPECT_EQ(pool.num_in_use(), 0);
+}
+
+// Checks that the slots of deleted objects are re-used.
+TEST_F(ObjectPoolTest, ReusesSlots) {
+  ObjectPool<Counted> pool(16);
+  uint64_t num_live = 0;
+  vector<Counted*> objects;
+  for (uint64_t i = 0; i < 16; ++i) {
+    objects.push_back(pool.New(i, &num_live));
+  }
+  Counted* deleted = objects[5];
+  pool.Delete(deleted);
+  objects[5] = pool.New(42, &num_live);
+  EXPECT_EQ(objects[5], deleted);
+  EXPECT_EQ(objects[5]->value_, 42);
+  EXPECT_EQ(pool.num_slabs(), 1);
+  for (auto& object : objects) {
+    pool.Delete(object);
+  }
+  for (uint64_t i = 0; i < 16; ++i) {
+    objects[i] = pool.New(i, &num_live);
+  }
+  EXPECT_EQ(pool.num_slabs(), 1);
+  EXPECT_EQ(pool.num_allocations(), 33);
+  for (auto& object : objects) {
+    pool.Delete(object);
+  }
+}
+
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
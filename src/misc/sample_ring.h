@@ -0,0 +1,214 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Fixed-capacity ring buffer of plain-old-data samples with a single writer
+// and any number of readers, none of which ever wait. Every slot carries a
+// sequence number that the writer makes odd while it overwrites the sample;
+// a reader copies the sample out and checks the sequence number again, and
+// drops the copy if the slot changed under it (a per-slot seqlock). Samples
+// are indexed from zero in the order in which they were pushed, and once the
+// ring is full a push overwrites the oldest sample. The slots are allocated
+// in chunks as the writer first reaches them, so a ring that only ever holds
+// a few samples stays small whatever its capacity.
+
+#ifndef FIRMAMENT_MISC_SAMPLE_RING_H
+#define FIRMAMENT_MISC_SAMPLE_RING_H
+
+#include <algorithm>
+#include <atomic>
+#include <type_traits>
+
+#include "base/common.h"
+#include "base/types.h"
+
+namespace firmament {
+
+template<typename T>
+class SampleRing {
+ public:
+  static_assert(std::is_pod<T>::value, "Samples must be plain old data");
+
+  explicit SampleRing(uint64_t capacity)
+    : capacity_(capacity),
+      num_chunks_((capacity + kSlotsPerChunk - 1) / kSlotsPerChunk),
+      chunks_(new std::atomic<Slot*>[num_chunks_]), num_pushed_(0) {
+    CHECK_GT(capacity_, 0);
+    for (uint64_t i = 0; i < num_chunks_; ++i) {
+      chunks_[i].store(NULL, std::memory_order_relaxed);
+    }
+  }
+
+  ~SampleRing() {
+    for (uint64_t i = 0; i < num_chunks_; ++i) {
+      delete[] chunks_[i].load(std::memory_order_relaxed);
+    }
+    delete[] chunks_;
+  }
+
+  /**
+   * Appends a sample, overwriting the oldest one if the ring is full. Must
+   * only be called by one thread at a time.
+   * @param sample the sample to append
+   * @return the index of the sample
+   */
+  uint64_t Push(const T& sample) {
+    uint64_t index = num_pushed_.load(std::memory_order_relaxed);
+    Slot* slot = MutableSlot(index % capacity_);
+    slot->seq_.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->sample_ = sample;
+    slot->seq_.store(2 * index + 2, std::memory_order_release);
+    num_pushed_.store(index + 1, std::memory_order_release);
+    return index;
+  }
+
+  /**
+   * Copies out the sample with the given index. Safe to call from any thread.
+   * @return false if the sample has not been pushed yet, or has been
+   * overwritten
+   */
+  bool Get(uint64_t index, T* sample) const {
+    uint64_t position = index % capacity_;
+    const Slot* chunk =
+      chunks_[position / kSlotsPerChunk].load(std::memory_order_acquire);
+    if (!chunk) {
+      return false;
+    }
+    const Slot& slot = chunk[position % kSlotsPerChunk];
+    uint64_t seq = slot.seq_.load(std::memory_order_acquire);
+    if (seq != 2 * index + 2) {
+      return false;
+    }
+    *sample = slot.sample_;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.seq_.load(std::memory_order_relaxed) == seq;
+  }
+
+  /**
+   * Copies out the most recent sample. Safe to call from any thread.
+   * @return false if no sample has been pushed yet
+   */
+  bool Latest(T* sample) const {
+    while (true) {
+      uint64_t num_pushed = this->num_pushed();
+      if (num_pushed == 0) {
+        return false;
+      }
+      // Only fails if the writer has wrapped around the whole ring since we
+      // read num_pushed.
+      if (Get(num_pushed - 1, sample)) {
+        return true;
+      }
+    }
+  }
+
+  /**
+   * Calls visitor(index, sample) on each of the most recent samples, oldest
+   * first, with a copy that stays valid while the visitor runs. Samples that
+   * the writer overwrites during the visit are skipped. Safe to call from any
+   * thread.
+   * @param max_samples the maximum number of samples to visit
+   * @return the number of samples visited
+   */
+  template<typename Visitor>
+  uint64_t Visit(uint64_t max_samples, Visitor visitor) const {
+    uint64_t end = num_pushed();
+    uint64_t begin = end - std::min(end, std::min(max_samples, capacity_));
+    uint64_t num_visited = 0;
+    T sample;
+    for (uint64_t index = begin; index < end; ++index) {
+      if (Get(index, &sample)) {
+        visitor(index, sample);
+        num_visited++;
+      }
+    }
+    return num_visited;
+  }
+
+  inline uint64_t capacity() const {
+    return capacity_;
+  }
+
+  /**
+   * Returns the number of samples pushed since the ring was created,
+   * including the ones that have since been overwritten.
+   */
+  inline uint64_t num_pushed() const {
+    return num_pushed_.load(std::memory_order_acquire);
+  }
+
+  /**
+   * Returns the number of slots that have been allocated so far.
+   */
+  inline uint64_t num_allocated_slots() const {
+    uint64_t num_used = std::min(num_pushed(), capacity_);
+    return std::min(capacity_, (num_used + kSlotsPerChunk - 1) /
+                    kSlotsPerChunk * kSlotsPerChunk);
+  }
+
+  /**
+   * Returns the number of bytes that every sample takes in a ring.
+   */
+  static inline uint64_t slot_size() {
+    return sizeof(Slot);
+  }
+
+ private:
+  struct Slot {
+    // 2 * index + 2 once the sample with the given index is in the slot,
+    // 2 * index + 1 while it is being written, and 0 before the first push.
+    std::atomic<uint64_t> seq_;
+    T sample_;
+  };
+
+  // The number of slots allocated at a time.
+  static const uint64_t kSlotsPerChunk = 16;
+
+  // Returns the slot at the given position, allocating its chunk if the
+  // writer has not reached it before.
+  Slot* MutableSlot(uint64_t position) {
+    uint64_t chunk_index = position / kSlotsPerChunk;
+    std::atomic<Slot*>* chunk_ptr = &chunks_[chunk_index];
+    Slot* chunk = chunk_ptr->load(std::memory_order_relaxed);
+    if (!chunk) {
+      uint64_t chunk_size =
+        std::min(kSlotsPerChunk, capacity_ - chunk_index * kSlotsPerChunk);
+      chunk = new Slot[chunk_size];
+      for (uint64_t i = 0; i < chunk_size; ++i) {
+        chunk[i].seq_.store(0, std::memory_order_relaxed);
+      }
+      chunk_ptr->store(chunk, std::memory_order_release);
+    }
+    return &chunk[position % kSlotsPerChunk];
+  }
+
+  const uint64_t capacity_;
+  const uint64_t num_chunks_;
+  // Chunks that the writer has not reached yet are NULL.
+  std::atomic<Slot*>* chunks_;
+  std::atomic<uint64_t> num_pushed_;
+};
+
+template<typename T>
+const uint64_t SampleRing<T>::kSlotsPerChunk;
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_MISC_SAMPLE_RING_H
@@ -0,0 +1,146 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Sample ring unit tests.
+
+#include <gtest/gtest.h>
+
+#include <boost/thread.hpp>
+
+#include "base/common.h"
+#include "misc/sample_ring.h"
+
+namespace firmament {
+
+struct TestSample {
+  uint64_t value_;
+  uint64_t twice_value_;
+};
+
+class SampleRingTest : public ::testing::Test {
+ protected:
+  SampleRingTest() {
+    FLAGS_v = 2;
+  }
+
+  TestSample MakeSample(uint64_t value) {
+    TestSample sample;
+    sample.value_ = value;
+    sample.twice_value_ = value * 2;
+    return sample;
+  }
+};
+
+// Checks that the ring keeps the most recent samples, and that overwritten
+// samples can no longer be read.
+TEST_F(SampleRingTest, Overwrite) {
+  SampleRing<TestSample> ring(4);
+  TestSample sample;
+  EXPECT_FALSE(ring.Latest(&sample));
+  EXPECT_FALSE(ring.Get(0, &sample));
+  for (uint64_t i = 0; i < 6; ++i) {
+    EXPECT_EQ(ring.Push(MakeSample(i)), i);
+  }
+  EXPECT_EQ(ring.num_pushed(), 6);
+  EXPECT_FALSE(ring.Get(1, &sample));
+  EXPECT_FALSE(ring.Get(6, &sample));
+  ASSERT_TRUE(ring.Get(2, &sample));
+  EXPECT_EQ(sample.value_, 2);
+  ASSERT_TRUE(ring.Latest(&sample));
+  EXPECT_EQ(sample.value_, 5);
+  vector<uint64_t> values;
+  EXPECT_EQ(ring.Visit(10, [&values](uint64_t index, const TestSample& s) {
+        EXPECT_EQ(index, s.value_);
+        values.push_back(s.value_);
+      }), 4);
+  EXPECT_EQ(values, vector<uint64_t>({2, 3, 4, 5}));
+  values.clear();
+  EXPECT_EQ(ring.Visit(2, [&values](uint64_t index, const TestSample& s) {
+        values.push_back(s.value_);
+      }), 2);
+  EXPECT_EQ(values, vector<uint64_t>({4, 5}));
+}
+
+// Checks that the slots are only allocated once the writer reaches them.
+TEST_F(SampleRingTest, LazyAllocation) {
+  SampleRing<TestSample> ring(100);
+  TestSample sample;
+  EXPECT_EQ(ring.num_allocated_slots(), 0);
+  EXPECT_FALSE(ring.Get(50, &sample));
+  EXPECT_EQ(ring.Visit(100, [](uint64_t index, const TestSample& s) {}), 0);
+  for (uint64_t i = 0; i < 20; ++i) {
+    ring.Push(MakeSample(i));
+  }
+  EXPECT_LT(ring.num_allocated_slots(), 50);
+  EXPECT_GE(ring.num_allocated_slots(), 20);
+  for (uint64_t i = 20; i < 250; ++i) {
+    ring.Push(MakeSample(i));
+  }
+  EXPECT_EQ(ring.num_allocated_slots(), 100);
+  vector<uint64_t> values;
+  EXPECT_EQ(ring.Visit(100, [&values](uint64_t index, const TestSample& s) {
+        EXPECT_EQ(index, s.value_);
+        values.push_back(s.value_);
+      }), 100);
+  EXPECT_EQ(values.front(), 150);
+  EXPECT_EQ(values.back(), 249);
+}
+
+// Checks that readers running concurrently with the writer never see a
+// partially written sample.
+TEST_F(SampleRingTest, ConcurrentReaders) {
+  const uint64_t kNumReaders = 4;
+  const uint64_t kNumSamples = 200000;
+  SampleRing<TestSample> ring(16);
+  std::atomic<bool> done(false);
+  boost::thread_group readers;
+  for (uint64_t reader = 0; reader < kNumReaders; ++reader) {
+    readers.create_thread([&ring, &done]() {
+        TestSample sample;
+        uint64_t last_value = 0;
+        while (!done.load()) {
+          if (ring.Latest(&sample)) {
+            CHECK_EQ(sample.twice_value_, sample.value_ * 2);
+            CHECK_GE(sample.value_, last_value);
+            last_value = sample.value_;
+          }
+          ring.Visit(16, [](uint64_t index, const TestSample& s) {
+              CHECK_EQ(s.value_, index);
+              CHECK_EQ(s.twice_value_, s.value_ * 2);
+            });
+        }
+      });
+  }
+  for (uint64_t i = 0; i < kNumSamples; ++i) {
+    ring.Push(MakeSample(i));
+  }
+  done.store(true);
+  readers.join_all();
+  TestSample sample;
+  ASSERT_TRUE(ring.Latest(&sample));
+  EXPECT_EQ(sample.value_, kNumSamples - 1);
+}
+
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,261 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Concurrent hash map for read-mostly tables such as the task and resource
+// maps. The keys are split over a fixed number of shards, each of which is
+// an unordered_map with its own reader-writer lock, so that lookups of
+// different keys rarely contend and lookups of the same key only take the
+// lock in shared mode.
+//
+// The interface is the subset of std::map's that the map utilities in
+// misc/map-util.h and the schedulers use. Each call is atomic. As with the
+// thread_safe::map it replaces, iterators are not protected by the locks:
+// the element an iterator returned by find() points to stays valid until it
+// is erased, but iterating over the map concurrently with insertions or
+// erasures is not safe. The iteration order is unspecified.
+
+#ifndef FIRMAMENT_MISC_SHARDED_MAP_H
+#define FIRMAMENT_MISC_SHARDED_MAP_H
+
+#include <functional>
+#include <iterator>
+#include <unordered_map>
+#include <utility>
+
+#include <boost/thread/locks.hpp>
+#include <boost/thread/shared_mutex.hpp>
+
+namespace firmament {
+
+template<typename K, typename V, typename Hash = std::hash<K>>
+class ShardedMap {
+ private:
+  typedef std::unordered_map<K, V, Hash> Shard_t;
+
+ public:
+  typedef K key_type;
+  typedef V mapped_type;
+  typedef typename Shard_t::value_type value_type;
+  typedef size_t size_type;
+
+  template<typename Map, typename ShardIterator, typename Value>
+  class Iterator
+    : public std::iterator<std::forward_iterator_tag, Value> {
+   public:
+    Iterator() : map_(NULL), shard_(kNumShards) {}
+    Iterator(Map* map, size_t shard, ShardIterator it)
+      : map_(map), shard_(shard), it_(it) {
+      SkipEmptyShards();
+    }
+    // Converts an iterator to a const_iterator.
+    template<typename OtherMap, typename OtherShardIterator,
+             typename OtherValue>
+    Iterator(const Iterator<OtherMap, OtherShardIterator, OtherValue>& other)
+      : map_(other.map_), shard_(other.shard_), it_(other.it_) {}
+
+    Value& operator*() const {
+      return *it_;
+    }
+    Value* operator->() const {
+      return &*it_;
+    }
+    Iterator& operator++() {
+      ++it_;
+      SkipEmptyShards();
+      return *this;
+    }
+    Iterator operator++(int) {
+      Iterator old = *this;
+      ++*this;
+      return old;
+    }
+    bool operator==(const Iterator& other) const {
+      // end() is the only iterator past the last shard, and comparing with
+      // it does not touch the shard iterators.
+      return shard_ == other.shard_ &&
+        (shard_ == kNumShards || it_ == other.it_);
+    }
+    bool operator!=(const Iterator& other) const {
+      return !(*this == other);
+    }
+
+   private:
+    template<typename, typename, typename> friend class Iterator;
+
+    void SkipEmptyShards() {
+      while (shard_ < kNumShards && it_ == map_->shards_[shard_].map_.end()) {
+        if (++shard_ < kNumShards) {
+          it_ = map_->shards_[shard_].map_.begin();
+        }
+      }
+    }
+
+    Map* map_;
+    size_t shard_;
+    ShardIterator it_;
+  };
+
+  typedef Iterator<ShardedMap, typename Shard_t::iterator, value_type>
+      iterator;
+  typedef Iterator<const ShardedMap, typename Shard_t::const_iterator,
+                   const value_type> const_iterator;
+
+  ShardedMap() {}
+
+  iterator find(const K& key) {
+    size_t shard = ShardForKey(key);
+    boost::shared_lock<boost::shared_mutex> lock(shards_[shard].lock_);
+    typename Shard_t::iterator it = shards_[shard].map_.find(key);
+    if (it == shards_[shard].map_.end()) {
+      return end();
+    }
+    return iterator(this, shard, it);
+  }
+
+  const_iterator find(const K& key) const {
+    size_t shard = ShardForKey(key);
+    boost::shared_lock<boost::shared_mutex> lock(shards_[shard].lock_);
+    typename Shard_t::const_iterator it = shards_[shard].map_.find(key);
+    if (it == shards_[shard].map_.end()) {
+      return end();
+    }
+    return const_iterator(this, shard, it);
+  }
+
+  size_type count(const K& key) const {
+    return find(key) == end() ? 0 : 1;
+  }
+
+  std::pair<iterator, bool> insert(const value_type& value) {
+    size_t shard = ShardForKey(value.first);
+    boost::unique_lock<boost::shared_mutex> lock(shards_[shard].lock_);
+    std::pair<typename Shard_t::iterator, bool> ret =
+      shards_[shard].map_.insert(value);
+    return std::make_pair(iterator(this, shard, ret.first), ret.second);
+  }
+
+  V& operator[](const K& key) {
+    size_t shard = ShardForKey(key);
+    boost::unique_lock<boost::shared_mutex> lock(shards_[shard].lock_);
+    return shards_[shard].map_[key];
+  }
+
+  size_type erase(const K& key) {
+    size_t shard = ShardForKey(key);
+    boost::unique_lock<boost::shared_mutex> lock(shards_[shard].lock_);
+    return shards_[shard].map_.erase(key);
+  }
+
+  // Erases the key and moves its value to *value, so that the caller can
+  // release it. Returns false if the key is not present.
+  bool erase(const K& key, V* value) {
+    size_t shard = ShardForKey(key);
+    boost::unique_lock<boost::shared_mutex> lock(shards_[shard].lock_);
+    typename Shard_t::iterator it = shards_[shard].map_.find(key);
+    if (it == shards_[shard].map_.end()) {
+      return false;
+    }
+    *value = std::move(it->second);
+    shards_[shard].map_.erase(it);
+    return true;
+  }
+
+  // Calls visitor(value) with the key's shard locked in shared mode, so that
+  // the value cannot be erased (and released) while the visitor uses it.
+  // Returns false if the key is not present.
+  template<typename Visitor>
+  bool Visit(const K& key, Visitor visitor) const {
+    size_t shard = ShardForKey(key);
+    boost::shared_lock<boost::shared_mutex> lock(shards_[shard].lock_);
+    typename Shard_t::const_iterator it = shards_[shard].map_.find(key);
+    if (it == shards_[shard].map_.end()) {
+      return false;
+    }
+    visitor(it->second);
+    return true;
+  }
+
+  void clear() {
+    for (size_t shard = 0; shard < kNumShards; ++shard) {
+      boost::unique_lock<boost::shared_mutex> lock(shards_[shard].lock_);
+      shards_[shard].map_.clear();
+    }
+  }
+
+  size_type size() const {
+    size_type size = 0;
+    for (size_t shard = 0; shard < kNumShards; ++shard) {
+      boost::shared_lock<boost::shared_mutex> lock(shards_[shard].lock_);
+      size += shards_[shard].map_.size();
+    }
+    return size;
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  iterator begin() {
+    return iterator(this, 0, shards_[0].map_.begin());
+  }
+  iterator end() {
+    return iterator();
+  }
+  const_iterator begin() const {
+    return const_iterator(this, 0, shards_[0].map_.begin());
+  }
+  const_iterator end() const {
+    return const_iterator();
+  }
+
+ private:
+  static const size_t kShardBits = 6;
+  static const size_t kNumShards = 1 << kShardBits;
+
+  struct Shard {
+    mutable boost::shared_mutex lock_;
+    Shard_t map_;
+    // Keeps the locks of neighbouring shards on different cache lines.
+    char padding_[64];
+  };
+
+  size_t ShardForKey(const K& key) const {
+    // The shard maps use the low bits of the hash to pick buckets, so pick
+    // the shard with the high bits of the mixed hash.
+    uint64_t hash = static_cast<uint64_t>(hasher_(key));
+    return static_cast<size_t>((hash * 0x9E3779B97F4A7C15ULL) >>
+                               (64 - kShardBits));
+  }
+
+  ShardedMap(const ShardedMap&);
+  ShardedMap& operator=(const ShardedMap&);
+
+  Hash hasher_;
+  Shard shards_[kNumShards];
+};
+
+template<typename K, typename V, typename Hash>
+const size_t ShardedMap<K, V, Hash>::kShardBits;
+template<typename K, typename V, typename Hash>
+const size_t ShardedMap<K, V, Hash>::kNumShards;
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_MISC_SHARDED_MAP_H
@@ -0,0 +1,129 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Benchmark for the maps that hold the tasks of a coordinator. It fills a
+// thread_safe::map and a ShardedMap with task ids, and measures the lookups
+// per second of 1, 8 and 32 threads that look up random tasks, as the
+// scheduler and the service handlers do. Every thread also inserts and
+// removes a task every few lookups, so that writers contend with readers.
+
+#include <random>
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+#include <boost/timer/timer.hpp>
+
+#include "base/common.h"
+#include "base/types.h"
+#include "base/units.h"
+#include "misc/map-util.h"
+#include "misc/sharded_map.h"
+
+DEFINE_uint64(benchmark_num_tasks, 100000, "Number of tasks in the map.");
+DEFINE_uint64(benchmark_lookups_per_thread, 1000000,
+              "Number of lookups that every thread does.");
+DEFINE_uint64(benchmark_lookups_per_update, 100,
+              "Number of lookups between a thread's insertions and removals. "
+              "0 disables updates.");
+
+namespace firmament {
+
+namespace {
+
+template<typename Map>
+void LookUpTasks(Map* map, const vector<TaskID_t>& task_ids, uint64_t thread,
+                 boost::barrier* start, uint64_t* num_found) {
+  std::mt19937_64 rng(thread);
+  TaskDescriptor* td_ptr = reinterpret_cast<TaskDescriptor*>(1);
+  uint64_t found = 0;
+  start->wait();
+  for (uint64_t i = 0; i < FLAGS_benchmark_lookups_per_thread; ++i) {
+    if (FindPtrOrNull(*map, task_ids[rng() % task_ids.size()])) {
+      found++;
+    }
+    if (FLAGS_benchmark_lookups_per_update > 0 &&
+        i % FLAGS_benchmark_lookups_per_update == 0) {
+      // Task ids are random, so this one does not clash with the others.
+      TaskID_t task_id = rng();
+      InsertIfNotPresent(map, task_id, td_ptr);
+      map->erase(task_id);
+    }
+  }
+  *num_found = found;
+}
+
+template<typename Map>
+double LookupsPerSecond(const vector<TaskID_t>& task_ids,
+                        uint64_t num_threads) {
+  Map map;
+  TaskDescriptor* td_ptr = reinterpret_cast<TaskDescriptor*>(1);
+  for (const auto& task_id : task_ids) {
+    InsertIfNotPresent(&map, task_id, td_ptr);
+  }
+  vector<uint64_t> num_found(num_threads, 0);
+  boost::barrier start(num_threads + 1);
+  boost::thread_group threads;
+  for (uint64_t thread = 0; thread < num_threads; ++thread) {
+    threads.create_thread(boost::bind(&LookUpTasks<Map>, &map,
+                                      boost::cref(task_ids), thread, &start,
+                                      &num_found[thread]));
+  }
+  start.wait();
+  boost::timer::cpu_timer timer;
+  threads.join_all();
+  double elapsed_sec = static_cast<double>(timer.elapsed().wall) /
+    SECONDS_TO_NANOSECONDS;
+  for (const auto& found : num_found) {
+    CHECK_EQ(found, FLAGS_benchmark_lookups_per_thread);
+  }
+  return num_threads * FLAGS_benchmark_lookups_per_thread / elapsed_sec;
+}
+
+}  // namespace
+
+void RunBenchmark() {
+  std::mt19937_64 rng(42);
+  vector<TaskID_t> task_ids;
+  for (uint64_t i = 0; i < FLAGS_benchmark_num_tasks; ++i) {
+    task_ids.push_back(rng());
+  }
+  LOG(INFO) << task_ids.size() << " tasks, "
+            << FLAGS_benchmark_lookups_per_thread << " lookups per thread";
+  const uint64_t kNumThreads[] = {1, 8, 32};
+  for (uint64_t num_threads : kNumThreads) {
+    double locked = LookupsPerSecond<thread_safe::map<TaskID_t,
+                                                      TaskDescriptor*>>(
+        task_ids, num_threads);
+    double sharded = LookupsPerSecond<ShardedMap<TaskID_t, TaskDescriptor*>>(
+        task_ids, num_threads);
+    LOG(INFO) << num_threads << " threads: thread_safe::map "
+              << locked / 1000000 << "M lookups/s, ShardedMap "
+              << sharded / 1000000 << "M lookups/s";
+  }
+}
+
+}  // namespace firmament
+
+int main(int argc, char *argv[]) {
+  firmament::common::InitFirmament(argc, argv);
+  FLAGS_logtostderr = true;
+  firmament::RunBenchmark();
+  return 0;
+}
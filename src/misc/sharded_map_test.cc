@@ -0,0 +1,139 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Sharded map unit tests.
+
+#include <gtest/gtest.h>
+
+#include <boost/thread.hpp>
+
+#include "base/common.h"
+#include "misc/map-util.h"
+#include "misc/sharded_map.h"
+
+namespace firmament {
+
+class ShardedMapTest : public ::testing::Test {
+ protected:
+  ShardedMapTest() {
+    FLAGS_v = 2;
+  }
+};
+
+TEST_F(ShardedMapTest, InsertFindErase) {
+  ShardedMap<uint64_t, string> map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_TRUE(map.find(1) == map.end());
+  EXPECT_TRUE(InsertIfNotPresent(&map, 1, "a"));
+  EXPECT_FALSE(InsertIfNotPresent(&map, 1, "b"));
+  EXPECT_TRUE(InsertIfNotPresent(&map, 2, "b"));
+  EXPECT_EQ(*FindOrNull(map, 1), "a");
+  EXPECT_EQ(FindWithDefault(map, 3, "none"), "none");
+  EXPECT_FALSE(InsertOrUpdate(&map, 2, "c"));
+  EXPECT_EQ(map.find(2)->second, "c");
+  map[3] = "d";
+  EXPECT_TRUE(ContainsKey(map, 3));
+  EXPECT_EQ(map.count(3), 1);
+  EXPECT_EQ(map.size(), 3);
+  EXPECT_EQ(map.erase(3), 1);
+  EXPECT_EQ(map.erase(3), 0);
+  EXPECT_FALSE(ContainsKey(map, 3));
+  map.clear();
+  EXPECT_TRUE(map.empty());
+}
+
+TEST_F(ShardedMapTest, VisitAndEraseValue) {
+  ShardedMap<uint64_t, string> map;
+  string value;
+  EXPECT_FALSE(map.Visit(1, [](const string& v) {
+        ADD_FAILURE() << "Visited a missing key";
+      }));
+  EXPECT_FALSE(map.erase(1, &value));
+  EXPECT_TRUE(InsertIfNotPresent(&map, 1, "a"));
+  EXPECT_TRUE(map.Visit(1, [&value](const string& v) {
+        value = v;
+      }));
+  EXPECT_EQ(value, "a");
+  value.clear();
+  EXPECT_TRUE(map.erase(1, &value));
+  EXPECT_EQ(value, "a");
+  EXPECT_FALSE(ContainsKey(map, 1));
+}
+
+// Checks that iteration visits every element once, across the shards.
+TEST_F(ShardedMapTest, Iterate) {
+  ShardedMap<uint64_t, uint64_t> map;
+  EXPECT_TRUE(map.begin() == map.end());
+  const uint64_t kNumElements = 1000;
+  for (uint64_t i = 0; i < kNumElements; ++i) {
+    map[i] = i * 2;
+  }
+  vector<bool> seen(kNumElements, false);
+  uint64_t num_seen = 0;
+  for (auto& key_value : map) {
+    EXPECT_EQ(key_value.second, key_value.first * 2);
+    EXPECT_FALSE(seen[key_value.first]);
+    seen[key_value.first] = true;
+    key_value.second++;
+    num_seen++;
+  }
+  EXPECT_EQ(num_seen, kNumElements);
+  const ShardedMap<uint64_t, uint64_t>& const_map = map;
+  for (ShardedMap<uint64_t, uint64_t>::const_iterator it = const_map.begin();
+       it != const_map.end(); ++it) {
+    EXPECT_EQ(it->second, it->first * 2 + 1);
+  }
+}
+
+// Checks that concurrent readers and writers of disjoint keys see
+// consistent values.
+TEST_F(ShardedMapTest, ConcurrentAccess) {
+  const uint64_t kNumThreads = 8;
+  const uint64_t kNumKeys = 10000;
+  ShardedMap<uint64_t, uint64_t> map;
+  for (uint64_t key = 0; key < kNumKeys; ++key) {
+    map[key] = key;
+  }
+  boost::thread_group threads;
+  for (uint64_t thread = 0; thread < kNumThreads; ++thread) {
+    threads.create_thread([&map, thread, kNumKeys]() {
+        for (uint64_t key = 0; key < kNumKeys; ++key) {
+          const uint64_t* value = FindOrNull(map, key);
+          CHECK_NOTNULL(value);
+          CHECK_EQ(*value, key);
+          // Every thread inserts and erases its own keys.
+          uint64_t own_key = kNumKeys * (thread + 1) + key;
+          CHECK(InsertIfNotPresent(&map, own_key, own_key));
+          if (key % 2 == 0) {
+            CHECK_EQ(map.erase(own_key), 1);
+          }
+        }
+      });
+  }
+  threads.join_all();
+  EXPECT_EQ(map.size(), kNumKeys + kNumThreads * kNumKeys / 2);
+}
+
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,79 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "misc/string_interner.h"
+
+#include <boost/thread/locks.hpp>
+
+namespace firmament {
+
+const StringID_t StringInterner::kNoStringID;
+
+StringInterner::StringInterner() {
+}
+
+StringInterner* StringInterner::Global() {
+  static StringInterner* interner = new StringInterner();
+  return interner;
+}
+
+StringID_t StringInterner::Intern(const string& str) {
+  {
+    boost::shared_lock<boost::shared_mutex> lock(lock_);
+    auto it = ids_.find(str);
+    if (it != ids_.end()) {
+      return it->second;
+    }
+  }
+  boost::unique_lock<boost::shared_mutex> lock(lock_);
+  // Another thread may have interned the string after we released the read
+  // lock.
+  auto it = ids_.find(str);
+  if (it != ids_.end()) {
+    return it->second;
+  }
+  CHECK_LT(strings_.size(), UINT32_MAX) << "Too many distinct strings";
+  strings_.push_back(str);
+  StringID_t id = static_cast<StringID_t>(strings_.size());
+  ids_[str] = id;
+  return id;
+}
+
+StringID_t StringInterner::Lookup(const string& str) const {
+  boost::shared_lock<boost::shared_mutex> lock(lock_);
+  auto it = ids_.find(str);
+  if (it == ids_.end()) {
+    return kNoStringID;
+  }
+  return it->second;
+}
+
+const string& StringInterner::String(StringID_t id) const {
+  boost::shared_lock<boost::shared_mutex> lock(lock_);
+  CHECK(id != kNoStringID && id <= strings_.size()) << "Unknown id " << id;
+  return strings_[id - 1];
+}
+
+uint64_t StringInterner::size() const {
+  boost::shared_lock<boost::shared_mutex> lock(lock_);
+  return strings_.size();
+}
+
+}  // namespace firmament
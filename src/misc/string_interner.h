@@ -0,0 +1,81 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Maps strings (e.g., label keys and values) to dense 32-bit ids, so that
+// they can be stored and compared as integers. Ids are never reclaimed: their
+// number is bounded by the number of distinct strings seen.
+
+#ifndef FIRMAMENT_MISC_STRING_INTERNER_H
+#define FIRMAMENT_MISC_STRING_INTERNER_H
+
+#include <deque>
+#include <string>
+
+#include <boost/thread/shared_mutex.hpp>
+
+#include "base/common.h"
+#include "base/types.h"
+
+namespace firmament {
+
+typedef uint32_t StringID_t;
+
+class StringInterner {
+ public:
+  // Id that never names a string.
+  static const StringID_t kNoStringID = 0;
+
+  StringInterner();
+
+  /**
+   * Returns the interner shared by the whole process.
+   */
+  static StringInterner* Global();
+
+  /**
+   * Returns the id of a string, assigning a new one if the string has not
+   * been seen before. Safe to call from any thread.
+   */
+  StringID_t Intern(const string& str);
+
+  /**
+   * Returns the id of a string, or kNoStringID if it has never been interned.
+   */
+  StringID_t Lookup(const string& str) const;
+
+  /**
+   * Returns the string that an id names. The reference stays valid for the
+   * lifetime of the interner.
+   */
+  const string& String(StringID_t id) const;
+
+  uint64_t size() const;
+
+ private:
+  mutable boost::shared_mutex lock_;
+  unordered_map<string, StringID_t> ids_;
+  // Strings indexed by id - 1. A deque never moves its elements when it
+  // grows, so references to them stay valid.
+  std::deque<string> strings_;
+};
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_MISC_STRING_INTERNER_H
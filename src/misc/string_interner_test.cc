@@ -0,0 +1,86 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// String interner unit tests.
+
+#include <gtest/gtest.h>
+
+#include <boost/thread.hpp>
+
+#include "base/common.h"
+#include "misc/string_interner.h"
+
+namespace firmament {
+
+class StringInternerTest : public ::testing::Test {
+ protected:
+  StringInternerTest() {
+    FLAGS_v = 2;
+  }
+};
+
+TEST_F(StringInternerTest, InternAndLookup) {
+  StringInterner interner;
+  EXPECT_EQ(interner.Lookup("zone"), StringInterner::kNoStringID);
+  StringID_t zone = interner.Intern("zone");
+  StringID_t region = interner.Intern("region");
+  EXPECT_NE(zone, StringInterner::kNoStringID);
+  EXPECT_NE(zone, region);
+  EXPECT_EQ(interner.Intern("zone"), zone);
+  EXPECT_EQ(interner.Lookup("zone"), zone);
+  EXPECT_EQ(interner.String(zone), "zone");
+  EXPECT_EQ(interner.String(region), "region");
+  // The empty string is a string like any other.
+  EXPECT_NE(interner.Intern(""), StringInterner::kNoStringID);
+  EXPECT_EQ(interner.size(), 3);
+}
+
+// Checks that threads interning the same strings concurrently get the same
+// ids.
+TEST_F(StringInternerTest, ConcurrentIntern) {
+  const uint64_t kNumThreads = 4;
+  const uint64_t kNumStrings = 10000;
+  StringInterner interner;
+  vector<vector<StringID_t>> ids(kNumThreads);
+  boost::thread_group threads;
+  for (uint64_t thread = 0; thread < kNumThreads; ++thread) {
+    vector<StringID_t>* thread_ids = &ids[thread];
+    threads.create_thread([&interner, thread_ids, kNumStrings]() {
+        for (uint64_t i = 0; i < kNumStrings; ++i) {
+          thread_ids->push_back(interner.Intern(to_string(i)));
+        }
+      });
+  }
+  threads.join_all();
+  EXPECT_EQ(interner.size(), kNumStrings);
+  for (uint64_t i = 0; i < kNumStrings; ++i) {
+    for (uint64_t thread = 1; thread < kNumThreads; ++thread) {
+      EXPECT_EQ(ids[thread][i], ids[0][i]);
+    }
+    EXPECT_EQ(interner.String(ids[0][i]), to_string(i));
+  }
+}
+
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
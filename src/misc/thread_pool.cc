@@ -0,0 +1,105 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "misc/thread_pool.h"
+
+#include <boost/bind.hpp>
+
+namespace firmament {
+
+ThreadPool::ThreadPool(uint32_t num_threads)
+  : loop_generation_(0), num_busy_workers_(0), shutdown_(false),
+    loop_fn_(NULL), num_items_(0), next_item_(0) {
+  CHECK_GT(num_threads, 0);
+  // The thread that calls ParallelFor also processes items.
+  for (uint32_t i = 1; i < num_threads; ++i) {
+    workers_.push_back(
+        new boost::thread(boost::bind(&ThreadPool::WorkerLoop, this)));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    boost::lock_guard<boost::mutex> lock(lock_);
+    shutdown_ = true;
+  }
+  loop_started_.notify_all();
+  for (auto& worker : workers_) {
+    worker->join();
+    delete worker;
+  }
+}
+
+void ThreadPool::ParallelFor(uint64_t num_items,
+                             const std::function<void(uint64_t)>& fn) {
+  if (num_items == 0) {
+    return;
+  }
+  if (workers_.empty() || num_items == 1) {
+    for (uint64_t i = 0; i < num_items; ++i) {
+      fn(i);
+    }
+    return;
+  }
+  {
+    boost::lock_guard<boost::mutex> lock(lock_);
+    loop_fn_ = &fn;
+    num_items_ = num_items;
+    next_item_ = 0;
+    num_busy_workers_ = workers_.size();
+    loop_generation_++;
+  }
+  loop_started_.notify_all();
+  RunItems();
+  boost::unique_lock<boost::mutex> lock(lock_);
+  while (num_busy_workers_ > 0) {
+    loop_finished_.wait(lock);
+  }
+  loop_fn_ = NULL;
+}
+
+void ThreadPool::RunItems() {
+  for (uint64_t i = next_item_++; i < num_items_; i = next_item_++) {
+    (*loop_fn_)(i);
+  }
+}
+
+void ThreadPool::WorkerLoop() {
+  uint64_t last_generation = 0;
+  while (true) {
+    {
+      boost::unique_lock<boost::mutex> lock(lock_);
+      while (!shutdown_ && loop_generation_ == last_generation) {
+        loop_started_.wait(lock);
+      }
+      if (shutdown_) {
+        return;
+      }
+      last_generation = loop_generation_;
+    }
+    RunItems();
+    boost::lock_guard<boost::mutex> lock(lock_);
+    if (--num_busy_workers_ == 0) {
+      loop_finished_.notify_one();
+    }
+  }
+}
+
+}  // namespace firmament
@@ -0,0 +1,86 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Fixed-size pool of worker threads for data-parallel loops. The workers are
+// started once and sleep between loops, so that short loops that run many
+// times (e.g., once per scheduling round) do not pay for thread creation.
+
+#ifndef FIRMAMENT_MISC_THREAD_POOL_H
+#define FIRMAMENT_MISC_THREAD_POOL_H
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+#include "base/common.h"
+#include "base/types.h"
+
+namespace firmament {
+
+class ThreadPool {
+ public:
+  /**
+   * @param num_threads the number of threads that run a loop, including the
+   * thread that calls ParallelFor
+   */
+  explicit ThreadPool(uint32_t num_threads);
+  ~ThreadPool();
+
+  /**
+   * Calls fn(i) for every i in [0, num_items) and returns once all calls have
+   * completed. The calls are spread over the workers and the calling thread,
+   * in no particular order. Loops must not be nested, and only one thread may
+   * call ParallelFor at a time.
+   * @param num_items the number of items to process
+   * @param fn the function to call for each item
+   */
+  void ParallelFor(uint64_t num_items,
+                   const std::function<void(uint64_t)>& fn);
+
+  inline uint32_t num_threads() const {
+    return workers_.size() + 1;
+  }
+
+ private:
+  // Processes items of the current loop until there are none left.
+  void RunItems();
+  void WorkerLoop();
+
+  vector<boost::thread*> workers_;
+  boost::mutex lock_;
+  // Signalled when a new loop starts or the pool shuts down.
+  boost::condition_variable loop_started_;
+  // Signalled when the last worker finishes its share of a loop.
+  boost::condition_variable loop_finished_;
+  // Incremented for every loop, so that workers can tell loops apart.
+  uint64_t loop_generation_;
+  // Number of workers that haven't finished the current loop yet.
+  uint32_t num_busy_workers_;
+  bool shutdown_;
+  const std::function<void(uint64_t)>* loop_fn_;
+  uint64_t num_items_;
+  std::atomic<uint64_t> next_item_;
+};
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_MISC_THREAD_POOL_H
@@ -0,0 +1,74 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Thread pool unit tests.
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+
+#include "base/common.h"
+#include "misc/thread_pool.h"
+
+namespace firmament {
+
+class ThreadPoolTest : public ::testing::Test {
+ protected:
+  ThreadPoolTest() {
+    FLAGS_v = 2;
+  }
+};
+
+// Checks that every item is processed exactly once, and that the pool can
+// run several loops in a row.
+TEST_F(ThreadPoolTest, ParallelFor) {
+  ThreadPool pool(4);
+  EXPECT_EQ(pool.num_threads(), 4);
+  for (uint64_t round = 0; round < 100; ++round) {
+    uint64_t num_items = round * 10;
+    vector<uint64_t> calls(num_items, 0);
+    pool.ParallelFor(num_items, [&calls](uint64_t i) {
+        calls[i]++;
+      });
+    for (uint64_t i = 0; i < num_items; ++i) {
+      EXPECT_EQ(calls[i], 1);
+    }
+  }
+}
+
+// Checks that a pool with a single thread runs the loop on the caller.
+TEST_F(ThreadPoolTest, SingleThread) {
+  ThreadPool pool(1);
+  EXPECT_EQ(pool.num_threads(), 1);
+  boost::thread::id caller = boost::this_thread::get_id();
+  std::atomic<uint64_t> num_calls(0);
+  pool.ParallelFor(10, [&caller, &num_calls](uint64_t i) {
+      EXPECT_EQ(boost::this_thread::get_id(), caller);
+      num_calls++;
+    });
+  EXPECT_EQ(num_calls, 10);
+}
+
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,363 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "scheduling/compiled_selector.h"
+
+#include <algorithm>
+
+#include "scheduling/label_utils.h"
+
+namespace firmament {
+namespace scheduler {
+
+namespace {
+
+template<typename T>
+bool LessByFirst(const T& lhs, const T& rhs) {
+  return lhs.first < rhs.first;
+}
+
+template<typename T>
+bool EqualFirst(const T& lhs, const T& rhs) {
+  return lhs.first == rhs.first;
+}
+
+// Sorts the pairs by their first element and keeps the first of the pairs
+// that have the same first element, i.e., the same pair as InsertIfNotPresent
+// would keep.
+template<typename T>
+void SortAndKeepFirst(vector<T>* pairs) {
+  stable_sort(pairs->begin(), pairs->end(), LessByFirst<T>);
+  pairs->erase(unique(pairs->begin(), pairs->end(), EqualFirst<T>),
+               pairs->end());
+}
+
+StringID_t Intern(const string& str) {
+  return StringInterner::Global()->Intern(str);
+}
+
+}  // namespace
+
+TaintEffect TaintEffectFromString(const string& effect) {
+  if (effect.empty()) {
+    return TAINT_EFFECT_NONE;
+  } else if (effect == "NoSchedule") {
+    return TAINT_EFFECT_NO_SCHEDULE;
+  } else if (effect == "NoExecute") {
+    return TAINT_EFFECT_NO_EXECUTE;
+  } else if (effect == "PreferNoSchedule") {
+    return TAINT_EFFECT_PREFER_NO_SCHEDULE;
+  }
+  return TAINT_EFFECT_OTHER;
+}
+
+CompiledNode::CompiledNode(const ResourceDescriptor& rd) {
+  labels_.reserve(rd.labels_size());
+  for (const auto& label : rd.labels()) {
+    labels_.push_back(pair<StringID_t, StringID_t>(Intern(label.key()),
+                                                   Intern(label.value())));
+  }
+  SortAndKeepFirst(&labels_);
+  taints_.reserve(rd.taints_size());
+  for (const auto& taint : rd.taints()) {
+    Taint compiled_taint;
+    compiled_taint.key_ = Intern(taint.key());
+    compiled_taint.value_ = Intern(taint.value());
+    compiled_taint.effect_ = TaintEffectFromString(taint.effect());
+    taints_.push_back(compiled_taint);
+  }
+}
+
+StringID_t CompiledNode::LabelValue(StringID_t key) const {
+  auto it = lower_bound(labels_.begin(), labels_.end(),
+                        pair<StringID_t, StringID_t>(key, 0),
+                        LessByFirst<pair<StringID_t, StringID_t>>);
+  if (it == labels_.end() || it->first != key) {
+    return StringInterner::kNoStringID;
+  }
+  return it->second;
+}
+
+CompiledLabelSelector::CompiledLabelSelector(const LabelSelector& selector)
+  : key_(Intern(selector.key())), type_(selector.type()), bound_(0) {
+  switch (type_) {
+    case LabelSelector::IN_SET:
+    case LabelSelector::NOT_IN_SET:
+      for (const auto& value : selector.values()) {
+        values_.push_back(Intern(value));
+      }
+      sort(values_.begin(), values_.end());
+      break;
+    case LabelSelector::EXISTS_KEY:
+    case LabelSelector::NOT_EXISTS_KEY:
+      break;
+    case LabelSelector::GREATER_THAN:
+    case LabelSelector::LESSER_THAN:
+      CHECK_GT(selector.values_size(), 0)
+        << "Selector on " << selector.key() << " has no bound";
+      bound_ = stoi(selector.values(0));
+      break;
+    default:
+      LOG(FATAL) << "Unsupported selector type: " << selector.type();
+  }
+}
+
+bool CompiledLabelSelector::Matches(const CompiledNode& node) const {
+  StringID_t value = node.LabelValue(key_);
+  bool has_key = value != StringInterner::kNoStringID;
+  switch (type_) {
+    case LabelSelector::IN_SET:
+      return has_key && binary_search(values_.begin(), values_.end(), value);
+    case LabelSelector::NOT_IN_SET:
+      return !has_key ||
+        !binary_search(values_.begin(), values_.end(), value);
+    case LabelSelector::EXISTS_KEY:
+      return has_key;
+    case LabelSelector::NOT_EXISTS_KEY:
+      return !has_key;
+    case LabelSelector::GREATER_THAN:
+      return has_key &&
+        stoi(StringInterner::Global()->String(value)) > bound_;
+    case LabelSelector::LESSER_THAN:
+      return has_key &&
+        stoi(StringInterner::Global()->String(value)) < bound_;
+    default:
+      LOG(FATAL) << "Unsupported selector type: " << type_;
+  }
+  return false;
+}
+
+CompiledLabelSelectors::CompiledLabelSelectors(
+    const RepeatedPtrField<LabelSelector>& selectors) {
+  selectors_.reserve(selectors.size());
+  for (const auto& selector : selectors) {
+    selectors_.push_back(CompiledLabelSelector(selector));
+  }
+}
+
+CompiledLabelSelectors::CompiledLabelSelectors(
+    const RepeatedPtrField<NodeSelectorRequirement>& match_expressions)
+  : CompiledLabelSelectors(
+      NodeSelectorRequirementsAsLabelSelectors(match_expressions)) {
+}
+
+bool CompiledLabelSelectors::Matches(const CompiledNode& node) const {
+  for (const auto& selector : selectors_) {
+    if (!selector.Matches(node)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+CompiledTaskConstraints::CompiledTaskConstraints()
+  : has_required_terms_(false), num_tolerations_(0),
+    tolerates_all_hard_taints_(false), tolerates_all_soft_taints_(false) {
+}
+
+CompiledTaskConstraints::CompiledTaskConstraints(const TaskDescriptor& td)
+  : node_selector_(td.label_selectors()), has_required_terms_(false),
+    num_tolerations_(td.tolerations_size()),
+    tolerates_all_hard_taints_(false), tolerates_all_soft_taints_(false) {
+  if (td.has_affinity() && td.affinity().has_node_affinity()) {
+    const NodeAffinity& node_affinity = td.affinity().node_affinity();
+    if (node_affinity.has_requiredduringschedulingignoredduringexecution()) {
+      const auto& terms =
+        node_affinity.requiredduringschedulingignoredduringexecution()
+        .nodeselectorterms();
+      has_required_terms_ = terms.size() > 0;
+      for (const auto& term : terms) {
+        // A term without match expressions matches no node.
+        if (term.matchexpressions_size() > 0) {
+          required_terms_.push_back(
+              CompiledLabelSelectors(term.matchexpressions()));
+        }
+      }
+    }
+    for (const auto& term :
+         node_affinity.preferredduringschedulingignoredduringexecution()) {
+      if (!term.weight() || !term.has_preference() ||
+          term.preference().matchexpressions_size() == 0) {
+        continue;
+      }
+      preferred_terms_.push_back(pair<int32_t, CompiledLabelSelectors>(
+          term.weight(),
+          CompiledLabelSelectors(term.preference().matchexpressions())));
+    }
+  }
+  CompileHardTolerations(td);
+  CompileSoftTolerations(td);
+}
+
+bool CompiledTaskConstraints::SatisfiesNodeSelectorAndNodeAffinity(
+    const CompiledNode& node) const {
+  if (!node_selector_.Matches(node)) {
+    return false;
+  }
+  if (!has_required_terms_) {
+    return true;
+  }
+  for (const auto& term : required_terms_) {
+    if (term.Matches(node)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int64_t CompiledTaskConstraints::NodeAffinitySoftScore(
+    const CompiledNode& node) const {
+  int64_t sum_of_weights = 0;
+  for (const auto& term : preferred_terms_) {
+    if (term.second.Matches(node)) {
+      sum_of_weights += term.first;
+    }
+  }
+  return sum_of_weights;
+}
+
+bool CompiledTaskConstraints::ToleratesHardTaints(
+    const CompiledNode& node) const {
+  if (tolerates_all_hard_taints_) {
+    return true;
+  }
+  for (const auto& taint : node.taints()) {
+    if (taint.effect_ != TAINT_EFFECT_NO_SCHEDULE &&
+        taint.effect_ != TAINT_EFFECT_NO_EXECUTE) {
+      continue;
+    }
+    // Tasks that only have the default tolerations cannot be placed on
+    // nodes with hard taints.
+    if (num_tolerations_ == DEFAULT_TOLERATIONS ||
+        !Tolerates(taint, taint.effect_, hard_exists_, hard_equal_)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int64_t CompiledTaskConstraints::IntolerableTaintsCost(
+    const CompiledNode& node) const {
+  if (tolerates_all_soft_taints_) {
+    return 0;
+  }
+  int64_t intolerable_taint_cost = 0;
+  for (const auto& taint : node.taints()) {
+    if (taint.effect_ == TAINT_EFFECT_PREFER_NO_SCHEDULE &&
+        !Tolerates(taint, TAINT_EFFECT_PREFER_NO_SCHEDULE, soft_exists_,
+                   soft_equal_)) {
+      intolerable_taint_cost++;
+    }
+  }
+  return intolerable_taint_cost;
+}
+
+void CompiledTaskConstraints::SortTolerations(ExistsTolerations_t* exists,
+                                              EqualTolerations_t* equal) {
+  sort(exists->begin(), exists->end());
+  exists->erase(unique(exists->begin(), exists->end()), exists->end());
+  SortAndKeepFirst(equal);
+}
+
+bool CompiledTaskConstraints::Tolerates(const CompiledNode::Taint& taint,
+                                        TaintEffect effect,
+                                        const ExistsTolerations_t& exists,
+                                        const EqualTolerations_t& equal) {
+  pair<StringID_t, TaintEffect> key(taint.key_, effect);
+  if (binary_search(exists.begin(), exists.end(), key)) {
+    return true;
+  }
+  auto it = lower_bound(
+      equal.begin(), equal.end(),
+      pair<pair<StringID_t, TaintEffect>, StringID_t>(key, 0),
+      LessByFirst<pair<pair<StringID_t, TaintEffect>, StringID_t>>);
+  return it != equal.end() && it->first == key && it->second == taint.value_;
+}
+
+void CompiledTaskConstraints::CompileHardTolerations(
+    const TaskDescriptor& td) {
+  // Only tasks with tolerations beyond the default ones tolerate hard taints.
+  if (td.tolerations_size() <= DEFAULT_TOLERATIONS) {
+    return;
+  }
+  for (const auto& toleration : td.tolerations()) {
+    TaintEffect effect = TaintEffectFromString(toleration.effect());
+    if (effect != TAINT_EFFECT_NO_SCHEDULE &&
+        effect != TAINT_EFFECT_NO_EXECUTE && effect != TAINT_EFFECT_NONE) {
+      continue;
+    }
+    StringID_t key = Intern(toleration.key());
+    StringID_t value = Intern(toleration.value());
+    if (toleration.operator_() == "Exists") {
+      if (toleration.key().empty()) {
+        tolerates_all_hard_taints_ = true;
+      } else if (effect != TAINT_EFFECT_NONE) {
+        hard_exists_.push_back(make_pair(key, effect));
+      } else {
+        hard_exists_.push_back(make_pair(key, TAINT_EFFECT_NO_EXECUTE));
+        hard_exists_.push_back(make_pair(key, TAINT_EFFECT_NO_SCHEDULE));
+      }
+    } else if (toleration.operator_() == "Equal" ||
+               toleration.operator_().empty()) {
+      if (effect != TAINT_EFFECT_NONE) {
+        hard_equal_.push_back(make_pair(make_pair(key, effect), value));
+      } else {
+        hard_equal_.push_back(
+            make_pair(make_pair(key, TAINT_EFFECT_NO_EXECUTE), value));
+        hard_equal_.push_back(
+            make_pair(make_pair(key, TAINT_EFFECT_NO_SCHEDULE), value));
+      }
+    } else {
+      LOG(FATAL) << "Unsupported operator :" << toleration.operator_();
+    }
+  }
+  SortTolerations(&hard_exists_, &hard_equal_);
+}
+
+void CompiledTaskConstraints::CompileSoftTolerations(
+    const TaskDescriptor& td) {
+  for (const auto& toleration : td.tolerations()) {
+    TaintEffect effect = TaintEffectFromString(toleration.effect());
+    if (effect != TAINT_EFFECT_PREFER_NO_SCHEDULE &&
+        effect != TAINT_EFFECT_NONE) {
+      continue;
+    }
+    StringID_t key = Intern(toleration.key());
+    StringID_t value = Intern(toleration.value());
+    if (toleration.operator_() == "Exists") {
+      if (toleration.key().empty()) {
+        tolerates_all_soft_taints_ = true;
+      } else {
+        soft_exists_.push_back(
+            make_pair(key, TAINT_EFFECT_PREFER_NO_SCHEDULE));
+      }
+    } else if (toleration.operator_() == "Equal" ||
+               toleration.operator_().empty()) {
+      soft_equal_.push_back(
+          make_pair(make_pair(key, TAINT_EFFECT_PREFER_NO_SCHEDULE), value));
+    } else {
+      LOG(FATAL) << "Unsupported operator :" << toleration.operator_();
+    }
+  }
+  SortTolerations(&soft_exists_, &soft_equal_);
+}
+
+}  // namespace scheduler
+}  // namespace firmament
@@ -0,0 +1,189 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Compiled forms of node labels and taints, and of the label selectors, node
+// affinity and tolerations of tasks. All strings are interned when the forms
+// are built, so that evaluating a task's constraints on a node only compares
+// integers over sorted vectors. The results are the same as those of the
+// corresponding functions in label_utils.h.
+
+#ifndef FIRMAMENT_SCHEDULING_COMPILED_SELECTOR_H
+#define FIRMAMENT_SCHEDULING_COMPILED_SELECTOR_H
+
+#include <utility>
+#include <vector>
+
+#include "base/common.h"
+#include "base/label_selector.pb.h"
+#include "base/resource_desc.pb.h"
+#include "base/task_desc.pb.h"
+#include "misc/string_interner.h"
+
+namespace firmament {
+namespace scheduler {
+
+enum TaintEffect {
+  TAINT_EFFECT_NONE = 0,
+  TAINT_EFFECT_NO_SCHEDULE = 1,
+  TAINT_EFFECT_NO_EXECUTE = 2,
+  TAINT_EFFECT_PREFER_NO_SCHEDULE = 3,
+  TAINT_EFFECT_OTHER = 4,
+};
+
+TaintEffect TaintEffectFromString(const string& effect);
+
+// The labels and taints of a node.
+class CompiledNode {
+ public:
+  CompiledNode() {}
+  explicit CompiledNode(const ResourceDescriptor& rd);
+
+  /**
+   * Returns the value of the node's label with the given key, or
+   * kNoStringID if the node does not have it.
+   */
+  StringID_t LabelValue(StringID_t key) const;
+
+  struct Taint {
+    StringID_t key_;
+    StringID_t value_;
+    TaintEffect effect_;
+  };
+
+  inline const vector<pair<StringID_t, StringID_t>>& labels() const {
+    return labels_;
+  }
+
+  inline const vector<Taint>& taints() const {
+    return taints_;
+  }
+
+ private:
+  // (key, value) pairs sorted by key. If a key appears several times, only
+  // the first value is kept.
+  vector<pair<StringID_t, StringID_t>> labels_;
+  vector<Taint> taints_;
+};
+
+// A label selector.
+struct CompiledLabelSelector {
+  StringID_t key_;
+  LabelSelector::SelectorType type_;
+  // Sorted selector values.
+  vector<StringID_t> values_;
+  // Bound of GREATER_THAN and LESSER_THAN selectors.
+  int64_t bound_;
+
+  explicit CompiledLabelSelector(const LabelSelector& selector);
+  bool Matches(const CompiledNode& node) const;
+};
+
+// A conjunction of label selectors.
+class CompiledLabelSelectors {
+ public:
+  CompiledLabelSelectors() {}
+  explicit CompiledLabelSelectors(
+      const RepeatedPtrField<LabelSelector>& selectors);
+  explicit CompiledLabelSelectors(
+      const RepeatedPtrField<NodeSelectorRequirement>& match_expressions);
+
+  bool Matches(const CompiledNode& node) const;
+
+  inline bool empty() const {
+    return selectors_.empty();
+  }
+
+  inline const vector<CompiledLabelSelector>& selectors() const {
+    return selectors_;
+  }
+
+ private:
+  vector<CompiledLabelSelector> selectors_;
+};
+
+// The node selector, node affinity and tolerations of a task.
+class CompiledTaskConstraints {
+ public:
+  CompiledTaskConstraints();
+  explicit CompiledTaskConstraints(const TaskDescriptor& td);
+
+  // Same as SatisfiesNodeSelectorAndNodeAffinity.
+  bool SatisfiesNodeSelectorAndNodeAffinity(const CompiledNode& node) const;
+  // Returns the sum of the weights of the preferred node affinity terms that
+  // the node satisfies.
+  int64_t NodeAffinitySoftScore(const CompiledNode& node) const;
+  // Same as HasMatchingTolerationforNodeTaints.
+  bool ToleratesHardTaints(const CompiledNode& node) const;
+  // Returns the number of PreferNoSchedule taints of the node that the task
+  // does not tolerate.
+  int64_t IntolerableTaintsCost(const CompiledNode& node) const;
+
+  inline const CompiledLabelSelectors& node_selector() const {
+    return node_selector_;
+  }
+
+  // Returns false if the task has no required node affinity terms, in which
+  // case required_terms() is ignored.
+  inline bool has_required_terms() const {
+    return has_required_terms_;
+  }
+
+  inline const vector<CompiledLabelSelectors>& required_terms() const {
+    return required_terms_;
+  }
+
+ private:
+  // Taint (key, effect) pairs tolerated with the Exists operator, sorted.
+  typedef vector<pair<StringID_t, TaintEffect>> ExistsTolerations_t;
+  // Taint (key, effect) pairs tolerated with the Equal operator, and the
+  // value they tolerate, sorted.
+  typedef vector<pair<pair<StringID_t, TaintEffect>, StringID_t>>
+      EqualTolerations_t;
+
+  static void SortTolerations(ExistsTolerations_t* exists,
+                              EqualTolerations_t* equal);
+  static bool Tolerates(const CompiledNode::Taint& taint,
+                        TaintEffect effect,
+                        const ExistsTolerations_t& exists,
+                        const EqualTolerations_t& equal);
+  void CompileHardTolerations(const TaskDescriptor& td);
+  void CompileSoftTolerations(const TaskDescriptor& td);
+
+  CompiledLabelSelectors node_selector_;
+  // True if the required node affinity terms must be checked.
+  bool has_required_terms_;
+  // Required node affinity terms with match expressions; a node must
+  // satisfy one of them.
+  vector<CompiledLabelSelectors> required_terms_;
+  // Weighted preferred node affinity terms.
+  vector<pair<int32_t, CompiledLabelSelectors>> preferred_terms_;
+  int32_t num_tolerations_;
+  bool tolerates_all_hard_taints_;
+  ExistsTolerations_t hard_exists_;
+  EqualTolerations_t hard_equal_;
+  bool tolerates_all_soft_taints_;
+  ExistsTolerations_t soft_exists_;
+  EqualTolerations_t soft_equal_;
+};
+
+}  // namespace scheduler
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SCHEDULING_COMPILED_SELECTOR_H
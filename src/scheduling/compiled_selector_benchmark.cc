@@ -0,0 +1,263 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Benchmark for the evaluation of node selectors, required node affinity and
+// hard taints. It generates nodes with the labels and taints of a typical
+// Kubernetes cluster, and task ECs with node selectors, node affinity terms
+// and tolerations, and evaluates every EC on every node with the label_utils
+// functions, which compare strings, with the compiled forms, which compare
+// interned ids, and with the bulk filter of the CPU cost model's columnar
+// machine index.
+
+#include <random>
+#include <string>
+#include <vector>
+#include <boost/timer/timer.hpp>
+
+#include "base/common.h"
+#include "base/units.h"
+#include "misc/utils.h"
+#include "scheduling/compiled_selector.h"
+#include "scheduling/flow/cpu_machine_index.h"
+#include "scheduling/label_utils.h"
+
+DEFINE_uint64(benchmark_num_machines, 5000, "Number of machines.");
+DEFINE_uint64(benchmark_num_ecs, 200, "Number of task equivalence classes.");
+
+namespace firmament {
+namespace scheduler {
+
+namespace {
+
+const char* kZones[] = {"us-east-1a", "us-east-1b", "us-east-1c",
+                        "us-west-2a", "us-west-2b", "us-west-2c"};
+const char* kInstanceTypes[] = {"m5.large", "m5.xlarge", "m5.2xlarge",
+                                "c5.xlarge", "c5.4xlarge", "r5.2xlarge",
+                                "p3.2xlarge", "g4dn.xlarge"};
+const char* kTeams[] = {"search", "ads", "payments", "infra", "ml"};
+
+template<typename T, size_t N>
+const T& Pick(const T (&values)[N], std::mt19937* rng) {
+  return values[(*rng)() % N];
+}
+
+void AddLabel(ResourceDescriptor* rd_ptr, const string& key,
+              const string& value) {
+  Label* label = rd_ptr->add_labels();
+  label->set_key(key);
+  label->set_value(value);
+}
+
+void AddToleration(TaskDescriptor* td_ptr, const string& key,
+                   const string& op, const string& value,
+                   const string& effect) {
+  Toleration* toleration = td_ptr->add_tolerations();
+  toleration->set_key(key);
+  toleration->set_operator_(op);
+  toleration->set_value(value);
+  toleration->set_effect(effect);
+}
+
+void AddRequirement(NodeSelectorTerm* term, const string& key,
+                    const string& op, const vector<string>& values) {
+  NodeSelectorRequirement* requirement = term->add_matchexpressions();
+  requirement->set_key(key);
+  requirement->set_operator_(op);
+  for (const auto& value : values) {
+    requirement->add_values(value);
+  }
+}
+
+ResourceDescriptor GenerateMachine(uint64_t index, std::mt19937* rng) {
+  ResourceDescriptor rd;
+  string zone = Pick(kZones, rng);
+  string instance_type = Pick(kInstanceTypes, rng);
+  bool arm = (*rng)() % 4 == 0;
+  string hostname = "ip-10-0-" + to_string(index / 256) + "-" +
+    to_string(index % 256);
+  AddLabel(&rd, "kubernetes.io/hostname", hostname);
+  AddLabel(&rd, "kubernetes.io/os", "linux");
+  AddLabel(&rd, "kubernetes.io/arch", arm ? "arm64" : "amd64");
+  AddLabel(&rd, "beta.kubernetes.io/os", "linux");
+  AddLabel(&rd, "beta.kubernetes.io/arch", arm ? "arm64" : "amd64");
+  AddLabel(&rd, "beta.kubernetes.io/instance-type", instance_type);
+  AddLabel(&rd, "node.kubernetes.io/instance-type", instance_type);
+  AddLabel(&rd, "topology.kubernetes.io/zone", zone);
+  AddLabel(&rd, "topology.kubernetes.io/region", zone.substr(0, 9));
+  AddLabel(&rd, "failure-domain.beta.kubernetes.io/zone", zone);
+  AddLabel(&rd, "node-role.kubernetes.io/worker", "");
+  AddLabel(&rd, "eks.amazonaws.com/nodegroup",
+           "ng-" + instance_type + "-" + zone);
+  AddLabel(&rd, "team", Pick(kTeams, rng));
+  AddLabel(&rd, "max-gpus", to_string((*rng)() % 9));
+  uint64_t taint_kind = (*rng)() % 10;
+  if (taint_kind == 0) {
+    Taint* taint = rd.add_taints();
+    taint->set_key("nvidia.com/gpu");
+    taint->set_value("present");
+    taint->set_effect("NoSchedule");
+  } else if (taint_kind == 1) {
+    Taint* taint = rd.add_taints();
+    taint->set_key("spot");
+    taint->set_value("true");
+    taint->set_effect("PreferNoSchedule");
+  }
+  return rd;
+}
+
+TaskDescriptor GenerateEC(std::mt19937* rng) {
+  TaskDescriptor td;
+  AddToleration(&td, "node.kubernetes.io/not-ready", "Exists", "",
+                "NoExecute");
+  AddToleration(&td, "node.kubernetes.io/unreachable", "Exists", "",
+                "NoExecute");
+  if ((*rng)() % 2 == 0) {
+    LabelSelector* selector = td.add_label_selectors();
+    selector->set_type(LabelSelector::IN_SET);
+    selector->set_key("kubernetes.io/os");
+    selector->add_values("linux");
+  }
+  if ((*rng)() % 3 == 0) {
+    LabelSelector* selector = td.add_label_selectors();
+    selector->set_type(LabelSelector::IN_SET);
+    selector->set_key("team");
+    selector->add_values(Pick(kTeams, rng));
+  }
+  if ((*rng)() % 2 == 0) {
+    NodeSelectorTerm* term = td.mutable_affinity()->mutable_node_affinity()
+      ->mutable_requiredduringschedulingignoredduringexecution()
+      ->add_nodeselectorterms();
+    AddRequirement(term, "topology.kubernetes.io/zone", "In",
+                   {Pick(kZones, rng), Pick(kZones, rng), Pick(kZones, rng)});
+    AddRequirement(term, "kubernetes.io/arch", "NotIn", {"arm64"});
+    if ((*rng)() % 2 == 0) {
+      AddRequirement(term, "node.kubernetes.io/instance-type", "In",
+                     {Pick(kInstanceTypes, rng), Pick(kInstanceTypes, rng)});
+    }
+    NodeSelectorTerm* gpu_term =
+      td.mutable_affinity()->mutable_node_affinity()
+      ->mutable_requiredduringschedulingignoredduringexecution()
+      ->add_nodeselectorterms();
+    AddRequirement(gpu_term, "max-gpus", "Gt", {"4"});
+  }
+  if ((*rng)() % 5 == 0) {
+    AddToleration(&td, "nvidia.com/gpu", "Equal", "present", "NoSchedule");
+    AddToleration(&td, "spot", "Exists", "", "PreferNoSchedule");
+  }
+  return td;
+}
+
+double ElapsedMs(const boost::timer::cpu_timer& timer) {
+  return static_cast<double>(timer.elapsed().wall) /
+    (NANOSECONDS_IN_MICROSECOND * MILLISECONDS_TO_MICROSECONDS);
+}
+
+}  // namespace
+
+void RunBenchmark() {
+  std::mt19937 rng(42);
+  vector<ResourceDescriptor> machines;
+  for (uint64_t m = 0; m < FLAGS_benchmark_num_machines; ++m) {
+    machines.push_back(GenerateMachine(m, &rng));
+  }
+  vector<TaskDescriptor> ecs;
+  for (uint64_t ec = 0; ec < FLAGS_benchmark_num_ecs; ++ec) {
+    ecs.push_back(GenerateEC(&rng));
+  }
+  uint64_t num_pairs = machines.size() * ecs.size();
+
+  boost::timer::cpu_timer timer;
+  uint64_t legacy_feasible = 0;
+  for (const auto& td : ecs) {
+    for (const auto& rd : machines) {
+      if (SatisfiesNodeSelectorAndNodeAffinity(rd, td) &&
+          HasMatchingTolerationforNodeTaints(rd, td)) {
+        legacy_feasible++;
+      }
+    }
+  }
+  double legacy_ms = ElapsedMs(timer);
+
+  timer.start();
+  vector<CompiledNode> compiled_machines;
+  for (const auto& rd : machines) {
+    compiled_machines.push_back(CompiledNode(rd));
+  }
+  vector<CompiledTaskConstraints> compiled_ecs;
+  for (const auto& td : ecs) {
+    compiled_ecs.push_back(CompiledTaskConstraints(td));
+  }
+  double compile_ms = ElapsedMs(timer);
+  timer.start();
+  uint64_t compiled_feasible = 0;
+  for (const auto& constraints : compiled_ecs) {
+    for (const auto& node : compiled_machines) {
+      if (constraints.SatisfiesNodeSelectorAndNodeAffinity(node) &&
+          constraints.ToleratesHardTaints(node)) {
+        compiled_feasible++;
+      }
+    }
+  }
+  double compiled_ms = ElapsedMs(timer);
+
+  CpuMachineIndex machine_index;
+  for (uint64_t m = 0; m < machines.size(); ++m) {
+    machines[m].mutable_available_resources()->set_cpu_cores(16);
+    machines[m].mutable_available_resources()->set_ram_cap(65536);
+    machines[m].mutable_available_resources()->set_ephemeral_storage(100);
+    machine_index.AddMachine(GenerateResourceID("m" + to_string(m)),
+                             machines[m]);
+  }
+  CpuMemResVector_t request;
+  request.cpu_cores_ = 0;
+  request.ram_cap_ = 0;
+  request.ephemeral_storage_ = 0;
+  timer.start();
+  uint64_t bulk_feasible = 0;
+  vector<ResourceID_t> eligible_machines;
+  for (const auto& constraints : compiled_ecs) {
+    eligible_machines.clear();
+    machine_index.EligibleMachines(&constraints, request, &eligible_machines);
+    bulk_feasible += eligible_machines.size();
+  }
+  double bulk_ms = ElapsedMs(timer);
+
+  CHECK_EQ(legacy_feasible, compiled_feasible);
+  CHECK_EQ(legacy_feasible, bulk_feasible);
+  LOG(INFO) << num_pairs << " (EC, machine) pairs, " << legacy_feasible
+            << " feasible";
+  LOG(INFO) << "label_utils: " << legacy_ms << " ms ("
+            << legacy_ms * 1000000 / num_pairs << " ns per pair)";
+  LOG(INFO) << "Compiled: " << compiled_ms << " ms ("
+            << compiled_ms * 1000000 / num_pairs << " ns per pair), "
+            << "compiling " << compile_ms << " ms";
+  LOG(INFO) << "Bulk filter: " << bulk_ms << " ms ("
+            << bulk_ms * 1000000 / num_pairs << " ns per pair)";
+}
+
+}  // namespace scheduler
+}  // namespace firmament
+
+int main(int argc, char *argv[]) {
+  firmament::common::InitFirmament(argc, argv);
+  FLAGS_logtostderr = true;
+  firmament::scheduler::RunBenchmark();
+  return 0;
+}
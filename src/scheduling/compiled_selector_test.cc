@@ -0,0 +1,245 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Compiled selector unit tests. The compiled forms must give the same
+// results as the functions in label_utils.h.
+
+#include <gtest/gtest.h>
+
+#include "scheduling/compiled_selector.h"
+#include "scheduling/label_utils.h"
+
+namespace firmament {
+namespace scheduler {
+
+class CompiledSelectorTest : public ::testing::Test {
+ protected:
+  CompiledSelectorTest() {
+    FLAGS_v = 2;
+  }
+
+  void AddLabel(ResourceDescriptor* rd_ptr, const string& key,
+                const string& value) {
+    Label* label = rd_ptr->add_labels();
+    label->set_key(key);
+    label->set_value(value);
+  }
+
+  void AddTaint(ResourceDescriptor* rd_ptr, const string& key,
+                const string& value, const string& effect) {
+    Taint* taint = rd_ptr->add_taints();
+    taint->set_key(key);
+    taint->set_value(value);
+    taint->set_effect(effect);
+  }
+
+  void AddToleration(TaskDescriptor* td_ptr, const string& key,
+                     const string& op, const string& value,
+                     const string& effect) {
+    Toleration* toleration = td_ptr->add_tolerations();
+    toleration->set_key(key);
+    toleration->set_operator_(op);
+    toleration->set_value(value);
+    toleration->set_effect(effect);
+  }
+
+  // Adds the two tolerations that every pod gets by default.
+  void AddDefaultTolerations(TaskDescriptor* td_ptr) {
+    AddToleration(td_ptr, "node.kubernetes.io/not-ready", "Exists", "",
+                  "NoExecute");
+    AddToleration(td_ptr, "node.kubernetes.io/unreachable", "Exists", "",
+                  "NoExecute");
+  }
+
+  void AddSelector(TaskDescriptor* td_ptr, LabelSelector::SelectorType type,
+                   const string& key, const vector<string>& values) {
+    LabelSelector* selector = td_ptr->add_label_selectors();
+    selector->set_type(type);
+    selector->set_key(key);
+    for (const auto& value : values) {
+      selector->add_values(value);
+    }
+  }
+
+  void AddRequirement(NodeSelectorTerm* term, const string& key,
+                      const string& op, const vector<string>& values) {
+    NodeSelectorRequirement* requirement = term->add_matchexpressions();
+    requirement->set_key(key);
+    requirement->set_operator_(op);
+    for (const auto& value : values) {
+      requirement->add_values(value);
+    }
+  }
+
+  NodeAffinity* MutableNodeAffinity(TaskDescriptor* td_ptr) {
+    return td_ptr->mutable_affinity()->mutable_node_affinity();
+  }
+
+  NodeSelectorTerm* AddRequiredTerm(TaskDescriptor* td_ptr) {
+    return MutableNodeAffinity(td_ptr)
+      ->mutable_requiredduringschedulingignoredduringexecution()
+      ->add_nodeselectorterms();
+  }
+
+  NodeSelectorTerm* AddPreferredTerm(TaskDescriptor* td_ptr, int32_t weight) {
+    PreferredSchedulingTerm* term = MutableNodeAffinity(td_ptr)
+      ->add_preferredduringschedulingignoredduringexecution();
+    term->set_weight(weight);
+    return term->mutable_preference();
+  }
+
+  // Checks that the compiled node selector, node affinity and hard taint
+  // checks agree with label_utils, and returns their results.
+  pair<bool, bool> Check(const ResourceDescriptor& rd,
+                         const TaskDescriptor& td) {
+    CompiledNode node(rd);
+    CompiledTaskConstraints constraints(td);
+    bool satisfies = constraints.SatisfiesNodeSelectorAndNodeAffinity(node);
+    bool tolerates = constraints.ToleratesHardTaints(node);
+    EXPECT_EQ(satisfies, SatisfiesNodeSelectorAndNodeAffinity(rd, td));
+    EXPECT_EQ(tolerates, HasMatchingTolerationforNodeTaints(rd, td));
+    return pair<bool, bool>(satisfies, tolerates);
+  }
+};
+
+TEST_F(CompiledSelectorTest, LabelSelectors) {
+  ResourceDescriptor rd;
+  AddLabel(&rd, "topology.kubernetes.io/zone", "us-east-1a");
+  AddLabel(&rd, "node.kubernetes.io/instance-type", "m5.xlarge");
+  AddLabel(&rd, "gpu-count", "4");
+  // Only the first value of a label key counts.
+  AddLabel(&rd, "gpu-count", "8");
+  TaskDescriptor td;
+  EXPECT_TRUE(Check(rd, td).first);
+  AddSelector(&td, LabelSelector::IN_SET, "topology.kubernetes.io/zone",
+              {"us-east-1b", "us-east-1a"});
+  EXPECT_TRUE(Check(rd, td).first);
+  AddSelector(&td, LabelSelector::EXISTS_KEY,
+              "node.kubernetes.io/instance-type", {});
+  EXPECT_TRUE(Check(rd, td).first);
+  AddSelector(&td, LabelSelector::GREATER_THAN, "gpu-count", {"2"});
+  EXPECT_TRUE(Check(rd, td).first);
+  AddSelector(&td, LabelSelector::LESSER_THAN, "gpu-count", {"5"});
+  EXPECT_TRUE(Check(rd, td).first);
+  AddSelector(&td, LabelSelector::NOT_EXISTS_KEY, "spot", {});
+  EXPECT_TRUE(Check(rd, td).first);
+  AddSelector(&td, LabelSelector::NOT_IN_SET,
+              "node.kubernetes.io/instance-type", {"m5.large", "m5.xlarge"});
+  EXPECT_FALSE(Check(rd, td).first);
+  TaskDescriptor td_missing_key;
+  AddSelector(&td_missing_key, LabelSelector::IN_SET, "disk", {"ssd"});
+  EXPECT_FALSE(Check(rd, td_missing_key).first);
+  TaskDescriptor td_not_in_missing_key;
+  AddSelector(&td_not_in_missing_key, LabelSelector::NOT_IN_SET, "disk",
+              {"ssd"});
+  EXPECT_TRUE(Check(rd, td_not_in_missing_key).first);
+}
+
+TEST_F(CompiledSelectorTest, RequiredNodeAffinity) {
+  ResourceDescriptor rd;
+  AddLabel(&rd, "kubernetes.io/os", "linux");
+  AddLabel(&rd, "kubernetes.io/arch", "amd64");
+  TaskDescriptor td;
+  NodeSelectorTerm* arm = AddRequiredTerm(&td);
+  AddRequirement(arm, "kubernetes.io/os", "In", {"linux"});
+  AddRequirement(arm, "kubernetes.io/arch", "In", {"arm64"});
+  EXPECT_FALSE(Check(rd, td).first);
+  // A term without match expressions matches no node.
+  AddRequiredTerm(&td);
+  EXPECT_FALSE(Check(rd, td).first);
+  // The terms are ORed.
+  NodeSelectorTerm* not_windows = AddRequiredTerm(&td);
+  AddRequirement(not_windows, "kubernetes.io/os", "NotIn", {"windows"});
+  EXPECT_TRUE(Check(rd, td).first);
+  // The node selector must still be satisfied.
+  AddSelector(&td, LabelSelector::EXISTS_KEY, "gpu", {});
+  EXPECT_FALSE(Check(rd, td).first);
+}
+
+TEST_F(CompiledSelectorTest, PreferredNodeAffinity) {
+  ResourceDescriptor rd;
+  AddLabel(&rd, "topology.kubernetes.io/zone", "us-east-1a");
+  AddLabel(&rd, "disk", "ssd");
+  TaskDescriptor td;
+  AddRequirement(AddPreferredTerm(&td, 10), "topology.kubernetes.io/zone",
+                 "In", {"us-east-1a"});
+  AddRequirement(AddPreferredTerm(&td, 5), "disk", "Exists", {});
+  AddRequirement(AddPreferredTerm(&td, 7), "disk", "In", {"hdd"});
+  // Terms with zero weight or without match expressions are ignored.
+  AddRequirement(AddPreferredTerm(&td, 0), "disk", "Exists", {});
+  AddPreferredTerm(&td, 3);
+  CompiledTaskConstraints constraints(td);
+  EXPECT_EQ(constraints.NodeAffinitySoftScore(CompiledNode(rd)), 15);
+  // Preferred terms do not restrict the nodes.
+  EXPECT_TRUE(Check(rd, td).first);
+}
+
+TEST_F(CompiledSelectorTest, HardTaints) {
+  ResourceDescriptor rd;
+  AddTaint(&rd, "dedicated", "gpu", "NoSchedule");
+  AddTaint(&rd, "maintenance", "true", "NoExecute");
+  TaskDescriptor td_default;
+  AddDefaultTolerations(&td_default);
+  EXPECT_FALSE(Check(rd, td_default).second);
+  TaskDescriptor td;
+  AddDefaultTolerations(&td);
+  AddToleration(&td, "dedicated", "Equal", "gpu", "NoSchedule");
+  EXPECT_FALSE(Check(rd, td).second);
+  // A toleration without effect tolerates NoSchedule and NoExecute taints.
+  AddToleration(&td, "maintenance", "Exists", "", "");
+  EXPECT_TRUE(Check(rd, td).second);
+  TaskDescriptor td_wrong_value;
+  AddDefaultTolerations(&td_wrong_value);
+  AddToleration(&td_wrong_value, "dedicated", "", "cpu", "");
+  AddToleration(&td_wrong_value, "maintenance", "Exists", "", "NoExecute");
+  EXPECT_FALSE(Check(rd, td_wrong_value).second);
+  TaskDescriptor td_all;
+  AddDefaultTolerations(&td_all);
+  AddToleration(&td_all, "", "Exists", "", "");
+  EXPECT_TRUE(Check(rd, td_all).second);
+  // Soft taints do not restrict the tasks.
+  ResourceDescriptor rd_soft;
+  AddTaint(&rd_soft, "dedicated", "gpu", "PreferNoSchedule");
+  EXPECT_TRUE(Check(rd_soft, td_default).second);
+}
+
+TEST_F(CompiledSelectorTest, SoftTaints) {
+  ResourceDescriptor rd;
+  AddTaint(&rd, "dedicated", "gpu", "PreferNoSchedule");
+  AddTaint(&rd, "spot", "true", "PreferNoSchedule");
+  AddTaint(&rd, "maintenance", "true", "NoSchedule");
+  CompiledNode node(rd);
+  TaskDescriptor td;
+  EXPECT_EQ(CompiledTaskConstraints(td).IntolerableTaintsCost(node), 2);
+  AddToleration(&td, "dedicated", "Equal", "cpu", "PreferNoSchedule");
+  EXPECT_EQ(CompiledTaskConstraints(td).IntolerableTaintsCost(node), 2);
+  AddToleration(&td, "spot", "Exists", "", "");
+  EXPECT_EQ(CompiledTaskConstraints(td).IntolerableTaintsCost(node), 1);
+  AddToleration(&td, "", "Exists", "", "PreferNoSchedule");
+  EXPECT_EQ(CompiledTaskConstraints(td).IntolerableTaintsCost(node), 0);
+}
+
+}  // namespace scheduler
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
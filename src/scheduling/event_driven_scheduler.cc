@@ -44,6 +44,9 @@
 
 DEFINE_uint64(task_fail_timeout, 60, "Time (in seconds) after which to declare "
               "a task as failed if it has not sent heartbeats");
+DEFINE_uint64(affinity_task_batch_size, 100, "Maximum number of pod affinity/"
+              "anti-affinity tasks that are placed in a queue based "
+              "scheduling round");
 
 namespace firmament {
 namespace scheduler {
@@ -67,11 +70,12 @@ EventDrivenScheduler::EventDrivenScheduler(
     const string& coordinator_uri,
     TimeInterface* time_manager,
     TraceGenerator* trace_generator,
-    unordered_map<string, unordered_map<string, vector<TaskID_t>>>* labels_map,
-    vector<TaskID_t> *affinity_antiaffinity_tasks)
+    LabelIndex* label_index,
+    IndexedQueue<TaskID_t>* affinity_antiaffinity_tasks,
+    TaskStore* task_store)
   : SchedulerInterface(job_map, knowledge_base, resource_map,
-                       resource_topology, object_store, task_map, labels_map,
-                       affinity_antiaffinity_tasks),
+                       resource_topology, object_store, task_map, label_index,
+                       affinity_antiaffinity_tasks, task_store),
       coordinator_uri_(coordinator_uri),
       coordinator_res_id_(coordinator_res_id),
       event_notifier_(event_notifier),
@@ -80,7 +84,7 @@ EventDrivenScheduler::EventDrivenScheduler(
       time_manager_(time_manager),
       trace_generator_(trace_generator) {
   VLOG(1) << "EventDrivenScheduler initiated.";
-  one_task_runnable = false;
+  affinity_batch_released = false;
   queue_based_schedule = false;
 }
 
@@ -120,6 +124,10 @@ void EventDrivenScheduler::BindTaskToResource(TaskDescriptor* td_ptr,
   rd_ptr->add_current_running_tasks(task_id);
   CHECK(InsertIfNotPresent(&task_bindings_, task_id, res_id));
   resource_bindings_.insert(pair<ResourceID_t, TaskID_t>(res_id, task_id));
+  if (label_index_) {
+    label_index_->PlaceTask(task_id,
+                            MachineResIDForResource(resource_map_, res_id));
+  }
 }
 
 ResourceID_t* EventDrivenScheduler::BoundResourceForTask(TaskID_t task_id) {
@@ -332,6 +340,9 @@ void EventDrivenScheduler::HandleTaskCompletion(TaskDescriptor* td_ptr,
   // Store the final report in the TD for future reference
   td_ptr->mutable_final_report()->CopyFrom(*report);
   trace_generator_->TaskCompleted(td_ptr->uid(), rs_ptr->descriptor());
+  if (knowledge_base_) {
+    knowledge_base_->RemoveTaskSamples(td_ptr->uid());
+  }
   if (event_notifier_) {
     event_notifier_->OnTaskCompletion(td_ptr, rs_ptr->mutable_descriptor());
   }
@@ -494,6 +505,9 @@ void EventDrivenScheduler::HandleTaskRemoval(TaskDescriptor* td_ptr) {
     td_ptr->set_state(TaskDescriptor::ABORTED);
   }
   trace_generator_->TaskRemoved(td_ptr->uid(), was_running);
+  if (knowledge_base_) {
+    knowledge_base_->RemoveTaskSamples(td_ptr->uid());
+  }
 }
 
 void EventDrivenScheduler::KillRunningTask(
@@ -543,6 +557,51 @@ void EventDrivenScheduler::InsertTaskIntoRunnables(JobID_t job_id,
   }
 }
 
+void EventDrivenScheduler::ReleaseAffinityTaskBatch() {
+  // Tasks released in the previous round that were not placed go back to the
+  // end of the queue. Tasks that no longer exist are dropped.
+  vector<TaskID_t> requeued_tasks;
+  vector<TaskID_t> removed_tasks;
+  for (auto& task_id : *affinity_antiaffinity_tasks_) {
+    TaskDescriptor* td_ptr = FindPtrOrNull(*task_map_, task_id);
+    if (!td_ptr) {
+      removed_tasks.push_back(task_id);
+    } else if (td_ptr->state() == TaskDescriptor::RUNNABLE) {
+      td_ptr->set_state(TaskDescriptor::CREATED);
+      runnable_tasks_[JobIDFromString(td_ptr->job_id())].erase(task_id);
+      requeued_tasks.push_back(task_id);
+    }
+  }
+  for (auto& task_id : removed_tasks) {
+    affinity_antiaffinity_tasks_->Erase(task_id);
+  }
+  for (auto& task_id : requeued_tasks) {
+    affinity_antiaffinity_tasks_->MoveToBack(task_id);
+  }
+  // Release the task at the head of the queue together with the following
+  // tasks of the same job. The cost model puts the affinity tasks of a job
+  // in the same equivalence class, so the batch shares its arcs.
+  string batch_job_id;
+  uint64_t num_released = 0;
+  for (auto& task_id : *affinity_antiaffinity_tasks_) {
+    if (num_released >= FLAGS_affinity_task_batch_size) {
+      break;
+    }
+    TaskDescriptor* td_ptr = FindPtrOrNull(*task_map_, task_id);
+    if (td_ptr->state() != TaskDescriptor::CREATED) {
+      continue;
+    }
+    if (num_released > 0 && td_ptr->job_id() != batch_job_id) {
+      continue;
+    }
+    batch_job_id = td_ptr->job_id();
+    td_ptr->set_state(TaskDescriptor::RUNNABLE);
+    InsertTaskIntoRunnables(JobIDFromString(batch_job_id), task_id);
+    num_released++;
+  }
+  affinity_batch_released = true;
+}
+
 // Implementation of lazy graph reduction algorithm, as per p58, fig. 3.5 in
 // Derek Murray's thesis on CIEL.
 void EventDrivenScheduler::LazyGraphReduction(
@@ -655,6 +714,15 @@ void EventDrivenScheduler::LazyGraphReduction(
       if (child_task.outputs_size() == 0)
         newly_active_tasks.push_back(&child_task);
     }
+    if (current_task == rtd_ptr && task_store_) {
+      // The job's tasks in the task store are children of the root task.
+      vector<TaskDescriptor*> stored_tasks;
+      task_store_->TasksForJob(job_id, &stored_tasks);
+      for (auto& child_task : stored_tasks) {
+        if (child_task->outputs_size() == 0)
+          newly_active_tasks.push_back(child_task);
+      }
+    }
     if (current_task->state() == TaskDescriptor::CREATED ||
         current_task->state() == TaskDescriptor::BLOCKING) {
       if (!will_block || (current_task->dependencies_size() == 0
@@ -663,30 +731,8 @@ void EventDrivenScheduler::LazyGraphReduction(
         if (current_task->has_affinity() &&
             (current_task->affinity().has_pod_affinity() ||
              current_task->affinity().has_pod_anti_affinity())) {
-          if (queue_based_schedule == false || one_task_runnable == true)
-            continue;
-          for (auto task_itr = affinity_antiaffinity_tasks_->begin();
-               task_itr != affinity_antiaffinity_tasks_->end(); ++task_itr) {
-            TaskDescriptor* tdp = FindPtrOrNull(*task_map_, *task_itr);
-            if (tdp) {
-              if ((tdp->state() == TaskDescriptor::RUNNABLE) &&
-                  (one_task_runnable == false)) {
-                TaskID_t task_id = *task_itr;
-                tdp->set_state(TaskDescriptor::CREATED);
-                task_itr = affinity_antiaffinity_tasks_->erase(task_itr);
-                affinity_antiaffinity_tasks_->push_back(task_id);
-                JobID_t tdp_job_id = JobIDFromString(tdp->job_id());
-                runnable_tasks_[tdp_job_id].erase(task_id);
-                continue;
-              }
-              if (tdp->state() == TaskDescriptor::CREATED) {
-                tdp->set_state(TaskDescriptor::RUNNABLE);
-                InsertTaskIntoRunnables(JobIDFromString(tdp->job_id()),
-                                      tdp->uid());
-                one_task_runnable = true;
-                break;
-              }
-            }
+          if (queue_based_schedule && !affinity_batch_released) {
+            ReleaseAffinityTaskBatch();
           }
         } else {
           current_task->set_state(TaskDescriptor::RUNNABLE);
@@ -917,6 +963,9 @@ bool EventDrivenScheduler::UnbindTaskFromResource(TaskDescriptor* td_ptr,
         break;
       }
     }
+    if (label_index_) {
+      label_index_->UnplaceTask(task_id);
+    }
     return task_bindings_.erase(task_id) == 1;
   } else {
     return false;
@@ -63,9 +63,9 @@ class EventDrivenScheduler : public SchedulerInterface {
                        const string& coordinator_uri,
                        TimeInterface* time_manager,
                        TraceGenerator* trace_generator,
-                       unordered_map<string, unordered_map<string, vector<TaskID_t>>>*
-                           labels_map,
-                       vector<TaskID_t> *affinity_antiaffinity_tasks);
+                       LabelIndex* label_index,
+                       IndexedQueue<TaskID_t>* affinity_antiaffinity_tasks,
+                       TaskStore* task_store);
   ~EventDrivenScheduler();
   virtual void AddJob(JobDescriptor* jd_ptr);
   ResourceID_t* BoundResourceForTask(TaskID_t task_id);
@@ -131,6 +131,12 @@ class EventDrivenScheduler : public SchedulerInterface {
   void RegisterLocalResource(ResourceID_t res_id);
   void RegisterRemoteResource(ResourceID_t res_id);
   void RegisterSimulatedResource(ResourceID_t res_id);
+  /**
+   * Makes the next batch of queued pod affinity/anti-affinity tasks runnable.
+   * The batch holds up to FLAGS_affinity_task_batch_size tasks of the job at
+   * the head of the queue.
+   */
+  void ReleaseAffinityTaskBatch();
 
   /**
    * Removes a resource from its parent's children list.
@@ -187,7 +193,7 @@ class EventDrivenScheduler : public SchedulerInterface {
   TimeInterface* time_manager_;
   TraceGenerator* trace_generator_;
   //Pod affinity/anti-affinity
-  bool one_task_runnable;
+  bool affinity_batch_released;
   bool queue_based_schedule;
   //Gang schedule tasks deltas
   unordered_set<JobDescriptor*> delta_jobs;
@@ -20,11 +20,14 @@
 
 #include <grpc++/grpc++.h>
 
+#include <atomic>
 #include <ctime>
+#include <deque>
 #include "base/resource_status.h"
 #include "base/resource_topology_node_desc.pb.h"
 #include "base/units.h"
 #include "misc/map-util.h"
+#include "misc/mpsc_queue.h"
 #include "misc/pb_utils.h"
 #include "misc/trace_generator.h"
 #include "misc/utils.h"
@@ -37,12 +40,14 @@
 #include "scheduling/knowledge_base_populator.h"
 #include "scheduling/scheduler_interface.h"
 #include "scheduling/scheduling_delta.pb.h"
+#include "scheduling/scheduling_round_trigger.h"
 #include "scheduling/simple/simple_scheduler.h"
 #include "storage/simple_object_store.h"
 
 using grpc::Server;
 using grpc::ServerBuilder;
 using grpc::ServerContext;
+using grpc::ServerWriter;
 using grpc::Status;
 
 using firmament::scheduler::FlowScheduler;
@@ -62,14 +67,72 @@ DECLARE_bool(resource_stats_update_based_on_resource_reservation);
 DEFINE_string(service_scheduler, "flow", "Scheduler to use: flow | simple");
 DEFINE_uint64(queue_based_scheduling_time, 100,
               "Queue Based Schedule run time");
+DEFINE_bool(async_event_ingest, false,
+            "If true, task and node events are appended to an event log "
+            "instead of waiting for the scheduling lock. The log is drained "
+            "by the thread that holds the lock, at the latest before the next "
+            "scheduling round.");
+DEFINE_bool(scheduling_loop, false,
+            "If true, the service runs scheduling rounds from a background "
+            "thread whenever enough work is pending, and buffers the deltas "
+            "for SubscribeDeltas.");
+DEFINE_uint64(scheduling_loop_check_interval_ms, 10,
+              "How often the scheduling loop checks whether to run a round");
+DEFINE_uint64(scheduling_loop_min_round_gap_ms, 100,
+              "Minimum time between the end of a round and the start of the "
+              "next round run by the scheduling loop");
+DEFINE_uint64(scheduling_loop_max_pending_task_age_ms, 500,
+              "The scheduling loop runs a round once the oldest task that "
+              "waits for a placement has been runnable for this long. Rounds "
+              "also run as soon as capacity is freed while tasks wait");
+DEFINE_uint64(scheduling_loop_graph_changes_threshold, 1000,
+              "The scheduling loop runs a round once this many flow graph "
+              "changes are pending");
+DEFINE_uint64(scheduling_loop_max_buffered_rounds, 100,
+              "The scheduling loop pauses while this many rounds' deltas are "
+              "waiting for a subscriber");
 
 namespace firmament {
 
+// A task or node event received while --async_event_ingest is set. The event
+// is applied by whichever thread next holds the scheduling lock.
+struct IngestEvent {
+  enum Type {
+    TASK_SUBMITTED = 0,
+    TASK_COMPLETED = 1,
+    TASK_FAILED = 2,
+    TASK_REMOVED = 3,
+    TASK_UPDATED = 4,
+    NODE_ADDED = 5,
+    NODE_FAILED = 6,
+    NODE_REMOVED = 7,
+    NODE_UPDATED = 8,
+  };
+
+  explicit IngestEvent(Type event_type)
+    : type(event_type), task_id(0), reply_type(0), applied(false) {
+  }
+
+  Type type;
+  // Payload; which field is set depends on the type.
+  TaskID_t task_id;
+  TaskDescription task_desc;
+  ResourceTopologyNodeDescriptor rtnd;
+  ResourceUID resource_uid;
+  // TaskReplyType or NodeReplyType of the event; only valid once applied.
+  int32_t reply_type;
+  std::atomic<bool> applied;
+};
+
 class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
  public:
-  FirmamentSchedulerServiceImpl() {
+  FirmamentSchedulerServiceImpl()
+    : round_trigger_(FLAGS_scheduling_loop_max_pending_task_age_ms *
+                     MILLISECONDS_TO_MICROSECONDS,
+                     FLAGS_scheduling_loop_graph_changes_threshold) {
     job_map_.reset(new JobMap_t);
     task_map_.reset(new TaskMap_t);
+    task_store_.reset(new TaskStore(task_map_));
     resource_map_.reset(new ResourceMap_t);
     knowledge_base_.reset(new KnowledgeBase);
     topology_manager_.reset(new TopologyManager);
@@ -83,8 +146,8 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
           job_map_, resource_map_,
           top_level_res_status->mutable_topology_node(), obj_store_, task_map_,
           knowledge_base_, topology_manager_, sim_messaging_adapter_, NULL,
-          top_level_res_id_, "", &wall_time_, trace_generator_, &labels_map_,
-          &affinity_antiaffinity_tasks_);
+          top_level_res_id_, "", &wall_time_, trace_generator_, &label_index_,
+          &affinity_antiaffinity_tasks_, task_store_.get());
       // Get cost model pointer to clear unscheduled tasks of previous
       // scheduling round and get unscheduled tasks of current scheduling round.
       cost_model_ = dynamic_cast<FlowScheduler*>(scheduler_)->cost_model();
@@ -93,16 +156,34 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
           job_map_, resource_map_,
           top_level_res_status->mutable_topology_node(), obj_store_, task_map_,
           knowledge_base_, topology_manager_, sim_messaging_adapter_, NULL,
-          top_level_res_id_, "", &wall_time_, trace_generator_);
+          top_level_res_id_, "", &wall_time_, trace_generator_,
+          task_store_.get());
+      cost_model_ = NULL;
     } else {
       LOG(FATAL) << "Flag specifies unknown scheduler "
                  << FLAGS_service_scheduler;
     }
 
     kb_populator_ = new KnowledgeBasePopulator(knowledge_base_);
+    stop_scheduling_loop_ = false;
+    if (FLAGS_scheduling_loop) {
+      scheduling_loop_thread_ = new boost::thread(
+          boost::bind(&FirmamentSchedulerServiceImpl::SchedulingLoop, this));
+    } else {
+      scheduling_loop_thread_ = NULL;
+    }
   }
 
   ~FirmamentSchedulerServiceImpl() {
+    if (scheduling_loop_thread_) {
+      {
+        boost::lock_guard<boost::mutex> lock(scheduling_loop_lock_);
+        stop_scheduling_loop_ = true;
+      }
+      scheduling_loop_cond_.notify_all();
+      scheduling_loop_thread_->join();
+      delete scheduling_loop_thread_;
+    }
     delete scheduler_;
     delete sim_messaging_adapter_;
     delete trace_generator_;
@@ -113,10 +194,13 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
     TaskDescriptor* td_ptr = FindPtrOrNull(*task_map_, delta.task_id());
     CHECK_NOTNULL(td_ptr);
     td_ptr->set_start_time(wall_time_.GetCurrentTimestamp());
+    round_trigger_.TaskNotRunnable(delta.task_id());
   }
 
   void HandlePreemptionDelta(const SchedulingDelta& delta) {
     // TODO(ionel): Implement!
+    round_trigger_.TaskRunnable(delta.task_id(),
+                                wall_time_.GetCurrentTimestamp());
   }
 
   void HandleMigrationDelta(const SchedulingDelta& delta) {
@@ -260,8 +344,113 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
 
   Status Schedule(ServerContext* context, const ScheduleRequest* request,
                   SchedulingDeltas* reply) override {
+    RunSchedulingRound(reply, NULL);
+    return Status::OK;
+  }
+
+  Status ScheduleStream(ServerContext* context,
+                        const ScheduleRequest* request,
+                        ServerWriter<SchedulingDeltas>* writer) override {
+    // The round runs on another thread and hands its final deltas to this
+    // one, which writes them to the client. The round holds the scheduling
+    // lock, so it must not wait for a slow client.
+    boost::mutex stream_lock;
+    boost::condition_variable stream_cond;
+    deque<SchedulingDeltas> deltas_to_write;
+    bool round_done = false;
+    boost::thread round_thread([&]() {
+      SchedulingDeltas reply;
+      RunSchedulingRound(&reply, [&](SchedulingDeltas* deltas) {
+          boost::lock_guard<boost::mutex> lock(stream_lock);
+          deltas_to_write.push_back(SchedulingDeltas());
+          deltas_to_write.back().Swap(deltas);
+          stream_cond.notify_one();
+        });
+      boost::lock_guard<boost::mutex> lock(stream_lock);
+      round_done = true;
+      stream_cond.notify_one();
+    });
+    bool client_gone = false;
+    boost::unique_lock<boost::mutex> lock(stream_lock);
+    while (!round_done || !deltas_to_write.empty()) {
+      if (deltas_to_write.empty()) {
+        stream_cond.wait(lock);
+        continue;
+      }
+      SchedulingDeltas deltas;
+      deltas.Swap(&deltas_to_write.front());
+      deltas_to_write.pop_front();
+      lock.unlock();
+      if (!client_gone && !writer->Write(deltas)) {
+        // The client went away. We still finish the round because its
+        // placements have already been applied to the scheduler's state.
+        LOG(WARNING) << "Could not stream " << deltas.deltas_size()
+                     << " scheduling deltas";
+        client_gone = true;
+      }
+      lock.lock();
+    }
+    lock.unlock();
+    round_thread.join();
+    return Status::OK;
+  }
+
+  Status SubscribeDeltas(ServerContext* context,
+                         const ScheduleRequest* request,
+                         ServerWriter<SchedulingDeltas>* writer) override {
+    if (!FLAGS_scheduling_loop) {
+      return Status(grpc::StatusCode::FAILED_PRECONDITION,
+                    "The scheduling loop is not enabled");
+    }
+    boost::unique_lock<boost::mutex> lock(scheduling_loop_lock_);
+    while (!stop_scheduling_loop_ && !context->IsCancelled()) {
+      if (buffered_deltas_.empty()) {
+        // Wake up now and then to notice cancelled subscriptions.
+        scheduling_loop_cond_.timed_wait(
+            lock, boost::posix_time::milliseconds(
+                FLAGS_scheduling_loop_check_interval_ms));
+        continue;
+      }
+      SchedulingDeltas deltas;
+      deltas.Swap(&buffered_deltas_.front());
+      buffered_deltas_.pop_front();
+      lock.unlock();
+      // The loop may be waiting for buffer space.
+      scheduling_loop_cond_.notify_all();
+      bool written = writer->Write(deltas);
+      lock.lock();
+      if (!written) {
+        // Keep the deltas for the next subscriber.
+        buffered_deltas_.push_front(SchedulingDeltas());
+        buffered_deltas_.front().Swap(&deltas);
+        break;
+      }
+    }
+    return Status::OK;
+  }
+
+  /**
+   * Runs a scheduling round: a flow solver run for the tasks without pod
+   * affinity/anti-affinity, followed by queue based rounds for the tasks with
+   * pod affinity/anti-affinity.
+   * @param reply the message to which the deltas and unscheduled tasks are
+   * added
+   * @param flush_reply if not NULL, it is called with the reply whenever some
+   * of the deltas are final (i.e., after the flow solver run and after each
+   * queue based round), and at the end of the round. It is expected to hand
+   * out and clear the reply. Deltas of gang scheduled jobs and unscheduled
+   * tasks are only final at the end of the round. It is called with the
+   * scheduling lock held, so it must not block.
+   */
+  void RunSchedulingRound(
+      SchedulingDeltas* reply,
+      const boost::function<void(SchedulingDeltas*)>& flush_reply) {
     boost::lock_guard<boost::recursive_mutex> lock(
         scheduler_->scheduling_lock_);
+    // Apply the events that arrived since the previous round.
+    DrainEventLog();
+    // The events reported so far are considered in this round.
+    round_trigger_.RoundStarted();
     // Clear unscheduled tasks related maps and sets of previous scheduling
     // round.
     if (FLAGS_gather_unscheduled_tasks) {
@@ -272,6 +461,11 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
     // Schedule tasks which does not have pod affinity/anti-affinity
     // requirements.
     scheduler_->ScheduleAllJobs(&sstat, &deltas);
+    uint64_t num_deltas = deltas.size();
+    AddDeltasToReply(deltas, reply);
+    if (flush_reply && reply->deltas_size() > 0) {
+      flush_reply(reply);
+    }
     uint64_t total_unsched_tasks_size = 0;
     vector<uint64_t> unscheduled_normal_tasks;
     if (FLAGS_gather_unscheduled_tasks) {
@@ -284,19 +478,48 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
     uint64_t elapsed = 0;
     unordered_set<uint64_t> unscheduled_affinity_tasks_set;
     vector<uint64_t> unscheduled_affinity_tasks;
+    // Deltas of gang scheduled jobs, which are reverted at the end of the
+    // round if not enough of the job's tasks have been placed.
+    vector<SchedulingDelta> gang_deltas;
     while (affinity_antiaffinity_tasks_.size() &&
            (elapsed < FLAGS_queue_based_scheduling_time)) {
-      uint64_t task_scheduled =
-          scheduler_->ScheduleAllQueueJobs(&sstat, &deltas);
-      TaskID_t task_id = dynamic_cast<FlowScheduler*>(scheduler_)
-                             ->GetSingleTaskTobeScheduled();
-      if (FLAGS_gather_unscheduled_tasks) {
-        TaskDescriptor* td_ptr = FindPtrOrNull(*task_map_, task_id);
+      // Each round places a batch of tasks of the same job.
+      deltas.clear();
+      scheduler_->ScheduleAllQueueJobs(&sstat, &deltas);
+      const vector<pair<TaskID_t, bool>>& task_batch =
+          dynamic_cast<FlowScheduler*>(scheduler_)->GetAffinityTaskBatch();
+      if (task_batch.empty()) {
+        break;
+      }
+      vector<SchedulingDelta> final_deltas;
+      for (auto& delta : deltas) {
+        TaskDescriptor* td_ptr = FindPtrOrNull(*task_map_, delta.task_id());
         CHECK_NOTNULL(td_ptr);
-        JobDescriptor* jd =
-                  FindOrNull(*job_map_, JobIDFromString(td_ptr->job_id()));
-        if (!(jd->is_gang_scheduling_job())) {
-          if (!task_scheduled) {
+        JobDescriptor* jd_ptr =
+            FindOrNull(*job_map_, JobIDFromString(td_ptr->job_id()));
+        CHECK_NOTNULL(jd_ptr);
+        if (jd_ptr->is_gang_scheduling_job()) {
+          gang_deltas.push_back(delta);
+        } else {
+          final_deltas.push_back(delta);
+        }
+      }
+      num_deltas += final_deltas.size();
+      AddDeltasToReply(final_deltas, reply);
+      if (flush_reply && reply->deltas_size() > 0) {
+        flush_reply(reply);
+      }
+      if (FLAGS_gather_unscheduled_tasks) {
+        for (auto& task_placed : task_batch) {
+          TaskID_t task_id = task_placed.first;
+          TaskDescriptor* td_ptr = FindPtrOrNull(*task_map_, task_id);
+          CHECK_NOTNULL(td_ptr);
+          JobDescriptor* jd =
+                    FindOrNull(*job_map_, JobIDFromString(td_ptr->job_id()));
+          if (jd->is_gang_scheduling_job()) {
+            continue;
+          }
+          if (!task_placed.second) {
             if (unscheduled_affinity_tasks_set.find(task_id) ==
                 unscheduled_affinity_tasks_set.end()) {
               unscheduled_affinity_tasks_set.insert(task_id);
@@ -311,10 +534,12 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
       elapsed = (double)(stop - start) * 1000.0 / CLOCKS_PER_SEC;
     }
     //For pod affinity/anti-affinity gang scheduling tasks
-    scheduler_->UpdateGangSchedulingDeltas(&sstat, &deltas,
+    scheduler_->UpdateGangSchedulingDeltas(&sstat, &gang_deltas,
                                 &unscheduled_normal_tasks,
                                 &unscheduled_affinity_tasks_set,
                                 &unscheduled_affinity_tasks);
+    num_deltas += gang_deltas.size();
+    AddDeltasToReply(gang_deltas, reply);
 
     // Get unscheduled tasks of above scheduling round which tried scheduling
     // tasks having pod affinity/anti-affinity. And populate the same into
@@ -339,10 +564,26 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
     }
 
     // Extract scheduling results.
-    LOG(INFO) << "Got " << deltas.size() << " scheduling deltas";
+    LOG(INFO) << "Got " << num_deltas << " scheduling deltas";
     if (FLAGS_gather_unscheduled_tasks) {
       LOG(INFO) << "Got " << total_unsched_tasks_size << " unscheduled tasks";
     }
+    // Apply the events that were queued while the solver was running, so that
+    // they do not wait for the next round.
+    DrainEventLog();
+    // The tasks that are still waiting keep the time at which they became
+    // runnable, so that they count towards the next round's trigger.
+    round_trigger_.RoundFinished(NumPendingGraphChanges());
+    if (flush_reply &&
+        (reply->deltas_size() > 0 || reply->unscheduled_tasks_size() > 0)) {
+      flush_reply(reply);
+    }
+  }
+
+  // Adds the deltas to the reply, and updates the state of the tasks they
+  // affect.
+  void AddDeltasToReply(const vector<SchedulingDelta>& deltas,
+                        SchedulingDeltas* reply) {
     for (auto& d : deltas) {
       // LOG(INFO) << "Delta: " << d.DebugString();
       SchedulingDelta* ret_delta = reply->add_deltas();
@@ -360,48 +601,33 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
                    << to_string(d.type());
       }
     }
-    return Status::OK;
   }
 
   // Pod affinity/anti-affinity
-  void RemoveTaskFromLabelsMap(const TaskDescriptor td) {
-    for (const auto& label : td.labels()) {
-      unordered_map<string, vector<TaskID_t>>* label_values =
-          FindOrNull(labels_map_, label.key());
-      if (label_values) {
-        vector<TaskID_t>* labels_map_tasks =
-            FindOrNull(*label_values, label.value());
-        if (labels_map_tasks) {
-          vector<TaskID_t>::iterator it_pos = find(
-              labels_map_tasks->begin(), labels_map_tasks->end(), td.uid());
-          if (it_pos != labels_map_tasks->end()) {
-            labels_map_tasks->erase(it_pos);
-            if (!labels_map_tasks->size()) {
-              label_values->erase(label.value());
-              if (label_values->empty()) labels_map_.erase(label.key());
-            }
-          }
-        }
-      }
-    }
-    if (td.has_affinity() && (td.affinity().has_pod_affinity() ||
-                              td.affinity().has_pod_anti_affinity())) {
-      vector<TaskID_t>::iterator it =
-          find(affinity_antiaffinity_tasks_.begin(),
-               affinity_antiaffinity_tasks_.end(), td.uid());
-      if (it != affinity_antiaffinity_tasks_.end()) {
-        affinity_antiaffinity_tasks_.erase(it);
-      }
-    }
+  void RemoveTaskFromLabelIndex(const TaskDescriptor& td) {
+    label_index_.RemoveTask(td.uid());
+    affinity_antiaffinity_tasks_.Erase(td.uid());
   }
 
   Status TaskCompleted(ServerContext* context, const TaskUID* tid_ptr,
                        TaskCompletedResponse* reply) override {
-    TaskDescriptor* td_ptr = FindPtrOrNull(*task_map_, tid_ptr->task_uid());
-    if (td_ptr == NULL) {
-      reply->set_type(TaskReplyType::TASK_NOT_FOUND);
+    if (FLAGS_async_event_ingest) {
+      shared_ptr<IngestEvent> event(
+          new IngestEvent(IngestEvent::TASK_COMPLETED));
+      event->task_id = tid_ptr->task_uid();
+      IngestEvents({event});
+      reply->set_type(TaskReplyOf(*event));
       return Status::OK;
     }
+    reply->set_type(HandleTaskCompleted(tid_ptr->task_uid()));
+    return Status::OK;
+  }
+
+  TaskReplyType HandleTaskCompleted(TaskID_t task_id) {
+    TaskDescriptor* td_ptr = FindPtrOrNull(*task_map_, task_id);
+    if (td_ptr == NULL) {
+      return TaskReplyType::TASK_NOT_FOUND;
+    }
     if (FLAGS_resource_stats_update_based_on_resource_reservation) {
       if (!td_ptr->scheduled_to_resource().empty()) {
         UpdateMachineSamplesToKnowledgeBaseStatically(td_ptr, true);
@@ -410,15 +636,16 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
     JobID_t job_id = JobIDFromString(td_ptr->job_id());
     JobDescriptor* jd_ptr = FindOrNull(*job_map_, job_id);
     if (jd_ptr == NULL) {
-      reply->set_type(TaskReplyType::TASK_JOB_NOT_FOUND);
-      return Status::OK;
+      return TaskReplyType::TASK_JOB_NOT_FOUND;
     }
     td_ptr->set_finish_time(wall_time_.GetCurrentTimestamp());
-    RemoveTaskFromLabelsMap(*td_ptr);
+    RemoveTaskFromLabelIndex(*td_ptr);
     TaskFinalReport report;
     scheduler_->HandleTaskCompletion(td_ptr, &report);
     kb_populator_->PopulateTaskFinalReport(*td_ptr, &report);
     scheduler_->HandleTaskFinalReport(report, td_ptr);
+    round_trigger_.TaskNotRunnable(task_id);
+    round_trigger_.CapacityFreed();
     // Check if it was the last task of the job.
     uint64_t* num_incomplete_tasks =
         FindOrNull(job_num_incomplete_tasks_, job_id);
@@ -428,37 +655,59 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
     if (*num_incomplete_tasks == 0) {
       scheduler_->HandleJobCompletion(job_id);
     }
-    reply->set_type(TaskReplyType::TASK_COMPLETED_OK);
-    return Status::OK;
+    return TaskReplyType::TASK_COMPLETED_OK;
   }
 
   Status TaskFailed(ServerContext* context, const TaskUID* tid_ptr,
                     TaskFailedResponse* reply) override {
-    TaskDescriptor* td_ptr = FindPtrOrNull(*task_map_, tid_ptr->task_uid());
-    if (td_ptr == NULL) {
-      reply->set_type(TaskReplyType::TASK_NOT_FOUND);
+    if (FLAGS_async_event_ingest) {
+      shared_ptr<IngestEvent> event(new IngestEvent(IngestEvent::TASK_FAILED));
+      event->task_id = tid_ptr->task_uid();
+      IngestEvents({event});
+      reply->set_type(TaskReplyOf(*event));
       return Status::OK;
     }
+    reply->set_type(HandleTaskFailed(tid_ptr->task_uid()));
+    return Status::OK;
+  }
+
+  TaskReplyType HandleTaskFailed(TaskID_t task_id) {
+    TaskDescriptor* td_ptr = FindPtrOrNull(*task_map_, task_id);
+    if (td_ptr == NULL) {
+      return TaskReplyType::TASK_NOT_FOUND;
+    }
     if (FLAGS_resource_stats_update_based_on_resource_reservation) {
       if (!td_ptr->scheduled_to_resource().empty()) {
         UpdateMachineSamplesToKnowledgeBaseStatically(td_ptr, true);
       }
     }
     scheduler_->HandleTaskFailure(td_ptr);
-    reply->set_type(TaskReplyType::TASK_FAILED_OK);
-    return Status::OK;
+    round_trigger_.TaskRunnable(task_id, wall_time_.GetCurrentTimestamp());
+    round_trigger_.CapacityFreed();
+    return TaskReplyType::TASK_FAILED_OK;
   }
 
   Status TaskRemoved(ServerContext* context, const TaskUID* tid_ptr,
                      TaskRemovedResponse* reply) override {
+    if (FLAGS_async_event_ingest) {
+      shared_ptr<IngestEvent> event(new IngestEvent(IngestEvent::TASK_REMOVED));
+      event->task_id = tid_ptr->task_uid();
+      IngestEvents({event});
+      reply->set_type(TaskReplyOf(*event));
+      return Status::OK;
+    }
     boost::lock_guard<boost::recursive_mutex> lock(
         scheduler_->scheduling_lock_);
-    TaskDescriptor* td_ptr = FindPtrOrNull(*task_map_, tid_ptr->task_uid());
+    reply->set_type(HandleTaskRemoved(tid_ptr->task_uid()));
+    return Status::OK;
+  }
+
+  TaskReplyType HandleTaskRemoved(TaskID_t task_id) {
+    TaskDescriptor* td_ptr = FindPtrOrNull(*task_map_, task_id);
     if (td_ptr == NULL) {
-      reply->set_type(TaskReplyType::TASK_NOT_FOUND);
-      return Status::OK;
+      return TaskReplyType::TASK_NOT_FOUND;
     }
-    RemoveTaskFromLabelsMap(*td_ptr);
+    RemoveTaskFromLabelIndex(*td_ptr);
     if (FLAGS_resource_stats_update_based_on_resource_reservation) {
       if (!(td_ptr->scheduled_to_resource().empty()) &&
           (td_ptr->state() != TaskDescriptor::COMPLETED) &&
@@ -466,14 +715,20 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
         UpdateMachineSamplesToKnowledgeBaseStatically(td_ptr, true);
       }
     }
+    bool was_running = td_ptr->state() == TaskDescriptor::RUNNING;
     scheduler_->HandleTaskRemoval(td_ptr);
+    round_trigger_.TaskNotRunnable(task_id);
+    if (was_running) {
+      round_trigger_.CapacityFreed();
+    }
     JobID_t job_id = JobIDFromString(td_ptr->job_id());
     JobDescriptor* jd_ptr = FindOrNull(*job_map_, job_id);
     CHECK_NOTNULL(jd_ptr);
     // Don't remove the root task so that tasks can still be appended to
-    // the job. We only remove the root task when the job completes.
+    // the job. We only remove the root task when the job completes. The
+    // other tasks are in the task store, which frees their descriptors.
     if (td_ptr != jd_ptr->mutable_root_task()) {
-      task_map_->erase(td_ptr->uid());
+      CHECK(task_store_->RemoveTask(task_id));
     }
     uint64_t* num_tasks_to_remove =
         FindOrNull(job_num_tasks_to_remove_, job_id);
@@ -491,57 +746,45 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
       job_num_incomplete_tasks_.erase(job_id);
       job_num_tasks_to_remove_.erase(job_id);
     }
-    reply->set_type(TaskReplyType::TASK_REMOVED_OK);
-    return Status::OK;
+    return TaskReplyType::TASK_REMOVED_OK;
   }
 
   // Pod affinity/anti-affinity
-  // Adding labels of task to the labels_map_
-  void AddTaskToLabelsMap(const TaskDescriptor& td) {
-    TaskID_t task_id = td.uid();
-    for (const auto& label : td.labels()) {
-      unordered_map<string, vector<TaskID_t>>* label_values =
-          FindOrNull(labels_map_, label.key());
-      if (!label_values) {
-        vector<TaskID_t> tasks;
-        tasks.push_back(task_id);
-        unordered_map<string, vector<TaskID_t>> values;
-        CHECK(InsertIfNotPresent(&values, label.value(), tasks));
-        CHECK(InsertIfNotPresent(&labels_map_, label.key(), values));
-      } else {
-        vector<TaskID_t>* labels_map_tasks =
-            FindOrNull(*label_values, label.value());
-        if (!labels_map_tasks) {
-          vector<TaskID_t> value_tasks;
-          value_tasks.push_back(task_id);
-          CHECK(
-              InsertIfNotPresent(&(*label_values), label.value(), value_tasks));
-        } else {
-          labels_map_tasks->push_back(task_id);
-        }
-      }
-    }
+  // Adds the labels of a task to the label index
+  void AddTaskToLabelIndex(const TaskDescriptor& td) {
+    label_index_.AddTask(td);
     if (td.has_affinity() && (td.affinity().has_pod_affinity() ||
                               td.affinity().has_pod_anti_affinity())) {
-      affinity_antiaffinity_tasks_.push_back(task_id);
+      affinity_antiaffinity_tasks_.PushBack(td.uid());
     }
   }
 
   Status TaskSubmitted(ServerContext* context,
                        const TaskDescription* task_desc_ptr,
                        TaskSubmittedResponse* reply) override {
+    if (FLAGS_async_event_ingest) {
+      shared_ptr<IngestEvent> event(
+          new IngestEvent(IngestEvent::TASK_SUBMITTED));
+      event->task_desc.CopyFrom(*task_desc_ptr);
+      IngestEvents({event});
+      reply->set_type(TaskReplyOf(*event));
+      return Status::OK;
+    }
     boost::lock_guard<boost::recursive_mutex> lock(
         scheduler_->scheduling_lock_);
+    reply->set_type(HandleTaskSubmitted(task_desc_ptr));
+    return Status::OK;
+  }
+
+  TaskReplyType HandleTaskSubmitted(const TaskDescription* task_desc_ptr) {
     TaskID_t task_id = task_desc_ptr->task_descriptor().uid();
     if (FindPtrOrNull(*task_map_, task_id)) {
-      reply->set_type(TaskReplyType::TASK_ALREADY_SUBMITTED);
-      return Status::OK;
+      return TaskReplyType::TASK_ALREADY_SUBMITTED;
     }
     if (task_desc_ptr->task_descriptor().state() != TaskDescriptor::CREATED) {
-      reply->set_type(TaskReplyType::TASK_STATE_NOT_CREATED);
-      return Status::OK;
+      return TaskReplyType::TASK_STATE_NOT_CREATED;
     }
-    AddTaskToLabelsMap(task_desc_ptr->task_descriptor());
+    AddTaskToLabelIndex(task_desc_ptr->task_descriptor());
     JobID_t job_id = JobIDFromString(task_desc_ptr->task_descriptor().job_id());
     JobDescriptor* jd_ptr = FindOrNull(*job_map_, job_id);
     if (jd_ptr == NULL) {
@@ -558,9 +801,10 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
       CHECK(InsertIfNotPresent(&job_num_incomplete_tasks_, job_id, 0));
       CHECK(InsertIfNotPresent(&job_num_tasks_to_remove_, job_id, 0));
     } else {
-      TaskDescriptor* td_ptr = jd_ptr->mutable_root_task()->add_spawned();
-      td_ptr->CopyFrom(task_desc_ptr->task_descriptor());
-      CHECK(InsertIfNotPresent(task_map_.get(), td_ptr->uid(), td_ptr));
+      // Keep the descriptor in the task store rather than in the root task's
+      // spawned list, which would never shrink.
+      TaskDescriptor* td_ptr =
+          task_store_->AddTask(task_desc_ptr->task_descriptor());
       td_ptr->set_submit_time(wall_time_.GetCurrentTimestamp());
     }
     uint64_t* num_incomplete_tasks =
@@ -573,18 +817,31 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
     uint64_t* num_tasks_to_remove =
         FindOrNull(job_num_tasks_to_remove_, job_id);
     (*num_tasks_to_remove)++;
-    reply->set_type(TaskReplyType::TASK_SUBMITTED_OK);
-    return Status::OK;
+    TaskDescriptor* td_ptr = FindPtrOrNull(*task_map_, task_id);
+    CHECK_NOTNULL(td_ptr);
+    round_trigger_.TaskRunnable(task_id, td_ptr->submit_time());
+    return TaskReplyType::TASK_SUBMITTED_OK;
   }
 
   Status TaskUpdated(ServerContext* context,
                      const TaskDescription* task_desc_ptr,
                      TaskUpdatedResponse* reply) override {
+    if (FLAGS_async_event_ingest) {
+      shared_ptr<IngestEvent> event(new IngestEvent(IngestEvent::TASK_UPDATED));
+      event->task_desc.CopyFrom(*task_desc_ptr);
+      IngestEvents({event});
+      reply->set_type(TaskReplyOf(*event));
+      return Status::OK;
+    }
+    reply->set_type(HandleTaskUpdated(task_desc_ptr));
+    return Status::OK;
+  }
+
+  TaskReplyType HandleTaskUpdated(const TaskDescription* task_desc_ptr) {
     TaskID_t task_id = task_desc_ptr->task_descriptor().uid();
     TaskDescriptor* td_ptr = FindPtrOrNull(*task_map_, task_id);
     if (td_ptr == NULL) {
-      reply->set_type(TaskReplyType::TASK_NOT_FOUND);
-      return Status::OK;
+      return TaskReplyType::TASK_NOT_FOUND;
     }
     // The scheduler will notice that the task's properties (e.g.,
     // resource requirements, labels) are different and react accordingly.
@@ -602,8 +859,7 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
       label_sel_ptr->CopyFrom(label_selector);
     }
     // XXX(ionel): We may want to add support for other field updates as well.
-    reply->set_type(TaskReplyType::TASK_UPDATED_OK);
-    return Status::OK;
+    return TaskReplyType::TASK_UPDATED_OK;
   }
 
   bool CheckResourceDoesntExist(const ResourceDescriptor& rd) {
@@ -623,15 +879,27 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
   Status NodeAdded(ServerContext* context,
                    const ResourceTopologyNodeDescriptor* submitted_rtnd_ptr,
                    NodeAddedResponse* reply) override {
+    if (FLAGS_async_event_ingest) {
+      shared_ptr<IngestEvent> event(new IngestEvent(IngestEvent::NODE_ADDED));
+      event->rtnd.CopyFrom(*submitted_rtnd_ptr);
+      IngestEvents({event});
+      reply->set_type(NodeReplyOf(*event));
+      return Status::OK;
+    }
     boost::lock_guard<boost::recursive_mutex> lock(
         scheduler_->scheduling_lock_);
+    reply->set_type(HandleNodeAdded(submitted_rtnd_ptr));
+    return Status::OK;
+  }
+
+  NodeReplyType HandleNodeAdded(
+      const ResourceTopologyNodeDescriptor* submitted_rtnd_ptr) {
     bool doesnt_exist = DFSTraverseResourceProtobufTreeWhileTrue(
         *submitted_rtnd_ptr,
         boost::bind(&FirmamentSchedulerServiceImpl::CheckResourceDoesntExist,
                     this, _1));
     if (!doesnt_exist) {
-      reply->set_type(NodeReplyType::NODE_ALREADY_EXISTS);
-      return Status::OK;
+      return NodeReplyType::NODE_ALREADY_EXISTS;
     }
     ResourceStatus* root_rs_ptr =
         FindPtrOrNull(*resource_map_, top_level_res_id_);
@@ -648,7 +916,7 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
     // Instead, we rely on the no-op SimulatedExecutor. We should change
     // it such that Firmament does not mandatorily create an executor.
     scheduler_->RegisterResource(rtnd_ptr, false, true);
-    reply->set_type(NodeReplyType::NODE_ADDED_OK);
+    round_trigger_.CapacityFreed();
 
     if (FLAGS_resource_stats_update_based_on_resource_reservation) {
       // Add Node initial status simulation
@@ -657,8 +925,7 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
           ResourceIDFromString(rtnd_ptr->resource_desc().uuid());
       ResourceStatus* rs_ptr = FindPtrOrNull(*resource_map_, res_id);
       if (rs_ptr == NULL || rs_ptr->mutable_descriptor() == NULL) {
-        reply->set_type(NodeReplyType::NODE_NOT_FOUND);
-        return Status::OK;
+        return NodeReplyType::NODE_NOT_FOUND;
       }
       resource_stats.set_resource_id(rtnd_ptr->resource_desc().uuid());
       resource_stats.set_timestamp(0);
@@ -698,44 +965,90 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
                                              ephemeral_storage_utilization);
       knowledge_base_->AddMachineSample(resource_stats);
     }
-    return Status::OK;
+    return NodeReplyType::NODE_ADDED_OK;
   }
 
   Status NodeFailed(ServerContext* context, const ResourceUID* rid_ptr,
                     NodeFailedResponse* reply) override {
+    if (FLAGS_async_event_ingest) {
+      shared_ptr<IngestEvent> event(new IngestEvent(IngestEvent::NODE_FAILED));
+      event->resource_uid.CopyFrom(*rid_ptr);
+      IngestEvents({event});
+      reply->set_type(NodeReplyOf(*event));
+      return Status::OK;
+    }
+    reply->set_type(HandleNodeFailed(rid_ptr));
+    return Status::OK;
+  }
+
+  NodeReplyType HandleNodeFailed(const ResourceUID* rid_ptr) {
     ResourceID_t res_id = ResourceIDFromString(rid_ptr->resource_uid());
     ResourceStatus* rs_ptr = FindPtrOrNull(*resource_map_, res_id);
     if (rs_ptr == NULL) {
-      reply->set_type(NodeReplyType::NODE_NOT_FOUND);
-      return Status::OK;
+      return NodeReplyType::NODE_NOT_FOUND;
     }
+    MarkRunningTasksRunnable(rs_ptr->mutable_topology_node());
     scheduler_->DeregisterResource(rs_ptr->mutable_topology_node());
-    reply->set_type(NodeReplyType::NODE_FAILED_OK);
-    return Status::OK;
+    return NodeReplyType::NODE_FAILED_OK;
   }
 
   Status NodeRemoved(ServerContext* context, const ResourceUID* rid_ptr,
                      NodeRemovedResponse* reply) override {
+    if (FLAGS_async_event_ingest) {
+      shared_ptr<IngestEvent> event(new IngestEvent(IngestEvent::NODE_REMOVED));
+      event->resource_uid.CopyFrom(*rid_ptr);
+      IngestEvents({event});
+      reply->set_type(NodeReplyOf(*event));
+      return Status::OK;
+    }
+    reply->set_type(HandleNodeRemoved(rid_ptr));
+    return Status::OK;
+  }
+
+  NodeReplyType HandleNodeRemoved(const ResourceUID* rid_ptr) {
     ResourceID_t res_id = ResourceIDFromString(rid_ptr->resource_uid());
     ResourceStatus* rs_ptr = FindPtrOrNull(*resource_map_, res_id);
     if (rs_ptr == NULL) {
-      reply->set_type(NodeReplyType::NODE_NOT_FOUND);
-      return Status::OK;
+      return NodeReplyType::NODE_NOT_FOUND;
     }
+    MarkRunningTasksRunnable(rs_ptr->mutable_topology_node());
     scheduler_->DeregisterResource(rs_ptr->mutable_topology_node());
-    reply->set_type(NodeReplyType::NODE_REMOVED_OK);
-    return Status::OK;
+    return NodeReplyType::NODE_REMOVED_OK;
+  }
+
+  // Reports the tasks running on a resource that is about to be deregistered
+  // as runnable, since the scheduler places them again.
+  void MarkRunningTasksRunnable(ResourceTopologyNodeDescriptor* rtnd_ptr) {
+    uint64_t now = wall_time_.GetCurrentTimestamp();
+    DFSTraverseResourceProtobufTree(
+        rtnd_ptr, [this, now](ResourceDescriptor* rd_ptr) {
+          for (auto task_id : rd_ptr->current_running_tasks()) {
+            round_trigger_.TaskRunnable(task_id, now);
+          }
+        });
   }
 
   Status NodeUpdated(ServerContext* context,
                      const ResourceTopologyNodeDescriptor* updated_rtnd_ptr,
                      NodeUpdatedResponse* reply) override {
+    if (FLAGS_async_event_ingest) {
+      shared_ptr<IngestEvent> event(new IngestEvent(IngestEvent::NODE_UPDATED));
+      event->rtnd.CopyFrom(*updated_rtnd_ptr);
+      IngestEvents({event});
+      reply->set_type(NodeReplyOf(*event));
+      return Status::OK;
+    }
+    reply->set_type(HandleNodeUpdated(updated_rtnd_ptr));
+    return Status::OK;
+  }
+
+  NodeReplyType HandleNodeUpdated(
+      const ResourceTopologyNodeDescriptor* updated_rtnd_ptr) {
     ResourceID_t res_id =
         ResourceIDFromString(updated_rtnd_ptr->resource_desc().uuid());
     ResourceStatus* rs_ptr = FindPtrOrNull(*resource_map_, res_id);
     if (rs_ptr == NULL) {
-      reply->set_type(NodeReplyType::NODE_NOT_FOUND);
-      return Status::OK;
+      return NodeReplyType::NODE_NOT_FOUND;
     }
     DFSTraverseResourceProtobufTreesReturnRTNDs(
         rs_ptr->mutable_topology_node(), *updated_rtnd_ptr,
@@ -745,9 +1058,16 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
         rs_ptr->mutable_topology_node(), *updated_rtnd_ptr,
         boost::bind(&FirmamentSchedulerServiceImpl::UpdateNodeTaints, this, _1,
                     _2));
+    if (cost_model_) {
+      // Let the cost model re-index the machine's labels and taints.
+      boost::lock_guard<boost::recursive_mutex> lock(
+          scheduler_->scheduling_lock_);
+      cost_model_->UpdateMachine(rs_ptr->mutable_topology_node());
+    }
     // TODO(ionel): Support other types of node updates.
-    reply->set_type(NodeReplyType::NODE_UPDATED_OK);
-    return Status::OK;
+    // New labels or removed taints may let waiting tasks run on the node.
+    round_trigger_.CapacityFreed();
+    return NodeReplyType::NODE_UPDATED_OK;
   }
 
   void UpdateNodeLabels(ResourceTopologyNodeDescriptor* old_rtnd_ptr,
@@ -797,6 +1117,144 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
     return Status::OK;
   }
 
+  Status TaskSubmittedBatch(ServerContext* context,
+                            const TaskSubmittedBatchRequest* request,
+                            TaskSubmittedBatchResponse* reply) override {
+    if (FLAGS_async_event_ingest) {
+      vector<shared_ptr<IngestEvent>> events;
+      for (const auto& task_desc : request->task_descriptions()) {
+        shared_ptr<IngestEvent> event(
+            new IngestEvent(IngestEvent::TASK_SUBMITTED));
+        event->task_desc.CopyFrom(task_desc);
+        events.push_back(event);
+      }
+      IngestEvents(events);
+      for (const auto& event : events) {
+        reply->add_responses()->set_type(TaskReplyOf(*event));
+      }
+      return Status::OK;
+    }
+    boost::lock_guard<boost::recursive_mutex> lock(
+        scheduler_->scheduling_lock_);
+    for (const auto& task_desc : request->task_descriptions()) {
+      reply->add_responses()->set_type(HandleTaskSubmitted(&task_desc));
+    }
+    return Status::OK;
+  }
+
+  Status TaskEventsBatch(ServerContext* context,
+                         const TaskEventsBatchRequest* request,
+                         TaskEventsBatchResponse* reply) override {
+    // proto3 enums are open, so a client may send types we don't know, and
+    // events without a type have the default type TASK_EVENT_UNKNOWN. The
+    // whole batch is rejected before any of its events is applied.
+    for (const auto& event : request->events()) {
+      if (!TaskEventType_IsValid(event.type()) ||
+          event.type() == TaskEventType::TASK_EVENT_UNKNOWN) {
+        return Status(grpc::StatusCode::INVALID_ARGUMENT,
+                      "Unsupported task event type: " +
+                      to_string(static_cast<int64_t>(event.type())));
+      }
+    }
+    if (FLAGS_async_event_ingest) {
+      vector<shared_ptr<IngestEvent>> events;
+      for (const auto& task_event : request->events()) {
+        shared_ptr<IngestEvent> event(
+            new IngestEvent(TaskEventToIngestEventType(task_event.type())));
+        event->task_id = task_event.task_uid();
+        events.push_back(event);
+      }
+      IngestEvents(events);
+      for (const auto& event : events) {
+        reply->add_responses()->set_type(TaskReplyOf(*event));
+      }
+      return Status::OK;
+    }
+    boost::lock_guard<boost::recursive_mutex> lock(
+        scheduler_->scheduling_lock_);
+    for (const auto& event : request->events()) {
+      switch (event.type()) {
+        case TaskEventType::TASK_EVENT_COMPLETED:
+          reply->add_responses()->set_type(
+              HandleTaskCompleted(event.task_uid()));
+          break;
+        case TaskEventType::TASK_EVENT_FAILED:
+          reply->add_responses()->set_type(
+              HandleTaskFailed(event.task_uid()));
+          break;
+        case TaskEventType::TASK_EVENT_REMOVED:
+          reply->add_responses()->set_type(
+              HandleTaskRemoved(event.task_uid()));
+          break;
+        default:
+          // Rejected above.
+          break;
+      }
+    }
+    return Status::OK;
+  }
+
+  Status NodeUpdatedBatch(ServerContext* context,
+                          const NodeUpdatedBatchRequest* request,
+                          NodeUpdatedBatchResponse* reply) override {
+    if (FLAGS_async_event_ingest) {
+      vector<shared_ptr<IngestEvent>> events;
+      for (const auto& rtnd : request->nodes()) {
+        shared_ptr<IngestEvent> event(
+            new IngestEvent(IngestEvent::NODE_UPDATED));
+        event->rtnd.CopyFrom(rtnd);
+        events.push_back(event);
+      }
+      IngestEvents(events);
+      for (const auto& event : events) {
+        reply->add_responses()->set_type(NodeReplyOf(*event));
+      }
+      return Status::OK;
+    }
+    boost::lock_guard<boost::recursive_mutex> lock(
+        scheduler_->scheduling_lock_);
+    for (const auto& rtnd : request->nodes()) {
+      reply->add_responses()->set_type(HandleNodeUpdated(&rtnd));
+    }
+    return Status::OK;
+  }
+
+  Status TaskStatsBatch(ServerContext* context,
+                        const TaskStatsBatchRequest* request,
+                        TaskStatsBatchResponse* reply) override {
+    // Like AddTaskStats, the samples only go to the knowledge base, so the
+    // scheduling lock is not needed.
+    vector<const TaskStats*> samples;
+    for (const auto& task_stats : request->task_stats()) {
+      TaskStatsResponse* response = reply->add_responses();
+      if (FindPtrOrNull(*task_map_, task_stats.task_id()) == NULL) {
+        response->set_type(TaskReplyType::TASK_NOT_FOUND);
+        continue;
+      }
+      samples.push_back(&task_stats);
+    }
+    knowledge_base_->AddTaskStatsSamples(samples);
+    return Status::OK;
+  }
+
+  Status NodeStatsBatch(ServerContext* context,
+                        const NodeStatsBatchRequest* request,
+                        NodeStatsBatchResponse* reply) override {
+    vector<const ResourceStats*> samples;
+    for (const auto& resource_stats : request->resource_stats()) {
+      ResourceStatsResponse* response = reply->add_responses();
+      ResourceID_t res_id = ResourceIDFromString(resource_stats.resource_id());
+      ResourceStatus* rs_ptr = FindPtrOrNull(*resource_map_, res_id);
+      if (rs_ptr == NULL || rs_ptr->mutable_descriptor() == NULL) {
+        response->set_type(NodeReplyType::NODE_NOT_FOUND);
+        continue;
+      }
+      samples.push_back(&resource_stats);
+    }
+    knowledge_base_->AddMachineSamples(samples);
+    return Status::OK;
+  }
+
   Status Check(ServerContext* context, const HealthCheckRequest* health_service,
                HealthCheckResponse* reply) override {
     if (health_service->grpc_service().empty()) {
@@ -819,6 +1277,8 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
   boost::shared_ptr<TopologyManager> topology_manager_;
   // Data structures that we populate in the scheduler service.
   boost::shared_ptr<ResourceMap_t> resource_map_;
+  // Owns the descriptors of the tasks other than the jobs' root tasks.
+  boost::scoped_ptr<TaskStore> task_store_;
   ResourceID_t top_level_res_id_;
   // Mapping from JobID_t to number of incomplete job tasks.
   unordered_map<JobID_t, uint64_t, boost::hash<boost::uuids::uuid>>
@@ -828,9 +1288,181 @@ class FirmamentSchedulerServiceImpl final : public FirmamentScheduler::Service {
       job_num_tasks_to_remove_;
   KnowledgeBasePopulator* kb_populator_;
   // Pod affinity/anti-affinity
-  unordered_map<string, unordered_map<string, vector<TaskID_t>>> labels_map_;
-  vector<TaskID_t> affinity_antiaffinity_tasks_;
+  LabelIndex label_index_;
+  IndexedQueue<TaskID_t> affinity_antiaffinity_tasks_;
   unordered_map<string, ResourceID_t> task_resource_map_;
+  // Task and node events that have not been applied yet. Only the thread that
+  // holds the scheduling lock pops from it.
+  MPSCQueue<shared_ptr<IngestEvent>> event_log_;
+  // Decides when the scheduling loop runs a round.
+  SchedulingRoundTrigger round_trigger_;
+  // Background scheduling loop (--scheduling_loop).
+  boost::thread* scheduling_loop_thread_;
+  // Protects stop_scheduling_loop_ and buffered_deltas_.
+  boost::mutex scheduling_loop_lock_;
+  // Signalled when the loop must stop, when deltas are buffered and when
+  // buffered deltas are handed to a subscriber.
+  boost::condition_variable scheduling_loop_cond_;
+  bool stop_scheduling_loop_;
+  // Results of the rounds run by the loop, oldest first.
+  deque<SchedulingDeltas> buffered_deltas_;
+
+  uint64_t NumPendingGraphChanges() {
+    FlowScheduler* flow_scheduler = dynamic_cast<FlowScheduler*>(scheduler_);
+    if (flow_scheduler == NULL) {
+      return 0;
+    }
+    return flow_scheduler->NumPendingGraphChanges();
+  }
+
+  /**
+   * Returns true if the scheduling loop should run a round, i.e. if a task has
+   * been waiting for too long, if capacity was freed while tasks wait or if
+   * many flow graph changes have accumulated.
+   * @param now the current time in microseconds
+   */
+  bool ShouldRunSchedulingRound(uint64_t now) {
+    boost::lock_guard<boost::recursive_mutex> lock(
+        scheduler_->scheduling_lock_);
+    // Apply the events of handlers that could not take the lock while we
+    // held it.
+    DrainEventLog();
+    return round_trigger_.ShouldRunRound(now, NumPendingGraphChanges());
+  }
+
+  void SchedulingLoop() {
+    uint64_t last_round_end_time = 0;
+    boost::unique_lock<boost::mutex> lock(scheduling_loop_lock_);
+    while (!stop_scheduling_loop_) {
+      scheduling_loop_cond_.timed_wait(
+          lock, boost::posix_time::milliseconds(
+              FLAGS_scheduling_loop_check_interval_ms));
+      if (stop_scheduling_loop_ ||
+          buffered_deltas_.size() >=
+          FLAGS_scheduling_loop_max_buffered_rounds) {
+        continue;
+      }
+      lock.unlock();
+      uint64_t now = wall_time_.GetCurrentTimestamp();
+      SchedulingDeltas deltas;
+      bool ran_round = false;
+      if (now >= last_round_end_time + FLAGS_scheduling_loop_min_round_gap_ms *
+          MILLISECONDS_TO_MICROSECONDS && ShouldRunSchedulingRound(now)) {
+        RunSchedulingRound(&deltas, NULL);
+        last_round_end_time = wall_time_.GetCurrentTimestamp();
+        ran_round = true;
+      }
+      lock.lock();
+      if (ran_round &&
+          (deltas.deltas_size() > 0 || deltas.unscheduled_tasks_size() > 0)) {
+        buffered_deltas_.push_back(SchedulingDeltas());
+        buffered_deltas_.back().Swap(&deltas);
+        scheduling_loop_cond_.notify_all();
+      }
+    }
+  }
+
+  /**
+   * Appends events to the event log, and applies the log if the scheduling
+   * lock is free. Otherwise, the events are applied by the thread that holds
+   * the lock (e.g., once the running scheduling round completes).
+   * @param events the events to append, in the order in which to apply them
+   */
+  void IngestEvents(const vector<shared_ptr<IngestEvent>>& events) {
+    for (const auto& event : events) {
+      event_log_.Push(event);
+    }
+    // Another handler may hold the lock while it drains the log. It checks
+    // the log again after releasing the lock, so our events are not left
+    // behind.
+    while (event_log_.size() > 0) {
+      boost::unique_lock<boost::recursive_mutex> lock(
+          scheduler_->scheduling_lock_, boost::try_to_lock);
+      if (!lock.owns_lock()) {
+        break;
+      }
+      DrainEventLog();
+    }
+  }
+
+  /**
+   * Applies all the events in the event log in FIFO order. The caller must
+   * hold the scheduling lock.
+   */
+  void DrainEventLog() {
+    shared_ptr<IngestEvent> event;
+    while (event_log_.Pop(&event)) {
+      ApplyIngestEvent(event.get());
+    }
+  }
+
+  void ApplyIngestEvent(IngestEvent* event) {
+    switch (event->type) {
+      case IngestEvent::TASK_SUBMITTED:
+        event->reply_type = HandleTaskSubmitted(&event->task_desc);
+        break;
+      case IngestEvent::TASK_COMPLETED:
+        event->reply_type = HandleTaskCompleted(event->task_id);
+        break;
+      case IngestEvent::TASK_FAILED:
+        event->reply_type = HandleTaskFailed(event->task_id);
+        break;
+      case IngestEvent::TASK_REMOVED:
+        event->reply_type = HandleTaskRemoved(event->task_id);
+        break;
+      case IngestEvent::TASK_UPDATED:
+        event->reply_type = HandleTaskUpdated(&event->task_desc);
+        break;
+      case IngestEvent::NODE_ADDED:
+        event->reply_type = HandleNodeAdded(&event->rtnd);
+        break;
+      case IngestEvent::NODE_FAILED:
+        event->reply_type = HandleNodeFailed(&event->resource_uid);
+        break;
+      case IngestEvent::NODE_REMOVED:
+        event->reply_type = HandleNodeRemoved(&event->resource_uid);
+        break;
+      case IngestEvent::NODE_UPDATED:
+        event->reply_type = HandleNodeUpdated(&event->rtnd);
+        break;
+      default:
+        LOG(FATAL) << "Unsupported ingest event type: " << event->type;
+    }
+    VLOG(2) << "Applied ingest event of type " << event->type
+            << " with reply type " << event->reply_type;
+    event->applied.store(true, std::memory_order_release);
+  }
+
+  TaskReplyType TaskReplyOf(const IngestEvent& event) {
+    if (!event.applied.load(std::memory_order_acquire)) {
+      return TaskReplyType::TASK_QUEUED;
+    }
+    return static_cast<TaskReplyType>(event.reply_type);
+  }
+
+  NodeReplyType NodeReplyOf(const IngestEvent& event) {
+    if (!event.applied.load(std::memory_order_acquire)) {
+      return NodeReplyType::NODE_QUEUED;
+    }
+    return static_cast<NodeReplyType>(event.reply_type);
+  }
+
+  /**
+   * Maps a task event type from the RPC interface to an ingest event type.
+   * Unknown types must have been rejected by the caller.
+   */
+  IngestEvent::Type TaskEventToIngestEventType(TaskEventType type) {
+    switch (type) {
+      case TaskEventType::TASK_EVENT_COMPLETED:
+        return IngestEvent::TASK_COMPLETED;
+      case TaskEventType::TASK_EVENT_FAILED:
+        return IngestEvent::TASK_FAILED;
+      case TaskEventType::TASK_EVENT_REMOVED:
+        return IngestEvent::TASK_REMOVED;
+      default:
+        LOG(FATAL) << "Unexpected task event type: " << type;
+    }
+  }
 
   ResourceStatus* CreateTopLevelResource() {
     ResourceID_t res_id = GenerateResourceID();
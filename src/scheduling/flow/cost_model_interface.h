@@ -201,6 +201,11 @@ class CostModelInterface {
 
   virtual void RemoveTask(TaskID_t task_id) = 0;
 
+  /**
+   * Called when the labels or taints of a machine have been updated.
+   */
+  virtual void UpdateMachine(ResourceTopologyNodeDescriptor* rtnd_ptr) {}
+
   /**
    * Gathers statistics during reverse traversal of resource topology (from
    * sink upwards). Called on pairs of connected nodes.
@@ -262,6 +267,18 @@ class CostModelInterface {
   virtual void GetUnscheduledTasks(vector<uint64_t>* unscheduled_tasks_ptr) {
   }
 
+  /**
+   * Returns true if the cost model can answer queries concurrently. The flow
+   * graph manager then issues the queries for several nodes of the same kind
+   * (i.e., tasks, equivalence classes or resources) from different threads.
+   * The queries for a single node are issued by one thread, in the same order
+   * as in a serial update, queries for nodes of different kinds never overlap,
+   * and no other method is called while queries are in flight.
+   */
+  virtual bool IsThreadSafe() const {
+    return false;
+  }
+
  protected:
   shared_ptr<FlowGraphManager> flow_graph_manager_;
 };
@@ -38,14 +38,17 @@ DECLARE_bool(pod_affinity_antiaffinity_symmetry);
 
 namespace firmament {
 
+thread_local unordered_set<string> CpuCostModel::namespaces;
+
 CpuCostModel::CpuCostModel(
     shared_ptr<ResourceMap_t> resource_map, shared_ptr<TaskMap_t> task_map,
     shared_ptr<KnowledgeBase> knowledge_base,
-    unordered_map<string, unordered_map<string, vector<TaskID_t>>>* labels_map)
+    LabelIndex* label_index)
     : resource_map_(resource_map),
       task_map_(task_map),
       knowledge_base_(knowledge_base),
-      labels_map_(labels_map) {
+      constraints_generation_(0),
+      label_index_(label_index) {
   // Set an initial value for infinity -- this overshoots a bit; would be nice
   // to have a tighter bound based on actual costs observed
   infinity_ = omega_ * CpuMemCostVector_t::dimensions_;
@@ -83,17 +86,54 @@ pair<TaskID_t, ResourceID_t> CpuCostModel::GetTaskMappingForSingleTask(
     TaskID_t task_id) {
   // This function returns best matching resource for given taskid.
   vector<EquivClass_t>* ecs = GetTaskEquivClasses(task_id);
+  EquivClass_t ec = (*ecs)[0];
+  delete ecs;
   pair<TaskID_t, ResourceID_t> delta;
   delta.first = task_id;
-  ResourceID_t* res_id = FindOrNull(ec_to_best_fit_resource_, (*ecs)[0]);
-  if (res_id) {
-    delta.second = *res_id;
-  } else {
 #ifdef __PLATFORM_HAS_BOOST__
-    delta.second = boost::uuids::nil_uuid();
+  delta.second = boost::uuids::nil_uuid();
 #else
-    delta.second = 0;
+  delta.second = 0;
 #endif
+  auto* machine_costs = FindOrNull(ec_to_machine_costs_, ec);
+  if (!machine_costs) {
+    return delta;
+  }
+  // Rank the machines by the cost of placing one more task on them, given
+  // the tasks already placed on them since the arc costs were computed.
+  vector<pair<Cost_t, ResourceID_t>> ranked_machines;
+  for (auto& machine_costs_it : *machine_costs) {
+    uint64_t* num_placed =
+        FindOrNull(machine_to_placed_tasks_, machine_costs_it.first);
+    uint64_t index = num_placed ? *num_placed : 0;
+    const vector<Cost_t>& costs = machine_costs_it.second;
+    // The EC has no arc for this index if the machine cannot fit one more
+    // task.
+    if (index >= costs.size() ||
+        costs[index] == numeric_limits<Cost_t>::max()) {
+      continue;
+    }
+    ranked_machines.push_back(
+        pair<Cost_t, ResourceID_t>(costs[index], machine_costs_it.first));
+  }
+  sort(ranked_machines.begin(), ranked_machines.end());
+  const TaskDescriptor& td = GetTask(task_id);
+  for (auto& cost_machine : ranked_machines) {
+    ResourceStatus* rs = FindPtrOrNull(*resource_map_, cost_machine.second);
+    if (!rs) {
+      continue;
+    }
+    const ResourceDescriptor& rd = rs->topology_node().resource_desc();
+    // The pod affinity/anti-affinity requirements were checked when the arcs
+    // were computed, but the tasks placed since then may violate them.
+    if (!machine_to_placed_tasks_.empty() &&
+        !SatisfiesPodAffinityAntiAffinityRequired(rd, td, ec)) {
+      continue;
+    }
+    machine_to_placed_tasks_[cost_machine.second]++;
+    delta.second = ResourceIDFromString(
+        rs->topology_node().children(0).resource_desc().uuid());
+    break;
   }
   return delta;
 }
@@ -131,8 +171,8 @@ ArcDescriptor CpuCostModel::ResourceNodeToResourceNode(
 
 ArcDescriptor CpuCostModel::LeafResourceNodeToSink(ResourceID_t resource_id) {
   ResourceStatus* rs = FindPtrOrNull(*resource_map_, resource_id);
-  ResourceTopologyNodeDescriptor* rtnd = rs->mutable_topology_node();
-  return ArcDescriptor(0LL, rtnd->resource_desc().num_slots_below(), 0ULL);;
+  const ResourceTopologyNodeDescriptor& rtnd = rs->topology_node();
+  return ArcDescriptor(0LL, rtnd.resource_desc().num_slots_below(), 0ULL);
 }
 
 ArcDescriptor CpuCostModel::TaskContinuation(TaskID_t task_id) {
@@ -222,8 +262,7 @@ ArcDescriptor CpuCostModel::EquivClassToEquivClass(EquivClass_t ec1,
               .preferredduringschedulingignoredduringexecution_size()) {
         unordered_map<ResourceID_t, PriorityScoresList_t,
                       boost::hash<boost::uuids::uuid>>*
-            nodes_priority_scores_ptr =
-                FindOrNull(ec_to_node_priority_scores, ec1);
+            nodes_priority_scores_ptr = NodePriorityScoresForEC(ec1, false);
         CHECK_NOTNULL(nodes_priority_scores_ptr);
         PriorityScoresList_t* priority_scores_struct_ptr =
             FindOrNull(*nodes_priority_scores_ptr, *machine_res_id);
@@ -232,7 +271,7 @@ ArcDescriptor CpuCostModel::EquivClassToEquivClass(EquivClass_t ec1,
             priority_scores_struct_ptr->node_affinity_priority;
         if (node_affinity_score.satisfy) {
           MinMaxScores_t* max_min_priority_scores =
-              FindOrNull(ec_to_max_min_priority_scores, ec1);
+              MaxMinPriorityScoresForEC(ec1, false);
           CHECK_NOTNULL(max_min_priority_scores);
           if (node_affinity_score.final_score == -1) {
             // Normalised node affinity score is not calculated for this
@@ -273,7 +312,7 @@ ArcDescriptor CpuCostModel::EquivClassToEquivClass(EquivClass_t ec1,
        ecs_with_pod_antiaffinity_symmetry_.end())) {
     unordered_map<ResourceID_t, PriorityScoresList_t,
                   boost::hash<boost::uuids::uuid>>* nodes_priority_scores_ptr =
-        FindOrNull(ec_to_node_priority_scores, ec1);
+        NodePriorityScoresForEC(ec1, false);
     CHECK_NOTNULL(nodes_priority_scores_ptr);
     PriorityScoresList_t* priority_scores_struct_ptr =
         FindOrNull(*nodes_priority_scores_ptr, *machine_res_id);
@@ -281,7 +320,7 @@ ArcDescriptor CpuCostModel::EquivClassToEquivClass(EquivClass_t ec1,
     PriorityScore_t& pod_affinity_score =
         priority_scores_struct_ptr->pod_affinity_priority;
     MinMaxScores_t* max_min_priority_scores =
-        FindOrNull(ec_to_max_min_priority_scores, ec1);
+        MaxMinPriorityScoresForEC(ec1, false);
     CHECK_NOTNULL(max_min_priority_scores);
     if (pod_affinity_score.final_score == -1) {
       int64_t max_score =
@@ -301,7 +340,7 @@ ArcDescriptor CpuCostModel::EquivClassToEquivClass(EquivClass_t ec1,
   // Expressing taints/tolerations priority scores
   unordered_map<ResourceID_t, PriorityScoresList_t,
                 boost::hash<boost::uuids::uuid>>* taints_priority_scores_ptr =
-      FindOrNull(ec_to_node_priority_scores, ec1);
+      NodePriorityScoresForEC(ec1, false);
   CHECK_NOTNULL(taints_priority_scores_ptr);
   PriorityScoresList_t* priority_scores_struct_ptr =
       FindOrNull(*taints_priority_scores_ptr, *machine_res_id);
@@ -310,7 +349,7 @@ ArcDescriptor CpuCostModel::EquivClassToEquivClass(EquivClass_t ec1,
       priority_scores_struct_ptr->intolerable_taints_priority;
   if (taints_score.satisfy) {
     MinMaxScores_t* max_min_priority_scores =
-        FindOrNull(ec_to_max_min_priority_scores, ec1);
+        MaxMinPriorityScoresForEC(ec1, false);
     CHECK_NOTNULL(max_min_priority_scores);
     if (taints_score.final_score == -1) {
       // Normalised taints score is not calculated for this
@@ -330,7 +369,7 @@ ArcDescriptor CpuCostModel::EquivClassToEquivClass(EquivClass_t ec1,
   if (rd.avoids_size()) {
     unordered_map<ResourceID_t, PriorityScoresList_t,
             boost::hash<boost::uuids::uuid>>* avoid_pods_priority_scores_ptr =
-                                  FindOrNull(ec_to_node_priority_scores, ec1);
+                                  NodePriorityScoresForEC(ec1, false);
     CHECK_NOTNULL(avoid_pods_priority_scores_ptr);
     PriorityScoresList_t* avoid_pods_scores_struct_ptr =
         FindOrNull(*avoid_pods_priority_scores_ptr, *machine_res_id);
@@ -350,18 +389,12 @@ ArcDescriptor CpuCostModel::EquivClassToEquivClass(EquivClass_t ec1,
   Cost_t final_cost = FlattenCostVector(cost_vector);
   // Added for solver
   if (pod_affinity_or_anti_affinity_task) {
-    ResourceID_t current_resource_id = ResourceIDFromString(
-        rs->topology_node().children(0).resource_desc().uuid());
-    ResourceID_t* res_id = FindOrNull(ec_to_best_fit_resource_, ec1);
-    if (!res_id) {
-      ec_to_min_cost_[ec1] = final_cost;
-      ec_to_best_fit_resource_[ec1] = current_resource_id;
-    } else {
-      if (ec_to_min_cost_[ec1] > final_cost) {
-        ec_to_min_cost_[ec1] = final_cost;
-        ec_to_best_fit_resource_[ec1] = current_resource_id;
-      }
+    boost::lock_guard<boost::mutex> lock(ec_state_lock_);
+    vector<Cost_t>& costs = ec_to_machine_costs_[ec1][*machine_res_id];
+    if (costs.size() <= ec_index) {
+      costs.resize(ec_index + 1, numeric_limits<Cost_t>::max());
     }
+    costs[ec_index] = final_cost;
   }
   return ArcDescriptor(final_cost, 1ULL, 0ULL);
 }
@@ -374,7 +407,10 @@ Cost_t CpuCostModel::FlattenCostVector(CpuMemCostVector_t cv) {
   accumulator += cv.pod_affinity_soft_cost_;
   accumulator += cv.intolerable_taints_cost_;
   accumulator += cv.prefer_avoid_pods_cost_;
-  if (accumulator > infinity_) infinity_ = accumulator + 1;
+  Cost_t infinity = infinity_;
+  while (accumulator > infinity &&
+         !infinity_.compare_exchange_weak(infinity, accumulator + 1)) {
+  }
   return accumulator;
 }
 
@@ -494,9 +530,17 @@ vector<EquivClass_t>* CpuCostModel::GetTaskEquivClasses(TaskID_t task_id) {
   }
   EquivClass_t resource_request_ec = static_cast<EquivClass_t>(task_agg);
   ecs->push_back(resource_request_ec);
+  boost::lock_guard<boost::mutex> lock(ec_state_lock_);
   InsertIfNotPresent(&ec_resource_requirement_, resource_request_ec,
                      *task_resource_request);
-  InsertIfNotPresent(&ec_to_td_requirements, resource_request_ec, *td_ptr);
+  if (InsertIfNotPresent(&ec_to_td_requirements, resource_request_ec,
+                         *td_ptr)) {
+    // The EC's requirements changed, so its cached constraint evaluation
+    // results are stale.
+    ECConstraintCache_t& ec_cache = ec_constraint_cache_[resource_request_ec];
+    ec_cache.generation = ++constraints_generation_;
+    ec_cache.task_constraints = scheduler::CompiledTaskConstraints(*td_ptr);
+  }
   if (pod_antiaffinity_symmetry) {
     ecs_with_pod_antiaffinity_symmetry_.insert(resource_request_ec);
   }
@@ -543,177 +587,52 @@ vector<ResourceID_t>* CpuCostModel::GetTaskPreferenceArcs(TaskID_t task_id) {
   return pref_res;
 }
 
-void CpuCostModel::CalculatePrioritiesCost(const EquivClass_t ec,
-                                           const ResourceDescriptor& rd) {
-  // Calculate priorities cost for node affinity.
-  const TaskDescriptor* td = FindOrNull(ec_to_td_requirements, ec);
-  CHECK_NOTNULL(td);
-  int64_t sum_of_weights = 0;
-  if (td->has_affinity()) {
-    const Affinity& affinity = td->affinity();
-    if (affinity.has_node_affinity()) {
-      if (affinity.node_affinity()
-              .preferredduringschedulingignoredduringexecution_size()) {
-        // Match PreferredDuringSchedulingIgnoredDuringExecution term by term
-        for (auto& preferredSchedulingTerm :
-             affinity.node_affinity()
-                 .preferredduringschedulingignoredduringexecution()) {
-          // If weight is zero then skip preferredSchedulingTerm.
-          if (!preferredSchedulingTerm.weight()) {
-            continue;
-          }
-          // A null or empty node selector term matches no objects.
-          if (!preferredSchedulingTerm.has_preference()) {
-            continue;
-          }
-          if (scheduler::NodeMatchesNodeSelectorTerm(
-                  rd, preferredSchedulingTerm.preference())) {
-            sum_of_weights += preferredSchedulingTerm.weight();
-          }
-        }
-        // Fill the node priority min, max and actual scores which will
-        // be used in cost calculation.
-        unordered_map<ResourceID_t, PriorityScoresList_t,
-                      boost::hash<boost::uuids::uuid>>*
-            nodes_priority_scores_ptr =
-                FindOrNull(ec_to_node_priority_scores, ec);
-        if (!nodes_priority_scores_ptr) {
-          // For this EC, no node to priority scores map exists, so initialize
-          // it.
-          unordered_map<ResourceID_t, PriorityScoresList_t,
-                        boost::hash<boost::uuids::uuid>>
-              node_to_priority_scores_map;
-          InsertIfNotPresent(&ec_to_node_priority_scores, ec,
-                             node_to_priority_scores_map);
-          nodes_priority_scores_ptr =
-              FindOrNull(ec_to_node_priority_scores, ec);
-        }
-        CHECK_NOTNULL(nodes_priority_scores_ptr);
-        ResourceID_t res_id = ResourceIDFromString(rd.uuid());
-        PriorityScoresList_t* priority_scores_struct_ptr =
-            FindOrNull(*nodes_priority_scores_ptr, res_id);
-        if (!priority_scores_struct_ptr) {
-          // Priority scores is empty for this node, so initialize it zero.
-          PriorityScoresList_t priority_scores_list;
-          InsertIfNotPresent(nodes_priority_scores_ptr, res_id,
-                             priority_scores_list);
-          priority_scores_struct_ptr =
-              FindOrNull(*nodes_priority_scores_ptr, res_id);
-        }
-        CHECK_NOTNULL(priority_scores_struct_ptr);
-        // Store the node affinity min, max and actual priority scores that will
-        // be utilized in calculating normalized cost.
-        PriorityScore_t& node_affinity_score =
-            priority_scores_struct_ptr->node_affinity_priority;
-        if (!sum_of_weights) {
-          // If machine does not satisfies soft constraint then we flag machine
-          // such that cost of omega_ is used in cost calculation.
-          node_affinity_score.satisfy = false;
-        }
-        if (node_affinity_score.satisfy) {
-          // Machine satisfies soft constraints.
-          // Store the node affinity min, max and actual priority scores.
-          node_affinity_score.score = sum_of_weights;
-          MinMaxScores_t* max_min_priority_scores =
-              FindOrNull(ec_to_max_min_priority_scores, ec);
-          if (!max_min_priority_scores) {
-            MinMaxScores_t priority_scores_list;
-            InsertIfNotPresent(&ec_to_max_min_priority_scores, ec,
-                               priority_scores_list);
-            max_min_priority_scores =
-                FindOrNull(ec_to_max_min_priority_scores, ec);
-          }
-          MinMaxScore_t& min_max_node_affinity_score =
-              max_min_priority_scores->node_affinity_priority;
-          if (min_max_node_affinity_score.max_score < sum_of_weights ||
-              min_max_node_affinity_score.max_score == -1) {
-            min_max_node_affinity_score.max_score = sum_of_weights;
-          }
-        }
-      }
+void CpuCostModel::UpdateNodeAffinityPriorityScore(const EquivClass_t ec,
+                                                   const TaskDescriptor& td,
+                                                   ResourceID_t res_id,
+                                                   int64_t sum_of_weights) {
+  if (!td.has_affinity() || !td.affinity().has_node_affinity() ||
+      !td.affinity()
+           .node_affinity()
+           .preferredduringschedulingignoredduringexecution_size()) {
+    return;
+  }
+  // Fill the node priority min, max and actual scores which will
+  // be used in cost calculation.
+  PriorityScoresList_t* priority_scores_struct_ptr =
+      PriorityScoresForMachine(ec, res_id);
+  // Store the node affinity min, max and actual priority scores that will
+  // be utilized in calculating normalized cost.
+  PriorityScore_t& node_affinity_score =
+      priority_scores_struct_ptr->node_affinity_priority;
+  if (!sum_of_weights) {
+    // If machine does not satisfies soft constraint then we flag machine
+    // such that cost of omega_ is used in cost calculation.
+    node_affinity_score.satisfy = false;
+  }
+  if (node_affinity_score.satisfy) {
+    // Machine satisfies soft constraints.
+    // Store the node affinity min, max and actual priority scores.
+    node_affinity_score.score = sum_of_weights;
+    MinMaxScores_t* max_min_priority_scores =
+        MaxMinPriorityScoresForEC(ec, true);
+    MinMaxScore_t& min_max_node_affinity_score =
+        max_min_priority_scores->node_affinity_priority;
+    if (min_max_node_affinity_score.max_score < sum_of_weights ||
+        min_max_node_affinity_score.max_score == -1) {
+      min_max_node_affinity_score.max_score = sum_of_weights;
     }
   }
 }
 
 // Taints and Tolerations
-void CpuCostModel::CalculateIntolerableTaintsCost(const ResourceDescriptor& rd,
-                                                  const TaskDescriptor* td_ptr,
-                                                  const EquivClass_t ec) {
-  bool IsTolerable = false;
-  int64_t intolerable_taint_cost = 0;
-  for (const auto& tolerations : td_ptr->tolerations()) {
-    if (tolerations.effect() == "PreferNoSchedule" ||
-        tolerations.effect() == "") {
-      if (tolerations.operator_() == "Exists") {
-        if (tolerations.key() != "") {
-          InsertIfNotPresent(&tolerationSoftExistsMap, tolerations.key(),
-                             tolerations.value());
-        } else {
-          IsTolerable = true;
-        }
-
-      } else if ((tolerations.operator_() == "Equal") ||
-                 (tolerations.operator_() == "")) {
-        InsertIfNotPresent(&tolerationSoftEqualMap, tolerations.key(),
-                           tolerations.value());
-
-      } else {
-        LOG(FATAL) << "Unsupported operator :" << tolerations.operator_();
-        break;
-      }
-    }
-  }
-
-  if (!IsTolerable) {
-    for (const auto& taint : rd.taints()) {
-      if (taint.effect() == "PreferNoSchedule") {
-        // If the key does not exist in Exists Map, look for Equal Map for any
-        // matching key and value
-
-        if (!ContainsKey(tolerationSoftExistsMap, taint.key())) {
-          const string* value = FindOrNull(tolerationSoftEqualMap, taint.key());
-
-          // If key is found, then value is not NULL
-          if (value != NULL) {
-            // Check if the value matches for the found key
-            if ((*value) != taint.value()) {
-              intolerable_taint_cost = intolerable_taint_cost + 1;
-            }
-          } else {  // If the key is not found, then taint is not tolerable
-            intolerable_taint_cost = intolerable_taint_cost + 1;
-          }
-        }
-      }
-    }
-  }
+void CpuCostModel::UpdateIntolerableTaintsPriorityScore(
+    const EquivClass_t ec, ResourceID_t res_id,
+    int64_t intolerable_taint_cost) {
   // Fill the intolerable taints priority min, max and actual scores which will
   // be used in cost calculation.
-  unordered_map<ResourceID_t, PriorityScoresList_t,
-                boost::hash<boost::uuids::uuid>>* taints_priority_scores_ptr =
-      FindOrNull(ec_to_node_priority_scores, ec);
-  if (!taints_priority_scores_ptr) {
-    // For this EC, no node to priority scores map exists, so initialize
-    // it.
-    unordered_map<ResourceID_t, PriorityScoresList_t,
-                  boost::hash<boost::uuids::uuid>>
-        node_to_priority_scores_map;
-    InsertIfNotPresent(&ec_to_node_priority_scores, ec,
-                       node_to_priority_scores_map);
-    taints_priority_scores_ptr = FindOrNull(ec_to_node_priority_scores, ec);
-  }
-  CHECK_NOTNULL(taints_priority_scores_ptr);
-  ResourceID_t res_id = ResourceIDFromString(rd.uuid());
   PriorityScoresList_t* priority_scores_struct_ptr =
-      FindOrNull(*taints_priority_scores_ptr, res_id);
-  if (!priority_scores_struct_ptr) {
-    // Priority scores is empty for this node, so initialize it zero.
-    PriorityScoresList_t priority_scores_list;
-    InsertIfNotPresent(taints_priority_scores_ptr, res_id,
-                       priority_scores_list);
-    priority_scores_struct_ptr =
-        FindOrNull(*taints_priority_scores_ptr, res_id);
-  }
-  CHECK_NOTNULL(priority_scores_struct_ptr);
+      PriorityScoresForMachine(ec, res_id);
   // Store the intolerable taints min, max and actual priority scores that will
   // be utilized in calculating normalized cost.
   PriorityScore_t& taints_score =
@@ -728,13 +647,7 @@ void CpuCostModel::CalculateIntolerableTaintsCost(const ResourceDescriptor& rd,
     // Store the intolerable taints min, max and actual priority scores.
     taints_score.score = intolerable_taint_cost;
     MinMaxScores_t* max_min_priority_scores =
-        FindOrNull(ec_to_max_min_priority_scores, ec);
-    if (!max_min_priority_scores) {
-      MinMaxScores_t priority_scores_list;
-      InsertIfNotPresent(&ec_to_max_min_priority_scores, ec,
-                         priority_scores_list);
-      max_min_priority_scores = FindOrNull(ec_to_max_min_priority_scores, ec);
-    }
+        MaxMinPriorityScoresForEC(ec, true);
     MinMaxScore_t& min_max_taints_score =
         max_min_priority_scores->intolerable_taints_priority;
     if (min_max_taints_score.max_score < intolerable_taint_cost ||
@@ -747,116 +660,49 @@ void CpuCostModel::CalculateIntolerableTaintsCost(const ResourceDescriptor& rd,
 // Pod affinity/anti-affinity
 bool CpuCostModel::MatchExpressionWithPodLabels(
     const ResourceDescriptor& rd, const LabelSelectorRequirement& expression) {
-  unordered_map<string, vector<TaskID_t>>* label_values =
-      FindOrNull(*labels_map_, expression.key());
-  if (label_values) {
-    for (auto& value : expression.values()) {
-      vector<TaskID_t>* labels_map_tasks = FindOrNull(*label_values, value);
-      if (labels_map_tasks) {
-        for (auto task_id : *labels_map_tasks) {
-          TaskDescriptor* tdp = FindPtrOrNull(*task_map_, task_id);
-          if (tdp) {
-            if (!HasNamespace(tdp->task_namespace())) continue;
-            if (tdp->state() == TaskDescriptor::RUNNING) {
-              ResourceID_t pu_res_id =
-                  ResourceIDFromString(tdp->scheduled_to_resource());
-              ResourceID_t machine_res_id = MachineResIDForResource(pu_res_id);
-              ResourceID_t res_id = ResourceIDFromString(rd.uuid());
-              if (machine_res_id == res_id) {
-                return true;
-              }
-            }
-          }
-        }
-      }
-    }
+  if (!label_index_) {
+    return false;
   }
-  return false;
+  return label_index_->HasPlacedTaskWithLabel(
+      ResourceIDFromString(rd.uuid()), expression.key(), expression.values(),
+      &namespaces);
 }
 
 bool CpuCostModel::NotMatchExpressionWithPodLabels(
     const ResourceDescriptor& rd, const LabelSelectorRequirement& expression) {
-  bool namespace_match = false;
-  unordered_map<string, vector<TaskID_t>>* label_values =
-      FindOrNull(*labels_map_, expression.key());
-  if (label_values) {
-    for (auto& value : expression.values()) {
-      vector<TaskID_t>* labels_map_tasks = FindOrNull(*label_values, value);
-      if (labels_map_tasks) {
-        for (auto task_id : *labels_map_tasks) {
-          TaskDescriptor* tdp = FindPtrOrNull(*task_map_, task_id);
-          if (tdp) {
-            if (tdp->state() == TaskDescriptor::RUNNING) {
-              ResourceID_t pu_res_id =
-                  ResourceIDFromString(tdp->scheduled_to_resource());
-              ResourceID_t machine_res_id = MachineResIDForResource(pu_res_id);
-              ResourceID_t res_id = ResourceIDFromString(rd.uuid());
-              if (machine_res_id == res_id) {
-                return false;
-              }
-            }
-          }
-          if (HasNamespace(tdp->task_namespace())) namespace_match = true;
-        }
-      }
-    }
+  if (!label_index_) {
+    return false;
   }
-  if (namespace_match == false) return false;
-  return true;
+  // No task with the label may run on the machine, whatever its namespace,
+  // and some task in the term's namespaces must have the label.
+  if (label_index_->HasPlacedTaskWithLabel(ResourceIDFromString(rd.uuid()),
+                                           expression.key(),
+                                           expression.values(), NULL)) {
+    return false;
+  }
+  return label_index_->HasTaskWithLabel(expression.key(), expression.values(),
+                                        &namespaces);
 }
 
 bool CpuCostModel::MatchExpressionKeyWithPodLabels(
     const ResourceDescriptor& rd, const LabelSelectorRequirement& expression) {
-  unordered_map<string, vector<TaskID_t>>* label_values =
-      FindOrNull(*labels_map_, expression.key());
-  if (label_values) {
-    for (auto it = label_values->begin(); it != label_values->end(); it++) {
-      for (auto task_id : it->second) {
-        TaskDescriptor* tdp = FindPtrOrNull(*task_map_, task_id);
-        if (tdp) {
-          if (!HasNamespace(tdp->task_namespace())) continue;
-          if (tdp->state() == TaskDescriptor::RUNNING) {
-            ResourceID_t pu_res_id =
-                ResourceIDFromString(tdp->scheduled_to_resource());
-            ResourceID_t machine_res_id = MachineResIDForResource(pu_res_id);
-            ResourceID_t res_id = ResourceIDFromString(rd.uuid());
-            if (machine_res_id == res_id) {
-              return true;
-            }
-          }
-        }
-      }
-    }
+  if (!label_index_) {
+    return false;
   }
-  return false;
+  return label_index_->HasPlacedTaskWithLabelKey(
+      ResourceIDFromString(rd.uuid()), expression.key(), &namespaces);
 }
 
 bool CpuCostModel::NotMatchExpressionKeyWithPodLabels(
     const ResourceDescriptor& rd, const LabelSelectorRequirement& expression) {
-  bool namespace_match = false;
-  unordered_map<string, vector<TaskID_t>>* label_values =
-      FindOrNull(*labels_map_, expression.key());
-  if (label_values) {
-    for (auto it = label_values->begin(); it != label_values->end(); it++) {
-      for (auto task_id : it->second) {
-        TaskDescriptor* tdp = FindPtrOrNull(*task_map_, task_id);
-        if (tdp) {
-          if (tdp->state() == TaskDescriptor::RUNNING) {
-            ResourceID_t pu_res_id =
-                ResourceIDFromString(tdp->scheduled_to_resource());
-            ResourceID_t machine_res_id = MachineResIDForResource(pu_res_id);
-            ResourceID_t res_id = ResourceIDFromString(rd.uuid());
-            if (machine_res_id == res_id) {
-              return false;
-            }
-          }
-        }
-        if (HasNamespace(tdp->task_namespace())) namespace_match = true;
-      }
-    }
+  if (!label_index_) {
+    return false;
   }
-  if (namespace_match == false) return false;
-  return true;
+  if (label_index_->HasPlacedTaskWithLabelKey(ResourceIDFromString(rd.uuid()),
+                                              expression.key(), NULL)) {
+    return false;
+  }
+  return label_index_->HasTaskWithLabelKey(expression.key(), &namespaces);
 }
 
 bool CpuCostModel::SatisfiesPodAntiAffinityMatchExpression(
@@ -1164,15 +1010,7 @@ void CpuCostModel::CalculatePodAffinityAntiAffinityPreference(
   }
   unordered_map<ResourceID_t, PriorityScoresList_t,
                 boost::hash<boost::uuids::uuid>>* nodes_priority_scores_ptr =
-      FindOrNull(ec_to_node_priority_scores, ec);
-  if (!nodes_priority_scores_ptr) {
-    unordered_map<ResourceID_t, PriorityScoresList_t,
-                  boost::hash<boost::uuids::uuid>>
-        node_to_priority_scores_map;
-    InsertIfNotPresent(&ec_to_node_priority_scores, ec,
-                       node_to_priority_scores_map);
-    nodes_priority_scores_ptr = FindOrNull(ec_to_node_priority_scores, ec);
-  }
+      NodePriorityScoresForEC(ec, true);
   CHECK_NOTNULL(nodes_priority_scores_ptr);
   ResourceID_t res_id = ResourceIDFromString(rd.uuid());
   PriorityScoresList_t* priority_scores_struct_ptr =
@@ -1190,13 +1028,7 @@ void CpuCostModel::CalculatePodAffinityAntiAffinityPreference(
   }
   pod_affinity_score.score = sum_of_weights;
   MinMaxScores_t* max_min_priority_scores =
-      FindOrNull(ec_to_max_min_priority_scores, ec);
-  if (!max_min_priority_scores) {
-    MinMaxScores_t priority_scores_list;
-    InsertIfNotPresent(&ec_to_max_min_priority_scores, ec,
-                       priority_scores_list);
-    max_min_priority_scores = FindOrNull(ec_to_max_min_priority_scores, ec);
-  }
+      MaxMinPriorityScoresForEC(ec, true);
   CHECK_NOTNULL(max_min_priority_scores);
   MinMaxScore_t& min_max_pod_affinity_score =
       max_min_priority_scores->pod_affinity_priority;
@@ -1210,31 +1042,8 @@ void CpuCostModel::CalculatePodAffinityAntiAffinityPreference(
   }
 }
 
-void CpuCostModel::CalculateNodePreferAvoidPodsPriority(
-                   const ResourceDescriptor rd, const TaskDescriptor td,
-                   const EquivClass_t ec) {
-  unordered_map<ResourceID_t, PriorityScoresList_t,
-            boost::hash<boost::uuids::uuid>>* nodes_priority_scores_ptr =
-                               FindOrNull(ec_to_node_priority_scores, ec);
-  if (!nodes_priority_scores_ptr) {
-    unordered_map<ResourceID_t, PriorityScoresList_t,
-                  boost::hash<boost::uuids::uuid>> node_to_priority_scores_map;
-    InsertIfNotPresent(&ec_to_node_priority_scores, ec,
-                                              node_to_priority_scores_map);
-    nodes_priority_scores_ptr = FindOrNull(ec_to_node_priority_scores, ec);
-  }
-  CHECK_NOTNULL(nodes_priority_scores_ptr);
-  ResourceID_t res_id = ResourceIDFromString(rd.uuid());
-  PriorityScoresList_t* priority_scores_struct_ptr =
-      FindOrNull(*nodes_priority_scores_ptr, res_id);
-  if (!priority_scores_struct_ptr) {
-    PriorityScoresList_t priority_scores_list;
-    InsertIfNotPresent(nodes_priority_scores_ptr, res_id, priority_scores_list);
-    priority_scores_struct_ptr = FindOrNull(*nodes_priority_scores_ptr, res_id);
-  }
-  CHECK_NOTNULL(priority_scores_struct_ptr);
-  PriorityScore_t& prefer_avoid_pods_priority =
-                   priority_scores_struct_ptr->prefer_avoid_pods_priority;
+int64_t CpuCostModel::CalculateNodePreferAvoidPodsScore(
+    const ResourceDescriptor& rd, const TaskDescriptor& td) {
   if ((rd.avoids_size())
       && (!td.owner_ref_kind().compare(string("ReplicationController")) 
       || !td.owner_ref_kind().compare(string("ReplicaSet")))) {
@@ -1243,14 +1052,20 @@ void CpuCostModel::CalculateNodePreferAvoidPodsPriority(
                                && (!td.owner_ref_uid().compare(avoid.uid()))) {
         // Avoid pods annotations matched. 
         // Score should be high so that cost will be high.
-        prefer_avoid_pods_priority.score = omega_;
-        return;
+        return omega_;
       }
     }
   }
   // No match for avoid pods annotations.
   // Score should be zero so that cost is not affected byt this.
-  prefer_avoid_pods_priority.score = 0;
+  return 0;
+}
+
+void CpuCostModel::UpdateNodePreferAvoidPodsPriorityScore(
+    const EquivClass_t ec, ResourceID_t res_id, int64_t score) {
+  PriorityScoresList_t* priority_scores_struct_ptr =
+      PriorityScoresForMachine(ec, res_id);
+  priority_scores_struct_ptr->prefer_avoid_pods_priority.score = score;
 }
 
 // Pod affinity/anti-affinity symmetry.
@@ -1459,24 +1274,39 @@ vector<EquivClass_t>* CpuCostModel::GetEquivClassToEquivClassesArcs(
   CpuMemResVector_t* task_resource_request =
       FindOrNull(ec_resource_requirement_, ec);
   if (task_resource_request) {
-    // Clear priority scores for node affinity and pod affinity.
+    // Reset the priority scores for node affinity and pod affinity.
     // TODO(jagadish): Currently we clear old affinity scores, and restore new
     // scores. But we are not clearing it just after scheduling round completed,
     // we are clearing in the subsequent scheduling round, need to improve this.
-    ec_to_node_priority_scores.clear();
-    // Added to clear the map before filling the values for each node
-    tolerationSoftEqualMap.clear();
-    tolerationSoftExistsMap.clear();
-    for (auto& ec_machines : ecs_for_machines_) {
-      ResourceStatus* rs = FindPtrOrNull(*resource_map_, ec_machines.first);
+    // N.B.: we only reset this EC's scores because the scores of other ECs
+    // may be in use by concurrent queries.
+    ResetPriorityScoresForEC(ec);
+    const TaskDescriptor* td_ptr = FindOrNull(ec_to_td_requirements, ec);
+    const scheduler::CompiledTaskConstraints* task_constraints = NULL;
+    if (td_ptr) {
+      boost::lock_guard<boost::mutex> lock(ec_state_lock_);
+      task_constraints = &ec_constraint_cache_[ec].task_constraints;
+    }
+    // Filter the machines by node selector, required node affinity, hard
+    // taints and resources in bulk, and only check the remaining
+    // constraints on the eligible machines.
+    vector<ResourceID_t> eligible_machines;
+    machine_index_.EligibleMachines(task_constraints, *task_resource_request,
+                                    &eligible_machines);
+    for (auto& machine_res_id : eligible_machines) {
+      ResourceStatus* rs = FindPtrOrNull(*resource_map_, machine_res_id);
       CHECK_NOTNULL(rs);
       const ResourceDescriptor& rd = rs->topology_node().resource_desc();
-      const TaskDescriptor* td_ptr = FindOrNull(ec_to_td_requirements, ec);
       if (td_ptr) {
+        // The node-level constraints are only re-evaluated if the machine
+        // or the EC changed since they were last evaluated.
+        const MachineConstraints_t& constraints =
+            ConstraintsForMachine(ec, *td_ptr, machine_res_id, rd);
         // Checking whether machine satisfies node selector and node affinity.
-        if (scheduler::SatisfiesNodeSelectorAndNodeAffinity(rd, *td_ptr)) {
+        if (constraints.satisfies_node_selector_and_affinity) {
           // Calculate costs for all priorities.
-          CalculatePrioritiesCost(ec, rd);
+          UpdateNodeAffinityPriorityScore(ec, *td_ptr, machine_res_id,
+                                          constraints.node_affinity_score);
         } else
           continue;
         // Checking pod affinity/anti-affinity
@@ -1486,12 +1316,13 @@ vector<EquivClass_t>* CpuCostModel::GetEquivClassToEquivClassesArcs(
           continue;
         }
         // Check whether taints in the machine has matching tolerations
-        if (scheduler::HasMatchingTolerationforNodeTaints(rd, *td_ptr)) {
-          CalculateIntolerableTaintsCost(rd, td_ptr, ec);
+        if (constraints.tolerates_hard_taints) {
+          // Checking costs for intolerable taints
+          UpdateIntolerableTaintsPriorityScore(
+              ec, machine_res_id, constraints.intolerable_taints_cost);
         } else {
           continue;
         }
-        // Checking costs for intolerable taints
 
         // Checking pod anti-affinity symmetry
         if (FLAGS_pod_affinity_antiaffinity_symmetry &&
@@ -1509,7 +1340,8 @@ vector<EquivClass_t>* CpuCostModel::GetEquivClassToEquivClassesArcs(
 
         // Calculate prefer avoid pods priority for node
         if (rd.avoids_size()) {
-          CalculateNodePreferAvoidPodsPriority(rd, *td_ptr, ec);
+          UpdateNodePreferAvoidPodsPriorityScore(
+              ec, machine_res_id, constraints.prefer_avoid_pods_score);
         }
       }
       CpuMemResVector_t available_resources;
@@ -1538,7 +1370,7 @@ vector<EquivClass_t>* CpuCostModel::GetEquivClassToEquivClassesArcs(
           cur_resource.ram_cap_ += task_resource_request->ram_cap_,
           cur_resource.ephemeral_storage_ += task_resource_request->ephemeral_storage_,
           index++, task_count++) {
-        pref_ecs->push_back(ec_machines.second[index]);
+        pref_ecs->push_back((*ecs_for_machine)[index]);
       }
     }
     if (FLAGS_gather_unscheduled_tasks) {
@@ -1547,6 +1379,7 @@ vector<EquivClass_t>* CpuCostModel::GetEquivClassToEquivClassesArcs(
         // this 'ec' to 'task_ec_with_no_pref_arcs_'. Reason why tasks not
         // scheduled could be 1) Not enough cpu/mem 2) Any nodes not satisfying
         // scheduling constraints like affinity etc.
+        boost::lock_guard<boost::mutex> lock(ec_state_lock_);
         if (task_ec_with_no_pref_arcs_set_.find(ec) ==
             task_ec_with_no_pref_arcs_set_.end()) {
           task_ec_with_no_pref_arcs_.push_back(ec);
@@ -1572,6 +1405,9 @@ void CpuCostModel::AddMachine(ResourceTopologyNodeDescriptor* rtnd_ptr) {
     CHECK(InsertIfNotPresent(&ec_to_machine_, multi_machine_ec, res_id));
   }
   CHECK(InsertIfNotPresent(&ecs_for_machines_, res_id, machine_ecs));
+  machine_index_.AddMachine(res_id, rd);
+  CHECK(InsertIfNotPresent(&machine_generations_, res_id,
+                           ++constraints_generation_));
 }
 
 void CpuCostModel::AddTask(TaskID_t task_id) {
@@ -1596,6 +1432,14 @@ void CpuCostModel::RemoveMachine(ResourceID_t res_id) {
     CHECK_EQ(ec_to_index_.erase(ec), 1);
   }
   CHECK_EQ(ecs_for_machines_.erase(res_id), 1);
+  machine_index_.RemoveMachine(res_id);
+  CHECK_EQ(machine_generations_.erase(res_id), 1);
+  for (auto& ec_scores : ec_to_node_priority_scores) {
+    ec_scores.second.erase(res_id);
+  }
+  for (auto& ec_cache : ec_constraint_cache_) {
+    ec_cache.second.machines.erase(res_id);
+  }
 }
 
 void CpuCostModel::RemoveTask(TaskID_t task_id) {
@@ -1603,6 +1447,100 @@ void CpuCostModel::RemoveTask(TaskID_t task_id) {
   task_resource_requirement_.erase(task_id);
 }
 
+void CpuCostModel::UpdateMachine(ResourceTopologyNodeDescriptor* rtnd_ptr) {
+  CHECK_NOTNULL(rtnd_ptr);
+  const ResourceDescriptor& rd = rtnd_ptr->resource_desc();
+  if (rd.type() != ResourceDescriptor::RESOURCE_MACHINE) {
+    return;
+  }
+  ResourceID_t res_id = ResourceIDFromString(rd.uuid());
+  if (ContainsKey(ecs_for_machines_, res_id)) {
+    machine_index_.UpdateMachine(res_id, rd);
+    // Invalidate the cached constraint evaluation results for the machine.
+    machine_generations_[res_id] = ++constraints_generation_;
+  }
+}
+
+unordered_map<ResourceID_t, PriorityScoresList_t,
+              boost::hash<boost::uuids::uuid>>*
+    CpuCostModel::NodePriorityScoresForEC(EquivClass_t ec, bool create) {
+  boost::lock_guard<boost::mutex> lock(ec_state_lock_);
+  if (create) {
+    return &ec_to_node_priority_scores[ec];
+  }
+  return FindOrNull(ec_to_node_priority_scores, ec);
+}
+
+MinMaxScores_t* CpuCostModel::MaxMinPriorityScoresForEC(EquivClass_t ec,
+                                                        bool create) {
+  boost::lock_guard<boost::mutex> lock(ec_state_lock_);
+  if (create) {
+    return &ec_to_max_min_priority_scores[ec];
+  }
+  return FindOrNull(ec_to_max_min_priority_scores, ec);
+}
+
+PriorityScoresList_t* CpuCostModel::PriorityScoresForMachine(
+    EquivClass_t ec, ResourceID_t res_id) {
+  unordered_map<ResourceID_t, PriorityScoresList_t,
+                boost::hash<boost::uuids::uuid>>* nodes_priority_scores_ptr =
+      NodePriorityScoresForEC(ec, true);
+  CHECK_NOTNULL(nodes_priority_scores_ptr);
+  // Priority scores are initialized to zero for new machines.
+  return &(*nodes_priority_scores_ptr)[res_id];
+}
+
+void CpuCostModel::ResetPriorityScoresForEC(EquivClass_t ec) {
+  unordered_map<ResourceID_t, PriorityScoresList_t,
+                boost::hash<boost::uuids::uuid>>* nodes_priority_scores_ptr =
+      NodePriorityScoresForEC(ec, false);
+  if (nodes_priority_scores_ptr) {
+    // Reset the entries in place rather than erasing them, so that they
+    // don't have to be allocated again for every round.
+    for (auto& node_priority_scores : *nodes_priority_scores_ptr) {
+      node_priority_scores.second = PriorityScoresList_t();
+    }
+  }
+  MinMaxScores_t* max_min_priority_scores =
+      MaxMinPriorityScoresForEC(ec, false);
+  if (max_min_priority_scores) {
+    *max_min_priority_scores = MinMaxScores_t();
+  }
+}
+
+const MachineConstraints_t& CpuCostModel::ConstraintsForMachine(
+    EquivClass_t ec, const TaskDescriptor& td, ResourceID_t res_id,
+    const ResourceDescriptor& rd) {
+  ECConstraintCache_t* ec_cache;
+  {
+    boost::lock_guard<boost::mutex> lock(ec_state_lock_);
+    ec_cache = &ec_constraint_cache_[ec];
+  }
+  uint64_t* machine_generation = FindOrNull(machine_generations_, res_id);
+  CHECK_NOTNULL(machine_generation);
+  MachineConstraints_t& constraints = ec_cache->machines[res_id];
+  if (constraints.ec_generation == ec_cache->generation &&
+      constraints.machine_generation == *machine_generation) {
+    return constraints;
+  }
+  constraints.ec_generation = ec_cache->generation;
+  constraints.machine_generation = *machine_generation;
+  const scheduler::CompiledNode& node = machine_index_.CompiledNodeFor(res_id);
+  const scheduler::CompiledTaskConstraints& task_constraints =
+    ec_cache->task_constraints;
+  constraints.satisfies_node_selector_and_affinity =
+    task_constraints.SatisfiesNodeSelectorAndNodeAffinity(node);
+  constraints.node_affinity_score =
+    task_constraints.NodeAffinitySoftScore(node);
+  constraints.tolerates_hard_taints =
+    task_constraints.ToleratesHardTaints(node);
+  constraints.intolerable_taints_cost =
+    task_constraints.IntolerableTaintsCost(node);
+  constraints.prefer_avoid_pods_score =
+      CalculateNodePreferAvoidPodsScore(rd, td);
+  return constraints;
+}
+
 EquivClass_t CpuCostModel::GetMachineEC(const string& machine_name,
                                         uint64_t ec_index) {
   uint64_t hash = HashString(machine_name);
@@ -1667,6 +1605,10 @@ FlowGraphNode* CpuCostModel::GatherStats(FlowGraphNode* accumulator,
     if (accumulator->rd_ptr_ && other->rd_ptr_) {
       AccumulateResourceStats(accumulator->rd_ptr_, other->rd_ptr_);
     }
+    if (ContainsKey(ecs_for_machines_, accumulator->resource_id_)) {
+      machine_index_.UpdateMachineResources(accumulator->resource_id_,
+                                            rd_ptr->available_resources());
+    }
   }
   return accumulator;
 }
@@ -1679,10 +1621,10 @@ void CpuCostModel::PrepareStats(FlowGraphNode* accumulator) {
   accumulator->rd_ptr_->clear_num_running_tasks_below();
   accumulator->rd_ptr_->clear_num_slots_below();
   accumulator->rd_ptr_->clear_available_resources();
-  // Clear maps related to priority scores.
-  ec_to_node_priority_scores.clear();
-  ec_to_min_cost_.clear();
-  ec_to_best_fit_resource_.clear();
+  // Clear maps related to priority scores. The per-machine scores are reset
+  // when the EC's arcs are computed.
+  ec_to_machine_costs_.clear();
+  machine_to_placed_tasks_.clear();
 }
 
 FlowGraphNode* CpuCostModel::UpdateStats(FlowGraphNode* accumulator,
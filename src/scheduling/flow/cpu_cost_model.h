@@ -21,17 +21,23 @@
 #ifndef FIRMAMENT_SCHEDULING_CPU_COST_MODEL_H
 #define FIRMAMENT_SCHEDULING_CPU_COST_MODEL_H
 
+#include <atomic>
 #include <set>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include <boost/thread/mutex.hpp>
+
 #include "base/common.h"
 #include "base/types.h"
 #include "misc/map-util.h"
 #include "scheduling/common.h"
+#include "scheduling/compiled_selector.h"
 #include "scheduling/flow/cost_model_interface.h"
+#include "scheduling/flow/cpu_machine_index.h"
 #include "scheduling/knowledge_base.h"
+#include "scheduling/label_index.h"
 
 namespace firmament {
 
@@ -53,12 +59,6 @@ struct CpuMemCostVector_t {
         prefer_avoid_pods_cost_(0) {}
 };
 
-struct CpuMemResVector_t {
-  uint64_t cpu_cores_;
-  uint64_t ram_cap_;
-  uint64_t ephemeral_storage_;
-};
-
 struct MinMaxScore_t {
   int64_t min_score;
   int64_t max_score;
@@ -86,13 +86,45 @@ struct PriorityScoresList_t {
   PriorityScore_t prefer_avoid_pods_priority;
 };
 
+// Results of evaluating the node-level constraints and priorities of an EC on
+// a machine. They only depend on the EC's task requirements and on the
+// machine's labels, taints and annotations, so they are cached until either
+// changes.
+struct MachineConstraints_t {
+  // Generations of the EC and of the machine at evaluation time.
+  uint64_t ec_generation;
+  uint64_t machine_generation;
+  bool satisfies_node_selector_and_affinity;
+  bool tolerates_hard_taints;
+  int64_t node_affinity_score;
+  int64_t intolerable_taints_cost;
+  int64_t prefer_avoid_pods_score;
+  MachineConstraints_t()
+      : ec_generation(0),
+        machine_generation(0),
+        satisfies_node_selector_and_affinity(false),
+        tolerates_hard_taints(false),
+        node_affinity_score(0),
+        intolerable_taints_cost(0),
+        prefer_avoid_pods_score(0) {}
+};
+
+struct ECConstraintCache_t {
+  uint64_t generation;
+  // The EC's node selector, node affinity and tolerations, compiled when its
+  // requirements are set.
+  scheduler::CompiledTaskConstraints task_constraints;
+  unordered_map<ResourceID_t, MachineConstraints_t,
+                boost::hash<boost::uuids::uuid>> machines;
+  ECConstraintCache_t() : generation(0) {}
+};
+
 class CpuCostModel : public CostModelInterface {
  public:
   CpuCostModel(shared_ptr<ResourceMap_t> resource_map,
                shared_ptr<TaskMap_t> task_map,
                shared_ptr<KnowledgeBase> knowledge_base,
-               unordered_map<string, unordered_map<string, vector<TaskID_t>>>*
-                   labels_map);
+               LabelIndex* label_index);
   // Costs pertaining to leaving tasks unscheduled
   ArcDescriptor TaskToUnscheduledAgg(TaskID_t task_id);
   ArcDescriptor UnscheduledAggToSink(JobID_t job_id);
@@ -111,8 +143,10 @@ class CpuCostModel : public CostModelInterface {
   ArcDescriptor EquivClassToEquivClass(EquivClass_t tec1, EquivClass_t tec2);
   // Calculate costs pertaining to pod priorities such node affinity, pod
   // affinity etc.
-  void CalculatePrioritiesCost(const EquivClass_t ec,
-                               const ResourceDescriptor& rd);
+  void UpdateNodeAffinityPriorityScore(const EquivClass_t ec,
+                                       const TaskDescriptor& td,
+                                       ResourceID_t res_id,
+                                       int64_t sum_of_weights);
   // Get the type of equiv class.
   vector<EquivClass_t>* GetTaskEquivClasses(TaskID_t task_id);
   vector<ResourceID_t>* GetOutgoingEquivClassPrefArcs(EquivClass_t tec);
@@ -157,12 +191,14 @@ class CpuCostModel : public CostModelInterface {
                                                   const TaskDescriptor& td,
                                                   const EquivClass_t ec);
   //Intolerable Taints
-  void CalculateIntolerableTaintsCost(const ResourceDescriptor& rd,
-                                                  const TaskDescriptor* td,
-                                                  const EquivClass_t ec);
-  void CalculateNodePreferAvoidPodsPriority(const ResourceDescriptor rd,
-                                            const TaskDescriptor td,
-                                            const EquivClass_t ec);
+  void UpdateIntolerableTaintsPriorityScore(const EquivClass_t ec,
+                                            ResourceID_t res_id,
+                                            int64_t intolerable_taint_cost);
+  int64_t CalculateNodePreferAvoidPodsScore(const ResourceDescriptor& rd,
+                                            const TaskDescriptor& td);
+  void UpdateNodePreferAvoidPodsPriorityScore(const EquivClass_t ec,
+                                              ResourceID_t res_id,
+                                              int64_t score);
   // Pod affinity/anti-affinity symmetry
   bool CheckPodAffinityAntiAffinitySymmetryConflict(TaskDescriptor* td_ptr);
   void UpdateResourceToTaskSymmetryMap(ResourceID_t res_id, TaskID_t td);
@@ -205,6 +241,7 @@ class CpuCostModel : public CostModelInterface {
   void AddTask(TaskID_t task_id);
   void RemoveMachine(ResourceID_t res_id);
   void RemoveTask(TaskID_t task_id);
+  void UpdateMachine(ResourceTopologyNodeDescriptor* rtnd_ptr);
   FlowGraphNode* GatherStats(FlowGraphNode* accumulator, FlowGraphNode* other);
   void PrepareStats(FlowGraphNode* accumulator);
   FlowGraphNode* UpdateStats(FlowGraphNode* accumulator, FlowGraphNode* other);
@@ -215,20 +252,28 @@ class CpuCostModel : public CostModelInterface {
   void ClearUnscheduledTasksData();
   // Get unscheduled tasks in a scheduling round.
   void GetUnscheduledTasks(vector<uint64_t>* unscheduled_tasks_ptr);
+  // Queries for different tasks (or for different ECs) only share the
+  // EC-keyed maps, which are guarded by ec_state_lock_.
+  bool IsThreadSafe() const {
+    return true;
+  }
 
  private:
   // Fixed value for OMEGA, the normalization ceiling for each dimension's cost
   // value
   const Cost_t omega_ = 1000;
   // Largest cost seen so far, plus one
-  Cost_t infinity_;
+  std::atomic<Cost_t> infinity_;
   FRIEND_TEST(CpuCostModelTest, AddMachine);
   FRIEND_TEST(CpuCostModelTest, AddTask);
   FRIEND_TEST(CpuCostModelTest, EquivClassToEquivClass);
   FRIEND_TEST(CpuCostModelTest, GetEquivClassToEquivClassesArcs);
+  FRIEND_TEST(CpuCostModelTest, GetEquivClassToEquivClassesArcsUsesIndex);
+  FRIEND_TEST(CpuCostModelTest, ConstraintsForMachineCache);
   FRIEND_TEST(CpuCostModelTest, GatherStats);
   FRIEND_TEST(CpuCostModelTest, GetOutgoingEquivClassPrefArcs);
   FRIEND_TEST(CpuCostModelTest, GetTaskEquivClasses);
+  FRIEND_TEST(CpuCostModelTest, GetTaskMappingForSingleTask);
   FRIEND_TEST(CpuCostModelTest, MachineResIDForResource);
   // Load statistics accumulator helper
   void AccumulateResourceStats(ResourceDescriptor* accumulator,
@@ -241,6 +286,24 @@ class CpuCostModel : public CostModelInterface {
     CHECK_NOTNULL(td);
     return *td;
   }
+  // Returns the machines' priority scores for ec, or NULL if there are none
+  // and create is false.
+  unordered_map<ResourceID_t, PriorityScoresList_t,
+                boost::hash<boost::uuids::uuid>>*
+      NodePriorityScoresForEC(EquivClass_t ec, bool create);
+  // Returns the min and max priority scores for ec, or NULL if there are none
+  // and create is false.
+  MinMaxScores_t* MaxMinPriorityScoresForEC(EquivClass_t ec, bool create);
+  // Returns the priority scores of a machine for ec, creating them if needed.
+  PriorityScoresList_t* PriorityScoresForMachine(EquivClass_t ec,
+                                                 ResourceID_t res_id);
+  void ResetPriorityScoresForEC(EquivClass_t ec);
+  // Returns the results of evaluating ec's node-level constraints on a
+  // machine, and re-evaluates them if the EC or the machine changed since
+  // they were cached.
+  const MachineConstraints_t& ConstraintsForMachine(
+      EquivClass_t ec, const TaskDescriptor& td, ResourceID_t res_id,
+      const ResourceDescriptor& rd);
   inline bool HasNamespace(const string name) {
     if (namespaces.find(name) == namespaces.end()) {
       return false;
@@ -263,6 +326,16 @@ class CpuCostModel : public CostModelInterface {
   unordered_map<ResourceID_t, vector<EquivClass_t>, boost::hash<ResourceID_t>>
       ecs_for_machines_;
   unordered_map<EquivClass_t, ResourceID_t> ec_to_machine_;
+  // Columnar table of the machines, used to find the machines that fit a
+  // task EC.
+  CpuMachineIndex machine_index_;
+  // Cached constraint evaluation results, and the generation counters used to
+  // invalidate them. A machine's generation changes when its labels or taints
+  // are updated; an EC's generation changes when its requirements are set.
+  unordered_map<EquivClass_t, ECConstraintCache_t> ec_constraint_cache_;
+  unordered_map<ResourceID_t, uint64_t, boost::hash<ResourceID_t>>
+      machine_generations_;
+  uint64_t constraints_generation_;
   unordered_map<EquivClass_t, uint64_t> ec_to_index_;
   unordered_map<EquivClass_t, const RepeatedPtrField<LabelSelector>>
       ec_to_label_selectors;
@@ -272,20 +345,33 @@ class CpuCostModel : public CostModelInterface {
       ec_to_node_priority_scores;
   unordered_map<EquivClass_t, MinMaxScores_t> ec_to_max_min_priority_scores;
   // Pod affinity/anti-affinity
-  unordered_map<string, unordered_map<string, vector<TaskID_t>>>* labels_map_;
-  unordered_set<string> namespaces;
+  LabelIndex* label_index_;
+  // Scratch space for the namespaces of the pod affinity term being checked.
+  // It is per thread because ECs are processed concurrently.
+  static thread_local unordered_set<string> namespaces;
   // Pod affinity/anti-affinity symmetry
   unordered_map<ResourceID_t, vector<TaskID_t>, boost::hash<ResourceID_t>> resource_to_task_symmetry_map_;
   unordered_set<EquivClass_t> ecs_with_pod_antiaffinity_symmetry_;
-  unordered_map<EquivClass_t, ResourceID_t> ec_to_best_fit_resource_;
-  unordered_map<EquivClass_t, Cost_t> ec_to_min_cost_;
-  unordered_map<string, string> tolerationSoftEqualMap;
-  unordered_map<string, string> tolerationSoftExistsMap;
+  // Costs of the arcs from pod affinity/anti-affinity task ECs to machines,
+  // indexed by the number of tasks placed on the machine in the current
+  // round. Used to place these tasks without running the solver.
+  unordered_map<EquivClass_t,
+                unordered_map<ResourceID_t, vector<Cost_t>,
+                              boost::hash<ResourceID_t>>>
+      ec_to_machine_costs_;
+  // Number of tasks placed on each machine since the arc costs were computed.
+  unordered_map<ResourceID_t, uint64_t, boost::hash<ResourceID_t>>
+      machine_to_placed_tasks_;
   unordered_set<EquivClass_t> task_ec_with_no_pref_arcs_set_;
   vector<EquivClass_t> task_ec_with_no_pref_arcs_;
   unordered_map<EquivClass_t, vector<uint64_t>> task_ec_to_connected_tasks_;
   unordered_map<EquivClass_t, unordered_set<uint64_t>>
     task_ec_to_connected_tasks_set_;
+  // Guards the insertion and removal of the entries of the maps and sets
+  // keyed by EC while the flow graph manager queries the cost model
+  // concurrently. The entries themselves are only accessed by the thread
+  // that handles the EC.
+  boost::mutex ec_state_lock_;
 };
 
 }  // namespace firmament
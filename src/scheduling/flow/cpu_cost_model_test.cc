@@ -245,6 +245,171 @@ TEST_F(CpuCostModelTest, GetEquivClassToEquivClassesArcs) {
   delete equiv_to_equiv_arcs;
 }
 
+TEST_F(CpuCostModelTest, GetEquivClassToEquivClassesArcsUsesIndex) {
+  // Create a task that must run in zone "a".
+  JobDescriptor test_job;
+  TaskDescriptor* td_ptr = CreateTask(&test_job, 45);
+  InsertIfNotPresent(cost_model->task_map_.get(), td_ptr->uid(), td_ptr);
+  TaskID_t task_id = td_ptr->uid();
+  td_ptr->mutable_resource_request()->set_cpu_cores(20.0);
+  td_ptr->mutable_resource_request()->set_ram_cap(1000);
+  LabelSelector* selector = td_ptr->add_label_selectors();
+  selector->set_type(LabelSelector::IN_SET);
+  selector->set_key("zone");
+  selector->add_values("a");
+  cost_model->AddTask(task_id);
+  vector<EquivClass_t>* equiv_classes =
+      cost_model->GetTaskEquivClasses(task_id);
+  // Create two machines, of which only the first one is in zone "a".
+  ResourceTopologyNodeDescriptor rtnds[2];
+  ResourceStatus* rss[2];
+  ResourceID_t res_ids[2];
+  for (uint32_t i = 0; i < 2; ++i) {
+    string name = "Machine" + to_string(i + 1);
+    res_ids[i] = GenerateResourceID(name);
+    ResourceDescriptor* rd_ptr = rtnds[i].mutable_resource_desc();
+    rd_ptr->set_friendly_name(name);
+    rd_ptr->set_uuid(to_string(res_ids[i]));
+    rd_ptr->set_type(ResourceDescriptor::RESOURCE_MACHINE);
+    rd_ptr->set_max_pods(10);
+    rd_ptr->mutable_available_resources()->set_cpu_cores(500.0);
+    rd_ptr->mutable_available_resources()->set_ram_cap(16000);
+    rd_ptr->mutable_available_resources()->set_ephemeral_storage(1000);
+    Label* label_ptr = rd_ptr->add_labels();
+    label_ptr->set_key("zone");
+    label_ptr->set_value(i == 0 ? "a" : "b");
+    rss[i] = new ResourceStatus(rd_ptr, &rtnds[i], name, 0);
+    CHECK(InsertIfNotPresent(resource_map_.get(), res_ids[i], rss[i]));
+    cost_model->AddMachine(&rtnds[i]);
+  }
+  vector<EquivClass_t>* equiv_to_equiv_arcs =
+      cost_model->GetEquivClassToEquivClassesArcs((*equiv_classes)[0]);
+  EXPECT_EQ(10U, equiv_to_equiv_arcs->size());
+  for (auto& machine_ec : *equiv_to_equiv_arcs) {
+    EXPECT_EQ(cost_model->ec_to_machine_[machine_ec], res_ids[0]);
+  }
+  delete equiv_to_equiv_arcs;
+  // Move the second machine to zone "a" as well.
+  rtnds[1].mutable_resource_desc()->mutable_labels(0)->set_value("a");
+  cost_model->UpdateMachine(&rtnds[1]);
+  equiv_to_equiv_arcs =
+      cost_model->GetEquivClassToEquivClassesArcs((*equiv_classes)[0]);
+  EXPECT_EQ(20U, equiv_to_equiv_arcs->size());
+  delete equiv_to_equiv_arcs;
+  // Clean up.
+  cost_model->RemoveTask(task_id);
+  delete equiv_classes;
+  for (uint32_t i = 0; i < 2; ++i) {
+    cost_model->RemoveMachine(res_ids[i]);
+    cost_model->resource_map_.get()->erase(res_ids[i]);
+    delete rss[i];
+  }
+}
+
+TEST_F(CpuCostModelTest, ConstraintsForMachineCache) {
+  // Create a task that must run in zone "a".
+  JobDescriptor test_job;
+  TaskDescriptor* td_ptr = CreateTask(&test_job, 46);
+  InsertIfNotPresent(cost_model->task_map_.get(), td_ptr->uid(), td_ptr);
+  TaskID_t task_id = td_ptr->uid();
+  LabelSelector* selector = td_ptr->add_label_selectors();
+  selector->set_type(LabelSelector::IN_SET);
+  selector->set_key("zone");
+  selector->add_values("a");
+  cost_model->AddTask(task_id);
+  vector<EquivClass_t>* equiv_classes =
+      cost_model->GetTaskEquivClasses(task_id);
+  EquivClass_t ec = (*equiv_classes)[0];
+  // Create a machine in zone "a" with a soft taint.
+  ResourceID_t res_id = GenerateResourceID("Machine1");
+  ResourceTopologyNodeDescriptor rtnd;
+  ResourceDescriptor* rd_ptr = rtnd.mutable_resource_desc();
+  rd_ptr->set_friendly_name("Machine1");
+  rd_ptr->set_uuid(to_string(res_id));
+  rd_ptr->set_type(ResourceDescriptor::RESOURCE_MACHINE);
+  Label* label_ptr = rd_ptr->add_labels();
+  label_ptr->set_key("zone");
+  label_ptr->set_value("a");
+  Taint* taint_ptr = rd_ptr->add_taints();
+  taint_ptr->set_key("spot");
+  taint_ptr->set_effect("PreferNoSchedule");
+  cost_model->AddMachine(&rtnd);
+  const MachineConstraints_t& constraints =
+      cost_model->ConstraintsForMachine(ec, *td_ptr, res_id, *rd_ptr);
+  EXPECT_TRUE(constraints.satisfies_node_selector_and_affinity);
+  EXPECT_TRUE(constraints.tolerates_hard_taints);
+  EXPECT_EQ(constraints.intolerable_taints_cost, 1);
+  // The results are cached until the machine is updated.
+  label_ptr->set_value("b");
+  EXPECT_TRUE(cost_model->ConstraintsForMachine(ec, *td_ptr, res_id, *rd_ptr)
+                  .satisfies_node_selector_and_affinity);
+  cost_model->UpdateMachine(&rtnd);
+  EXPECT_FALSE(cost_model->ConstraintsForMachine(ec, *td_ptr, res_id, *rd_ptr)
+                   .satisfies_node_selector_and_affinity);
+  // Removing the machine drops its cached results.
+  cost_model->RemoveMachine(res_id);
+  EXPECT_EQ(cost_model->ec_constraint_cache_[ec].machines.size(), 0);
+  cost_model->RemoveTask(task_id);
+  delete equiv_classes;
+}
+
+TEST_F(CpuCostModelTest, GetTaskMappingForSingleTask) {
+  // Create a task with pod anti-affinity, but without required terms.
+  JobDescriptor test_job;
+  TaskDescriptor* td_ptr = CreateTask(&test_job, 47);
+  InsertIfNotPresent(cost_model->task_map_.get(), td_ptr->uid(), td_ptr);
+  TaskID_t task_id = td_ptr->uid();
+  td_ptr->mutable_affinity()->mutable_pod_anti_affinity();
+  cost_model->AddTask(task_id);
+  vector<EquivClass_t>* equiv_classes =
+      cost_model->GetTaskEquivClasses(task_id);
+  EquivClass_t ec = (*equiv_classes)[0];
+  // Create two machines with a PU each.
+  ResourceTopologyNodeDescriptor rtnds[2];
+  ResourceStatus* rss[2];
+  ResourceID_t res_ids[2];
+  ResourceID_t pu_ids[2];
+  for (uint32_t i = 0; i < 2; ++i) {
+    string name = "Machine" + to_string(i + 1);
+    res_ids[i] = GenerateResourceID(name);
+    pu_ids[i] = GenerateResourceID(name + "PU");
+    ResourceDescriptor* rd_ptr = rtnds[i].mutable_resource_desc();
+    rd_ptr->set_friendly_name(name);
+    rd_ptr->set_uuid(to_string(res_ids[i]));
+    rd_ptr->set_type(ResourceDescriptor::RESOURCE_MACHINE);
+    ResourceDescriptor* pu_rd_ptr =
+        rtnds[i].add_children()->mutable_resource_desc();
+    pu_rd_ptr->set_uuid(to_string(pu_ids[i]));
+    pu_rd_ptr->set_type(ResourceDescriptor::RESOURCE_PU);
+    rss[i] = new ResourceStatus(rd_ptr, &rtnds[i], name, 0);
+    CHECK(InsertIfNotPresent(resource_map_.get(), res_ids[i], rss[i]));
+  }
+  // The first machine fits two tasks, the second one fits one task.
+  cost_model->ec_to_machine_costs_[ec][res_ids[0]] = {10, 50};
+  cost_model->ec_to_machine_costs_[ec][res_ids[1]] = {20};
+  // Each placement makes the next task on the same machine more expensive.
+  EXPECT_EQ(cost_model->GetTaskMappingForSingleTask(task_id).second,
+            pu_ids[0]);
+  EXPECT_EQ(cost_model->GetTaskMappingForSingleTask(task_id).second,
+            pu_ids[1]);
+  EXPECT_EQ(cost_model->GetTaskMappingForSingleTask(task_id).second,
+            pu_ids[0]);
+  EXPECT_TRUE(cost_model->GetTaskMappingForSingleTask(task_id).second.is_nil());
+  // Recomputing the statistics starts a new round.
+  FlowGraphNode machine_node(1);
+  machine_node.type_ = FlowNodeType::MACHINE;
+  machine_node.rd_ptr_ = rtnds[0].mutable_resource_desc();
+  cost_model->PrepareStats(&machine_node);
+  EXPECT_TRUE(cost_model->GetTaskMappingForSingleTask(task_id).second.is_nil());
+  // Clean up.
+  cost_model->RemoveTask(task_id);
+  delete equiv_classes;
+  for (uint32_t i = 0; i < 2; ++i) {
+    cost_model->resource_map_.get()->erase(res_ids[i]);
+    delete rss[i];
+  }
+}
+
 TEST_F(CpuCostModelTest, GatherStats) {
   // Create machine Machine1.
   ResourceID_t res_id1 = GenerateResourceID("Machine1");
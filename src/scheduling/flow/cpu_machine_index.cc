@@ -0,0 +1,346 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "scheduling/flow/cpu_machine_index.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <cstdlib>
+
+#include "misc/map-util.h"
+#include "misc/utils.h"
+#include "scheduling/label_utils.h"
+
+namespace firmament {
+
+using scheduler::CompiledLabelSelector;
+using scheduler::CompiledLabelSelectors;
+using scheduler::CompiledNode;
+using scheduler::CompiledTaskConstraints;
+
+CpuMachineIndex::CpuMachineIndex() {
+}
+
+void CpuMachineIndex::AddMachine(ResourceID_t res_id,
+                                 const ResourceDescriptor& rd) {
+  if (free_slots_.empty()) {
+    Grow();
+  }
+  uint64_t slot = free_slots_.back();
+  free_slots_.pop_back();
+  CHECK(InsertIfNotPresent(&slot_for_machine_, res_id, slot));
+  res_ids_[slot] = res_id;
+  SetBit(slot, true, &used_);
+  SetLabels(slot, rd);
+  SetResources(slot, AsCpuMemResVector(rd.available_resources()));
+}
+
+void CpuMachineIndex::RemoveMachine(ResourceID_t res_id) {
+  uint64_t* slot_ptr = FindOrNull(slot_for_machine_, res_id);
+  CHECK_NOTNULL(slot_ptr);
+  uint64_t slot = *slot_ptr;
+  ClearLabels(slot);
+  SetResources(slot, CpuMemResVector_t());
+  SetBit(slot, false, &used_);
+  free_slots_.push_back(slot);
+  slot_for_machine_.erase(res_id);
+}
+
+void CpuMachineIndex::UpdateMachine(ResourceID_t res_id,
+                                    const ResourceDescriptor& rd) {
+  uint64_t* slot_ptr = FindOrNull(slot_for_machine_, res_id);
+  CHECK_NOTNULL(slot_ptr);
+  ClearLabels(*slot_ptr);
+  SetLabels(*slot_ptr, rd);
+  SetResources(*slot_ptr, AsCpuMemResVector(rd.available_resources()));
+}
+
+void CpuMachineIndex::UpdateMachineResources(
+    ResourceID_t res_id,
+    const ResourceVector& available_resources) {
+  uint64_t* slot_ptr = FindOrNull(slot_for_machine_, res_id);
+  CHECK_NOTNULL(slot_ptr);
+  SetResources(*slot_ptr, AsCpuMemResVector(available_resources));
+}
+
+void CpuMachineIndex::EligibleMachines(
+    const CompiledTaskConstraints* constraints,
+    const CpuMemResVector_t& request,
+    vector<ResourceID_t>* machines) const {
+  CHECK_NOTNULL(machines);
+  SlotBitmap_t slots = used_;
+  if (constraints) {
+    FilterBySelectors(constraints->node_selector(), &slots);
+    if (constraints->has_required_terms()) {
+      // The machines must satisfy one of the terms.
+      SlotBitmap_t term_slots(slots.size(), 0);
+      for (const auto& term : constraints->required_terms()) {
+        SlotBitmap_t slots_for_term = slots;
+        FilterBySelectors(term, &slots_for_term);
+        for (uint64_t word = 0; word < slots.size(); ++word) {
+          term_slots[word] |= slots_for_term[word];
+        }
+      }
+      slots.swap(term_slots);
+    }
+  }
+  FilterByResources(request, &slots);
+  if (constraints) {
+    FilterByHardTaints(*constraints, &slots);
+  }
+  for (uint64_t word = 0; word < slots.size(); ++word) {
+    for (uint64_t bits = slots[word]; bits; bits &= bits - 1) {
+      uint64_t slot = word * kBitsPerWord + __builtin_ctzll(bits);
+      machines->push_back(res_ids_[slot]);
+    }
+  }
+}
+
+const CompiledNode& CpuMachineIndex::CompiledNodeFor(
+    ResourceID_t res_id) const {
+  const uint64_t* slot_ptr = FindOrNull(slot_for_machine_, res_id);
+  CHECK_NOTNULL(slot_ptr);
+  return nodes_[*slot_ptr];
+}
+
+CpuMemResVector_t CpuMachineIndex::AsCpuMemResVector(
+    const ResourceVector& resources) {
+  CpuMemResVector_t res_vector;
+  res_vector.cpu_cores_ = static_cast<uint64_t>(resources.cpu_cores());
+  res_vector.ram_cap_ = static_cast<uint64_t>(resources.ram_cap());
+  res_vector.ephemeral_storage_ =
+      static_cast<uint64_t>(resources.ephemeral_storage());
+  return res_vector;
+}
+
+void CpuMachineIndex::SetBit(uint64_t slot, bool value, SlotBitmap_t* bitmap) {
+  uint64_t mask = 1ULL << (slot % kBitsPerWord);
+  if (value) {
+    (*bitmap)[slot / kBitsPerWord] |= mask;
+  } else {
+    (*bitmap)[slot / kBitsPerWord] &= ~mask;
+  }
+}
+
+void CpuMachineIndex::MatchValues(const LabelColumn& column,
+                                  const vector<StringID_t>& values,
+                                  SlotBitmap_t* matches) const {
+  matches->assign(used_.size(), 0);
+  for (StringID_t value : values) {
+    for (uint64_t word = 0; word < used_.size(); ++word) {
+      const StringID_t* entries = &column.values_[word * kBitsPerWord];
+      uint64_t bits = 0;
+#ifdef __SSE2__
+      // Compare four slots per instruction.
+      __m128i pattern = _mm_set1_epi32(static_cast<int32_t>(value));
+      for (uint64_t i = 0; i < kBitsPerWord; i += 4) {
+        __m128i block = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(entries + i));
+        __m128i equal = _mm_cmpeq_epi32(block, pattern);
+        bits |= static_cast<uint64_t>(
+            _mm_movemask_ps(_mm_castsi128_ps(equal))) << i;
+      }
+#else
+      for (uint64_t i = 0; i < kBitsPerWord; ++i) {
+        bits |= static_cast<uint64_t>(entries[i] == value) << i;
+      }
+#endif
+      (*matches)[word] |= bits;
+    }
+  }
+}
+
+void CpuMachineIndex::MatchSelector(const CompiledLabelSelector& selector,
+                                    SlotBitmap_t* matches) const {
+  const LabelColumn* column = FindOrNull(label_columns_, selector.key_);
+  bool negate = selector.type_ == LabelSelector::NOT_IN_SET ||
+    selector.type_ == LabelSelector::NOT_EXISTS_KEY;
+  if (!column) {
+    // No machine has the label key.
+    matches->assign(used_.size(), negate ? ~0ULL : 0);
+    return;
+  }
+  switch (selector.type_) {
+    case LabelSelector::IN_SET:
+    case LabelSelector::NOT_IN_SET:
+      MatchValues(*column, selector.values_, matches);
+      break;
+    case LabelSelector::EXISTS_KEY:
+    case LabelSelector::NOT_EXISTS_KEY: {
+      vector<StringID_t> no_value(1, StringInterner::kNoStringID);
+      MatchValues(*column, no_value, matches);
+      negate = !negate;
+      break;
+    }
+    case LabelSelector::GREATER_THAN:
+    case LabelSelector::LESSER_THAN: {
+      bool greater = selector.type_ == LabelSelector::GREATER_THAN;
+      matches->assign(used_.size(), 0);
+      for (uint64_t word = 0; word < used_.size(); ++word) {
+        for (uint64_t bits = column->numeric_[word]; bits; bits &= bits - 1) {
+          uint64_t slot = word * kBitsPerWord + __builtin_ctzll(bits);
+          int64_t number = column->numbers_[slot];
+          if (greater ? number > selector.bound_ : number < selector.bound_) {
+            SetBit(slot, true, matches);
+          }
+        }
+      }
+      break;
+    }
+    default:
+      LOG(FATAL) << "Unsupported selector type: " << selector.type_;
+  }
+  if (negate) {
+    for (auto& bits : *matches) {
+      bits = ~bits;
+    }
+  }
+}
+
+void CpuMachineIndex::FilterBySelectors(
+    const CompiledLabelSelectors& selectors,
+    SlotBitmap_t* slots) const {
+  SlotBitmap_t matches;
+  for (const auto& selector : selectors.selectors()) {
+    MatchSelector(selector, &matches);
+    uint64_t remaining = 0;
+    for (uint64_t word = 0; word < slots->size(); ++word) {
+      (*slots)[word] &= matches[word];
+      remaining |= (*slots)[word];
+    }
+    if (!remaining) {
+      return;
+    }
+  }
+}
+
+void CpuMachineIndex::FilterByResources(const CpuMemResVector_t& request,
+                                        SlotBitmap_t* slots) const {
+  for (uint64_t word = 0; word < slots->size(); ++word) {
+    if (!(*slots)[word]) {
+      continue;
+    }
+    uint64_t first_slot = word * kBitsPerWord;
+    const uint64_t* cpu_cores = &available_cpu_cores_[first_slot];
+    const uint64_t* ram_cap = &available_ram_cap_[first_slot];
+    const uint64_t* ephemeral_storage =
+      &available_ephemeral_storage_[first_slot];
+    uint64_t fits = 0;
+    // Branch-free, so that the compiler can vectorize the loop.
+    for (uint64_t i = 0; i < kBitsPerWord; ++i) {
+      fits |= static_cast<uint64_t>(
+          (request.cpu_cores_ < cpu_cores[i]) &
+          (request.ram_cap_ < ram_cap[i]) &
+          (request.ephemeral_storage_ < ephemeral_storage[i])) << i;
+    }
+    (*slots)[word] &= fits;
+  }
+}
+
+void CpuMachineIndex::FilterByHardTaints(
+    const CompiledTaskConstraints& constraints,
+    SlotBitmap_t* slots) const {
+  for (uint64_t word = 0; word < slots->size(); ++word) {
+    for (uint64_t bits = (*slots)[word] & hard_tainted_[word]; bits;
+         bits &= bits - 1) {
+      uint64_t slot = word * kBitsPerWord + __builtin_ctzll(bits);
+      if (!constraints.ToleratesHardTaints(nodes_[slot])) {
+        SetBit(slot, false, slots);
+      }
+    }
+  }
+}
+
+void CpuMachineIndex::Grow() {
+  uint64_t first_slot = res_ids_.size();
+  uint64_t num_slots = first_slot + kBitsPerWord;
+  res_ids_.resize(num_slots);
+  nodes_.resize(num_slots);
+  used_.push_back(0);
+  hard_tainted_.push_back(0);
+  for (auto& key_column : label_columns_) {
+    LabelColumn& column = key_column.second;
+    column.values_.resize(num_slots, StringInterner::kNoStringID);
+    column.numbers_.resize(num_slots, 0);
+    column.numeric_.push_back(0);
+  }
+  available_cpu_cores_.resize(num_slots, 0);
+  available_ram_cap_.resize(num_slots, 0);
+  available_ephemeral_storage_.resize(num_slots, 0);
+  // Hand out the lowest slots first.
+  for (uint64_t slot = num_slots; slot > first_slot; --slot) {
+    free_slots_.push_back(slot - 1);
+  }
+}
+
+void CpuMachineIndex::SetLabels(uint64_t slot, const ResourceDescriptor& rd) {
+  nodes_[slot] = CompiledNode(rd);
+  const CompiledNode& node = nodes_[slot];
+  for (const auto& label : node.labels()) {
+    LabelColumn& column = label_columns_[label.first];
+    if (column.values_.empty()) {
+      column.values_.resize(res_ids_.size(), StringInterner::kNoStringID);
+      column.numbers_.resize(res_ids_.size(), 0);
+      column.numeric_.resize(used_.size(), 0);
+    }
+    column.values_[slot] = label.second;
+    // Parse the value like stoi does, i.e., ignoring trailing characters.
+    const string& value = StringInterner::Global()->String(label.second);
+    char* end;
+    column.numbers_[slot] = strtoll(value.c_str(), &end, 10);
+    SetBit(slot, end != value.c_str(), &column.numeric_);
+    column.num_machines_++;
+  }
+  bool has_hard_taints = false;
+  for (const auto& taint : node.taints()) {
+    if (taint.effect_ == scheduler::TAINT_EFFECT_NO_SCHEDULE ||
+        taint.effect_ == scheduler::TAINT_EFFECT_NO_EXECUTE) {
+      has_hard_taints = true;
+    }
+  }
+  SetBit(slot, has_hard_taints, &hard_tainted_);
+}
+
+void CpuMachineIndex::ClearLabels(uint64_t slot) {
+  for (const auto& label : nodes_[slot].labels()) {
+    auto it = label_columns_.find(label.first);
+    CHECK(it != label_columns_.end());
+    LabelColumn& column = it->second;
+    if (--column.num_machines_ == 0) {
+      label_columns_.erase(it);
+      continue;
+    }
+    column.values_[slot] = StringInterner::kNoStringID;
+    SetBit(slot, false, &column.numeric_);
+  }
+  SetBit(slot, false, &hard_tainted_);
+  nodes_[slot] = CompiledNode();
+}
+
+void CpuMachineIndex::SetResources(uint64_t slot,
+                                   const CpuMemResVector_t& available) {
+  available_cpu_cores_[slot] = available.cpu_cores_;
+  available_ram_cap_[slot] = available.ram_cap_;
+  available_ephemeral_storage_[slot] = available.ephemeral_storage_;
+}
+
+}  // namespace firmament
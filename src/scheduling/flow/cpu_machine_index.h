@@ -0,0 +1,155 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Columnar table of the machines known to the CPU cost model. Every machine
+// has a dense slot; for every label key there is a column with the
+// (interned) label value of each slot, and there are columns for the
+// available resources. The machines that satisfy a task equivalence class's
+// node selector, required node affinity, hard taint and resource
+// constraints are found with one bulk filter over the columns, which
+// produces a bitmap of slots 64 machines at a time.
+
+#ifndef FIRMAMENT_SCHEDULING_FLOW_CPU_MACHINE_INDEX_H
+#define FIRMAMENT_SCHEDULING_FLOW_CPU_MACHINE_INDEX_H
+
+#include <vector>
+
+#include "base/common.h"
+#include "base/resource_desc.pb.h"
+#include "base/types.h"
+#include "scheduling/compiled_selector.h"
+
+namespace firmament {
+
+struct CpuMemResVector_t {
+  uint64_t cpu_cores_;
+  uint64_t ram_cap_;
+  uint64_t ephemeral_storage_;
+};
+
+class CpuMachineIndex {
+ public:
+  CpuMachineIndex();
+
+  /**
+   * Indexes a new machine.
+   * @param res_id the resource id of the machine
+   * @param rd the machine's resource descriptor
+   */
+  void AddMachine(ResourceID_t res_id, const ResourceDescriptor& rd);
+  void RemoveMachine(ResourceID_t res_id);
+
+  /**
+   * Re-indexes the labels, the taints and the available resources of a
+   * machine that is already indexed.
+   */
+  void UpdateMachine(ResourceID_t res_id, const ResourceDescriptor& rd);
+
+  /**
+   * Re-indexes the available resources of a machine that is already indexed.
+   */
+  void UpdateMachineResources(ResourceID_t res_id,
+                              const ResourceVector& available_resources);
+
+  /**
+   * Gets the machines that satisfy the node selector, the required node
+   * affinity and the hard taint restrictions of a task equivalence class,
+   * and that have strictly more available resources than it requests.
+   * @param constraints the compiled constraints of the EC, or NULL if the
+   * machines should only be filtered by resources
+   * @param request the resources requested by a task of the EC
+   * @param machines vector to which the machines are appended, in slot order
+   */
+  void EligibleMachines(const scheduler::CompiledTaskConstraints* constraints,
+                        const CpuMemResVector_t& request,
+                        vector<ResourceID_t>* machines) const;
+
+  /**
+   * Returns the compiled labels and taints of an indexed machine.
+   */
+  const scheduler::CompiledNode& CompiledNodeFor(ResourceID_t res_id) const;
+
+  inline uint64_t num_machines() const {
+    return slot_for_machine_.size();
+  }
+
+ private:
+  // One bit per slot.
+  typedef vector<uint64_t> SlotBitmap_t;
+
+  struct LabelColumn {
+    // Label value of each slot, or kNoStringID if the machine in the slot
+    // does not have the label.
+    vector<StringID_t> values_;
+    // Numeric label values, for Gt and Lt selectors; only valid for the slots
+    // set in numeric_.
+    vector<int64_t> numbers_;
+    SlotBitmap_t numeric_;
+    // Number of machines that have the label.
+    uint64_t num_machines_;
+    LabelColumn() : num_machines_(0) {}
+  };
+
+  static const uint64_t kBitsPerWord = 64;
+
+  static CpuMemResVector_t AsCpuMemResVector(
+      const ResourceVector& resources);
+  static void SetBit(uint64_t slot, bool value, SlotBitmap_t* bitmap);
+  // Returns a bitmap of the slots for which the column's value is one of the
+  // values.
+  void MatchValues(const LabelColumn& column,
+                   const vector<StringID_t>& values,
+                   SlotBitmap_t* matches) const;
+  // Returns a bitmap of the slots whose machines satisfy the selector. It may
+  // have bits set for free slots.
+  void MatchSelector(const scheduler::CompiledLabelSelector& selector,
+                     SlotBitmap_t* matches) const;
+  // Clears the bits of the slots whose machines do not satisfy all of the
+  // selectors.
+  void FilterBySelectors(const scheduler::CompiledLabelSelectors& selectors,
+                         SlotBitmap_t* slots) const;
+  void FilterByResources(const CpuMemResVector_t& request,
+                         SlotBitmap_t* slots) const;
+  void FilterByHardTaints(const scheduler::CompiledTaskConstraints& constraints,
+                          SlotBitmap_t* slots) const;
+  void Grow();
+  void SetLabels(uint64_t slot, const ResourceDescriptor& rd);
+  void ClearLabels(uint64_t slot);
+  void SetResources(uint64_t slot, const CpuMemResVector_t& available);
+
+  vector<ResourceID_t> res_ids_;
+  vector<scheduler::CompiledNode> nodes_;
+  vector<uint64_t> free_slots_;
+  unordered_map<ResourceID_t, uint64_t, boost::hash<boost::uuids::uuid>>
+      slot_for_machine_;
+  // Slots that hold a machine.
+  SlotBitmap_t used_;
+  // Slots whose machines have at least one NoSchedule or NoExecute taint.
+  SlotBitmap_t hard_tainted_;
+  unordered_map<StringID_t, LabelColumn> label_columns_;
+  // Available resources of each slot.
+  vector<uint64_t> available_cpu_cores_;
+  vector<uint64_t> available_ram_cap_;
+  vector<uint64_t> available_ephemeral_storage_;
+};
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SCHEDULING_FLOW_CPU_MACHINE_INDEX_H
@@ -0,0 +1,205 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Tests for the CPU cost model's machine index.
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+#include "base/common.h"
+#include "misc/utils.h"
+#include "scheduling/flow/cpu_machine_index.h"
+
+namespace firmament {
+
+class CpuMachineIndexTest : public ::testing::Test {
+ protected:
+  CpuMachineIndexTest() {
+    request_.cpu_cores_ = 1;
+    request_.ram_cap_ = 100;
+    request_.ephemeral_storage_ = 10;
+  }
+
+  ResourceID_t AddMachine(const string& name, const string& zone,
+                          uint64_t cpu_cores) {
+    ResourceID_t res_id = GenerateResourceID(name);
+    ResourceDescriptor rd;
+    rd.set_uuid(to_string(res_id));
+    rd.set_type(ResourceDescriptor::RESOURCE_MACHINE);
+    if (!zone.empty()) {
+      Label* label_ptr = rd.add_labels();
+      label_ptr->set_key("zone");
+      label_ptr->set_value(zone);
+    }
+    rd.mutable_available_resources()->set_cpu_cores(cpu_cores);
+    rd.mutable_available_resources()->set_ram_cap(1000);
+    rd.mutable_available_resources()->set_ephemeral_storage(1000);
+    index_.AddMachine(res_id, rd);
+    rds_[res_id] = rd;
+    return res_id;
+  }
+
+  vector<ResourceID_t> Eligible(const TaskDescriptor* td_ptr) {
+    vector<ResourceID_t> eligible;
+    if (td_ptr) {
+      scheduler::CompiledTaskConstraints constraints(*td_ptr);
+      index_.EligibleMachines(&constraints, request_, &eligible);
+    } else {
+      index_.EligibleMachines(NULL, request_, &eligible);
+    }
+    sort(eligible.begin(), eligible.end());
+    return eligible;
+  }
+
+  vector<ResourceID_t> Sorted(vector<ResourceID_t> res_ids) {
+    sort(res_ids.begin(), res_ids.end());
+    return res_ids;
+  }
+
+  CpuMachineIndex index_;
+  CpuMemResVector_t request_;
+  unordered_map<ResourceID_t, ResourceDescriptor,
+                boost::hash<boost::uuids::uuid>> rds_;
+};
+
+TEST_F(CpuMachineIndexTest, LabelSelectors) {
+  ResourceID_t m1 = AddMachine("m1", "a", 10);
+  ResourceID_t m2 = AddMachine("m2", "b", 10);
+  ResourceID_t m3 = AddMachine("m3", "", 10);
+  EXPECT_EQ(index_.num_machines(), 3);
+  TaskDescriptor td;
+  EXPECT_EQ(Eligible(&td), Sorted({m1, m2, m3}));
+  LabelSelector* selector = td.add_label_selectors();
+  selector->set_type(LabelSelector::IN_SET);
+  selector->set_key("zone");
+  selector->add_values("a");
+  EXPECT_EQ(Eligible(&td), Sorted({m1}));
+  selector->add_values("b");
+  EXPECT_EQ(Eligible(&td), Sorted({m1, m2}));
+  selector->set_type(LabelSelector::EXISTS_KEY);
+  EXPECT_EQ(Eligible(&td), Sorted({m1, m2}));
+  // Machines without the label key satisfy NOT_IN_SET selectors.
+  selector->set_type(LabelSelector::NOT_IN_SET);
+  EXPECT_EQ(Eligible(&td), Sorted({m3}));
+  selector->set_type(LabelSelector::NOT_EXISTS_KEY);
+  EXPECT_EQ(Eligible(&td), Sorted({m3}));
+  selector->set_type(LabelSelector::IN_SET);
+  selector->clear_values();
+  selector->add_values("c");
+  EXPECT_TRUE(Eligible(&td).empty());
+}
+
+TEST_F(CpuMachineIndexTest, NodeAffinity) {
+  ResourceID_t m1 = AddMachine("m1", "a", 10);
+  ResourceID_t m2 = AddMachine("m2", "b", 10);
+  AddMachine("m3", "", 10);
+  TaskDescriptor td;
+  NodeSelector* node_selector = td.mutable_affinity()
+      ->mutable_node_affinity()
+      ->mutable_requiredduringschedulingignoredduringexecution();
+  // The machines must match one of the two terms.
+  for (const string& zone : {"a", "b"}) {
+    NodeSelectorRequirement* requirement =
+        node_selector->add_nodeselectorterms()->add_matchexpressions();
+    requirement->set_key("zone");
+    requirement->set_operator_("In");
+    requirement->add_values(zone);
+  }
+  EXPECT_EQ(Eligible(&td), Sorted({m1, m2}));
+}
+
+TEST_F(CpuMachineIndexTest, TaintsAndResources) {
+  ResourceID_t m1 = AddMachine("m1", "", 10);
+  ResourceID_t m2 = AddMachine("m2", "", 10);
+  ResourceID_t m3 = AddMachine("m3", "", 1);
+  // m3 does not have strictly more CPU than requested.
+  TaskDescriptor td;
+  EXPECT_EQ(Eligible(&td), Sorted({m1, m2}));
+  EXPECT_EQ(Eligible(NULL), Sorted({m1, m2}));
+  ResourceVector available = rds_[m3].available_resources();
+  available.set_cpu_cores(2);
+  index_.UpdateMachineResources(m3, available);
+  EXPECT_EQ(Eligible(&td), Sorted({m1, m2, m3}));
+  // Tasks without tolerations don't fit on machines with hard taints.
+  Taint* taint_ptr = rds_[m1].add_taints();
+  taint_ptr->set_key("dedicated");
+  taint_ptr->set_effect("NoSchedule");
+  index_.UpdateMachine(m1, rds_[m1]);
+  EXPECT_EQ(Eligible(&td), Sorted({m2, m3}));
+  EXPECT_EQ(Eligible(NULL), Sorted({m1, m2, m3}));
+  index_.RemoveMachine(m2);
+  EXPECT_EQ(index_.num_machines(), 2);
+  EXPECT_EQ(Eligible(&td), Sorted({m3}));
+  // Removed slots are reused.
+  ResourceID_t m4 = AddMachine("m4", "", 10);
+  EXPECT_EQ(Eligible(&td), Sorted({m3, m4}));
+}
+
+TEST_F(CpuMachineIndexTest, NumericSelectors) {
+  ResourceID_t m1 = AddMachine("m1", "3", 10);
+  ResourceID_t m2 = AddMachine("m2", "12", 10);
+  AddMachine("m3", "b", 10);
+  TaskDescriptor td;
+  LabelSelector* selector = td.add_label_selectors();
+  selector->set_type(LabelSelector::GREATER_THAN);
+  selector->set_key("zone");
+  selector->add_values("5");
+  EXPECT_EQ(Eligible(&td), Sorted({m2}));
+  // Machines with non-numeric values do not match.
+  selector->set_type(LabelSelector::LESSER_THAN);
+  EXPECT_EQ(Eligible(&td), Sorted({m1}));
+}
+
+TEST_F(CpuMachineIndexTest, ManyMachines) {
+  vector<ResourceID_t> zone_a;
+  vector<ResourceID_t> all;
+  for (uint64_t i = 0; i < 200; ++i) {
+    string zone = i % 3 == 0 ? "a" : "b";
+    ResourceID_t res_id = AddMachine("m" + to_string(i), zone, 10);
+    all.push_back(res_id);
+    if (i % 3 == 0) {
+      zone_a.push_back(res_id);
+    }
+  }
+  TaskDescriptor td;
+  LabelSelector* selector = td.add_label_selectors();
+  selector->set_type(LabelSelector::IN_SET);
+  selector->set_key("zone");
+  selector->add_values("a");
+  EXPECT_EQ(Eligible(&td), Sorted(zone_a));
+  EXPECT_EQ(Eligible(NULL), Sorted(all));
+  // The label column goes away with the last machine that has the key.
+  for (const auto& res_id : all) {
+    index_.RemoveMachine(res_id);
+  }
+  EXPECT_EQ(index_.num_machines(), 0);
+  EXPECT_TRUE(Eligible(&td).empty());
+  ResourceID_t m = AddMachine("m", "", 10);
+  selector->set_type(LabelSelector::NOT_IN_SET);
+  EXPECT_EQ(Eligible(&td), Sorted({m}));
+}
+
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,172 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Binary wire format used to communicate with solvers that support it.
+// Every message starts with a DIMACSBinaryHeader, which is followed by
+// num_records fixed-width records. Graphs and graph changes are sent as
+// DIMACSBinaryRecords, and solver results come back as
+// DIMACSBinaryResultRecords. All fields are in host byte order, as the solver
+// always runs on the same machine.
+//
+// When the graph is shared via memory (see solver_shared_memory.h), the
+// region starts with a SolverSharedMemoryHeader, followed by node_capacity
+// SolverSharedNodes indexed by node id, arc_capacity SolverSharedArcs and
+// arc_capacity uint64_t flows, at the offsets given in the header. The pipe
+// then only carries a DIMACS_MESSAGE_SHARED_GRAPH message whose
+// DIMACSBinarySlotRecords list the node and arc slots that changed.
+// NOTE: Do not reorder fields or change the record codes without bumping
+// DIMACS_BINARY_VERSION, because it will affect the communication with the
+// solver.
+
+#ifndef FIRMAMENT_SCHEDULING_FLOW_DIMACS_BINARY_FORMAT_H
+#define FIRMAMENT_SCHEDULING_FLOW_DIMACS_BINARY_FORMAT_H
+
+#include <stdint.h>
+
+namespace firmament {
+
+// "FDMB" in ASCII.
+const uint32_t DIMACS_BINARY_MAGIC = 0x424d4446;
+const uint16_t DIMACS_BINARY_VERSION = 1;
+
+enum DIMACSBinaryMessageType {
+  // Full graph or incremental graph changes (firmament -> solver).
+  DIMACS_MESSAGE_GRAPH = 0,
+  // Asks a solver running in daemon mode to terminate (firmament -> solver).
+  DIMACS_MESSAGE_END_OF_STREAM = 1,
+  // Flow on the arcs or task to PU assignments (solver -> firmament).
+  DIMACS_MESSAGE_RESULT = 2,
+  // The graph in the shared memory region has changed (firmament -> solver).
+  DIMACS_MESSAGE_SHARED_GRAPH = 3,
+};
+
+// The record codes match the line prefixes of the text format.
+enum DIMACSBinaryRecordType {
+  // num_nodes in src, num_arcs in dst.
+  DIMACS_RECORD_PROBLEM = 'p',
+  // Node id in src, excess in cost and DIMACS node type in type.
+  DIMACS_RECORD_ADD_NODE = 'n',
+  // Node id in src.
+  DIMACS_RECORD_REMOVE_NODE = 'r',
+  // Arc with its FlowGraphArcType in type.
+  DIMACS_RECORD_NEW_ARC = 'a',
+  // Arc with its FlowGraphArcType in type and its previous cost in old_cost.
+  DIMACS_RECORD_CHANGE_ARC = 'x',
+  // Flow of value on the arc from src to dst.
+  DIMACS_RECORD_FLOW = 'f',
+  // Task node src is assigned to PU node dst.
+  DIMACS_RECORD_TASK_MAPPING = 'm',
+  // Total cost of the solution in value.
+  DIMACS_RECORD_SOLUTION_COST = 's',
+  // Algorithm runtime (in u-sec) in value.
+  DIMACS_RECORD_ALGORITHM_TIME = 't',
+  // Node slot index in the shared memory region has changed.
+  DIMACS_RECORD_NODE_SLOT = 'N',
+  // Arc slot index in the shared memory region has changed.
+  DIMACS_RECORD_ARC_SLOT = 'A',
+};
+
+struct DIMACSBinaryHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t message_type;
+  uint64_t num_records;
+};
+
+struct DIMACSBinaryRecord {
+  uint8_t record_type;
+  uint8_t padding[3];
+  uint32_t type;
+  uint64_t src;
+  uint64_t dst;
+  uint64_t cap_lower_bound;
+  uint64_t cap_upper_bound;
+  int64_t cost;
+  int64_t old_cost;
+};
+
+struct DIMACSBinaryResultRecord {
+  uint8_t record_type;
+  uint8_t padding[7];
+  uint64_t src;
+  uint64_t dst;
+  uint64_t value;
+};
+
+struct DIMACSBinarySlotRecord {
+  uint8_t record_type;
+  uint8_t padding[7];
+  uint64_t index;
+};
+
+struct SolverSharedMemoryHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t padding;
+  // Incremented every time the graph in the region is updated.
+  uint64_t generation;
+  // The same values as in the DIMACS problem line.
+  uint64_t num_nodes;
+  uint64_t num_arcs;
+  // Arc slots at or beyond this index have never been used.
+  uint64_t num_arc_slots;
+  uint64_t node_capacity;
+  uint64_t arc_capacity;
+  uint64_t nodes_offset;
+  uint64_t arcs_offset;
+  uint64_t flows_offset;
+};
+
+struct SolverSharedNode {
+  int64_t excess;
+  // DIMACS node type.
+  uint32_t type;
+  uint32_t in_use;
+};
+
+struct SolverSharedArc {
+  uint64_t src;
+  uint64_t dst;
+  uint64_t cap_lower_bound;
+  uint64_t cap_upper_bound;
+  int64_t cost;
+  // FlowGraphArcType.
+  uint32_t type;
+  uint32_t in_use;
+};
+
+static_assert(sizeof(DIMACSBinaryHeader) == 16,
+              "DIMACSBinaryHeader must not contain implicit padding");
+static_assert(sizeof(DIMACSBinaryRecord) == 56,
+              "DIMACSBinaryRecord must not contain implicit padding");
+static_assert(sizeof(DIMACSBinaryResultRecord) == 32,
+              "DIMACSBinaryResultRecord must not contain implicit padding");
+static_assert(sizeof(DIMACSBinarySlotRecord) == 16,
+              "DIMACSBinarySlotRecord must not contain implicit padding");
+static_assert(sizeof(SolverSharedMemoryHeader) == 80,
+              "SolverSharedMemoryHeader must not contain implicit padding");
+static_assert(sizeof(SolverSharedNode) == 16,
+              "SolverSharedNode must not contain implicit padding");
+static_assert(sizeof(SolverSharedArc) == 48,
+              "SolverSharedArc must not contain implicit padding");
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SCHEDULING_FLOW_DIMACS_BINARY_FORMAT_H
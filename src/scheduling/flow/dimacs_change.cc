@@ -0,0 +1,92 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "scheduling/flow/dimacs_change.h"
+
+namespace firmament {
+
+DIMACSChange DIMACSChange::AddNode(const FlowGraphNode& node) {
+  DIMACSChange change = DIMACSChange();
+  change.comment_ = "";
+  change.op_ = DIMACS_RECORD_ADD_NODE;
+  change.type_ = GetDIMACSNodeType(node.type_);
+  change.src_ = node.id_;
+  change.cost_ = node.excess_;
+  return change;
+}
+
+DIMACSChange DIMACSChange::RemoveNode(const FlowGraphNode& node) {
+  DIMACSChange change = DIMACSChange();
+  change.comment_ = "";
+  change.op_ = DIMACS_RECORD_REMOVE_NODE;
+  change.src_ = node.id_;
+  return change;
+}
+
+DIMACSChange DIMACSChange::NewArc(const FlowGraphArc& arc) {
+  DIMACSChange change = DIMACSChange();
+  change.comment_ = "";
+  change.op_ = DIMACS_RECORD_NEW_ARC;
+  change.type_ = arc.type_;
+  change.src_ = arc.src_;
+  change.dst_ = arc.dst_;
+  change.cap_lower_bound_ = arc.cap_lower_bound_;
+  change.cap_upper_bound_ = arc.cap_upper_bound_;
+  change.cost_ = arc.cost_;
+  return change;
+}
+
+DIMACSChange DIMACSChange::ChangeArc(const FlowGraphArc& arc,
+                                     int64_t old_cost) {
+  DIMACSChange change = NewArc(arc);
+  change.op_ = DIMACS_RECORD_CHANGE_ARC;
+  change.old_cost_ = old_cost;
+  return change;
+}
+
+bool DIMACSChange::SameEffect(const DIMACSChange& other) const {
+  return op_ == other.op_ && type_ == other.type_ && src_ == other.src_ &&
+    dst_ == other.dst_ && cap_lower_bound_ == other.cap_lower_bound_ &&
+    cap_upper_bound_ == other.cap_upper_bound_ && cost_ == other.cost_ &&
+    old_cost_ == other.old_cost_;
+}
+
+DIMACSNodeType GetDIMACSNodeType(FlowNodeType type) {
+  if (type == FlowNodeType::PU) {
+    return DIMACS_NODE_PU;
+  } else if (type == FlowNodeType::MACHINE) {
+    return DIMACS_NODE_MACHINE;
+  } else if (type == FlowNodeType::NUMA_NODE ||
+             type == FlowNodeType::SOCKET ||
+             type == FlowNodeType::CACHE ||
+             type == FlowNodeType::CORE) {
+    return DIMACS_NODE_INTERMEDIATE_RES;
+  } else if (type == FlowNodeType::SINK) {
+    return DIMACS_NODE_SINK;
+  } else if (type == FlowNodeType::UNSCHEDULED_TASK ||
+             type == FlowNodeType::SCHEDULED_TASK ||
+             type == FlowNodeType::ROOT_TASK) {
+    return DIMACS_NODE_TASK;
+  } else {
+    return DIMACS_NODE_OTHER;
+  }
+}
+
+} // namespace firmament
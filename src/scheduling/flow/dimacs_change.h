@@ -18,44 +18,67 @@
  * permissions and limitations under the License.
  */
 
+// A change to the flow graph, recorded by the FlowGraphChangeManager between
+// two scheduling rounds and sent to incremental solvers. Changes are plain
+// fixed-size records; the exporter only renders them as DIMACS text when the
+// text format is used.
+
 #ifndef FIRMAMENT_SCHEDULING_FLOW_DIMACS_CHANGE_H
 #define FIRMAMENT_SCHEDULING_FLOW_DIMACS_CHANGE_H
 
-#include <string>
-
 #include "base/types.h"
+#include "scheduling/flow/dimacs_binary_format.h"
+#include "scheduling/flow/flow_graph_arc.h"
+#include "scheduling/flow/flow_graph_node.h"
 
 namespace firmament {
 
-class DIMACSChange {
- public:
-  virtual ~DIMACSChange() {
-  }
-  virtual const string& comment() const {
-    return comment_;
-  }
-  virtual void set_comment(const char* comment) {
-    if (comment) {
-      comment_ = comment;
-    }
-  }
+struct DIMACSChange {
+  // DIMACS_RECORD_ADD_NODE, DIMACS_RECORD_REMOVE_NODE, DIMACS_RECORD_NEW_ARC
+  // or DIMACS_RECORD_CHANGE_ARC. The fields are used as in the binary
+  // DIMACSBinaryRecords.
+  uint8_t op_;
+  // DIMACS node type of added nodes, FlowGraphArcType of arcs.
+  uint32_t type_;
+  // Node id of node changes.
+  uint64_t src_;
+  uint64_t dst_;
+  uint64_t cap_lower_bound_;
+  uint64_t cap_upper_bound_;
+  // Excess of added nodes.
+  int64_t cost_;
+  int64_t old_cost_;
+  // Never NULL. Owned by the FlowGraphChangeManager, which frees it when the
+  // changes are reset.
+  const char* comment_;
+
+  static DIMACSChange AddNode(const FlowGraphNode& node);
+  static DIMACSChange RemoveNode(const FlowGraphNode& node);
+  static DIMACSChange NewArc(const FlowGraphArc& arc);
+  static DIMACSChange ChangeArc(const FlowGraphArc& arc, int64_t old_cost);
 
-  const string GenerateChangeDescription() const {
-    if (!comment_.empty()) {
-      stringstream ss;
-      ss << "c " << comment_ << "\n";
-      return ss.str();
-    } else {
-      return "";
-    }
+  inline bool is_arc_change() const {
+    return op_ == DIMACS_RECORD_NEW_ARC || op_ == DIMACS_RECORD_CHANGE_ARC;
   }
 
-  virtual const std::string GenerateChange() const = 0;
+  // True if the changes have the same effect; comments are ignored.
+  bool SameEffect(const DIMACSChange& other) const;
+};
 
- protected:
-  string comment_;
+// Node type is used to construct the mapping of tasks to PUs in the solver.
+// NOTE: Do not reorder types because it will affect the communication with
+// the solver.
+enum DIMACSNodeType {
+  DIMACS_NODE_OTHER = 0,
+  DIMACS_NODE_TASK = 1,
+  DIMACS_NODE_PU = 2,
+  DIMACS_NODE_SINK = 3,
+  DIMACS_NODE_MACHINE = 4,
+  DIMACS_NODE_INTERMEDIATE_RES = 5
 };
 
+DIMACSNodeType GetDIMACSNodeType(FlowNodeType type);
+
 } // namespace firmament
 
 #endif // FIRMAMENT_SCHEDULING_FLOW_DIMACS_CHANGE_H
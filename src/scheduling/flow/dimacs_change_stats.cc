@@ -31,6 +31,11 @@ DIMACSChangeStats::DIMACSChangeStats() {
   arcs_added_ = 0;
   arcs_changed_ = 0;
   arcs_removed_ = 0;
+  changes_allocated_ = 0;
+  change_arena_bytes_ = 0;
+  change_arena_blocks_ = 0;
+  arc_pool_slabs_ = 0;
+  node_pool_slabs_ = 0;
   for (uint32_t chg_index = 0; chg_index < NUM_CHANGE_TYPES; ++chg_index) {
     num_changes_of_type_[chg_index] = 0;
   }
@@ -48,6 +53,11 @@ string DIMACSChangeStats::GetStatsString() const {
   for (uint32_t index = 0; index < NUM_CHANGE_TYPES; index++) {
     stats += "," + boost::lexical_cast<string>(num_changes_of_type_[index]);
   }
+  stats += "," + boost::lexical_cast<string>(changes_allocated_) + "," +
+    boost::lexical_cast<string>(change_arena_bytes_) + "," +
+    boost::lexical_cast<string>(change_arena_blocks_) + "," +
+    boost::lexical_cast<string>(arc_pool_slabs_) + "," +
+    boost::lexical_cast<string>(node_pool_slabs_);
   return stats;
 }
 
@@ -57,6 +67,11 @@ void DIMACSChangeStats::ResetStats() {
   arcs_added_ = 0;
   arcs_changed_ = 0;
   arcs_removed_ = 0;
+  changes_allocated_ = 0;
+  change_arena_bytes_ = 0;
+  change_arena_blocks_ = 0;
+  arc_pool_slabs_ = 0;
+  node_pool_slabs_ = 0;
   for (uint32_t index = 0; index < NUM_CHANGE_TYPES; index++) {
     num_changes_of_type_[index] = 0;
   }
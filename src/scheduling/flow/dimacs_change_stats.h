@@ -30,10 +30,6 @@
 
 namespace firmament {
 
-// Forward declaration, since DIMACSChange contains a DIMACSChangeStats
-// instance itself
-class DIMACSChange;
-
 enum DIMACSChangeType {
   ADD_TASK_NODE = 0,
   ADD_RESOURCE_NODE = 1,
@@ -80,6 +76,14 @@ struct DIMACSChangeStats {
   uint64_t arcs_changed_;
   uint64_t arcs_removed_;
   uint64_t num_changes_of_type_[NUM_CHANGE_TYPES];
+  // Allocator statistics. The number of change records recorded and the
+  // bytes their comments used are counted per round. The number of blocks and slabs
+  // are the totals held by the allocators at the end of the round.
+  uint64_t changes_allocated_;
+  uint64_t change_arena_bytes_;
+  uint64_t change_arena_blocks_;
+  uint64_t arc_pool_slabs_;
+  uint64_t node_pool_slabs_;
   DIMACSChangeStats();
   ~DIMACSChangeStats();
   string GetStatsString() const;
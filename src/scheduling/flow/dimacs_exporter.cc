@@ -24,90 +24,211 @@
 #include "scheduling/flow/dimacs_exporter.h"
 
 #include <string>
+#include <cinttypes>
+#include <cstdarg>
+#include <cstddef>
 #include <cstdio>
+#include <cstring>
 #include <boost/bind.hpp>
 
 #include "misc/pb_utils.h"
 
 namespace firmament {
 
-DIMACSExporter::DIMACSExporter() {
+DIMACSExporter::DIMACSExporter() : num_records_(0) {
 }
 
 void DIMACSExporter::Export(const FlowGraph& graph, FILE* stream) {
-  fprintf(stream, "c ===========================\n");
-  fflush(stream);
-  fprintf(stream, "p min %" PRIu64 " %" PRIu64 "\n",
-          graph.NumNodes(), graph.NumArcs());
-  fflush(stream);
-  fprintf(stream, "c ===========================\n");
-  fflush(stream);
-  fprintf(stream, "c === ALL NODES FOLLOW ===\n");
-  fflush(stream);
-  for (auto& id_node : graph.Nodes()) {
-    GenerateNode(*id_node.second, stream);
+  buffer_.clear();
+  AppendText("c ===========================\n");
+  AppendText("p min %" PRIu64 " %" PRIu64 "\n",
+             graph.NumNodes(), graph.NumArcs());
+  AppendText("c ===========================\n");
+  AppendText("c === ALL NODES FOLLOW ===\n");
+  for (const auto& node : graph.Nodes()) {
+    GenerateNode(*node);
   }
-  fprintf(stream, "c === ALL ARCS FOLLOW ===\n");
-  fflush(stream);
+  AppendText("c === ALL ARCS FOLLOW ===\n");
   for (const auto& arc : graph.Arcs()) {
-    GenerateArc(*arc, stream);
+    GenerateArc(*arc);
   }
   // Add end of iteration comment.
-  fprintf(stream, "c EOI\n");
-  fflush(stream);
+  AppendText("c EOI\n");
+  WriteBuffer(stream);
+}
+
+void DIMACSExporter::ExportBinary(const FlowGraph& graph, FILE* stream) {
+  StartBinaryMessage(DIMACS_MESSAGE_GRAPH);
+  buffer_.reserve(sizeof(DIMACSBinaryHeader) +
+                  (graph.Nodes().size() + graph.NumArcs() + 1) *
+                  sizeof(DIMACSBinaryRecord));
+  AppendRecord(DIMACS_RECORD_PROBLEM, 0, graph.NumNodes(), graph.NumArcs(),
+               0, 0, 0, 0);
+  for (const auto& node : graph.Nodes()) {
+    AppendRecord(DIMACS_RECORD_ADD_NODE, GetNodeType(*node), node->id_, 0, 0,
+                 0, node->excess_, 0);
+  }
+  for (const auto& arc : graph.Arcs()) {
+    AppendRecord(DIMACS_RECORD_NEW_ARC, arc->type_, arc->src_, arc->dst_,
+                 arc->cap_lower_bound_, arc->cap_upper_bound_, arc->cost_, 0);
+  }
+  WriteBinaryMessage(stream);
+}
+
+void DIMACSExporter::ExportBinaryEndOfStream(FILE* stream) {
+  StartBinaryMessage(DIMACS_MESSAGE_END_OF_STREAM);
+  WriteBinaryMessage(stream);
 }
 
-void DIMACSExporter::ExportIncremental(const vector<DIMACSChange*>& changes,
+void DIMACSExporter::ExportIncremental(const vector<DIMACSChange>& changes,
                                        FILE* stream) {
+  buffer_.clear();
   for (const auto& change : changes) {
-    fprintf(stream, "%s", change->GenerateChange().c_str());
-    fflush(stream);
+    AppendChange(change);
   }
   // Add end of iteration comment.
-  fprintf(stream, "c EOI\n");
-  fflush(stream);
+  AppendText("c EOI\n");
+  WriteBuffer(stream);
 }
 
-inline void DIMACSExporter::GenerateArc(const FlowGraphArc& arc, FILE* stream) {
-  fprintf(stream,
-          "a %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRId64 "\n",
-          arc.src_, arc.dst_, arc.cap_lower_bound_, arc.cap_upper_bound_,
-          arc.cost_);
-  fflush(stream);
+void DIMACSExporter::ExportIncrementalBinary(
+    const vector<DIMACSChange>& changes, FILE* stream) {
+  StartBinaryMessage(DIMACS_MESSAGE_GRAPH);
+  buffer_.reserve(sizeof(DIMACSBinaryHeader) +
+                  changes.size() * sizeof(DIMACSBinaryRecord));
+  // The changes already use the fields of the binary records.
+  for (const auto& change : changes) {
+    AppendRecord(change.op_, change.type_, change.src_, change.dst_,
+                 change.cap_lower_bound_, change.cap_upper_bound_,
+                 change.cost_, change.old_cost_);
+  }
+  WriteBinaryMessage(stream);
+}
+
+void DIMACSExporter::ExportSharedGraph(
+    const vector<DIMACSBinarySlotRecord>& updated_slots, FILE* stream) {
+  StartBinaryMessage(DIMACS_MESSAGE_SHARED_GRAPH);
+  buffer_.append(reinterpret_cast<const char*>(updated_slots.data()),
+                 updated_slots.size() * sizeof(DIMACSBinarySlotRecord));
+  num_records_ = updated_slots.size();
+  WriteBinaryMessage(stream);
+}
+
+inline void DIMACSExporter::AppendChange(const DIMACSChange& change) {
+  if (change.comment_ && change.comment_[0] != '\0') {
+    AppendText("c %s\n", change.comment_);
+  }
+  switch (change.op_) {
+    case DIMACS_RECORD_ADD_NODE:
+      AppendText("n %" PRIu64 " %" PRId64 " %u\n",
+                 change.src_, change.cost_, change.type_);
+      break;
+    case DIMACS_RECORD_REMOVE_NODE:
+      AppendText("r %" PRIu64 "\n", change.src_);
+      break;
+    case DIMACS_RECORD_NEW_ARC:
+      AppendText("a %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRId64
+                 " %u\n", change.src_, change.dst_, change.cap_lower_bound_,
+                 change.cap_upper_bound_, change.cost_, change.type_);
+      break;
+    case DIMACS_RECORD_CHANGE_ARC:
+      AppendText("x %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRId64
+                 " %u %" PRId64 "\n", change.src_, change.dst_,
+                 change.cap_lower_bound_, change.cap_upper_bound_,
+                 change.cost_, change.type_, change.old_cost_);
+      break;
+    default:
+      LOG(FATAL) << "Unexpected type of change: "
+                 << static_cast<uint32_t>(change.op_);
+  }
+}
+
+inline void DIMACSExporter::AppendRecord(uint8_t record_type, uint32_t type,
+                                         uint64_t src, uint64_t dst,
+                                         uint64_t cap_lower_bound,
+                                         uint64_t cap_upper_bound,
+                                         int64_t cost, int64_t old_cost) {
+  DIMACSBinaryRecord record;
+  memset(&record, 0, sizeof(record));
+  record.record_type = record_type;
+  record.type = type;
+  record.src = src;
+  record.dst = dst;
+  record.cap_lower_bound = cap_lower_bound;
+  record.cap_upper_bound = cap_upper_bound;
+  record.cost = cost;
+  record.old_cost = old_cost;
+  buffer_.append(reinterpret_cast<const char*>(&record), sizeof(record));
+  num_records_++;
+}
+
+void DIMACSExporter::AppendText(const char* format, ...) {
+  char line[256];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  CHECK_GE(length, 0);
+  if (static_cast<size_t>(length) < sizeof(line)) {
+    buffer_.append(line, static_cast<size_t>(length));
+  } else {
+    // The line did not fit; format it again straight into the buffer.
+    size_t offset = buffer_.size();
+    buffer_.resize(offset + static_cast<size_t>(length) + 1);
+    va_start(args, format);
+    vsnprintf(&buffer_[offset], static_cast<size_t>(length) + 1, format, args);
+    va_end(args);
+    buffer_.resize(offset + static_cast<size_t>(length));
+  }
+}
+
+inline void DIMACSExporter::GenerateArc(const FlowGraphArc& arc) {
+  AppendText("a %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRId64
+             "\n", arc.src_, arc.dst_, arc.cap_lower_bound_,
+             arc.cap_upper_bound_, arc.cost_);
 }
 
-inline void DIMACSExporter::GenerateNode(const FlowGraphNode& node,
-                                         FILE* stream) {
+inline void DIMACSExporter::GenerateNode(const FlowGraphNode& node) {
   if (node.rd_ptr_) {
-    fprintf(stream, "c nd Res_%s\n", node.rd_ptr_->uuid().c_str());
+    AppendText("c nd Res_%s\n", node.rd_ptr_->uuid().c_str());
   } else if (node.td_ptr_) {
-    fprintf(stream, "c nd Task_%" PRIu64 "\n", node.td_ptr_->uid());
+    AppendText("c nd Task_%" PRIu64 "\n", node.td_ptr_->uid());
   } else if (node.ec_id_) {
-    fprintf(stream, "c nd EC_%" PRIu64 "\n", node.ec_id_);
+    AppendText("c nd EC_%" PRIu64 "\n", node.ec_id_);
   } else if (node.comment_ != "") {
-    fprintf(stream, "c nd %s\n", node.comment_.c_str());
+    AppendText("c nd %s\n", node.comment_.c_str());
   }
-  uint32_t node_type = 0;
-  if (node.type_ == FlowNodeType::PU) {
-    node_type = 2;
-  } else if (node.type_ == FlowNodeType::MACHINE) {
-    node_type = 4;
-  } else if (node.type_ == FlowNodeType::NUMA_NODE ||
-             node.type_ == FlowNodeType::SOCKET ||
-             node.type_ == FlowNodeType::CACHE ||
-             node.type_ == FlowNodeType::CORE) {
-    node_type = 5;
-  } else if (node.type_ == FlowNodeType::SINK) {
-    node_type = 3;
-  } else if (node.type_ == FlowNodeType::UNSCHEDULED_TASK ||
-             node.type_ == FlowNodeType::SCHEDULED_TASK ||
-             node.type_ == FlowNodeType::ROOT_TASK) {
-    node_type = 1;
-  } else {
-    node_type = 0;
+  AppendText("n %" PRIu64 " %" PRId64 " %d\n",
+             node.id_, node.excess_, GetNodeType(node));
+}
+
+uint32_t DIMACSExporter::GetNodeType(const FlowGraphNode& node) {
+  return GetDIMACSNodeType(node.type_);
+}
+
+void DIMACSExporter::StartBinaryMessage(DIMACSBinaryMessageType message_type) {
+  DIMACSBinaryHeader header;
+  header.magic = DIMACS_BINARY_MAGIC;
+  header.version = DIMACS_BINARY_VERSION;
+  header.message_type = static_cast<uint16_t>(message_type);
+  // The number of records is filled in when the message is written.
+  header.num_records = 0;
+  buffer_.clear();
+  buffer_.append(reinterpret_cast<const char*>(&header), sizeof(header));
+  num_records_ = 0;
+}
+
+void DIMACSExporter::WriteBinaryMessage(FILE* stream) {
+  CHECK_GE(buffer_.size(), sizeof(DIMACSBinaryHeader));
+  memcpy(&buffer_[offsetof(DIMACSBinaryHeader, num_records)], &num_records_,
+         sizeof(num_records_));
+  WriteBuffer(stream);
+}
+
+void DIMACSExporter::WriteBuffer(FILE* stream) {
+  if (fwrite(buffer_.data(), 1, buffer_.size(), stream) != buffer_.size()) {
+    PLOG(FATAL) << "Error while writing the flow graph";
   }
-  fprintf(stream, "n %" PRIu64 " %" PRId64 " %d\n",
-          node.id_, node.excess_, node_type);
   fflush(stream);
 }
 
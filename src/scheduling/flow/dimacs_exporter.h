@@ -20,7 +20,9 @@
 
 
 // Export utility that converts a given resource topology and set of job's into
-// a DIMACS file for use with the solvers.
+// a DIMACS file for use with the solvers. The graph is either exported as
+// DIMACS text or in the binary format described in dimacs_binary_format.h.
+// Every export is assembled in memory and written to the stream at once.
 
 #ifndef FIRMAMENT_SCHEDULING_FLOW_DIMACS_EXPORTER_H
 #define FIRMAMENT_SCHEDULING_FLOW_DIMACS_EXPORTER_H
@@ -31,6 +33,7 @@
 #include "base/common.h"
 #include "base/types.h"
 #include "base/resource_topology_node_desc.pb.h"
+#include "scheduling/flow/dimacs_binary_format.h"
 #include "scheduling/flow/dimacs_change.h"
 #include "scheduling/flow/flow_graph.h"
 #include "scheduling/flow/flow_graph_arc.h"
@@ -42,11 +45,34 @@ class DIMACSExporter {
  public:
   DIMACSExporter();
   void Export(const FlowGraph& graph, FILE* stream);
-  void ExportIncremental(const vector<DIMACSChange*>& changes, FILE* stream);
+  void ExportBinary(const FlowGraph& graph, FILE* stream);
+  void ExportBinaryEndOfStream(FILE* stream);
+  void ExportIncremental(const vector<DIMACSChange>& changes, FILE* stream);
+  void ExportIncrementalBinary(const vector<DIMACSChange>& changes,
+                               FILE* stream);
+  void ExportSharedGraph(const vector<DIMACSBinarySlotRecord>& updated_slots,
+                         FILE* stream);
+  static uint32_t GetNodeType(const FlowGraphNode& node);
 
  private:
-  inline void GenerateArc(const FlowGraphArc& arc, FILE* stream);
-  inline void GenerateNode(const FlowGraphNode& node, FILE* stream);
+  inline void AppendChange(const DIMACSChange& change);
+  inline void AppendRecord(uint8_t record_type, uint32_t type, uint64_t src,
+                           uint64_t dst, uint64_t cap_lower_bound,
+                           uint64_t cap_upper_bound, int64_t cost,
+                           int64_t old_cost);
+  void AppendText(const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
+  inline void GenerateArc(const FlowGraphArc& arc);
+  inline void GenerateNode(const FlowGraphNode& node);
+  void StartBinaryMessage(DIMACSBinaryMessageType message_type);
+  void WriteBinaryMessage(FILE* stream);
+  void WriteBuffer(FILE* stream);
+
+  // Holds the export until it is written to the stream. It is kept across
+  // exports to avoid re-allocating it every round.
+  string buffer_;
+  // Number of records appended to the current binary message.
+  uint64_t num_records_;
 };
 
 }  // namespace firmament
@@ -37,11 +37,15 @@
 #include "misc/wall_time.h"
 #include "misc/string_utils.h"
 #include "misc/utils.h"
+#include "scheduling/flow/dimacs_binary_format.h"
 #include "scheduling/flow/dimacs_change_stats.h"
 #include "scheduling/flow/dimacs_exporter.h"
+#include "scheduling/flow/flow_graph_change_manager.h"
 #include "scheduling/flow/flow_graph_manager.h"
 #include "scheduling/flow/trivial_cost_model.h"
 
+DECLARE_bool(incremental_flow);
+
 namespace firmament {
 
 // The fixture for testing the DIMACSExporter container class.
@@ -152,6 +156,97 @@ TEST_F(DIMACSExporterTest, SimpleGraphOutput) {
   delete leaf_res_ids;
 }
 
+// Exports a small graph in the binary format and checks that it can be read
+// back record by record.
+TEST_F(DIMACSExporterTest, BinaryGraphOutput) {
+  DIMACSChangeStats dimacs_stats;
+  FlowGraphChangeManager change_manager(&dimacs_stats);
+  FlowGraphNode* sink = change_manager.AddNode(FlowNodeType::SINK, -1,
+                                               ADD_SINK_NODE, "sink");
+  FlowGraphNode* pu = change_manager.AddNode(FlowNodeType::PU, 0,
+                                             ADD_RESOURCE_NODE, "pu");
+  FlowGraphNode* task =
+    change_manager.AddNode(FlowNodeType::UNSCHEDULED_TASK, 1, ADD_TASK_NODE,
+                           "task");
+  change_manager.AddArc(pu, sink, 0, 1, 0, FlowGraphArcType::OTHER,
+                        ADD_ARC_RES_TO_SINK, "pu_to_sink");
+  change_manager.AddArc(task, pu, 0, 1, 42, FlowGraphArcType::RUNNING,
+                        ADD_ARC_RUNNING_TASK, "task_to_pu");
+  DIMACSExporter exp;
+  FILE* stream = tmpfile();
+  CHECK_NOTNULL(stream);
+  exp.ExportBinary(change_manager.flow_graph(), stream);
+  rewind(stream);
+  DIMACSBinaryHeader header;
+  CHECK_EQ(fread(&header, sizeof(header), 1, stream), 1);
+  EXPECT_EQ(header.magic, DIMACS_BINARY_MAGIC);
+  EXPECT_EQ(header.version, DIMACS_BINARY_VERSION);
+  EXPECT_EQ(header.message_type, DIMACS_MESSAGE_GRAPH);
+  // One problem line, three nodes and two arcs.
+  CHECK_EQ(header.num_records, 6);
+  vector<DIMACSBinaryRecord> records(header.num_records);
+  CHECK_EQ(fread(&records[0], sizeof(DIMACSBinaryRecord), records.size(),
+                 stream), records.size());
+  EXPECT_EQ(records[0].record_type, DIMACS_RECORD_PROBLEM);
+  EXPECT_EQ(records[0].dst, 2);
+  uint64_t num_nodes = 0;
+  for (auto& record : records) {
+    if (record.record_type == DIMACS_RECORD_ADD_NODE) {
+      num_nodes++;
+      if (record.src == task->id_) {
+        EXPECT_EQ(record.cost, 1);
+      }
+    } else if (record.record_type == DIMACS_RECORD_NEW_ARC &&
+               record.src == task->id_) {
+      EXPECT_EQ(record.dst, pu->id_);
+      EXPECT_EQ(record.cap_upper_bound, 1);
+      EXPECT_EQ(record.cost, 42);
+      EXPECT_EQ(record.type, FlowGraphArcType::RUNNING);
+    }
+  }
+  EXPECT_EQ(num_nodes, 3);
+  // Nothing follows the message.
+  EXPECT_EQ(fgetc(stream), EOF);
+  fclose(stream);
+}
+
+// Exports graph changes in the binary format.
+TEST_F(DIMACSExporterTest, BinaryIncrementalOutput) {
+  FLAGS_incremental_flow = true;
+  DIMACSChangeStats dimacs_stats;
+  FlowGraphChangeManager change_manager(&dimacs_stats);
+  FlowGraphNode* sink = change_manager.AddNode(FlowNodeType::SINK, 0,
+                                               ADD_SINK_NODE, "sink");
+  FlowGraphNode* pu = change_manager.AddNode(FlowNodeType::PU, 0,
+                                             ADD_RESOURCE_NODE, "pu");
+  FlowGraphArc* arc = change_manager.AddArc(pu, sink, 0, 1, 0,
+                                            FlowGraphArcType::OTHER,
+                                            ADD_ARC_RES_TO_SINK, "pu_to_sink");
+  change_manager.ResetChanges();
+  change_manager.ChangeArcCost(arc, 7, CHG_ARC_RES_TO_SINK, "pu_to_sink");
+  uint64_t pu_id = pu->id_;
+  change_manager.DeleteNode(pu, DEL_RESOURCE_NODE, "pu");
+  DIMACSExporter exp;
+  FILE* stream = tmpfile();
+  CHECK_NOTNULL(stream);
+  exp.ExportIncrementalBinary(change_manager.GetGraphChanges(), stream);
+  rewind(stream);
+  DIMACSBinaryHeader header;
+  CHECK_EQ(fread(&header, sizeof(header), 1, stream), 1);
+  CHECK_EQ(header.num_records, 2);
+  vector<DIMACSBinaryRecord> records(header.num_records);
+  CHECK_EQ(fread(&records[0], sizeof(DIMACSBinaryRecord), records.size(),
+                 stream), records.size());
+  EXPECT_EQ(records[0].record_type, DIMACS_RECORD_CHANGE_ARC);
+  EXPECT_EQ(records[0].cost, 7);
+  EXPECT_EQ(records[0].old_cost, 0);
+  EXPECT_EQ(records[1].record_type, DIMACS_RECORD_REMOVE_NODE);
+  EXPECT_EQ(records[1].src, pu_id);
+  fclose(stream);
+  change_manager.ResetChanges();
+  FLAGS_incremental_flow = false;
+}
+
 // Runs the graph export for a single simulated graph (somewhat simplified),
 // with the following parameters:
 //  - 2500 machines
@@ -1,36 +0,0 @@
-/*
- * Firmament
- * Copyright (c) The Firmament Authors.
- * All rights reserved.
- *
- * Licensed under the Apache License, Version 2.0 (the "License");
- * you may not use this file except in compliance with the License.
- * You may obtain a copy of the License at
- *
- *     http://www.apache.org/licenses/LICENSE-2.0
- *
- * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
- * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
- * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
- * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
- *
- * See the Apache Version 2.0 License for specific language governing
- * permissions and limitations under the License.
- */
-
-#include "scheduling/flow/dimacs_remove_node.h"
-
-namespace firmament {
-
-DIMACSRemoveNode::DIMACSRemoveNode(const FlowGraphNode& node)
-  : DIMACSChange(), node_id_(node.id_) {
-}
-
-const string DIMACSRemoveNode::GenerateChange() const {
-  stringstream ss;
-  ss << DIMACSChange::GenerateChangeDescription();
-  ss << "r " << node_id_ << "\n";
-  return ss.str();
-}
-
-} // namespace firmament
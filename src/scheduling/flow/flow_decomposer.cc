@@ -0,0 +1,211 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "scheduling/flow/flow_decomposer.h"
+
+#include <algorithm>
+
+namespace firmament {
+
+const uint64_t FlowDecomposer::kNoRun;
+const uint8_t FlowDecomposer::kNoNode;
+
+FlowDecomposer::FlowDecomposer() : sink_(0), num_node_slots_(0) {
+}
+
+void FlowDecomposer::AppendRun(uint64_t node_id, uint64_t pu_id,
+                               uint64_t units) {
+  uint64_t last_run = last_run_[node_id];
+  if (last_run != kNoRun && runs_[last_run].pu_id_ == pu_id) {
+    runs_[last_run].units_ += units;
+    return;
+  }
+  PURun run;
+  run.pu_id_ = pu_id;
+  run.units_ = units;
+  run.next_ = kNoRun;
+  runs_.push_back(run);
+  if (last_run == kNoRun) {
+    first_run_[node_id] = runs_.size() - 1;
+  } else {
+    runs_[last_run].next_ = runs_.size() - 1;
+  }
+  last_run_[node_id] = runs_.size() - 1;
+}
+
+void FlowDecomposer::BuildIncomingArcs() {
+  num_node_slots_ = 0;
+  for (auto& arc : arcs_) {
+    num_node_slots_ = max(num_node_slots_, max(arc.src_, arc.dst_) + 1);
+  }
+  // Counting sort of the arcs by destination.
+  in_offset_.assign(num_node_slots_ + 1, 0);
+  for (auto& arc : arcs_) {
+    in_offset_[arc.dst_ + 1]++;
+  }
+  for (uint64_t node_id = 0; node_id < num_node_slots_; ++node_id) {
+    in_offset_[node_id + 1] += in_offset_[node_id];
+  }
+  next_in_arc_.assign(in_offset_.begin(), in_offset_.end() - 1);
+  in_src_.resize(arcs_.size());
+  in_flow_.resize(arcs_.size());
+  for (auto& arc : arcs_) {
+    uint64_t in_arc = next_in_arc_[arc.dst_]++;
+    in_src_[in_arc] = arc.src_;
+    in_flow_[in_arc] = arc.flow_;
+  }
+  next_in_arc_.assign(in_offset_.begin(), in_offset_.end() - 1);
+  runs_.clear();
+  first_run_.assign(num_node_slots_, kNoRun);
+  last_run_.assign(num_node_slots_, kNoRun);
+  queued_.assign(num_node_slots_, false);
+}
+
+void FlowDecomposer::Clear() {
+  arcs_.clear();
+}
+
+uint64_t FlowDecomposer::Flow(uint64_t src, uint64_t dst) const {
+  uint64_t flow = 0;
+  for (auto& arc : arcs_) {
+    if (arc.src_ == src && arc.dst_ == dst) {
+      flow += arc.flow_;
+    }
+  }
+  return flow;
+}
+
+multimap<uint64_t, uint64_t>* FlowDecomposer::GetMappings() {
+  multimap<uint64_t, uint64_t>* task_to_pu =
+    new multimap<uint64_t, uint64_t>();
+  BuildIncomingArcs();
+  if (sink_ >= num_node_slots_) {
+    // There's no flow to the sink.
+    return task_to_pu;
+  }
+  // Every unit of flow a PU sends to the sink comes from a task that is
+  // placed on the PU.
+  for (uint64_t in_arc = in_offset_[sink_]; in_arc < in_offset_[sink_ + 1];
+       ++in_arc) {
+    uint64_t leaf_node = in_src_[in_arc];
+    if (leaf_node < leaves_.size() && leaves_[leaf_node]) {
+      AppendRun(leaf_node, leaf_node, in_flow_[in_arc]);
+      Schedule(leaf_node);
+    }
+  }
+  while (!to_visit_.empty()) {
+    uint64_t node_id = to_visit_.front();
+    to_visit_.pop();
+    queued_[node_id] = false;
+    if (IsTaskNode(node_id)) {
+      for (uint64_t run = first_run_[node_id]; run != kNoRun;
+           run = runs_[run].next_) {
+        for (uint64_t unit = 0; unit < runs_[run].units_; ++unit) {
+          task_to_pu->insert(
+              pair<uint64_t, uint64_t>(node_id, runs_[run].pu_id_));
+        }
+      }
+      first_run_[node_id] = kNoRun;
+      last_run_[node_id] = kNoRun;
+    } else {
+      PassOnRuns(node_id);
+    }
+  }
+  return task_to_pu;
+}
+
+bool FlowDecomposer::IsCurrentMapping(const FlowGraph& graph,
+                                      uint64_t task_node_id,
+                                      uint64_t pu_node_id) const {
+  FlowGraphNode* task_node = graph.GetNode(task_node_id);
+  FlowGraphNode* pu_node = graph.GetNode(pu_node_id);
+  if (task_node == NULL || pu_node == NULL ||
+      task_node_id >= node_types_.size() || pu_node_id >= node_types_.size()) {
+    return false;
+  }
+  // A task node whose type changed has been placed or evicted since, and a
+  // task node id with a different task has been re-used by a new task.
+  return task_node->type_ == node_types_[task_node_id] &&
+    task_node->td_ptr_ != NULL &&
+    task_node->td_ptr_->uid() == task_ids_[task_node_id] &&
+    pu_node->type_ == node_types_[pu_node_id];
+}
+
+void FlowDecomposer::PassOnRuns(uint64_t node_id) {
+  uint64_t run = first_run_[node_id];
+  uint64_t in_arc = next_in_arc_[node_id];
+  uint64_t end_in_arc = in_offset_[node_id + 1];
+  while (run != kNoRun && in_arc < end_in_arc) {
+    uint64_t src_node_id = in_src_[in_arc];
+    uint64_t pu_id = runs_[run].pu_id_;
+    uint64_t units = min(runs_[run].units_, in_flow_[in_arc]);
+    // Appending may re-allocate runs_, so the run is accessed by index.
+    AppendRun(src_node_id, pu_id, units);
+    runs_[run].units_ -= units;
+    in_flow_[in_arc] -= units;
+    if (runs_[run].units_ == 0) {
+      run = runs_[run].next_;
+    }
+    if (in_flow_[in_arc] == 0) {
+      ++in_arc;
+    }
+    Schedule(src_node_id);
+  }
+  // The node may be reached again with more runs, which then go to the arcs
+  // that still have flow left.
+  first_run_[node_id] = run;
+  if (run == kNoRun) {
+    last_run_[node_id] = kNoRun;
+  }
+  next_in_arc_[node_id] = in_arc;
+}
+
+void FlowDecomposer::Schedule(uint64_t node_id) {
+  if (!queued_[node_id]) {
+    queued_[node_id] = true;
+    to_visit_.push(node_id);
+  }
+}
+
+void FlowDecomposer::SetGraph(const FlowGraph& graph,
+                              const unordered_set<uint64_t>& leaves,
+                              uint64_t sink) {
+  uint64_t num_ids = 0;
+  for (auto& node : graph.Nodes()) {
+    num_ids = max(num_ids, node->id_ + 1);
+  }
+  node_types_.assign(num_ids, kNoNode);
+  task_ids_.assign(num_ids, 0);
+  for (auto& node : graph.Nodes()) {
+    node_types_[node->id_] = static_cast<uint8_t>(node->type_);
+    if (node->IsTaskNode() && node->td_ptr_) {
+      task_ids_[node->id_] = node->td_ptr_->uid();
+    }
+  }
+  leaves_.assign(num_ids, false);
+  for (auto& leaf_node : leaves) {
+    if (leaf_node < num_ids) {
+      leaves_[leaf_node] = true;
+    }
+  }
+  sink_ = sink;
+}
+
+}  // namespace firmament
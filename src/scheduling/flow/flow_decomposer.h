@@ -0,0 +1,157 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Flow extracted from a solver's result, and its decomposition into task to
+// PU mappings. The arcs with positive flow are kept in flat arrays; before
+// the decomposition, they are bucketed by destination node with a counting
+// sort. Every node then holds a list of PU runs, i.e., (PU, units of flow)
+// pairs, which are handed out to the sources of the node's incoming arcs in
+// bulk, so the decomposition takes time linear in the number of arcs with
+// flow and the number of mappings.
+// The node types are taken from a snapshot of the graph, so the decomposition
+// does not read the graph and the graph may change while it runs.
+
+#ifndef FIRMAMENT_SCHEDULING_FLOW_FLOW_DECOMPOSER_H
+#define FIRMAMENT_SCHEDULING_FLOW_FLOW_DECOMPOSER_H
+
+#include <map>
+#include <queue>
+#include <vector>
+
+#include "base/common.h"
+#include "base/types.h"
+#include "scheduling/flow/flow_graph.h"
+
+namespace firmament {
+
+class FlowDecomposer {
+ public:
+  FlowDecomposer();
+  /**
+   * Forgets the flow added since the last call.
+   */
+  void Clear();
+  /**
+   * Records the flow on an arc. Arcs without flow are ignored.
+   */
+  inline void AddFlow(uint64_t src, uint64_t dst, uint64_t flow) {
+    if (flow > 0) {
+      FlowArc arc;
+      arc.src_ = src;
+      arc.dst_ = dst;
+      arc.flow_ = flow;
+      arcs_.push_back(arc);
+    }
+  }
+  /**
+   * Returns the flow on an arc. Scans all the arcs, so it is only meant for
+   * tests and debugging.
+   */
+  uint64_t Flow(uint64_t src, uint64_t dst) const;
+  /**
+   * Takes a snapshot of the node types of the graph the flow is computed for.
+   * @param graph the flow graph
+   * @param leaves the ids of the PU nodes
+   * @param sink the id of the sink node
+   */
+  void SetGraph(const FlowGraph& graph,
+                const unordered_set<uint64_t>& leaves,
+                uint64_t sink);
+  /**
+   * Maps the tasks to the PUs their flow reaches.
+   * @return a multimap from task node id to PU node id, with one entry per
+   * unit of flow
+   */
+  multimap<uint64_t, uint64_t>* GetMappings();
+  /**
+   * Checks if a mapping still refers to the same task and PU, i.e., the nodes
+   * have neither been removed nor changed type since the snapshot was taken,
+   * and the task node has not been re-used by another task.
+   * @param graph the current flow graph
+   */
+  bool IsCurrentMapping(const FlowGraph& graph, uint64_t task_node_id,
+                        uint64_t pu_node_id) const;
+  inline uint64_t num_arcs() const {
+    return arcs_.size();
+  }
+
+ private:
+  struct FlowArc {
+    uint64_t src_;
+    uint64_t dst_;
+    uint64_t flow_;
+  };
+  // Units of flow that reach a PU. Runs are linked into per-node lists.
+  struct PURun {
+    uint64_t pu_id_;
+    uint64_t units_;
+    uint64_t next_;
+  };
+  static const uint64_t kNoRun = static_cast<uint64_t>(-1);
+  // Snapshot type of the node ids that were not in use.
+  static const uint8_t kNoNode = 0xff;
+
+  void AppendRun(uint64_t node_id, uint64_t pu_id, uint64_t units);
+  void BuildIncomingArcs();
+  inline bool IsTaskNode(uint64_t node_id) const {
+    if (node_id >= node_types_.size()) {
+      return false;
+    }
+    uint8_t type = node_types_[node_id];
+    return type == FlowNodeType::ROOT_TASK ||
+      type == FlowNodeType::SCHEDULED_TASK ||
+      type == FlowNodeType::UNSCHEDULED_TASK;
+  }
+  /**
+   * Passes the runs a node holds on to the sources of its incoming arcs, in
+   * proportion to the (remaining) flow on the arcs.
+   */
+  void PassOnRuns(uint64_t node_id);
+  void Schedule(uint64_t node_id);
+
+  // Arcs with positive flow, in the order they were added.
+  vector<FlowArc> arcs_;
+  // Snapshot of the graph: the type of every node id, the ids of the tasks
+  // of the task nodes and whether a node is a PU. Task ids are kept rather
+  // than descriptors because the task store re-uses descriptor slots.
+  vector<uint8_t> node_types_;
+  vector<TaskID_t> task_ids_;
+  vector<bool> leaves_;
+  uint64_t sink_;
+  uint64_t num_node_slots_;
+  // Incoming arcs of every node: the sources and the flow not yet handed out
+  // of node i's arcs are at [in_offset_[i], in_offset_[i + 1]).
+  vector<uint64_t> in_offset_;
+  vector<uint64_t> in_src_;
+  vector<uint64_t> in_flow_;
+  // Per node position of the first incoming arc with flow left.
+  vector<uint64_t> next_in_arc_;
+  // Per node lists of PU runs.
+  vector<PURun> runs_;
+  vector<uint64_t> first_run_;
+  vector<uint64_t> last_run_;
+  // Whether a node is waiting in to_visit_.
+  vector<bool> queued_;
+  queue<uint64_t> to_visit_;
+};
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SCHEDULING_FLOW_FLOW_DECOMPOSER_H
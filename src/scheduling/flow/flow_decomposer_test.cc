@@ -0,0 +1,220 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Tests for the decomposition of a flow into task to PU mappings.
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <vector>
+
+#include "base/common.h"
+#include "scheduling/flow/flow_decomposer.h"
+#include "scheduling/flow/flow_graph.h"
+
+namespace firmament {
+
+class FlowDecomposerTest : public ::testing::Test {
+ protected:
+  FlowDecomposerTest() {
+    FLAGS_v = 2;
+    sink_ = AddNode(FlowNodeType::SINK);
+  }
+
+  FlowGraphNode* AddNode(FlowNodeType type) {
+    FlowGraphNode* node = graph_.AddNode();
+    node->type_ = type;
+    return node;
+  }
+
+  FlowGraphNode* AddPU() {
+    FlowGraphNode* pu = AddNode(FlowNodeType::PU);
+    leaves_.insert(pu->id_);
+    return pu;
+  }
+
+  void AddFlow(FlowGraphNode* src, FlowGraphNode* dst, uint64_t flow) {
+    flow_.AddFlow(src->id_, dst->id_, flow);
+  }
+
+  multimap<uint64_t, uint64_t>* GetMappings() {
+    flow_.SetGraph(graph_, leaves_, sink_->id_);
+    return flow_.GetMappings();
+  }
+
+  FlowGraph graph_;
+  FlowGraphNode* sink_;
+  unordered_set<uint64_t> leaves_;
+  FlowDecomposer flow_;
+};
+
+// Tasks connected directly to PUs are mapped to them.
+TEST_F(FlowDecomposerTest, DirectPlacement) {
+  FlowGraphNode* task1 = AddNode(FlowNodeType::UNSCHEDULED_TASK);
+  FlowGraphNode* task2 = AddNode(FlowNodeType::SCHEDULED_TASK);
+  FlowGraphNode* pu1 = AddPU();
+  FlowGraphNode* pu2 = AddPU();
+  AddFlow(task1, pu2, 1);
+  AddFlow(task2, pu1, 1);
+  AddFlow(pu1, sink_, 1);
+  AddFlow(pu2, sink_, 1);
+  EXPECT_EQ(flow_.num_arcs(), 4);
+  EXPECT_EQ(flow_.Flow(task1->id_, pu2->id_), 1);
+  EXPECT_EQ(flow_.Flow(task1->id_, pu1->id_), 0);
+  multimap<uint64_t, uint64_t>* mappings =
+    GetMappings();
+  EXPECT_EQ(mappings->size(), 2);
+  EXPECT_EQ(mappings->find(task1->id_)->second, pu2->id_);
+  EXPECT_EQ(mappings->find(task2->id_)->second, pu1->id_);
+  delete mappings;
+}
+
+// Flow routed via aggregators is handed out in bulk, and every unit of flow
+// that reaches a PU results in one mapping.
+TEST_F(FlowDecomposerTest, PlacementViaAggregators) {
+  FlowGraphNode* ec = AddNode(FlowNodeType::EQUIVALENCE_CLASS);
+  FlowGraphNode* machine = AddNode(FlowNodeType::MACHINE);
+  FlowGraphNode* pu1 = AddPU();
+  FlowGraphNode* pu2 = AddPU();
+  vector<FlowGraphNode*> tasks;
+  for (uint32_t i = 0; i < 5; ++i) {
+    FlowGraphNode* task = AddNode(FlowNodeType::UNSCHEDULED_TASK);
+    AddFlow(task, ec, 1);
+    tasks.push_back(task);
+  }
+  AddFlow(ec, machine, 5);
+  AddFlow(machine, pu1, 3);
+  AddFlow(machine, pu2, 2);
+  AddFlow(pu1, sink_, 3);
+  AddFlow(pu2, sink_, 2);
+  multimap<uint64_t, uint64_t>* mappings =
+    GetMappings();
+  EXPECT_EQ(mappings->size(), 5);
+  map<uint64_t, uint64_t> tasks_per_pu;
+  for (auto& task : tasks) {
+    EXPECT_EQ(mappings->count(task->id_), 1);
+    tasks_per_pu[mappings->find(task->id_)->second]++;
+  }
+  EXPECT_EQ(tasks_per_pu[pu1->id_], 3);
+  EXPECT_EQ(tasks_per_pu[pu2->id_], 2);
+  delete mappings;
+}
+
+// Tasks whose flow goes to the unscheduled aggregator are not mapped.
+TEST_F(FlowDecomposerTest, UnscheduledTasks) {
+  FlowGraphNode* unsched_agg = AddNode(FlowNodeType::JOB_AGGREGATOR);
+  FlowGraphNode* pu = AddPU();
+  FlowGraphNode* running_task = AddNode(FlowNodeType::SCHEDULED_TASK);
+  FlowGraphNode* waiting_task = AddNode(FlowNodeType::UNSCHEDULED_TASK);
+  AddFlow(running_task, pu, 1);
+  AddFlow(waiting_task, unsched_agg, 1);
+  AddFlow(pu, sink_, 1);
+  AddFlow(unsched_agg, sink_, 1);
+  multimap<uint64_t, uint64_t>* mappings =
+    GetMappings();
+  EXPECT_EQ(mappings->size(), 1);
+  EXPECT_EQ(mappings->find(running_task->id_)->second, pu->id_);
+  EXPECT_EQ(mappings->count(waiting_task->id_), 0);
+  delete mappings;
+}
+
+// A node that is reached via paths of different lengths receives its PUs in
+// several pieces, and hands them all out.
+TEST_F(FlowDecomposerTest, PiecewiseArrival) {
+  FlowGraphNode* ec = AddNode(FlowNodeType::EQUIVALENCE_CLASS);
+  FlowGraphNode* rack = AddNode(FlowNodeType::EQUIVALENCE_CLASS);
+  FlowGraphNode* machine = AddNode(FlowNodeType::MACHINE);
+  FlowGraphNode* pu1 = AddPU();
+  FlowGraphNode* pu2 = AddPU();
+  FlowGraphNode* task1 = AddNode(FlowNodeType::UNSCHEDULED_TASK);
+  FlowGraphNode* task2 = AddNode(FlowNodeType::UNSCHEDULED_TASK);
+  AddFlow(task1, ec, 1);
+  AddFlow(task2, ec, 1);
+  AddFlow(ec, pu1, 1);
+  AddFlow(ec, rack, 1);
+  AddFlow(rack, machine, 1);
+  AddFlow(machine, pu2, 1);
+  AddFlow(pu1, sink_, 1);
+  AddFlow(pu2, sink_, 1);
+  multimap<uint64_t, uint64_t>* mappings =
+    GetMappings();
+  EXPECT_EQ(mappings->size(), 2);
+  EXPECT_EQ(mappings->count(task1->id_), 1);
+  EXPECT_EQ(mappings->count(task2->id_), 1);
+  EXPECT_NE(mappings->find(task1->id_)->second,
+            mappings->find(task2->id_)->second);
+  delete mappings;
+}
+
+// The decomposer can be re-used after clearing it.
+TEST_F(FlowDecomposerTest, Clear) {
+  FlowGraphNode* task = AddNode(FlowNodeType::UNSCHEDULED_TASK);
+  FlowGraphNode* pu = AddPU();
+  AddFlow(task, pu, 1);
+  AddFlow(pu, sink_, 1);
+  AddFlow(sink_, pu, 0);
+  EXPECT_EQ(flow_.num_arcs(), 2);
+  multimap<uint64_t, uint64_t>* mappings =
+    GetMappings();
+  EXPECT_EQ(mappings->size(), 1);
+  delete mappings;
+  flow_.Clear();
+  EXPECT_EQ(flow_.num_arcs(), 0);
+  mappings = GetMappings();
+  EXPECT_EQ(mappings->size(), 0);
+  delete mappings;
+}
+
+// Mappings to task nodes that have been removed, re-used or placed since the
+// snapshot are not current.
+TEST_F(FlowDecomposerTest, IsCurrentMapping) {
+  TaskDescriptor td1;
+  td1.set_uid(1);
+  TaskDescriptor td2;
+  td2.set_uid(2);
+  TaskDescriptor td3;
+  td3.set_uid(3);
+  FlowGraphNode* pu = AddPU();
+  FlowGraphNode* task1 = AddNode(FlowNodeType::UNSCHEDULED_TASK);
+  task1->td_ptr_ = &td1;
+  FlowGraphNode* task2 = AddNode(FlowNodeType::UNSCHEDULED_TASK);
+  task2->td_ptr_ = &td2;
+  FlowGraphNode* task3 = AddNode(FlowNodeType::UNSCHEDULED_TASK);
+  task3->td_ptr_ = &td3;
+  uint64_t task1_id = task1->id_;
+  flow_.SetGraph(graph_, leaves_, sink_->id_);
+  EXPECT_TRUE(flow_.IsCurrentMapping(graph_, task1_id, pu->id_));
+  EXPECT_FALSE(flow_.IsCurrentMapping(graph_, task1_id, task1_id + 100));
+  graph_.DeleteNode(task1);
+  EXPECT_FALSE(flow_.IsCurrentMapping(graph_, task1_id, pu->id_));
+  // A new task with the same node id, whose descriptor re-uses the removed
+  // task's descriptor slot.
+  td1.set_uid(4);
+  FlowGraphNode* new_task = AddNode(FlowNodeType::UNSCHEDULED_TASK);
+  new_task->td_ptr_ = &td1;
+  EXPECT_EQ(new_task->id_, task1_id);
+  EXPECT_FALSE(flow_.IsCurrentMapping(graph_, task1_id, pu->id_));
+  // A task that has been placed since.
+  task2->type_ = FlowNodeType::SCHEDULED_TASK;
+  EXPECT_FALSE(flow_.IsCurrentMapping(graph_, task2->id_, pu->id_));
+  EXPECT_TRUE(flow_.IsCurrentMapping(graph_, task3->id_, pu->id_));
+}
+
+}  // namespace firmament
@@ -34,38 +34,43 @@ FlowGraph::FlowGraph() : current_id_(1) {
 }
 
 FlowGraph::~FlowGraph() {
-  for (unordered_map<uint64_t, FlowGraphNode*>::iterator it = node_map_.begin();
-       it != node_map_.end(); ) {
-    unordered_map<uint64_t, FlowGraphNode*>::iterator it_tmp = it;
-    ++it;
-    DeleteNode(it_tmp->second);
+  for (auto& arc : arcs_) {
+    arc_pool_.Delete(arc);
+  }
+  for (auto& node : nodes_) {
+    node_pool_.Delete(node);
   }
 }
 
 FlowGraphArc* FlowGraph::AddArc(FlowGraphNode* src,
                                 FlowGraphNode* dst) {
-  FlowGraphArc* arc = new FlowGraphArc(src->id_, dst->id_, src, dst);
-  CHECK(arc_set_.insert(arc).second);
+  DCHECK(GetArc(src, dst) == NULL);
+  FlowGraphArc* arc = arc_pool_.New(src->id_, dst->id_, src, dst);
+  arc->index_ = arcs_.size();
+  arcs_.push_back(arc);
   src->AddArc(arc);
   return arc;
 }
 
 FlowGraphArc* FlowGraph::AddArc(uint64_t src, uint64_t dst) {
-  FlowGraphNode* src_node = FindPtrOrNull(node_map_, src);
+  FlowGraphNode* src_node = GetNode(src);
   CHECK_NOTNULL(src_node);
-  FlowGraphNode* dst_node = FindPtrOrNull(node_map_, dst);
+  FlowGraphNode* dst_node = GetNode(dst);
   CHECK_NOTNULL(dst_node);
-  FlowGraphArc* arc = new FlowGraphArc(src, dst, src_node, dst_node);
-  arc_set_.insert(arc);
-  src_node->AddArc(arc);
-  return arc;
+  return AddArc(src_node, dst_node);
 }
 
 FlowGraphNode* FlowGraph::AddNode() {
   uint64_t id = NextId();
-  FlowGraphNode* node = new FlowGraphNode(id);
+  FlowGraphNode* node = node_pool_.New(id);
   CHECK_NOTNULL(node);
-  CHECK(InsertIfNotPresent(&node_map_, id, node));
+  if (id >= node_by_id_.size()) {
+    node_by_id_.resize(id + 1, NULL);
+  }
+  CHECK(node_by_id_[id] == NULL);
+  node_by_id_[id] = node;
+  node->index_ = nodes_.size();
+  nodes_.push_back(node);
   return node;
 }
 
@@ -81,56 +86,80 @@ void FlowGraph::ChangeArcCost(FlowGraphArc* arc, int64_t cost) {
 }
 
 void FlowGraph::DeleteArc(FlowGraphArc* arc) {
-  // Remove the arc from the incoming and outgoing collections.
-  arc->src_node_->outgoing_arc_map_.erase(arc->dst_node_->id_);
-  arc->dst_node_->incoming_arc_map_.erase(arc->src_node_->id_);
+  // Remove the arc from the incoming and outgoing collections. The arcs moved
+  // into the freed positions must have their positions updated.
+  FlowGraphArc* moved_arc =
+    arc->src_node_->outgoing_arc_map_.RemoveAt(arc->outgoing_index_);
+  if (moved_arc) {
+    moved_arc->outgoing_index_ = arc->outgoing_index_;
+  }
+  moved_arc = arc->dst_node_->incoming_arc_map_.RemoveAt(arc->incoming_index_);
+  if (moved_arc) {
+    moved_arc->incoming_index_ = arc->incoming_index_;
+  }
   // First remove various meta-data relating to this arc
-  arc_set_.erase(arc);
+  CHECK_EQ(arcs_[arc->index_], arc);
+  arcs_[arc->index_] = arcs_.back();
+  arcs_[arc->index_]->index_ = arc->index_;
+  arcs_.pop_back();
   // Then delete the arc itself
-  delete arc;
+  arc_pool_.Delete(arc);
 }
 
 void FlowGraph::DeleteNode(FlowGraphNode* node) {
   unused_ids_.push(node->id_);
-  // First remove all outgoing arcs
-  for (unordered_map<uint64_t, FlowGraphArc*>::iterator it =
-         node->outgoing_arc_map_.begin();
-       it != node->outgoing_arc_map_.end();) {
-    CHECK_EQ(it->first, it->second->dst_);
-    CHECK_EQ(node->id_, it->second->src_);
-    CHECK_EQ(it->second->dst_node_->incoming_arc_map_.erase(it->second->src_),
-             1);
-    unordered_map<uint64_t, FlowGraphArc*>::iterator it_tmp = it;
-    ++it;
-    DeleteArc(it_tmp->second);
+  // First remove all outgoing arcs. We remove the last arc every time so that
+  // no arcs have to be moved.
+  while (!node->outgoing_arc_map_.empty()) {
+    FlowGraphArc* arc = node->outgoing_arc_map_.back();
+    CHECK_EQ(node->id_, arc->src_);
+    DeleteArc(arc);
   }
-  node->outgoing_arc_map_.clear();
   // Remove all incoming arcs.
-  for (unordered_map<uint64_t, FlowGraphArc*>::iterator it =
-         node->incoming_arc_map_.begin();
-       it != node->incoming_arc_map_.end();) {
-    CHECK_EQ(node->id_, it->second->dst_);
-    CHECK_EQ(it->first, it->second->src_);
-    CHECK_EQ(it->second->src_node_->outgoing_arc_map_.erase(it->second->dst_),
-             1);
-    unordered_map<uint64_t, FlowGraphArc*>::iterator it_tmp = it;
-    ++it;
-    DeleteArc(it_tmp->second);
+  while (!node->incoming_arc_map_.empty()) {
+    FlowGraphArc* arc = node->incoming_arc_map_.back();
+    CHECK_EQ(node->id_, arc->dst_);
+    DeleteArc(arc);
   }
-  node->incoming_arc_map_.clear();
-  node_map_.erase(node->id_);
-  delete node;
+  CHECK_EQ(node_by_id_[node->id_], node);
+  node_by_id_[node->id_] = NULL;
+  CHECK_EQ(nodes_[node->index_], node);
+  nodes_[node->index_] = nodes_.back();
+  nodes_[node->index_]->index_ = node->index_;
+  nodes_.pop_back();
+  node_pool_.Delete(node);
 }
 
-FlowGraphArc* FlowGraph::GetArc(FlowGraphNode* src, FlowGraphNode* dst) {
+FlowGraphArc* FlowGraph::GetArc(FlowGraphNode* src, FlowGraphNode* dst) const {
   CHECK_NOTNULL(src);
   CHECK_NOTNULL(dst);
-  unordered_map<uint64_t, FlowGraphArc*>::iterator arc_it =
-    src->outgoing_arc_map_.find(dst->id_);
-  if (arc_it == src->outgoing_arc_map_.end()) {
+  // Search the shorter of the two arc arrays. Nodes with many arcs (e.g., the
+  // sink or equivalence classes) are usually connected to nodes with few, and
+  // the arrays of high-degree nodes are indexed.
+  if (src->outgoing_arc_map_.size() <= dst->incoming_arc_map_.size()) {
+    FlowGraphArcMap::const_iterator arc_it =
+      src->outgoing_arc_map_.find(dst->id_);
+    if (arc_it == src->outgoing_arc_map_.end()) {
+      return NULL;
+    }
+    return arc_it->second;
+  } else {
+    FlowGraphArcMap::const_iterator arc_it =
+      dst->incoming_arc_map_.find(src->id_);
+    if (arc_it == dst->incoming_arc_map_.end()) {
+      return NULL;
+    }
+    return arc_it->second;
+  }
+}
+
+FlowGraphArc* FlowGraph::GetArc(uint64_t src, uint64_t dst) const {
+  FlowGraphNode* src_node = GetNode(src);
+  FlowGraphNode* dst_node = GetNode(dst);
+  if (src_node == NULL || dst_node == NULL) {
     return NULL;
   }
-  return arc_it->second;
+  return GetArc(src_node, dst_node);
 }
 
 uint64_t FlowGraph::NextId() {
@@ -25,6 +25,7 @@
 #include <vector>
 
 #include "misc/map-util.h"
+#include "misc/object_pool.h"
 #include "scheduling/flow/flow_graph_arc.h"
 #include "scheduling/flow/flow_graph_node.h"
 
@@ -32,6 +33,11 @@ DECLARE_string(flow_scheduling_solver);
 
 namespace firmament {
 
+// Nodes are looked up via an array indexed by node id, and the nodes and arcs
+// are kept in contiguous arrays for fast iteration. The arrays are compacted
+// when nodes and arcs are removed, so the iteration order is not stable.
+// The node and arc objects themselves are allocated from pools, which re-use
+// the memory of removed nodes and arcs.
 class FlowGraph {
  public:
   FlowGraph();
@@ -44,20 +50,35 @@ class FlowGraph {
   void ChangeArcCost(FlowGraphArc* arc, int64_t cost);
   void DeleteArc(FlowGraphArc* arc);
   void DeleteNode(FlowGraphNode* node);
-  FlowGraphArc* GetArc(FlowGraphNode* src, FlowGraphNode* dst);
-  inline const unordered_set<FlowGraphArc*>& Arcs() const { return arc_set_; }
-  inline const unordered_map<uint64_t, FlowGraphNode*>& Nodes() const {
-    return node_map_;
+  FlowGraphArc* GetArc(FlowGraphNode* src, FlowGraphNode* dst) const;
+  /**
+   * Looks up the arc between two nodes.
+   * @return the arc, or NULL if either node or the arc does not exist
+   */
+  FlowGraphArc* GetArc(uint64_t src, uint64_t dst) const;
+  /**
+   * @return the node with the given id, or NULL if it does not exist
+   */
+  inline FlowGraphNode* GetNode(uint64_t id) const {
+    return id < node_by_id_.size() ? node_by_id_[id] : NULL;
   }
+  inline const vector<FlowGraphArc*>& Arcs() const { return arcs_; }
+  inline const vector<FlowGraphNode*>& Nodes() const { return nodes_; }
   inline const FlowGraphNode& Node(uint64_t id) const {
-    FlowGraphNode* node = FindPtrOrNull(node_map_, id);
+    FlowGraphNode* node = GetNode(id);
     CHECK_NOTNULL(node);
     return *node;
   }
-  inline uint64_t NumArcs() const { return arc_set_.size(); }
+  inline const ObjectPool<FlowGraphArc>& arc_pool() const {
+    return arc_pool_;
+  }
+  inline const ObjectPool<FlowGraphNode>& node_pool() const {
+    return node_pool_;
+  }
+  inline uint64_t NumArcs() const { return arcs_.size(); }
   inline uint64_t NumNodes() const {
     if (!FLAGS_flow_scheduling_solver.compare("flowlessly")) {
-      return node_map_.size();
+      return nodes_.size();
     } else {
       // TODO(malte): This is a work-around as cs2 and Relax IV do not allow
       // sparse node IDs, and will get tripped up
@@ -78,10 +99,17 @@ class FlowGraph {
   uint64_t NextId();
   void PopulateUnusedIds(uint64_t new_current_id);
 
-  unordered_set<FlowGraphArc*> arc_set_;
+  ObjectPool<FlowGraphArc> arc_pool_;
+  ObjectPool<FlowGraphNode> node_pool_;
+  // All arcs, in no particular order.
+  vector<FlowGraphArc*> arcs_;
   // Graph structure containers and helper fields
   uint64_t current_id_;
-  unordered_map<uint64_t, FlowGraphNode*> node_map_;
+  // All nodes, in no particular order.
+  vector<FlowGraphNode*> nodes_;
+  // Nodes indexed by id. Removed nodes leave NULL entries behind until their
+  // ids are re-used.
+  vector<FlowGraphNode*> node_by_id_;
   // Queue storing the ids of the nodes we've previously removed.
   queue<uint64_t> unused_ids_;
 };
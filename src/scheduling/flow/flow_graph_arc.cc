@@ -27,11 +27,13 @@ namespace firmament {
                              FlowGraphNode* dst_node)
       : src_(src), dst_(dst), cap_lower_bound_(0),
         cap_upper_bound_(0), cost_(0), src_node_(src_node),
-        dst_node_(dst_node), type_(OTHER) {}
+        dst_node_(dst_node), type_(OTHER), index_(0), outgoing_index_(0),
+        incoming_index_(0) {}
   FlowGraphArc::FlowGraphArc(uint64_t src, uint64_t dst, uint64_t clb,
                              uint64_t cub, int64_t cost,
                              FlowGraphNode* src_node, FlowGraphNode* dst_node)
       : src_(src), dst_(dst), cap_lower_bound_(clb), cap_upper_bound_(cub),
-        cost_(cost), src_node_(src_node), dst_node_(dst_node), type_(OTHER) {
+        cost_(cost), src_node_(src_node), dst_node_(dst_node), type_(OTHER),
+        index_(0), outgoing_index_(0), incoming_index_(0) {
   }
 } // namespace firmament
@@ -52,6 +52,12 @@ struct FlowGraphArc {
   FlowGraphNode* src_node_;
   FlowGraphNode* dst_node_;
   FlowGraphArcType type_;
+  // Positions of the arc in FlowGraph::Arcs(), in its source node's
+  // outgoing_arc_map_ and in its destination node's incoming_arc_map_.
+  // They are maintained by the FlowGraph.
+  uint32_t index_;
+  uint32_t outgoing_index_;
+  uint32_t incoming_index_;
 };
 
 } // namespace firmament
@@ -0,0 +1,155 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// The arcs of a flow graph node in one direction, keyed by the node at their
+// other end. The arcs are stored in a contiguous array, which makes iterating
+// over them cheap. The FlowGraph records the position of every arc in its
+// source's and destination's arrays, which makes removals take constant time:
+// the last arc is moved into the position of the removed arc. Hence, the order
+// of the arcs changes when arcs are removed.
+// find() scans the array while it is short. Once a node has more than
+// kIndexThreshold arcs in a direction (e.g., the sink, or the equivalence
+// classes of a dense task EC to machine EC graph), the map also keeps a hash
+// index from the other end's node id to the arc's position, so that lookups
+// stay cheap for high-degree nodes. FlowGraph::GetArc should be used to look
+// up an arc between two nodes, as it searches the shorter of the two arrays.
+
+#ifndef FIRMAMENT_SCHEDULING_FLOW_FLOW_GRAPH_ARC_MAP_H
+#define FIRMAMENT_SCHEDULING_FLOW_FLOW_GRAPH_ARC_MAP_H
+
+#include <utility>
+#include <vector>
+
+#include "base/common.h"
+#include "base/types.h"
+#include "misc/map-util.h"
+
+namespace firmament {
+
+// Forward declaration.
+struct FlowGraphArc;
+
+class FlowGraphArcMap {
+ public:
+  typedef pair<uint64_t, FlowGraphArc*> value_type;
+  typedef vector<value_type>::iterator iterator;
+  typedef vector<value_type>::const_iterator const_iterator;
+
+  inline FlowGraphArc* back() const {
+    return arcs_.back().second;
+  }
+  inline iterator begin() {
+    return arcs_.begin();
+  }
+  inline const_iterator begin() const {
+    return arcs_.begin();
+  }
+  inline void clear() {
+    arcs_.clear();
+    index_.reset();
+  }
+  inline bool empty() const {
+    return arcs_.empty();
+  }
+  inline iterator end() {
+    return arcs_.end();
+  }
+  inline const_iterator end() const {
+    return arcs_.end();
+  }
+  inline iterator find(uint64_t node_id) {
+    if (index_) {
+      const uint32_t* position = FindOrNull(*index_, node_id);
+      return position ? arcs_.begin() + *position : arcs_.end();
+    }
+    iterator it = arcs_.begin();
+    for (; it != arcs_.end() && it->first != node_id; ++it) {
+    }
+    return it;
+  }
+  inline const_iterator find(uint64_t node_id) const {
+    if (index_) {
+      const uint32_t* position = FindOrNull(*index_, node_id);
+      return position ? arcs_.begin() + *position : arcs_.end();
+    }
+    const_iterator it = arcs_.begin();
+    for (; it != arcs_.end() && it->first != node_id; ++it) {
+    }
+    return it;
+  }
+  inline uint64_t size() const {
+    return arcs_.size();
+  }
+  /**
+   * Appends an arc.
+   * @return the position of the arc
+   */
+  inline uint32_t Append(uint64_t node_id, FlowGraphArc* arc) {
+    uint32_t position = static_cast<uint32_t>(arcs_.size());
+    arcs_.push_back(value_type(node_id, arc));
+    if (index_) {
+      (*index_)[node_id] = position;
+    } else if (arcs_.size() > kIndexThreshold) {
+      BuildIndex();
+    }
+    return position;
+  }
+  /**
+   * Removes the arc at the given position.
+   * @return the arc that was moved into the position, or NULL if the removed
+   * arc was the last one
+   */
+  inline FlowGraphArc* RemoveAt(uint32_t position) {
+    DCHECK_LT(position, arcs_.size());
+    FlowGraphArc* moved_arc = NULL;
+    if (index_) {
+      index_->erase(arcs_[position].first);
+    }
+    if (position + 1 < arcs_.size()) {
+      arcs_[position] = arcs_.back();
+      moved_arc = arcs_[position].second;
+      if (index_) {
+        (*index_)[arcs_[position].first] = position;
+      }
+    }
+    arcs_.pop_back();
+    return moved_arc;
+  }
+
+  // Number of arcs above which lookups use a hash index.
+  static const uint64_t kIndexThreshold = 16;
+
+ private:
+  void BuildIndex() {
+    index_.reset(new unordered_map<uint64_t, uint32_t>());
+    for (uint32_t position = 0; position < arcs_.size(); ++position) {
+      (*index_)[arcs_[position].first] = position;
+    }
+  }
+
+  vector<value_type> arcs_;
+  // Position of every arc by the id of the node at its other end; only kept
+  // once the map has had more than kIndexThreshold arcs.
+  scoped_ptr<unordered_map<uint64_t, uint32_t>> index_;
+};
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SCHEDULING_FLOW_FLOW_GRAPH_ARC_MAP_H
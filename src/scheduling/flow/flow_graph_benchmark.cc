@@ -0,0 +1,392 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Memory and traversal benchmark for the FlowGraph. It builds a Quincy-style
+// scheduling graph (tasks with arcs to their job's unscheduled aggregator, to
+// a cluster aggregator and to preferred machines) and a CpuCostModel-style
+// graph (a dense bipartite graph between task equivalence classes and machine
+// equivalence classes), and compares the FlowGraph against the previous
+// layout, in which nodes and arcs were kept in hash containers and every node
+// had hash maps of its incoming and outgoing arcs.
+
+#include <malloc.h>
+
+#include <queue>
+#include <random>
+#include <utility>
+#include <vector>
+#include <boost/timer/timer.hpp>
+
+#include "base/common.h"
+#include "base/units.h"
+#include "scheduling/flow/flow_graph.h"
+
+DEFINE_uint64(benchmark_num_machines, 12000, "Number of machines.");
+DEFINE_uint64(benchmark_pus_per_machine, 4, "Number of PUs per machine.");
+DEFINE_uint64(benchmark_num_tasks, 100000, "Number of tasks.");
+DEFINE_uint64(benchmark_tasks_per_job, 100, "Number of tasks per job.");
+DEFINE_uint64(benchmark_preferences_per_task, 2,
+              "Number of preference arcs from every task to machines.");
+DEFINE_uint64(benchmark_num_task_ecs, 100,
+              "Number of task equivalence classes in the CpuCostModel-style "
+              "graph. Every task EC has an arc to every machine EC.");
+
+namespace firmament {
+
+// The node and arc containers of the FlowGraph before it was changed to use
+// arrays. The nodes carry the same payload as FlowGraphNodes.
+struct LegacyArc;
+
+struct LegacyNode {
+  explicit LegacyNode(uint64_t id)
+    : id_(id), excess_(0), type_(FlowNodeType::SINK),
+      job_id_(boost::uuids::nil_uuid()),
+      resource_id_(boost::uuids::nil_uuid()), rd_ptr_(NULL), td_ptr_(NULL),
+      ec_id_(0), visited_(0) {
+  }
+
+  uint64_t id_;
+  int64_t excess_;
+  FlowNodeType type_;
+  JobID_t job_id_;
+  ResourceID_t resource_id_;
+  ResourceDescriptor* rd_ptr_;
+  TaskDescriptor* td_ptr_;
+  EquivClass_t ec_id_;
+  string comment_;
+  unordered_map<uint64_t, LegacyArc*> outgoing_arc_map_;
+  unordered_map<uint64_t, LegacyArc*> incoming_arc_map_;
+  uint32_t visited_;
+};
+
+struct LegacyArc {
+  LegacyArc(LegacyNode* src_node, LegacyNode* dst_node)
+    : src_(src_node->id_), dst_(dst_node->id_), cap_lower_bound_(0),
+      cap_upper_bound_(0), cost_(0), src_node_(src_node),
+      dst_node_(dst_node), type_(OTHER) {
+  }
+
+  uint64_t src_;
+  uint64_t dst_;
+  uint64_t cap_lower_bound_;
+  uint64_t cap_upper_bound_;
+  int64_t cost_;
+  LegacyNode* src_node_;
+  LegacyNode* dst_node_;
+  FlowGraphArcType type_;
+};
+
+class LegacyFlowGraph {
+ public:
+  LegacyFlowGraph() : current_id_(1) {
+  }
+  ~LegacyFlowGraph() {
+    while (!node_map_.empty()) {
+      DeleteNode(node_map_.begin()->second);
+    }
+  }
+  LegacyArc* AddArc(uint64_t src, uint64_t dst) {
+    LegacyNode* src_node = FindPtrOrNull(node_map_, src);
+    LegacyNode* dst_node = FindPtrOrNull(node_map_, dst);
+    LegacyArc* arc = new LegacyArc(src_node, dst_node);
+    CHECK(arc_set_.insert(arc).second);
+    CHECK(InsertIfNotPresent(&src_node->outgoing_arc_map_, dst, arc));
+    CHECK(InsertIfNotPresent(&dst_node->incoming_arc_map_, src, arc));
+    return arc;
+  }
+  LegacyNode* AddNode() {
+    LegacyNode* node = new LegacyNode(current_id_++);
+    CHECK(InsertIfNotPresent(&node_map_, node->id_, node));
+    return node;
+  }
+  void DeleteArc(LegacyArc* arc) {
+    arc->src_node_->outgoing_arc_map_.erase(arc->dst_);
+    arc->dst_node_->incoming_arc_map_.erase(arc->src_);
+    arc_set_.erase(arc);
+    delete arc;
+  }
+  void DeleteNode(LegacyNode* node) {
+    while (!node->outgoing_arc_map_.empty()) {
+      DeleteArc(node->outgoing_arc_map_.begin()->second);
+    }
+    while (!node->incoming_arc_map_.empty()) {
+      DeleteArc(node->incoming_arc_map_.begin()->second);
+    }
+    node_map_.erase(node->id_);
+    delete node;
+  }
+  LegacyArc* GetArc(LegacyNode* src, LegacyNode* dst) const {
+    return FindPtrOrNull(src->outgoing_arc_map_, dst->id_);
+  }
+  LegacyNode* GetNode(uint64_t id) const {
+    return FindPtrOrNull(node_map_, id);
+  }
+  const unordered_set<LegacyArc*>& Arcs() const {
+    return arc_set_;
+  }
+  const unordered_map<uint64_t, LegacyNode*>& Nodes() const {
+    return node_map_;
+  }
+
+ private:
+  unordered_set<LegacyArc*> arc_set_;
+  uint64_t current_id_;
+  unordered_map<uint64_t, LegacyNode*> node_map_;
+};
+
+// Node ids are assigned in the same order by both graphs. The tasks are the
+// nodes with the highest ids.
+struct GraphShape {
+  uint64_t sink;
+  vector<uint64_t> machines;
+  vector<uint64_t> tasks;
+  vector<pair<uint64_t, uint64_t>> arcs;
+  // Pairs of nodes whose arc is looked up, as the FlowGraphManager does when
+  // it updates the graph.
+  vector<pair<uint64_t, uint64_t>> lookups;
+};
+
+struct BenchmarkResult {
+  uint64_t memory_bytes;
+  double build_ms;
+  double bfs_ms;
+  double scan_ms;
+  double lookup_ms;
+  double delete_ms;
+  uint64_t checksum;
+};
+
+uint64_t HeapBytesInUse() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || \
+    (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  return mallinfo2().uordblks;
+#else
+  return static_cast<uint64_t>(mallinfo().uordblks);
+#endif
+}
+
+double ElapsedMs(const boost::timer::cpu_timer& timer) {
+  return static_cast<double>(timer.elapsed().wall) /
+    (NANOSECONDS_IN_MICROSECOND * MILLISECONDS_TO_MICROSECONDS);
+}
+
+// Adds the sink, the machines and their PUs.
+void GenerateMachines(GraphShape* shape, uint64_t* next_id) {
+  shape->sink = (*next_id)++;
+  for (uint64_t m = 0; m < FLAGS_benchmark_num_machines; ++m) {
+    uint64_t machine = (*next_id)++;
+    shape->machines.push_back(machine);
+    for (uint64_t p = 0; p < FLAGS_benchmark_pus_per_machine; ++p) {
+      uint64_t pu = (*next_id)++;
+      shape->arcs.push_back(make_pair(machine, pu));
+      shape->arcs.push_back(make_pair(pu, shape->sink));
+    }
+  }
+}
+
+GraphShape GenerateQuincyShape() {
+  GraphShape shape;
+  std::mt19937 rng(42);
+  uint64_t next_id = 1;
+  GenerateMachines(&shape, &next_id);
+  uint64_t cluster_agg = next_id++;
+  for (auto& machine : shape.machines) {
+    shape.arcs.push_back(make_pair(cluster_agg, machine));
+  }
+  std::uniform_int_distribution<uint64_t> machine_dist(
+      0, shape.machines.size() - 1);
+  uint64_t unsched_agg = 0;
+  for (uint64_t t = 0; t < FLAGS_benchmark_num_tasks; ++t) {
+    if (t % FLAGS_benchmark_tasks_per_job == 0) {
+      unsched_agg = next_id++;
+      shape.arcs.push_back(make_pair(unsched_agg, shape.sink));
+    }
+    uint64_t task = next_id++;
+    shape.tasks.push_back(task);
+    shape.arcs.push_back(make_pair(task, unsched_agg));
+    shape.lookups.push_back(make_pair(task, unsched_agg));
+    shape.arcs.push_back(make_pair(task, cluster_agg));
+    unordered_set<uint64_t> preferences;
+    while (preferences.size() < FLAGS_benchmark_preferences_per_task &&
+           preferences.size() < shape.machines.size()) {
+      uint64_t machine = shape.machines[machine_dist(rng)];
+      if (preferences.insert(machine).second) {
+        shape.arcs.push_back(make_pair(task, machine));
+      }
+    }
+  }
+  return shape;
+}
+
+// Every machine has a machine EC, and every task EC has an arc to every
+// machine EC, as in the CpuCostModel. The arcs between the ECs are looked up
+// whenever the FlowGraphManager updates them.
+GraphShape GenerateCpuCostModelShape() {
+  GraphShape shape;
+  uint64_t next_id = 1;
+  GenerateMachines(&shape, &next_id);
+  vector<uint64_t> machine_ecs;
+  for (auto& machine : shape.machines) {
+    uint64_t machine_ec = next_id++;
+    machine_ecs.push_back(machine_ec);
+    shape.arcs.push_back(make_pair(machine_ec, machine));
+  }
+  vector<uint64_t> task_ecs;
+  for (uint64_t e = 0; e < FLAGS_benchmark_num_task_ecs; ++e) {
+    uint64_t task_ec = next_id++;
+    task_ecs.push_back(task_ec);
+    for (auto& machine_ec : machine_ecs) {
+      shape.arcs.push_back(make_pair(task_ec, machine_ec));
+      shape.lookups.push_back(make_pair(task_ec, machine_ec));
+    }
+  }
+  uint64_t unsched_agg = 0;
+  for (uint64_t t = 0; t < FLAGS_benchmark_num_tasks; ++t) {
+    if (t % FLAGS_benchmark_tasks_per_job == 0) {
+      unsched_agg = next_id++;
+      shape.arcs.push_back(make_pair(unsched_agg, shape.sink));
+    }
+    uint64_t task = next_id++;
+    shape.tasks.push_back(task);
+    shape.arcs.push_back(make_pair(task, unsched_agg));
+    shape.arcs.push_back(make_pair(task, task_ecs[t % task_ecs.size()]));
+  }
+  return shape;
+}
+
+// The graph-specific operations the benchmark needs.
+uint64_t NodeId(const FlowGraphNode* node) {
+  return node->id_;
+}
+
+uint64_t NodeId(const pair<const uint64_t, LegacyNode*>& id_node) {
+  return id_node.first;
+}
+
+const FlowGraphNode* NodeOf(const FlowGraphNode* node) {
+  return node;
+}
+
+const LegacyNode* NodeOf(const pair<const uint64_t, LegacyNode*>& id_node) {
+  return id_node.second;
+}
+
+template <typename Graph>
+BenchmarkResult RunBenchmark(const GraphShape& shape) {
+  BenchmarkResult result;
+  result.checksum = 0;
+  uint64_t heap_before = HeapBytesInUse();
+  boost::timer::cpu_timer timer;
+  Graph* graph = new Graph();
+  uint64_t num_nodes = shape.tasks.back() + 1;
+  for (uint64_t id = 1; id < num_nodes; ++id) {
+    graph->AddNode();
+  }
+  int64_t cost = 0;
+  for (auto& src_dst : shape.arcs) {
+    auto arc = graph->AddArc(src_dst.first, src_dst.second);
+    arc->cap_upper_bound_ = 1;
+    arc->cost_ = cost++ % 100;
+  }
+  result.build_ms = ElapsedMs(timer);
+  result.memory_bytes = HeapBytesInUse() - heap_before;
+
+  // Breadth-first traversal from the sink over the incoming arcs, as done by
+  // the FlowGraphManager when it updates the costs.
+  timer.start();
+  auto sink_node = graph->GetNode(shape.sink);
+  std::queue<decltype(sink_node)> to_visit;
+  sink_node->visited_ = 1;
+  to_visit.push(sink_node);
+  while (!to_visit.empty()) {
+    auto cur_node = to_visit.front();
+    to_visit.pop();
+    result.checksum += cur_node->id_;
+    for (auto& src_arc : cur_node->incoming_arc_map_) {
+      auto src_node = src_arc.second->src_node_;
+      if (src_node->visited_ != 1) {
+        src_node->visited_ = 1;
+        to_visit.push(src_node);
+      }
+    }
+  }
+  result.bfs_ms = ElapsedMs(timer);
+
+  // Scan of all nodes and arcs, as done by the exporters.
+  timer.start();
+  for (const auto& node : graph->Nodes()) {
+    result.checksum += NodeId(node) + NodeOf(node)->excess_;
+  }
+  for (const auto& arc : graph->Arcs()) {
+    result.checksum += arc->src_ + arc->dst_ + arc->cost_;
+  }
+  result.scan_ms = ElapsedMs(timer);
+
+  timer.start();
+  for (auto& src_dst : shape.lookups) {
+    auto src_node = graph->GetNode(src_dst.first);
+    auto dst_node = graph->GetNode(src_dst.second);
+    result.checksum += graph->GetArc(src_node, dst_node)->cost_;
+  }
+  result.lookup_ms = ElapsedMs(timer);
+
+  // Remove all the tasks.
+  timer.start();
+  for (auto& task : shape.tasks) {
+    graph->DeleteNode(graph->GetNode(task));
+  }
+  result.delete_ms = ElapsedMs(timer);
+  delete graph;
+  return result;
+}
+
+void PrintResult(const char* name, const BenchmarkResult& result) {
+  LOG(INFO) << name << ": memory " << result.memory_bytes / BYTES_TO_MB
+            << " MB, build " << result.build_ms << " ms, BFS "
+            << result.bfs_ms << " ms, scan " << result.scan_ms
+            << " ms, lookup " << result.lookup_ms << " ms, delete tasks "
+            << result.delete_ms << " ms (checksum " << result.checksum << ")";
+}
+
+}  // namespace firmament
+
+int main(int argc, char *argv[]) {
+  firmament::common::InitFirmament(argc, argv);
+  FLAGS_logtostderr = true;
+  firmament::GraphShape shape = firmament::GenerateQuincyShape();
+  LOG(INFO) << "Quincy graph with " << shape.tasks.back() << " nodes and "
+            << shape.arcs.size() << " arcs";
+  firmament::PrintResult(
+      "Legacy layout",
+      firmament::RunBenchmark<firmament::LegacyFlowGraph>(shape));
+  firmament::PrintResult(
+      "FlowGraph",
+      firmament::RunBenchmark<firmament::FlowGraph>(shape));
+  shape = firmament::GenerateCpuCostModelShape();
+  LOG(INFO) << "CpuCostModel graph with " << shape.tasks.back()
+            << " nodes and " << shape.arcs.size() << " arcs";
+  firmament::PrintResult(
+      "Legacy layout",
+      firmament::RunBenchmark<firmament::LegacyFlowGraph>(shape));
+  firmament::PrintResult(
+      "FlowGraph",
+      firmament::RunBenchmark<firmament::FlowGraph>(shape));
+  return 0;
+}
@@ -0,0 +1,516 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Benchmark for the compaction of the flow graph changes recorded between two
+// scheduling rounds. It replays change logs through a FlowGraphChangeManager
+// and compares the streaming compaction done while the changes are recorded
+// against the previous compactor, which made three passes over the recorded
+// changes (removing duplicates, merging changes to the same arc and purging
+// changes to removed nodes), each with fresh hash maps.
+//
+// The change logs are either DIMACS files written by a simulation run with
+// --debug_flow_graph and --incremental_flow (a full graph followed by the
+// incremental rounds, e.g. debug_0.dm,debug_incremental_1.dm,...), or a
+// synthetic node drain. Note that the incremental debug files contain the
+// already optimized changes, so the synthetic drain has more to compact.
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+#include <vector>
+#include <boost/algorithm/string.hpp>
+#include <boost/timer/timer.hpp>
+
+#include "base/common.h"
+#include "base/units.h"
+#include "misc/map-util.h"
+#include "scheduling/flow/dimacs_change.h"
+#include "scheduling/flow/dimacs_change_stats.h"
+#include "scheduling/flow/flow_graph_change_manager.h"
+
+DEFINE_string(benchmark_change_logs, "", "Comma-separated DIMACS change logs "
+              "to replay, one per scheduling round. A synthetic node drain "
+              "is replayed if empty.");
+DEFINE_uint64(benchmark_num_machines, 2000, "Number of machines.");
+DEFINE_uint64(benchmark_pus_per_machine, 8, "Number of PUs per machine.");
+DEFINE_uint64(benchmark_num_tasks, 40000, "Number of tasks; the first tasks "
+              "run on the PUs.");
+DEFINE_uint64(benchmark_tasks_per_job, 100, "Number of tasks per job.");
+DEFINE_uint64(benchmark_drained_machines, 500,
+              "Number of machines drained in the second round.");
+DEFINE_uint64(benchmark_cost_updates, 3, "Number of times the costs of an "
+              "evicted task's arcs are updated in a round.");
+
+DECLARE_bool(incremental_flow);
+DECLARE_bool(remove_duplicate_changes);
+DECLARE_bool(merge_changes_to_same_arc);
+DECLARE_bool(purge_changes_before_node_removal);
+
+namespace firmament {
+
+// A recorded change. Node ids are the ids of the log, which are mapped to the
+// ids of the replayed graph.
+struct LogRecord {
+  DIMACSChange change;
+  string comment;
+};
+
+typedef vector<LogRecord> Round;
+
+struct ReplayResult {
+  double record_ms;
+  double compact_ms;
+  uint64_t num_recorded;
+  uint64_t num_compacted;
+  vector<vector<DIMACSChange>> rounds;
+};
+
+double ElapsedMs(const boost::timer::cpu_timer& timer) {
+  return static_cast<double>(timer.elapsed().wall) /
+    (NANOSECONDS_IN_MICROSECOND * MILLISECONDS_TO_MICROSECONDS);
+}
+
+// The compactor the FlowGraphChangeManager used before the changes were
+// compacted while they are recorded.
+class LegacyChangeCompactor {
+ public:
+  static void Compact(vector<DIMACSChange>* changes) {
+    RemoveDuplicateChanges(changes);
+    MergeChangesToSameArc(changes);
+    PurgeChangesBeforeNodeRemoval(changes);
+  }
+
+ private:
+  struct ArcChangeEntry {
+    uint64_t index_;
+    uint64_t src_generation_;
+    uint64_t dst_generation_;
+  };
+  typedef unordered_map<pair<uint64_t, uint64_t>, ArcChangeEntry,
+                        boost::hash<pair<uint64_t, uint64_t>>> ArcChangeMap;
+
+  static ArcChangeEntry* FindArcChange(
+      const DIMACSChange& change, ArcChangeMap* arc_changes,
+      const unordered_map<uint64_t, uint64_t>& node_generations) {
+    ArcChangeEntry* entry =
+      FindOrNull(*arc_changes, make_pair(change.src_, change.dst_));
+    if (entry &&
+        entry->src_generation_ == FindWithDefault(node_generations,
+                                                  change.src_, 0) &&
+        entry->dst_generation_ == FindWithDefault(node_generations,
+                                                  change.dst_, 0)) {
+      return entry;
+    }
+    return NULL;
+  }
+
+  static void RecordArcChange(
+      const DIMACSChange& change, uint64_t index, ArcChangeMap* arc_changes,
+      const unordered_map<uint64_t, uint64_t>& node_generations) {
+    ArcChangeEntry& entry =
+      (*arc_changes)[make_pair(change.src_, change.dst_)];
+    entry.index_ = index;
+    entry.src_generation_ = FindWithDefault(node_generations, change.src_, 0);
+    entry.dst_generation_ = FindWithDefault(node_generations, change.dst_, 0);
+  }
+
+  static void MergeChangesToSameArc(vector<DIMACSChange>* changes) {
+    ArcChangeMap arc_changes;
+    unordered_map<uint64_t, uint64_t> node_generations;
+    uint64_t num_kept = 0;
+    for (uint64_t index = 0; index < changes->size(); ++index) {
+      const DIMACSChange& change = (*changes)[index];
+      if (change.is_arc_change()) {
+        ArcChangeEntry* entry =
+          FindArcChange(change, &arc_changes, node_generations);
+        if (entry) {
+          DIMACSChange* first_change = &(*changes)[entry->index_];
+          first_change->cap_lower_bound_ = change.cap_lower_bound_;
+          first_change->cap_upper_bound_ = change.cap_upper_bound_;
+          first_change->cost_ = change.cost_;
+          first_change->type_ = change.type_;
+          continue;
+        }
+        RecordArcChange(change, num_kept, &arc_changes, node_generations);
+      } else if (change.op_ == DIMACS_RECORD_ADD_NODE) {
+        node_generations[change.src_]++;
+      }
+      (*changes)[num_kept++] = change;
+    }
+    changes->resize(num_kept);
+  }
+
+  static void PurgeChangesBeforeNodeRemoval(vector<DIMACSChange>* changes) {
+    unordered_set<uint64_t> nodes_removed;
+    uint64_t first_kept = changes->size();
+    for (uint64_t index = changes->size(); index > 0; --index) {
+      const DIMACSChange& change = (*changes)[index - 1];
+      bool keep = true;
+      if (change.op_ == DIMACS_RECORD_REMOVE_NODE) {
+        keep = nodes_removed.insert(change.src_).second;
+      } else if (change.op_ == DIMACS_RECORD_ADD_NODE) {
+        nodes_removed.erase(change.src_);
+      } else {
+        keep = nodes_removed.find(change.src_) == nodes_removed.end() &&
+          nodes_removed.find(change.dst_) == nodes_removed.end();
+      }
+      if (keep) {
+        (*changes)[--first_kept] = change;
+      }
+    }
+    changes->erase(changes->begin(), changes->begin() + first_kept);
+  }
+
+  static void RemoveDuplicateChanges(vector<DIMACSChange>* changes) {
+    ArcChangeMap arc_changes;
+    unordered_map<uint64_t, uint64_t> node_generations;
+    uint64_t num_kept = 0;
+    for (uint64_t index = 0; index < changes->size(); ++index) {
+      const DIMACSChange& change = (*changes)[index];
+      if (change.is_arc_change()) {
+        ArcChangeEntry* entry =
+          FindArcChange(change, &arc_changes, node_generations);
+        if (entry && (*changes)[entry->index_].SameEffect(change)) {
+          continue;
+        }
+        RecordArcChange(change, num_kept, &arc_changes, node_generations);
+      } else if (change.op_ == DIMACS_RECORD_ADD_NODE) {
+        node_generations[change.src_]++;
+      }
+      (*changes)[num_kept++] = change;
+    }
+    changes->resize(num_kept);
+  }
+};
+
+FlowNodeType FlowNodeTypeOf(uint32_t dimacs_node_type) {
+  switch (dimacs_node_type) {
+    case DIMACS_NODE_TASK:
+      return FlowNodeType::UNSCHEDULED_TASK;
+    case DIMACS_NODE_PU:
+      return FlowNodeType::PU;
+    case DIMACS_NODE_SINK:
+      return FlowNodeType::SINK;
+    case DIMACS_NODE_MACHINE:
+      return FlowNodeType::MACHINE;
+    case DIMACS_NODE_INTERMEDIATE_RES:
+      return FlowNodeType::CORE;
+    default:
+      return FlowNodeType::EQUIVALENCE_CLASS;
+  }
+}
+
+// Reads a DIMACS file, either a full graph or incremental changes, as one
+// round. Comment lines become the comment of the following change.
+Round ReadChangeLog(const string& file_name) {
+  Round round;
+  FILE* log_file = fopen(file_name.c_str(), "r");
+  CHECK(log_file != NULL) << "Cannot open " << file_name;
+  char line[1024];
+  string comment;
+  while (fgets(line, sizeof(line), log_file)) {
+    LogRecord record;
+    record.change = DIMACSChange();
+    DIMACSChange* change = &record.change;
+    uint32_t type = 0;
+    int num_fields = 0;
+    switch (line[0]) {
+      case 'c':
+        if (strncmp(line, "c EOI", 5)) {
+          comment = boost::trim_copy(string(line + 1));
+        }
+        continue;
+      case 'n':
+        change->op_ = DIMACS_RECORD_ADD_NODE;
+        num_fields = sscanf(line, "n %" SCNu64 " %" SCNd64 " %" SCNu32,
+                            &change->src_, &change->cost_, &change->type_);
+        CHECK_EQ(num_fields, 3) << line;
+        break;
+      case 'r':
+        change->op_ = DIMACS_RECORD_REMOVE_NODE;
+        num_fields = sscanf(line, "r %" SCNu64, &change->src_);
+        CHECK_EQ(num_fields, 1) << line;
+        break;
+      case 'a':
+      case 'x':
+        change->op_ = line[0] == 'a' ? DIMACS_RECORD_NEW_ARC :
+          DIMACS_RECORD_CHANGE_ARC;
+        // The arcs of a full graph have no type.
+        num_fields = sscanf(line + 1, " %" SCNu64 " %" SCNu64 " %" SCNu64
+                            " %" SCNu64 " %" SCNd64 " %" SCNu32,
+                            &change->src_, &change->dst_,
+                            &change->cap_lower_bound_,
+                            &change->cap_upper_bound_, &change->cost_, &type);
+        CHECK_GE(num_fields, 5) << line;
+        change->type_ = type;
+        break;
+      default:
+        // Problem lines and anything else we don't replay.
+        continue;
+    }
+    record.comment = comment;
+    comment.clear();
+    round.push_back(record);
+  }
+  fclose(log_file);
+  return round;
+}
+
+// Generates the change logs of two scheduling rounds around a node drain. In
+// the first round, the cluster is built and the first tasks are placed on the
+// PUs. In the second round, the tasks on the drained machines are evicted,
+// the costs of their arcs are updated several times and the machines are
+// removed. A new job is submitted in the same round, so node ids are re-used.
+vector<Round> GenerateNodeDrain() {
+  vector<Round> rounds(2);
+  uint64_t next_id = 1;
+  auto add_node = [&](Round* round, uint32_t type, int64_t excess) {
+    LogRecord record;
+    record.change = DIMACSChange();
+    record.change.op_ = DIMACS_RECORD_ADD_NODE;
+    record.change.type_ = type;
+    record.change.src_ = next_id++;
+    record.change.cost_ = excess;
+    round->push_back(record);
+    return record.change.src_;
+  };
+  auto change_arc = [](Round* round, uint8_t op, uint64_t src, uint64_t dst,
+                       uint64_t cap_upper_bound, int64_t cost,
+                       uint32_t type) {
+    LogRecord record;
+    record.change = DIMACSChange();
+    record.change.op_ = op;
+    record.change.type_ = type;
+    record.change.src_ = src;
+    record.change.dst_ = dst;
+    record.change.cap_upper_bound_ = cap_upper_bound;
+    record.change.cost_ = cost;
+    round->push_back(record);
+  };
+  auto remove_node = [](Round* round, uint64_t id) {
+    LogRecord record;
+    record.change = DIMACSChange();
+    record.change.op_ = DIMACS_RECORD_REMOVE_NODE;
+    record.change.src_ = id;
+    round->push_back(record);
+  };
+  Round* build = &rounds[0];
+  uint64_t sink = add_node(build, DIMACS_NODE_SINK, 0);
+  uint64_t cluster_agg = add_node(build, DIMACS_NODE_OTHER, 0);
+  vector<uint64_t> machines;
+  vector<uint64_t> pus;
+  for (uint64_t m = 0; m < FLAGS_benchmark_num_machines; ++m) {
+    uint64_t machine = add_node(build, DIMACS_NODE_MACHINE, 0);
+    machines.push_back(machine);
+    change_arc(build, DIMACS_RECORD_NEW_ARC, cluster_agg, machine,
+               FLAGS_benchmark_pus_per_machine, 0, OTHER);
+    for (uint64_t p = 0; p < FLAGS_benchmark_pus_per_machine; ++p) {
+      uint64_t pu = add_node(build, DIMACS_NODE_PU, 0);
+      pus.push_back(pu);
+      change_arc(build, DIMACS_RECORD_NEW_ARC, machine, pu, 1, 0, OTHER);
+      change_arc(build, DIMACS_RECORD_NEW_ARC, pu, sink, 1, 0, OTHER);
+    }
+  }
+  vector<uint64_t> tasks;
+  vector<uint64_t> task_unsched_aggs;
+  uint64_t unsched_agg = 0;
+  for (uint64_t t = 0; t < FLAGS_benchmark_num_tasks; ++t) {
+    if (t % FLAGS_benchmark_tasks_per_job == 0) {
+      unsched_agg = add_node(build, DIMACS_NODE_OTHER, 0);
+      change_arc(build, DIMACS_RECORD_NEW_ARC, unsched_agg, sink,
+                 FLAGS_benchmark_tasks_per_job, 0, OTHER);
+    }
+    uint64_t task = add_node(build, DIMACS_NODE_TASK, 1);
+    tasks.push_back(task);
+    task_unsched_aggs.push_back(unsched_agg);
+    change_arc(build, DIMACS_RECORD_NEW_ARC, task, unsched_agg, 1, 1000,
+               OTHER);
+    change_arc(build, DIMACS_RECORD_NEW_ARC, task, cluster_agg, 1, 500,
+               OTHER);
+    if (t < pus.size()) {
+      change_arc(build, DIMACS_RECORD_NEW_ARC, task, pus[t], 1, 0, RUNNING);
+    }
+  }
+  Round* drain = &rounds[1];
+  uint64_t num_drained =
+    min(FLAGS_benchmark_drained_machines, FLAGS_benchmark_num_machines);
+  for (uint64_t m = 0; m < num_drained; ++m) {
+    for (uint64_t p = 0; p < FLAGS_benchmark_pus_per_machine; ++p) {
+      uint64_t pu_index = m * FLAGS_benchmark_pus_per_machine + p;
+      if (pu_index >= tasks.size()) {
+        continue;
+      }
+      uint64_t task = tasks[pu_index];
+      // Evict the task and update the costs of its arcs while the cost
+      // model reacts to the eviction.
+      change_arc(drain, DIMACS_RECORD_CHANGE_ARC, task, pus[pu_index], 0, 0,
+                 RUNNING);
+      for (uint64_t u = 1; u <= FLAGS_benchmark_cost_updates; ++u) {
+        change_arc(drain, DIMACS_RECORD_CHANGE_ARC, task,
+                   task_unsched_aggs[pu_index], 1, 1000 + u, OTHER);
+        change_arc(drain, DIMACS_RECORD_CHANGE_ARC, task, cluster_agg, 1,
+                   500 + u, OTHER);
+      }
+      change_arc(drain, DIMACS_RECORD_CHANGE_ARC, pus[pu_index], sink, 0, 0,
+                 OTHER);
+      remove_node(drain, pus[pu_index]);
+    }
+    change_arc(drain, DIMACS_RECORD_CHANGE_ARC, cluster_agg, machines[m], 0,
+               0, OTHER);
+    remove_node(drain, machines[m]);
+  }
+  // The new job's nodes re-use the ids of the removed resources.
+  uint64_t new_unsched_agg = add_node(drain, DIMACS_NODE_OTHER, 0);
+  change_arc(drain, DIMACS_RECORD_NEW_ARC, new_unsched_agg, sink,
+             FLAGS_benchmark_tasks_per_job, 0, OTHER);
+  for (uint64_t t = 0; t < FLAGS_benchmark_tasks_per_job; ++t) {
+    uint64_t task = add_node(drain, DIMACS_NODE_TASK, 1);
+    change_arc(drain, DIMACS_RECORD_NEW_ARC, task, new_unsched_agg, 1, 1000,
+               OTHER);
+    change_arc(drain, DIMACS_RECORD_NEW_ARC, task, cluster_agg, 1, 500,
+               OTHER);
+  }
+  return rounds;
+}
+
+// Applies a recorded change to the flow graph via the change manager.
+void ReplayRecord(const LogRecord& record,
+                  unordered_map<uint64_t, uint64_t>* node_ids,
+                  FlowGraphChangeManager* change_manager) {
+  const DIMACSChange& change = record.change;
+  const char* comment = record.comment.c_str();
+  FlowGraph* graph = change_manager->mutable_flow_graph();
+  switch (change.op_) {
+    case DIMACS_RECORD_ADD_NODE: {
+      FlowGraphNode* node =
+        change_manager->AddNode(FlowNodeTypeOf(change.type_), change.cost_,
+                                ADD_TASK_NODE, comment);
+      (*node_ids)[change.src_] = node->id_;
+      break;
+    }
+    case DIMACS_RECORD_REMOVE_NODE: {
+      FlowGraphNode* node = graph->GetNode(FindOrDie(*node_ids, change.src_));
+      change_manager->DeleteNode(node, DEL_TASK_NODE, comment);
+      node_ids->erase(change.src_);
+      break;
+    }
+    case DIMACS_RECORD_NEW_ARC:
+      change_manager->AddArc(FindOrDie(*node_ids, change.src_),
+                             FindOrDie(*node_ids, change.dst_),
+                             change.cap_lower_bound_, change.cap_upper_bound_,
+                             change.cost_,
+                             static_cast<FlowGraphArcType>(change.type_),
+                             ADD_ARC_TASK_TO_RES, comment);
+      break;
+    case DIMACS_RECORD_CHANGE_ARC: {
+      FlowGraphArc* arc = graph->GetArc(FindOrDie(*node_ids, change.src_),
+                                        FindOrDie(*node_ids, change.dst_));
+      CHECK_NOTNULL(arc);
+      if (change.cap_upper_bound_ == 0) {
+        change_manager->DeleteArc(arc, DEL_ARC_TASK_TO_RES, comment);
+      } else {
+        change_manager->ChangeArc(arc, change.cap_lower_bound_,
+                                  change.cap_upper_bound_, change.cost_,
+                                  CHG_ARC_TASK_TO_RES, comment);
+      }
+      break;
+    }
+    default:
+      LOG(FATAL) << "Unexpected change: " << static_cast<uint32_t>(change.op_);
+  }
+}
+
+ReplayResult Replay(const vector<Round>& rounds, bool streaming) {
+  ReplayResult result;
+  result.record_ms = 0;
+  result.compact_ms = 0;
+  result.num_recorded = 0;
+  result.num_compacted = 0;
+  // The legacy compactor gets the changes as they were recorded.
+  FLAGS_remove_duplicate_changes = streaming;
+  FLAGS_merge_changes_to_same_arc = streaming;
+  FLAGS_purge_changes_before_node_removal = streaming;
+  DIMACSChangeStats dimacs_stats;
+  FlowGraphChangeManager change_manager(&dimacs_stats);
+  unordered_map<uint64_t, uint64_t> node_ids;
+  for (auto& round : rounds) {
+    boost::timer::cpu_timer timer;
+    for (auto& record : round) {
+      ReplayRecord(record, &node_ids, &change_manager);
+    }
+    result.record_ms += ElapsedMs(timer);
+    result.num_recorded += round.size();
+    timer.start();
+    if (streaming) {
+      result.rounds.push_back(change_manager.GetOptimizedGraphChanges());
+    } else {
+      vector<DIMACSChange> changes = change_manager.GetGraphChanges();
+      LegacyChangeCompactor::Compact(&changes);
+      result.rounds.push_back(changes);
+    }
+    result.compact_ms += ElapsedMs(timer);
+    result.num_compacted += result.rounds.back().size();
+    change_manager.ResetChanges();
+  }
+  return result;
+}
+
+void PrintResult(const char* name, const ReplayResult& result) {
+  LOG(INFO) << name << ": " << result.num_recorded << " changes recorded in "
+            << result.record_ms << " ms, compacted to "
+            << result.num_compacted << " changes in " << result.compact_ms
+            << " ms; " << result.record_ms + result.compact_ms
+            << " ms in total";
+}
+
+}  // namespace firmament
+
+int main(int argc, char *argv[]) {
+  firmament::common::InitFirmament(argc, argv);
+  FLAGS_logtostderr = true;
+  FLAGS_incremental_flow = true;
+  std::vector<firmament::Round> rounds;
+  if (FLAGS_benchmark_change_logs.empty()) {
+    rounds = firmament::GenerateNodeDrain();
+  } else {
+    std::vector<std::string> file_names;
+    boost::split(file_names, FLAGS_benchmark_change_logs,
+                 boost::is_any_of(","));
+    for (auto& file_name : file_names) {
+      rounds.push_back(firmament::ReadChangeLog(file_name));
+    }
+  }
+  firmament::ReplayResult legacy = firmament::Replay(rounds, false);
+  firmament::ReplayResult streaming = firmament::Replay(rounds, true);
+  // Both compactors must produce the same changes.
+  CHECK_EQ(legacy.rounds.size(), streaming.rounds.size());
+  for (uint64_t r = 0; r < legacy.rounds.size(); ++r) {
+    CHECK_EQ(legacy.rounds[r].size(), streaming.rounds[r].size())
+      << "in round " << r;
+    for (uint64_t i = 0; i < legacy.rounds[r].size(); ++i) {
+      CHECK(legacy.rounds[r][i].SameEffect(streaming.rounds[r][i]))
+        << "change " << i << " in round " << r;
+    }
+  }
+  firmament::PrintResult("Three-pass compaction", legacy);
+  firmament::PrintResult("Streaming compaction", streaming);
+  return 0;
+}
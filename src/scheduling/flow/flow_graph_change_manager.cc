@@ -20,11 +20,6 @@
 
 #include "scheduling/flow/flow_graph_change_manager.h"
 
-#include "scheduling/flow/dimacs_add_node.h"
-#include "scheduling/flow/dimacs_change_arc.h"
-#include "scheduling/flow/dimacs_new_arc.h"
-#include "scheduling/flow/dimacs_remove_node.h"
-
 DEFINE_bool(remove_duplicate_changes, true,
             "True if duplicate DIMACS changes should be removed");
 DEFINE_bool(merge_changes_to_same_arc, true, "True if changes to the same arc "
@@ -39,15 +34,14 @@ namespace firmament {
 
 FlowGraphChangeManager::FlowGraphChangeManager(
     DIMACSChangeStats* dimacs_stats)
-  : flow_graph_(new FlowGraph), dimacs_stats_(dimacs_stats) {
+  : flow_graph_(new FlowGraph), num_changes_purged_(0), compaction_round_(0),
+    dimacs_stats_(dimacs_stats) {
 }
 
 FlowGraphChangeManager::~FlowGraphChangeManager() {
   // We don't delete dimacs_stats_ because it is owned by the FlowScheduler.
+  // The change comments are freed by the change arena's destructor.
   delete flow_graph_;
-  ResetChanges();
-  // XXX(malte): N.B. this leaks memory as we haven't destroyed all of the
-  // nodes and arcs in the flow graph (which are allocated on the heap)
 }
 
 FlowGraphArc* FlowGraphChangeManager::AddArc(FlowGraphNode* src,
@@ -76,19 +70,78 @@ FlowGraphArc* FlowGraphChangeManager::AddArc(uint64_t src_node_id,
   arc->cost_ = cost;
   arc->type_ = arc_type;
   if (FLAGS_incremental_flow) {
-    DIMACSChange* chg = new DIMACSNewArc(*arc);
-    chg->set_comment(comment);
-    AddGraphChange(chg);
+    AddGraphChange(DIMACSChange::NewArc(*arc), comment);
   }
   dimacs_stats_->UpdateStats(change_type);
   return arc;
 }
 
-void FlowGraphChangeManager::AddGraphChange(DIMACSChange* change) {
-  if (change->comment().empty()) {
-    change->set_comment("AddGraphChange: anonymous caller");
+void FlowGraphChangeManager::AddGraphChange(DIMACSChange change,
+                                            const char* comment) {
+  dimacs_stats_->changes_allocated_++;
+  uint64_t index = graph_changes_.size();
+  if (change.is_arc_change()) {
+    if (FLAGS_remove_duplicate_changes || FLAGS_merge_changes_to_same_arc) {
+      // Looks up and, if needed, inserts the arc's entry in one go.
+      pair<ArcChangeMap::iterator, bool> inserted = arc_changes_.insert(
+          make_pair(make_pair(change.src_, change.dst_), ArcChangeEntry()));
+      ArcChangeEntry* entry = &inserted.first->second;
+      if (!inserted.second && IsLatestArcChange(*entry, change)) {
+        DIMACSChange* latest_change = &graph_changes_[entry->index_];
+        if (FLAGS_merge_changes_to_same_arc) {
+          // Update the existing change. We don't update the op or the
+          // old_cost on a merge because we want to keep the first recorded
+          // old cost value which is the value that the solver currently has
+          // for the arc.
+          latest_change->cap_lower_bound_ = change.cap_lower_bound_;
+          latest_change->cap_upper_bound_ = change.cap_upper_bound_;
+          latest_change->cost_ = change.cost_;
+          latest_change->type_ = change.type_;
+          return;
+        }
+        if (latest_change->SameEffect(change)) {
+          return;
+        }
+      }
+      entry->index_ = index;
+      entry->src_generation_ = NodeGeneration(change.src_);
+      entry->dst_generation_ = NodeGeneration(change.dst_);
+    }
+    if (FLAGS_purge_changes_before_node_removal) {
+      RecordNodeArcChange(change.src_, index);
+      RecordNodeArcChange(change.dst_, index);
+    }
+  } else if (change.op_ == DIMACS_RECORD_ADD_NODE) {
+    // Forget the changes to the arcs of the node that used to have this id.
+    NodeChangeState* node_state = MutableNodeState(change.src_);
+    node_state->generation_++;
+    node_state->first_arc_change_ = kNoChange;
+    node_state->removal_index_ = kNoChange;
+  } else {
+    CHECK_EQ(change.op_, DIMACS_RECORD_REMOVE_NODE);
+    if (FLAGS_purge_changes_before_node_removal) {
+      // There's no point in changing the arcs of a node that is removed.
+      NodeChangeState* node_state = MutableNodeState(change.src_);
+      for (uint64_t link = node_state->first_arc_change_; link != kNoChange;
+           link = node_arc_changes_[link].next_) {
+        PurgeChange(node_arc_changes_[link].index_);
+      }
+      node_state->first_arc_change_ = kNoChange;
+      if (node_state->removal_index_ != kNoChange) {
+        PurgeChange(node_state->removal_index_);
+      }
+      node_state->removal_index_ = index;
+    }
+  }
+  // The comment may point into a temporary string of the caller, so we keep a
+  // copy until the changes are reset.
+  if (comment && comment[0] != '\0') {
+    change.comment_ = change_arena_.CopyString(comment);
+  } else {
+    change.comment_ = "AddGraphChange: anonymous caller";
   }
   graph_changes_.push_back(change);
+  change_purged_.push_back(false);
 }
 
 FlowGraphNode* FlowGraphChangeManager::AddNode(
@@ -101,9 +154,7 @@ FlowGraphNode* FlowGraphChangeManager::AddNode(
   node->excess_ = excess;
   node->comment_ = comment;
   if (FLAGS_incremental_flow) {
-    DIMACSChange* chg = new DIMACSAddNode(*node, vector<FlowGraphArc*>());
-    chg->set_comment(comment);
-    AddGraphChange(chg);
+    AddGraphChange(DIMACSChange::AddNode(*node), comment);
   }
   dimacs_stats_->UpdateStats(change_type);
   return node;
@@ -123,9 +174,7 @@ void FlowGraphChangeManager::ChangeArc(FlowGraphArc* arc,
       arc->cap_upper_bound_ != cap_upper_bound) {
     flow_graph_->ChangeArc(arc, cap_lower_bound, cap_upper_bound, cost);
     if (FLAGS_incremental_flow) {
-      DIMACSChange* chg = new DIMACSChangeArc(*arc, old_cost);
-      chg->set_comment(comment);
-      AddGraphChange(chg);
+      AddGraphChange(DIMACSChange::ChangeArc(*arc, old_cost), comment);
     }
     dimacs_stats_->UpdateStats(change_type);
   }
@@ -140,9 +189,7 @@ void FlowGraphChangeManager::ChangeArcCapacity(FlowGraphArc* arc,
   if (old_capacity != capacity) {
     flow_graph_->ChangeArc(arc, arc->cap_lower_bound_, capacity, arc->cost_);
     if (FLAGS_incremental_flow) {
-      DIMACSChange* chg = new DIMACSChangeArc(*arc, arc->cost_);
-      chg->set_comment(comment);
-      AddGraphChange(chg);
+      AddGraphChange(DIMACSChange::ChangeArc(*arc, arc->cost_), comment);
     }
     dimacs_stats_->UpdateStats(change_type);
   }
@@ -157,9 +204,7 @@ void FlowGraphChangeManager::ChangeArcCost(FlowGraphArc* arc,
   if (old_cost != cost) {
     flow_graph_->ChangeArcCost(arc, cost);
     if (FLAGS_incremental_flow) {
-      DIMACSChange* chg = new DIMACSChangeArc(*arc, old_cost);
-      chg->set_comment(comment);
-      AddGraphChange(chg);
+      AddGraphChange(DIMACSChange::ChangeArc(*arc, old_cost), comment);
     }
     dimacs_stats_->UpdateStats(change_type);
   }
@@ -171,9 +216,7 @@ void FlowGraphChangeManager::DeleteArc(FlowGraphArc* arc,
   arc->cap_lower_bound_ = 0;
   arc->cap_upper_bound_ = 0;
   if (FLAGS_incremental_flow) {
-    DIMACSChange *chg = new DIMACSChangeArc(*arc, arc->cost_);
-    chg->set_comment(comment);
-    AddGraphChange(chg);
+    AddGraphChange(DIMACSChange::ChangeArc(*arc, arc->cost_), comment);
   }
   dimacs_stats_->UpdateStats(change_type);
   flow_graph_->DeleteArc(arc);
@@ -183,293 +226,86 @@ void FlowGraphChangeManager::DeleteNode(FlowGraphNode* node,
                                         DIMACSChangeType change_type,
                                         const char* comment) {
   if (FLAGS_incremental_flow) {
-    DIMACSChange *chg = new DIMACSRemoveNode(*node);
-    chg->set_comment(comment);
-    AddGraphChange(chg);
+    AddGraphChange(DIMACSChange::RemoveNode(*node), comment);
   }
   dimacs_stats_->UpdateStats(change_type);
   flow_graph_->DeleteNode(node);
 }
 
-void FlowGraphChangeManager::MergeChangesToSameArcHelper(
-    uint64_t src_id, uint64_t dst_id, uint64_t cap_lower_bound,
-    uint64_t cap_upper_bound, int64_t cost, FlowGraphArcType type,
-    DIMACSChange* change, vector<DIMACSChange*>* new_graph_changes,
-    unordered_map<uint64_t, unordered_map<uint64_t, DIMACSChange*>>*
-    arcs_src_changes,
-    unordered_map<uint64_t, unordered_map<uint64_t, DIMACSChange*>>*
-    arcs_dst_changes) {
-  CHECK_NOTNULL(change);
-  unordered_map<uint64_t, DIMACSChange*>* dst_to_change =
-    FindOrNull(*arcs_src_changes, src_id);
-  if (dst_to_change) {
-    // We already have at least one arc starting at src.
-    DIMACSChange* chg = FindPtrOrNull(*dst_to_change, dst_id);
-    if (chg) {
-      // Update the existing entry.
-      if (DIMACSChangeArc* chg_arc = dynamic_cast<DIMACSChangeArc*>(chg)) {
-        chg_arc->cap_lower_bound_ = cap_lower_bound;
-        chg_arc->cap_upper_bound_ = cap_upper_bound;
-        chg_arc->cost_ = cost;
-        chg_arc->type_ = type;
-        // We don't update the old_cost on a merge because we want to keep the
-        // first recorded old cost value which is the value that the solver
-        // currently has for the arc.
-      } else if (DIMACSNewArc* new_arc = dynamic_cast<DIMACSNewArc*>(chg)) {
-        new_arc->cap_lower_bound_ = cap_lower_bound;
-        new_arc->cap_upper_bound_ = cap_upper_bound;
-        new_arc->cost_ = cost;
-        new_arc->type_ = type;
-      } else {
-        LOG(FATAL) << "Unexpected type of change";
-      }
-    } else {
-      // We don't have an entry for the arc.
-      CHECK(InsertIfNotPresent(dst_to_change, dst_id, change));
-      new_graph_changes->push_back(change);
-    }
-  } else {
-    // No arc starting at source has been changed.
-    unordered_map<uint64_t, DIMACSChange*> new_dst_to_change;
-    InsertIfNotPresent(&new_dst_to_change, dst_id, change);
-    InsertIfNotPresent(arcs_src_changes, src_id, new_dst_to_change);
-    // Append the change to the change list because it's the first time we
-    // update this arc.
-    new_graph_changes->push_back(change);
-  }
-  unordered_map<uint64_t, DIMACSChange*>* src_to_change =
-    FindOrNull(*arcs_dst_changes, dst_id);
-  if (src_to_change) {
-    // Only insert the change if we don't already have one for the arc.
-    InsertIfNotPresent(src_to_change, src_id, change);
-  } else {
-    unordered_map<uint64_t, DIMACSChange*> new_src_to_change;
-    InsertIfNotPresent(&new_src_to_change, src_id, change);
-    InsertIfNotPresent(arcs_dst_changes, dst_id, new_src_to_change);
-  }
+bool FlowGraphChangeManager::IsLatestArcChange(const ArcChangeEntry& entry,
+                                               const DIMACSChange& change) {
+  // The entry is stale if the change has been purged, or if the arc
+  // connected nodes that have since been replaced by new nodes with the same
+  // ids.
+  return !change_purged_[entry.index_] &&
+    entry.src_generation_ == NodeGeneration(change.src_) &&
+    entry.dst_generation_ == NodeGeneration(change.dst_);
 }
 
-void FlowGraphChangeManager::MergeChangesToSameArc() {
-  vector<DIMACSChange*> new_graph_changes;
-  // For each arc change we have an entry in arcs_src_changes and one in
-  // arcs_dst_changes. arcs_src_changes is indexed by src_id and then by
-  // dst_id. arcs_dst_changes is indexed by dst_id and then by src_id.
-  // These two maps allow us to get all the arcs that have a particular
-  // node as a source or destination.
-  unordered_map<uint64_t, unordered_map<uint64_t, DIMACSChange*>>
-    arcs_src_changes;
-  unordered_map<uint64_t, unordered_map<uint64_t, DIMACSChange*>>
-    arcs_dst_changes;
-  for (auto& change : graph_changes_) {
-    if (DIMACSChangeArc* chg_arc = dynamic_cast<DIMACSChangeArc*>(change)) {
-      // Check if we can merge the arc change.
-      MergeChangesToSameArcHelper(
-          chg_arc->src_, chg_arc->dst_, chg_arc->cap_lower_bound_,
-          chg_arc->cap_upper_bound_, chg_arc->cost_, chg_arc->type_, change,
-          &new_graph_changes, &arcs_src_changes, &arcs_dst_changes);
-    } else if (DIMACSNewArc* new_arc = dynamic_cast<DIMACSNewArc*>(change)) {
-      // Check if we can merge the arc change.
-      MergeChangesToSameArcHelper(
-          new_arc->src_, new_arc->dst_, new_arc->cap_lower_bound_,
-          new_arc->cap_upper_bound_, new_arc->cost_, new_arc->type_, change,
-          &new_graph_changes, &arcs_src_changes, &arcs_dst_changes);
-    } else if (DIMACSAddNode* new_node = dynamic_cast<DIMACSAddNode*>(change)) {
-      // Remove all the arcs that have new_node->id_ as source or destination.
-      unordered_map<uint64_t, DIMACSChange*>* dst_to_change =
-        FindOrNull(arcs_src_changes, new_node->id_);
-      if (dst_to_change) {
-        for (auto& dst_change : *dst_to_change) {
-          unordered_map<uint64_t, DIMACSChange*>* src_to_change =
-            FindOrNull(arcs_dst_changes, dst_change.first);
-          CHECK_NOTNULL(src_to_change);
-          src_to_change->erase(new_node->id_);
-        }
-      }
-      arcs_src_changes.erase(new_node->id_);
-      arcs_dst_changes.erase(new_node->id_);
-      new_graph_changes.push_back(change);
-    } else if (dynamic_cast<DIMACSRemoveNode*>(change)) {
-      new_graph_changes.push_back(change);
-    } else {
-      LOG(FATAL) << "Unexpected type of change";
-    }
+void FlowGraphChangeManager::PurgeChange(uint64_t index) {
+  if (!change_purged_[index]) {
+    change_purged_[index] = true;
+    num_changes_purged_++;
   }
-  graph_changes_.clear();
-  graph_changes_.insert(graph_changes_.begin(), new_graph_changes.begin(),
-                        new_graph_changes.end());
 }
 
-void FlowGraphChangeManager::OptimizeChanges() {
-  if (FLAGS_remove_duplicate_changes) {
-    RemoveDuplicateChanges();
-  }
-  if (FLAGS_merge_changes_to_same_arc) {
-    MergeChangesToSameArc();
-  }
-  if (FLAGS_purge_changes_before_node_removal) {
-    PurgeChangesBeforeNodeRemoval();
-  }
+void FlowGraphChangeManager::RecordNodeArcChange(uint64_t node_id,
+                                                 uint64_t index) {
+  NodeChangeState* node_state = MutableNodeState(node_id);
+  NodeArcChange link;
+  link.index_ = index;
+  link.next_ = node_state->first_arc_change_;
+  node_state->first_arc_change_ = node_arc_changes_.size();
+  node_arc_changes_.push_back(link);
 }
 
-void FlowGraphChangeManager::PurgeChangesBeforeNodeRemoval() {
-  // Set in which we store the ids of the nodes that are removed. We process
-  // the changes from the last to the first one. Whenever we encounter a
-  // remove node change we put its node id to the set. Similarly, whenever
-  // we encounter an add node change we remove its node id from the set.
-  // In this way we make sure we handle the case when ids are re-used upon
-  // node addition.
-  unordered_set<uint64_t> nodes_removed;
-  list<DIMACSChange*> new_graph_changes;
-  for (vector<DIMACSChange*>::reverse_iterator rev_it = graph_changes_.rbegin();
-       rev_it != graph_changes_.rend(); ++rev_it) {
-    if (DIMACSRemoveNode* rem_node =
-        dynamic_cast<DIMACSRemoveNode*>(*rev_it)) {
-      if (nodes_removed.insert(rem_node->node_id_).second) {
-        // Only add the change if the node has not been previosly inserted into
-        // nodes_removed. It if has been inserted then there's no point to add
-        // the change because the node is going to be removed in a future
-        // change.
-        new_graph_changes.push_front(rem_node);
-      }
-    } else if (DIMACSAddNode* new_node =
-               dynamic_cast<DIMACSAddNode*>(*rev_it)) {
-      nodes_removed.erase(new_node->id_);
-      new_graph_changes.push_front(new_node);
-    } else if (DIMACSNewArc* new_arc =
-               dynamic_cast<DIMACSNewArc*>(*rev_it)) {
-      if (nodes_removed.find(new_arc->src_) == nodes_removed.end() &&
-          nodes_removed.find(new_arc->dst_) == nodes_removed.end()) {
-        // Only add the change if neither of its arc source or destination
-        // nodes are going to be removed.
-        new_graph_changes.push_front(new_arc);
-      }
-    } else if (DIMACSChangeArc* chg_arc =
-               dynamic_cast<DIMACSChangeArc*>(*rev_it)) {
-      if (nodes_removed.find(chg_arc->src_) == nodes_removed.end() &&
-          nodes_removed.find(chg_arc->dst_) == nodes_removed.end()) {
-        // Only add the change if neither of its arc source or destination
-        // nodes are going to be removed.
-        new_graph_changes.push_front(chg_arc);
-      }
-    } else {
-      LOG(FATAL) << "Unexpected type of change";
-    }
-  }
-  graph_changes_.clear();
-  graph_changes_.insert(graph_changes_.begin(), new_graph_changes.begin(),
-                        new_graph_changes.end());
-}
-
-void FlowGraphChangeManager::RemoveDuplicateChanges() {
-  vector<DIMACSChange*> new_graph_changes;
-  // For each arc change we have two entries in node_to_change. One entry
-  // which is indexed by src_id and another one with is indexed by dst_id.
-  // Thus, whenever we re-use a node id we can make sure to remove from the
-  // state all the arcs that connect the previously removed node that was
-  // using the same id.
-  unordered_map<uint64_t, unordered_map<string, DIMACSChange*>> node_to_change;
-  for (auto& change : graph_changes_) {
-    if (DIMACSChangeArc* chg_arc = dynamic_cast<DIMACSChangeArc*>(change)) {
-      RemoveDuplicateChangesHelper(chg_arc->src_, chg_arc->dst_, change,
-                                   &new_graph_changes, &node_to_change);
-    } else if (DIMACSNewArc* new_arc = dynamic_cast<DIMACSNewArc*>(change)) {
-      RemoveDuplicateChangesHelper(new_arc->src_, new_arc->dst_, change,
-                                   &new_graph_changes, &node_to_change);
-    } else if (DIMACSAddNode* new_node = dynamic_cast<DIMACSAddNode*>(change)) {
-      // Remove from the state the arc changes that connect a node with the
-      // same id as the node we're adding.
-      unordered_map<string, DIMACSChange*>* desc_to_change =
-        FindOrNull(node_to_change, new_node->id_);
-      if (desc_to_change) {
-        for (auto& desc_change : *desc_to_change) {
-          if (DIMACSNewArc* new_arc =
-              dynamic_cast<DIMACSNewArc*>(desc_change.second)) {
-            RemoveDuplicateCleanState(new_node->id_, new_arc->src_,
-                                      new_arc->dst_, desc_change.first,
-                                      &node_to_change);
-          } else if (DIMACSChangeArc* chg_arc =
-                     dynamic_cast<DIMACSChangeArc*>(desc_change.second)) {
-            RemoveDuplicateCleanState(new_node->id_, chg_arc->src_,
-                                      chg_arc->dst_, desc_change.first,
-                                      &node_to_change);
-          } else {
-            LOG(FATAL) << "Unexpected change type";
-          }
-        }
-      }
-      node_to_change.erase(new_node->id_);
-      new_graph_changes.push_back(change);
-    } else if (dynamic_cast<DIMACSRemoveNode*>(change)) {
-      new_graph_changes.push_back(change);
-    }
+FlowGraphChangeManager::NodeChangeState*
+FlowGraphChangeManager::MutableNodeState(uint64_t node_id) {
+  if (node_id >= node_states_.size()) {
+    node_states_.resize(node_id + 1);
   }
-  graph_changes_.clear();
-  graph_changes_.insert(graph_changes_.begin(), new_graph_changes.begin(),
-                        new_graph_changes.end());
-}
-
-void FlowGraphChangeManager::RemoveDuplicateChangesHelper(
-    uint64_t src_id, uint64_t dst_id, DIMACSChange* change,
-    vector<DIMACSChange*>* new_graph_changes,
-    unordered_map<uint64_t, unordered_map<string, DIMACSChange*>>*
-    node_to_change) {
-  if (RemoveDuplicateChangesUpdateState(src_id, change, node_to_change) &&
-      RemoveDuplicateChangesUpdateState(dst_id, change, node_to_change)) {
-    new_graph_changes->push_back(change);
+  NodeChangeState* node_state = &node_states_[node_id];
+  if (node_state->round_ != compaction_round_) {
+    // The state was set in an earlier round and refers to cleared changes.
+    node_state->round_ = compaction_round_;
+    node_state->removal_index_ = kNoChange;
+    node_state->first_arc_change_ = kNoChange;
   }
+  return node_state;
 }
 
-bool FlowGraphChangeManager::RemoveDuplicateChangesUpdateState(
-    uint64_t node_id, DIMACSChange* change,
-    unordered_map<uint64_t, unordered_map<string, DIMACSChange*>>*
-    node_to_change) {
-  string change_desc = change->GenerateChange();
-  unordered_map<string, DIMACSChange*>* changes =
-    FindOrNull(*node_to_change, node_id);
-  if (changes) {
-    if (!InsertIfNotPresent(changes, change_desc, change)) {
-      // The change is already in the map.
-      return false;
+void FlowGraphChangeManager::RemovePurgedChanges() {
+  uint64_t num_kept = 0;
+  for (uint64_t index = 0; index < graph_changes_.size(); ++index) {
+    if (!change_purged_[index]) {
+      graph_changes_[num_kept++] = graph_changes_[index];
     }
-  } else {
-    unordered_map<string, DIMACSChange*> new_changes;
-    InsertIfNotPresent(&new_changes, change_desc, change);
-    InsertIfNotPresent(node_to_change, node_id, new_changes);
   }
-  return true;
+  graph_changes_.resize(num_kept);
+  change_purged_.assign(num_kept, false);
+  num_changes_purged_ = 0;
+  ResetCompactionState();
 }
 
-void FlowGraphChangeManager::RemoveDuplicateCleanState(
-    uint64_t new_node_id, uint64_t src, uint64_t dst, const string& change_desc,
-    unordered_map<uint64_t, unordered_map<string, DIMACSChange*>>*
-    node_to_change) {
-  if (new_node_id == src) {
-    auto dst_change_map = FindOrNull(*node_to_change, dst);
-    CHECK_NOTNULL(dst_change_map);
-    dst_change_map->erase(change_desc);
-    if (dst_change_map->size() == 0) {
-      node_to_change->erase(dst);
-    }
-  } else if (new_node_id == dst) {
-    auto src_change_map = FindOrNull(*node_to_change, src);
-    CHECK_NOTNULL(src_change_map);
-    src_change_map->erase(change_desc);
-    if (src_change_map->size() == 0) {
-      node_to_change->erase(src);
-    }
-  } else {
-    LOG(FATAL) << "New node id is not equal to the source or destination ids";
-  }
+void FlowGraphChangeManager::ResetCompactionState() {
+  // The node generations are kept, since the arc change entries that refer to
+  // them are cleared. Bumping the round lazily invalidates the node states.
+  arc_changes_.clear();
+  node_arc_changes_.clear();
+  compaction_round_++;
 }
 
 void FlowGraphChangeManager::ResetChanges() {
-  for (vector<DIMACSChange*>::iterator it = graph_changes_.begin();
-       it != graph_changes_.end(); ) {
-    vector<DIMACSChange*>::iterator it_tmp = it;
-    ++it;
-    delete *it_tmp;
-  }
+  // The arena only holds the change comments.
+  dimacs_stats_->change_arena_bytes_ += change_arena_.bytes_used();
+  dimacs_stats_->change_arena_blocks_ = change_arena_.num_blocks();
+  dimacs_stats_->arc_pool_slabs_ = flow_graph_->arc_pool().num_slabs();
+  dimacs_stats_->node_pool_slabs_ = flow_graph_->node_pool().num_slabs();
   graph_changes_.clear();
+  change_purged_.clear();
+  num_changes_purged_ = 0;
+  ResetCompactionState();
+  change_arena_.Reset();
 }
 
 }  // namespace firmament
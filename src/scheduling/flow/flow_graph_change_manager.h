@@ -22,14 +22,22 @@
 // graph change done by the FlowGraphManager should be conducted via
 // FlowGraphChangeManager's methods.
 // The class stores all the changes conducted in-between two scheduling rounds.
-// Moreover, FlowGraphChangeManager applies various algorithms to reduce
-// the number of changes (e.g., merges idempotent changes, removes superfluous
-// changes).
+// Moreover, FlowGraphChangeManager reduces the number of changes (e.g., merges
+// idempotent changes, removes superfluous changes) while it records them, so
+// that the optimized changes are ready when the solver is run.
+// The changes are plain records kept in a flat vector. Their comments are
+// copied into an arena, which is reset together with the changes at the end of
+// every scheduling round.
 
 #ifndef FIRMAMENT_SCHEDULING_FLOW_FLOW_GRAPH_CHANGE_MANAGER_H
 #define FIRMAMENT_SCHEDULING_FLOW_FLOW_GRAPH_CHANGE_MANAGER_H
 
+#include <utility>
+#include <boost/functional/hash.hpp>
+
 #include "base/types.h"
+#include "misc/arena.h"
+#include "scheduling/flow/dimacs_change.h"
 #include "scheduling/flow/dimacs_change_stats.h"
 #include "scheduling/flow/flow_graph.h"
 
@@ -70,11 +78,15 @@ class FlowGraphChangeManager {
                  const char* comment);
   void DeleteNode(FlowGraphNode* node, DIMACSChangeType change_type,
                   const char* comment);
-  const vector<DIMACSChange*>& GetGraphChanges() {
+  // Returns the changes recorded since the last reset. The changes may still
+  // include changes to the arcs of nodes that have been removed since.
+  const vector<DIMACSChange>& GetGraphChanges() {
     return graph_changes_;
   }
-  const vector<DIMACSChange*>& GetOptimizedGraphChanges() {
-    OptimizeChanges();
+  const vector<DIMACSChange>& GetOptimizedGraphChanges() {
+    if (num_changes_purged_ > 0) {
+      RemovePurgedChanges();
+    }
     return graph_changes_;
   }
   void ResetChanges();
@@ -93,56 +105,98 @@ class FlowGraphChangeManager {
 
  private:
   FRIEND_TEST(FlowGraphChangeManagerTest, AddGraphChange);
+  FRIEND_TEST(FlowGraphChangeManagerTest, AllOptimizations);
   FRIEND_TEST(FlowGraphChangeManagerTest, MergeChangesToSameArc);
   FRIEND_TEST(FlowGraphChangeManagerTest, PurgeChangesBeforeNodeRemoval);
   FRIEND_TEST(FlowGraphChangeManagerTest, RemoveDuplicateChanges);
+  FRIEND_TEST(FlowGraphChangeManagerTest, RemoveDuplicateChangesKeepsReverts);
   FRIEND_TEST(FlowGraphChangeManagerTest, ResetChanges);
 
-  void AddGraphChange(DIMACSChange* change);
-  void OptimizeChanges();
-  void MergeChangesToSameArc();
   /**
-   * Checks if there's already a change for the (src_id, dst_id) arc.
-   * If there's no change then it adds one to the state, otherwise
-   * it updates the existing change.
+   * Latest kept change to an arc, together with the generations of the arc's
+   * endpoints when the change was recorded. A node id's generation is bumped
+   * whenever a node with the id is added, which invalidates the entries of
+   * arcs that connected a previous node with the same id.
+   */
+  struct ArcChangeEntry {
+    uint64_t index_;
+    uint64_t src_generation_;
+    uint64_t dst_generation_;
+  };
+  typedef unordered_map<pair<uint64_t, uint64_t>, ArcChangeEntry,
+                        boost::hash<pair<uint64_t, uint64_t>>> ArcChangeMap;
+  /**
+   * Changes that refer to a node id since the node was last added: the
+   * kept arc changes that touch the node and its removal, if any. The state
+   * is only valid if it was set in the current compaction round; this avoids
+   * having to visit every node when the compaction state is cleared.
    */
-  void MergeChangesToSameArcHelper(
-      uint64_t src_id, uint64_t dst_id, uint64_t cap_lower_bound,
-      uint64_t cap_upper_bound, int64_t cost, FlowGraphArcType type,
-      DIMACSChange* change, vector<DIMACSChange*>* new_graph_changes,
-      unordered_map<uint64_t, unordered_map<uint64_t, DIMACSChange*>>*
-      arcs_src_changes,
-      unordered_map<uint64_t, unordered_map<uint64_t, DIMACSChange*>>*
-      arcs_dst_changes);
-  void PurgeChangesBeforeNodeRemoval();
-  void RemoveDuplicateChanges();
+  struct NodeChangeState {
+    NodeChangeState() : generation_(0), round_(0), removal_index_(kNoChange),
+      first_arc_change_(kNoChange) {
+    }
+    uint64_t generation_;
+    uint64_t round_;
+    uint64_t removal_index_;
+    // Head of the node's list in node_arc_changes_.
+    uint64_t first_arc_change_;
+  };
+  // Link in the list of the kept arc changes that touch a node.
+  struct NodeArcChange {
+    uint64_t index_;
+    uint64_t next_;
+  };
+  static const uint64_t kNoChange = static_cast<uint64_t>(-1);
+
   /**
-   * Checks if there's already an identical change for the (src_id, dst_id) arc.
-   * If there's no change the it updates the state, otherwise it just ignores
-   * the change we're currently processing because it's duplicate.
+   * Records a change, unless it is superseded by a change recorded earlier.
+   * If the change supersedes earlier changes, they are merged into it or
+   * purged.
+   * @param change the change to record
+   * @param comment the change's comment; copied
    */
-  void RemoveDuplicateChangesHelper(
-      uint64_t src_id, uint64_t dst_id, DIMACSChange* change,
-      vector<DIMACSChange*>* new_graph_changes,
-      unordered_map<uint64_t, unordered_map<string, DIMACSChange*>>*
-      node_to_change);
-  bool RemoveDuplicateChangesUpdateState(
-      uint64_t node_id, DIMACSChange* change,
-      unordered_map<uint64_t, unordered_map<string, DIMACSChange*>>*
-      node_to_change);
+  void AddGraphChange(DIMACSChange change, const char* comment);
+  /**
+   * Checks if the entry still refers to the latest kept change to the arc the
+   * change modifies, i.e., the arc hasn't been changed since its endpoints
+   * were last added.
+   */
+  bool IsLatestArcChange(const ArcChangeEntry& entry,
+                         const DIMACSChange& change);
+  inline uint64_t NodeGeneration(uint64_t node_id) const {
+    return node_id < node_states_.size() ?
+      node_states_[node_id].generation_ : 0;
+  }
+  NodeChangeState* MutableNodeState(uint64_t node_id);
+  void PurgeChange(uint64_t index);
+  void RecordNodeArcChange(uint64_t node_id, uint64_t index);
   /**
-   * Method to be called upon node addition. This method makes sure that the
-   * state is cleaned when we re-use a node id.
+   * Removes the purged changes from graph_changes_. The compaction state
+   * refers to changes by index, so it is cleared as well; later changes are
+   * still recorded correctly, but they are not merged with the earlier ones.
    */
-  void RemoveDuplicateCleanState(
-      uint64_t new_node_id, uint64_t src, uint64_t dst,
-      const string& change_desc,
-      unordered_map<uint64_t, unordered_map<string, DIMACSChange*>>*
-      node_to_change);
+  void RemovePurgedChanges();
+  void ResetCompactionState();
 
   FlowGraph* flow_graph_;
   // Vector storing the graph changes occured since the last scheduling round.
-  vector<DIMACSChange*> graph_changes_;
+  vector<DIMACSChange> graph_changes_;
+  // True for the changes in graph_changes_ that have been purged because one
+  // of the nodes they refer to has been removed since.
+  vector<bool> change_purged_;
+  uint64_t num_changes_purged_;
+  // Compaction state. The latest kept change to every arc, and the state of
+  // every node id, indexed by the id. Node ids are dense because the
+  // FlowGraph re-uses the ids of removed nodes.
+  ArcChangeMap arc_changes_;
+  vector<NodeChangeState> node_states_;
+  // The per-node lists of arc changes, kept in a single vector so that
+  // recording a change doesn't allocate per node.
+  vector<NodeArcChange> node_arc_changes_;
+  uint64_t compaction_round_;
+  // Arena holding the comments of the changes recorded since the last
+  // scheduling round.
+  Arena change_arena_;
   DIMACSChangeStats* dimacs_stats_;
 };
 
@@ -20,13 +20,14 @@
 
 #include <gtest/gtest.h>
 
-#include "scheduling/flow/dimacs_add_node.h"
-#include "scheduling/flow/dimacs_change_arc.h"
+#include "scheduling/flow/dimacs_change.h"
 #include "scheduling/flow/dimacs_change_stats.h"
-#include "scheduling/flow/dimacs_new_arc.h"
-#include "scheduling/flow/dimacs_remove_node.h"
 #include "scheduling/flow/flow_graph_change_manager.h"
 
+DECLARE_bool(remove_duplicate_changes);
+DECLARE_bool(merge_changes_to_same_arc);
+DECLARE_bool(purge_changes_before_node_removal);
+
 namespace firmament {
 
 class FlowGraphChangeManagerTest : public ::testing::Test {
@@ -37,6 +38,9 @@ class FlowGraphChangeManagerTest : public ::testing::Test {
   FlowGraphChangeManagerTest() {
     // You can do set-up work for each test here.
     FLAGS_v = 2;
+    FLAGS_remove_duplicate_changes = true;
+    FLAGS_merge_changes_to_same_arc = true;
+    FLAGS_purge_changes_before_node_removal = true;
     change_manager_ = new FlowGraphChangeManager(&dimacs_stats_);
   }
 
@@ -65,99 +69,157 @@ TEST_F(FlowGraphChangeManagerTest, AddGraphChange) {
   FlowGraphNode node1(1);
   FlowGraphNode node2(2);
   FlowGraphArc arc12(1, 2, 0, 1, 42, &node1, &node2);
-  change_manager_->AddGraphChange(
-      new DIMACSAddNode(node1, vector<FlowGraphArc*>()));
-  change_manager_->AddGraphChange(
-      new DIMACSAddNode(node2, vector<FlowGraphArc*>()));
-  change_manager_->AddGraphChange(new DIMACSNewArc(arc12));
+  string comment = "AddArc: task to machine";
+  change_manager_->AddGraphChange(DIMACSChange::AddNode(node1), NULL);
+  change_manager_->AddGraphChange(DIMACSChange::AddNode(node2), "");
+  change_manager_->AddGraphChange(DIMACSChange::NewArc(arc12),
+                                  comment.c_str());
+  comment.clear();
   EXPECT_EQ(change_manager_->graph_changes_.size(), 3);
+  EXPECT_STREQ(change_manager_->graph_changes_[0].comment_,
+               "AddGraphChange: anonymous caller");
+  EXPECT_STREQ(change_manager_->graph_changes_[1].comment_,
+               "AddGraphChange: anonymous caller");
+  // The comment is copied, so it outlives the caller's string.
+  EXPECT_STREQ(change_manager_->graph_changes_[2].comment_,
+               "AddArc: task to machine");
+}
+
+TEST_F(FlowGraphChangeManagerTest, AllOptimizations) {
+  FlowGraphNode node1(1);
+  FlowGraphNode node2(2);
+  FlowGraphNode node3(3);
+  FlowGraphArc arc12(1, 2, 0, 1, 42, &node1, &node2);
+  FlowGraphArc arc13(1, 3, 0, 1, 42, &node1, &node3);
+  change_manager_->AddGraphChange(DIMACSChange::AddNode(node1), NULL);
+  change_manager_->AddGraphChange(DIMACSChange::AddNode(node2), NULL);
+  change_manager_->AddGraphChange(DIMACSChange::AddNode(node3), NULL);
+  change_manager_->AddGraphChange(DIMACSChange::NewArc(arc12), NULL);
+  change_manager_->AddGraphChange(DIMACSChange::NewArc(arc13), NULL);
+  arc13.cost_ = 43;
+  change_manager_->AddGraphChange(DIMACSChange::ChangeArc(arc13, 42), NULL);
+  change_manager_->AddGraphChange(DIMACSChange::ChangeArc(arc13, 42), NULL);
+  arc12.cost_ = 43;
+  change_manager_->AddGraphChange(DIMACSChange::ChangeArc(arc12, 42), NULL);
+  // Purges the merged change to arc (1,2).
+  change_manager_->AddGraphChange(DIMACSChange::RemoveNode(node2), NULL);
+  const vector<DIMACSChange>& changes =
+    change_manager_->GetOptimizedGraphChanges();
+  ASSERT_EQ(changes.size(), 5);
+  EXPECT_EQ(changes[3].op_, DIMACS_RECORD_NEW_ARC);
+  EXPECT_EQ(changes[3].dst_, 3);
+  EXPECT_EQ(changes[3].cost_, 43);
+  EXPECT_EQ(changes[4].op_, DIMACS_RECORD_REMOVE_NODE);
+  // Changes recorded after the compaction are still recorded.
+  change_manager_->AddGraphChange(DIMACSChange::ChangeArc(arc13, 43), NULL);
+  EXPECT_EQ(change_manager_->GetOptimizedGraphChanges().size(), 6);
+  change_manager_->ResetChanges();
+  EXPECT_EQ(change_manager_->GetOptimizedGraphChanges().size(), 0);
 }
 
 TEST_F(FlowGraphChangeManagerTest, MergeChangesToSameArc) {
+  FLAGS_remove_duplicate_changes = false;
+  FLAGS_purge_changes_before_node_removal = false;
   FlowGraphNode node1(1);
   FlowGraphNode node2(2);
   FlowGraphArc arc12(1, 2, 0, 1, 42, &node1, &node2);
-  change_manager_->graph_changes_.push_back(
-      new DIMACSAddNode(node1, vector<FlowGraphArc*>()));
-  change_manager_->graph_changes_.push_back(
-      new DIMACSAddNode(node2, vector<FlowGraphArc*>()));
+  change_manager_->AddGraphChange(DIMACSChange::AddNode(node1), NULL);
+  change_manager_->AddGraphChange(DIMACSChange::AddNode(node2), NULL);
   // The following two arc changes should be merged into one.
-  change_manager_->graph_changes_.push_back(new DIMACSNewArc(arc12));
+  change_manager_->AddGraphChange(DIMACSChange::NewArc(arc12), NULL);
   // Change the arc we've just added.
   arc12.cap_upper_bound_ = 2;
   arc12.cost_ = 43;
-  change_manager_->graph_changes_.push_back(new DIMACSChangeArc(arc12, 42));
-  change_manager_->graph_changes_.push_back(new DIMACSRemoveNode(node1));
+  change_manager_->AddGraphChange(DIMACSChange::ChangeArc(arc12, 42), NULL);
+  change_manager_->AddGraphChange(DIMACSChange::RemoveNode(node1), NULL);
   // Add a new node that reuses the id of the node we've just removed.
-  change_manager_->graph_changes_.push_back(
-      new DIMACSAddNode(node1, vector<FlowGraphArc*>()));
-  change_manager_->graph_changes_.push_back(new DIMACSNewArc(arc12));
-  EXPECT_EQ(change_manager_->graph_changes_.size(), 7);
-  change_manager_->MergeChangesToSameArc();
-  EXPECT_EQ(change_manager_->graph_changes_.size(), 6);
-  DIMACSNewArc* new_arc =
-    dynamic_cast<DIMACSNewArc*>(change_manager_->graph_changes_[2]);
-  EXPECT_EQ(new_arc->src_, 1);
-  EXPECT_EQ(new_arc->dst_, 2);
-  EXPECT_EQ(new_arc->cap_upper_bound_, 2);
-  EXPECT_EQ(new_arc->cost_, 43);
+  change_manager_->AddGraphChange(DIMACSChange::AddNode(node1), NULL);
+  change_manager_->AddGraphChange(DIMACSChange::NewArc(arc12), NULL);
+  EXPECT_EQ(change_manager_->GetOptimizedGraphChanges().size(), 6);
+  const DIMACSChange& new_arc = change_manager_->graph_changes_[2];
+  EXPECT_EQ(new_arc.op_, DIMACS_RECORD_NEW_ARC);
+  EXPECT_EQ(new_arc.src_, 1);
+  EXPECT_EQ(new_arc.dst_, 2);
+  EXPECT_EQ(new_arc.cap_upper_bound_, 2);
+  EXPECT_EQ(new_arc.cost_, 43);
+  EXPECT_EQ(change_manager_->graph_changes_[5].op_, DIMACS_RECORD_NEW_ARC);
 }
 
 TEST_F(FlowGraphChangeManagerTest, PurgeChangesBeforeNodeRemoval) {
+  FLAGS_remove_duplicate_changes = false;
+  FLAGS_merge_changes_to_same_arc = false;
   FlowGraphNode node1(1);
   FlowGraphNode node2(2);
   FlowGraphArc arc12(1, 2, 0, 1, 42, &node1, &node2);
-  change_manager_->graph_changes_.push_back(
-      new DIMACSAddNode(node1, vector<FlowGraphArc*>()));
-  change_manager_->graph_changes_.push_back(
-      new DIMACSAddNode(node2, vector<FlowGraphArc*>()));
+  change_manager_->AddGraphChange(DIMACSChange::AddNode(node1), NULL);
+  change_manager_->AddGraphChange(DIMACSChange::AddNode(node2), NULL);
   // The following change should be purged because we latter remove one of
   // the node it connects.
-  change_manager_->graph_changes_.push_back(new DIMACSNewArc(arc12));
-  change_manager_->graph_changes_.push_back(new DIMACSRemoveNode(node1));
-  change_manager_->graph_changes_.push_back(
-      new DIMACSAddNode(node1, vector<FlowGraphArc*>()));
-  change_manager_->graph_changes_.push_back(new DIMACSNewArc(arc12));
-  EXPECT_EQ(change_manager_->graph_changes_.size(), 6);
-  change_manager_->PurgeChangesBeforeNodeRemoval();
-  EXPECT_EQ(change_manager_->graph_changes_.size(), 5);
+  change_manager_->AddGraphChange(DIMACSChange::NewArc(arc12), NULL);
+  change_manager_->AddGraphChange(DIMACSChange::RemoveNode(node1), NULL);
+  change_manager_->AddGraphChange(DIMACSChange::AddNode(node1), NULL);
+  change_manager_->AddGraphChange(DIMACSChange::NewArc(arc12), NULL);
+  // The purged change is only dropped once the optimized changes are
+  // requested.
+  EXPECT_EQ(change_manager_->GetGraphChanges().size(), 6);
+  EXPECT_EQ(change_manager_->GetOptimizedGraphChanges().size(), 5);
+  EXPECT_EQ(change_manager_->graph_changes_[2].op_,
+            DIMACS_RECORD_REMOVE_NODE);
 }
 
 TEST_F(FlowGraphChangeManagerTest, RemoveDuplicateChanges) {
+  FLAGS_merge_changes_to_same_arc = false;
+  FLAGS_purge_changes_before_node_removal = false;
   FlowGraphNode node1(1);
   FlowGraphNode node2(2);
   FlowGraphArc arc12(1, 2, 0, 1, 42, &node1, &node2);
-  change_manager_->graph_changes_.push_back(
-      new DIMACSAddNode(node1, vector<FlowGraphArc*>()));
-  change_manager_->graph_changes_.push_back(
-      new DIMACSAddNode(node2, vector<FlowGraphArc*>()));
-  change_manager_->graph_changes_.push_back(new DIMACSNewArc(arc12));
-  change_manager_->graph_changes_.push_back(new DIMACSChangeArc(arc12, 42));
+  change_manager_->AddGraphChange(DIMACSChange::AddNode(node1), NULL);
+  change_manager_->AddGraphChange(DIMACSChange::AddNode(node2), NULL);
+  change_manager_->AddGraphChange(DIMACSChange::NewArc(arc12), NULL);
+  change_manager_->AddGraphChange(DIMACSChange::ChangeArc(arc12, 42), NULL);
   // Add duplicate change.
-  change_manager_->graph_changes_.push_back(new DIMACSChangeArc(arc12, 42));
-  change_manager_->graph_changes_.push_back(new DIMACSRemoveNode(node1));
-  change_manager_->graph_changes_.push_back(
-      new DIMACSAddNode(node1, vector<FlowGraphArc*>()));
-  change_manager_->graph_changes_.push_back(new DIMACSNewArc(arc12));
+  change_manager_->AddGraphChange(DIMACSChange::ChangeArc(arc12, 42), NULL);
+  change_manager_->AddGraphChange(DIMACSChange::RemoveNode(node1), NULL);
+  change_manager_->AddGraphChange(DIMACSChange::AddNode(node1), NULL);
+  change_manager_->AddGraphChange(DIMACSChange::NewArc(arc12), NULL);
   // Add again change to arc (1,2), but this one should not be removed.
-  change_manager_->graph_changes_.push_back(new DIMACSChangeArc(arc12, 42));
-  EXPECT_EQ(change_manager_->graph_changes_.size(), 9);
-  change_manager_->RemoveDuplicateChanges();
-  EXPECT_EQ(change_manager_->graph_changes_.size(), 8);
+  change_manager_->AddGraphChange(DIMACSChange::ChangeArc(arc12, 42), NULL);
+  EXPECT_EQ(change_manager_->GetOptimizedGraphChanges().size(), 8);
+}
+
+TEST_F(FlowGraphChangeManagerTest, RemoveDuplicateChangesKeepsReverts) {
+  FLAGS_merge_changes_to_same_arc = false;
+  FlowGraphNode node1(1);
+  FlowGraphNode node2(2);
+  FlowGraphArc arc12(1, 2, 0, 1, 42, &node1, &node2);
+  change_manager_->AddGraphChange(DIMACSChange::ChangeArc(arc12, 0), NULL);
+  arc12.cost_ = 43;
+  change_manager_->AddGraphChange(DIMACSChange::ChangeArc(arc12, 0), NULL);
+  // Reverting to the first change is not a duplicate, because the arc would
+  // otherwise end up with the cost of the second change.
+  arc12.cost_ = 42;
+  change_manager_->AddGraphChange(DIMACSChange::ChangeArc(arc12, 0), NULL);
+  change_manager_->AddGraphChange(DIMACSChange::ChangeArc(arc12, 0), NULL);
+  ASSERT_EQ(change_manager_->GetOptimizedGraphChanges().size(), 3);
+  EXPECT_EQ(change_manager_->graph_changes_[0].cost_, 42);
+  EXPECT_EQ(change_manager_->graph_changes_[1].cost_, 43);
+  EXPECT_EQ(change_manager_->graph_changes_[2].cost_, 42);
 }
 
 TEST_F(FlowGraphChangeManagerTest, ResetChanges) {
   FlowGraphNode node1(1);
   FlowGraphNode node2(2);
   FlowGraphArc arc12(1, 2, 0, 1, 42, &node1, &node2);
-  change_manager_->AddGraphChange(
-      new DIMACSAddNode(node1, vector<FlowGraphArc*>()));
-  change_manager_->AddGraphChange(
-      new DIMACSAddNode(node2, vector<FlowGraphArc*>()));
-  change_manager_->AddGraphChange(new DIMACSNewArc(arc12));
+  change_manager_->AddGraphChange(DIMACSChange::AddNode(node1), "node1");
+  change_manager_->AddGraphChange(DIMACSChange::AddNode(node2), "node2");
+  change_manager_->AddGraphChange(DIMACSChange::NewArc(arc12), "arc12");
   EXPECT_EQ(change_manager_->graph_changes_.size(), 3);
   change_manager_->ResetChanges();
   EXPECT_EQ(change_manager_->graph_changes_.size(), 0);
+  EXPECT_EQ(dimacs_stats_.changes_allocated_, 3);
+  EXPECT_GT(dimacs_stats_.change_arena_bytes_, 0);
+  EXPECT_EQ(dimacs_stats_.change_arena_blocks_, 1);
+  EXPECT_EQ(change_manager_->change_arena_.bytes_used(), 0);
 }
 
 }  // namespace firmament
@@ -39,15 +39,14 @@
 #include "misc/utils.h"
 #include "scheduling/flow/cost_model_interface.h"
 #include "scheduling/flow/cost_model_utils.h"
-#include "scheduling/flow/dimacs_add_node.h"
-#include "scheduling/flow/dimacs_change_arc.h"
-#include "scheduling/flow/dimacs_new_arc.h"
-#include "scheduling/flow/dimacs_remove_node.h"
 
 DEFINE_bool(preemption, false, "Enable preemption and migration of tasks");
 DEFINE_bool(update_preferences_running_task, false,
             "True if the preferences of a running task should be updated before"
             " each scheduling round");
+DEFINE_uint64(flow_graph_update_threads, 1,
+              "Number of threads that compute arc costs when updating the "
+              "flow graph. Only used with cost models that are thread-safe.");
 
 DECLARE_string(flow_scheduling_solver);
 DECLARE_uint64(max_tasks_per_pu);
@@ -66,7 +65,13 @@ FlowGraphManager::FlowGraphManager(
       leaf_res_ids_(leaf_res_ids),
       trace_generator_(trace_generator),
       dimacs_stats_(dimacs_stats),
-      cur_traversal_counter_(0) {
+      cur_traversal_counter_(0),
+      precomputed_costs_(NULL),
+      task_store_(NULL) {
+  if (FLAGS_flow_graph_update_threads > 1) {
+    update_thread_pool_.reset(
+        new ThreadPool(FLAGS_flow_graph_update_threads));
+  }
   // Add sink node.
   sink_node_ = graph_change_manager_->AddNode(
       FlowNodeType::SINK, 0, ADD_SINK_NODE, "SINK");
@@ -126,6 +131,15 @@ void FlowGraphManager::AddOrUpdateJobNodes(
       node_queue.push(new TDOrNodeWrapper(root_task_node, root_td_ptr));
       marked_nodes.insert(root_task_node->id_);
     }
+    if (task_store_) {
+      // The job's other tasks are in the task store rather than in the root
+      // task's spawned list.
+      vector<TaskDescriptor*> tasks;
+      task_store_->TasksForJob(job_id, &tasks);
+      for (const auto& td_ptr : tasks) {
+        QueueChildTask(td_ptr, &node_queue, &marked_nodes);
+      }
+    }
   }
   // UpdateFlowGraph is responsible for making sure that the node_queue is
   // empty upon completion.
@@ -263,6 +277,86 @@ FlowGraphNode* FlowGraphManager::AddUnscheduledAggNode(JobID_t job_id) {
   return unsched_agg_node;
 }
 
+void FlowGraphManager::ComputeNodeCosts(NodeCosts* costs) {
+  FlowGraphNode* node = costs->node_;
+  if (node->IsTaskNode()) {
+    TaskID_t task_id = node->td_ptr_->uid();
+    auto query_pref_ecs = [this, costs, task_id]() {
+      costs->pref_ecs_ = cost_model_->GetTaskEquivClasses(task_id);
+      costs->has_pref_ecs_ = true;
+      if (costs->pref_ecs_) {
+        for (auto& ec : *costs->pref_ecs_) {
+          InsertIfNotPresent(&costs->ec_arcs_, ec,
+                             cost_model_->TaskToEquivClassAggregator(task_id,
+                                                                     ec));
+        }
+      }
+    };
+    auto query_pref_res = [this, costs, task_id]() {
+      costs->pref_res_ = cost_model_->GetTaskPreferenceArcs(task_id);
+      costs->has_pref_res_ = true;
+      if (costs->pref_res_) {
+        for (auto& res_id : *costs->pref_res_) {
+          InsertIfNotPresent(&costs->res_arcs_, res_id,
+                             cost_model_->TaskToResourceNode(task_id, res_id));
+        }
+      }
+    };
+    if (node->IsTaskAssignedOrRunning()) {
+      costs->continuation_ = cost_model_->TaskContinuation(task_id);
+      costs->has_continuation_ = true;
+      if (FLAGS_preemption) {
+        costs->preemption_ = cost_model_->TaskPreemption(task_id);
+        costs->has_preemption_ = true;
+        if (FLAGS_update_preferences_running_task) {
+          query_pref_res();
+          query_pref_ecs();
+        }
+      }
+    } else {
+      costs->to_unsched_ = cost_model_->TaskToUnscheduledAgg(task_id);
+      costs->has_to_unsched_ = true;
+      query_pref_ecs();
+      query_pref_res();
+    }
+  } else if (node->IsEquivalenceClassNode()) {
+    costs->pref_ecs_ =
+      cost_model_->GetEquivClassToEquivClassesArcs(node->ec_id_);
+    costs->has_pref_ecs_ = true;
+    if (costs->pref_ecs_) {
+      for (auto& ec : *costs->pref_ecs_) {
+        InsertIfNotPresent(&costs->ec_arcs_, ec,
+                           cost_model_->EquivClassToEquivClass(node->ec_id_,
+                                                               ec));
+      }
+    }
+    costs->pref_res_ =
+      cost_model_->GetOutgoingEquivClassPrefArcs(node->ec_id_);
+    costs->has_pref_res_ = true;
+    if (costs->pref_res_) {
+      for (auto& res_id : *costs->pref_res_) {
+        InsertIfNotPresent(&costs->res_arcs_, res_id,
+                           cost_model_->EquivClassToResourceNode(node->ec_id_,
+                                                                 res_id));
+      }
+    }
+  } else if (node->IsResourceNode()) {
+    for (auto& dst_arc : node->outgoing_arc_map_) {
+      FlowGraphNode* dst_node = dst_arc.second->dst_node_;
+      if (!dst_node->resource_id_.is_nil()) {
+        InsertIfNotPresent(
+            &costs->dst_node_arcs_, dst_node->id_,
+            cost_model_->ResourceNodeToResourceNode(*node->rd_ptr_,
+                                                    *dst_node->rd_ptr_));
+      } else if (node->type_ == FlowNodeType::PU) {
+        InsertIfNotPresent(
+            &costs->dst_node_arcs_, dst_node->id_,
+            cost_model_->LeafResourceNodeToSink(node->resource_id_));
+      }
+    }
+  }
+}
+
 void FlowGraphManager::ComputeTopologyStatistics(
     FlowGraphNode* node,
     boost::function<void(FlowGraphNode*)> prepare,
@@ -301,6 +395,112 @@ void FlowGraphManager::ComputeTopologyStatistics(
   }
 }
 
+ArcDescriptor FlowGraphManager::CostOfEquivClassToEquivClass(
+    FlowGraphNode* ec_node,
+    EquivClass_t pref_ec) {
+  NodeCosts* costs = PrecomputedCosts(ec_node);
+  if (costs) {
+    ArcDescriptor* arc_descriptor = FindOrNull(costs->ec_arcs_, pref_ec);
+    if (arc_descriptor) {
+      return *arc_descriptor;
+    }
+  }
+  return cost_model_->EquivClassToEquivClass(ec_node->ec_id_, pref_ec);
+}
+
+ArcDescriptor FlowGraphManager::CostOfEquivClassToResource(
+    FlowGraphNode* ec_node,
+    ResourceID_t res_id) {
+  NodeCosts* costs = PrecomputedCosts(ec_node);
+  if (costs) {
+    ArcDescriptor* arc_descriptor = FindOrNull(costs->res_arcs_, res_id);
+    if (arc_descriptor) {
+      return *arc_descriptor;
+    }
+  }
+  return cost_model_->EquivClassToResourceNode(ec_node->ec_id_, res_id);
+}
+
+ArcDescriptor FlowGraphManager::CostOfResourceToResource(
+    FlowGraphNode* res_node,
+    FlowGraphNode* dst_node) {
+  NodeCosts* costs = PrecomputedCosts(res_node);
+  if (costs) {
+    ArcDescriptor* arc_descriptor =
+      FindOrNull(costs->dst_node_arcs_, dst_node->id_);
+    if (arc_descriptor) {
+      return *arc_descriptor;
+    }
+  }
+  return cost_model_->ResourceNodeToResourceNode(*res_node->rd_ptr_,
+                                                 *dst_node->rd_ptr_);
+}
+
+ArcDescriptor FlowGraphManager::CostOfResourceToSink(FlowGraphNode* res_node) {
+  NodeCosts* costs = PrecomputedCosts(res_node);
+  if (costs) {
+    ArcDescriptor* arc_descriptor =
+      FindOrNull(costs->dst_node_arcs_, sink_node_->id_);
+    if (arc_descriptor) {
+      return *arc_descriptor;
+    }
+  }
+  return cost_model_->LeafResourceNodeToSink(res_node->resource_id_);
+}
+
+ArcDescriptor FlowGraphManager::CostOfTaskContinuation(
+    FlowGraphNode* task_node) {
+  NodeCosts* costs = PrecomputedCosts(task_node);
+  if (costs && costs->has_continuation_) {
+    return costs->continuation_;
+  }
+  return cost_model_->TaskContinuation(task_node->td_ptr_->uid());
+}
+
+ArcDescriptor FlowGraphManager::CostOfTaskPreemption(
+    FlowGraphNode* task_node) {
+  NodeCosts* costs = PrecomputedCosts(task_node);
+  if (costs && costs->has_preemption_) {
+    return costs->preemption_;
+  }
+  return cost_model_->TaskPreemption(task_node->td_ptr_->uid());
+}
+
+ArcDescriptor FlowGraphManager::CostOfTaskToEquivClass(
+    FlowGraphNode* task_node,
+    EquivClass_t ec) {
+  NodeCosts* costs = PrecomputedCosts(task_node);
+  if (costs) {
+    ArcDescriptor* arc_descriptor = FindOrNull(costs->ec_arcs_, ec);
+    if (arc_descriptor) {
+      return *arc_descriptor;
+    }
+  }
+  return cost_model_->TaskToEquivClassAggregator(task_node->td_ptr_->uid(),
+                                                 ec);
+}
+
+ArcDescriptor FlowGraphManager::CostOfTaskToResource(FlowGraphNode* task_node,
+                                                     ResourceID_t res_id) {
+  NodeCosts* costs = PrecomputedCosts(task_node);
+  if (costs) {
+    ArcDescriptor* arc_descriptor = FindOrNull(costs->res_arcs_, res_id);
+    if (arc_descriptor) {
+      return *arc_descriptor;
+    }
+  }
+  return cost_model_->TaskToResourceNode(task_node->td_ptr_->uid(), res_id);
+}
+
+ArcDescriptor FlowGraphManager::CostOfTaskToUnscheduledAgg(
+    FlowGraphNode* task_node) {
+  NodeCosts* costs = PrecomputedCosts(task_node);
+  if (costs && costs->has_to_unsched_) {
+    return costs->to_unsched_;
+  }
+  return cost_model_->TaskToUnscheduledAgg(task_node->td_ptr_->uid());
+}
+
 void FlowGraphManager::JobCompleted(JobID_t job_id) {
   RemoveUnscheduledAggNode(job_id);
   // We don't have to do anything else here. The task nodes have already been
@@ -400,12 +600,14 @@ void FlowGraphManager::NodeBindingToSchedulingDeltas(
 void FlowGraphManager::PinTaskToNode(FlowGraphNode* task_node,
                                      FlowGraphNode* res_node) {
   bool added_running_arc = false;
-  // Remove all arcs apart from the task -> resource mapping.
-  for (unordered_map<uint64_t, FlowGraphArc*>::iterator it =
-         task_node->outgoing_arc_map_.begin();
-       it != task_node->outgoing_arc_map_.end(); ) {
-    FlowGraphArc* arc = it->second;
-    ++it;
+  // Remove all arcs apart from the task -> resource mapping. We iterate over
+  // a copy of the arcs because removing an arc reorders the node's arcs.
+  vector<FlowGraphArc*> task_arcs;
+  task_arcs.reserve(task_node->outgoing_arc_map_.size());
+  for (auto& dst_arc : task_node->outgoing_arc_map_) {
+    task_arcs.push_back(dst_arc.second);
+  }
+  for (auto& arc : task_arcs) {
     if (arc->dst_node_->id_ == res_node->id_) {
       // This preference arc connects the same nodes as the running arc. Hence,
       // we just transform it into the running arc.
@@ -459,27 +661,65 @@ void FlowGraphManager::PinTaskToNode(FlowGraphNode* task_node,
   }
 }
 
-multimap<uint64_t, uint64_t>* FlowGraphManager::PopulateTaskMappingsForSimpleSolver(
-                   unordered_map<TaskID_t, ResourceID_t>* task_bindings,
-                   pair<TaskID_t, ResourceID_t> delta) {
-  multimap<uint64_t, uint64_t>* task_mappings = new multimap<uint64_t, uint64_t>();
-  for (auto & item : *task_bindings) {
-    FlowGraphNode* task_node = NodeForTaskID(item.first);
-    FlowGraphNode* res_node = NodeForResourceID(item.second);
-    task_mappings->insert(pair<uint64_t, uint64_t>(task_node->id_, res_node->id_));
+void FlowGraphManager::TaskBindingToSchedulingDeltas(
+    TaskID_t task_id, ResourceID_t res_id,
+    unordered_map<TaskID_t, ResourceID_t>* task_bindings,
+    vector<SchedulingDelta*>* deltas) {
+  FlowGraphNode* task_node = NodeForTaskID(task_id);
+  CHECK_NOTNULL(task_node);
+  FlowGraphNode* res_node = NodeForResourceID(res_id);
+  CHECK_NOTNULL(res_node);
+  NodeBindingToSchedulingDeltas(task_node->id_, res_node->id_, task_bindings,
+                                deltas);
+}
+
+vector<EquivClass_t>* FlowGraphManager::PrefECsOfEquivClass(
+    FlowGraphNode* ec_node) {
+  NodeCosts* costs = PrecomputedCosts(ec_node);
+  if (costs && costs->has_pref_ecs_) {
+    // The caller takes ownership of the preferences.
+    costs->has_pref_ecs_ = false;
+    vector<EquivClass_t>* pref_ecs = costs->pref_ecs_;
+    costs->pref_ecs_ = NULL;
+    return pref_ecs;
   }
-#ifdef __PLATFORM_HAS_BOOST__
-  if (delta.second.is_nil()) {
-#else
-  if (delta.second == 0) {
-#endif
-    // We did not recieve matching node for this task.
-    return task_mappings;
+  return cost_model_->GetEquivClassToEquivClassesArcs(ec_node->ec_id_);
+}
+
+vector<EquivClass_t>* FlowGraphManager::PrefECsOfTask(
+    FlowGraphNode* task_node) {
+  NodeCosts* costs = PrecomputedCosts(task_node);
+  if (costs && costs->has_pref_ecs_) {
+    costs->has_pref_ecs_ = false;
+    vector<EquivClass_t>* pref_ecs = costs->pref_ecs_;
+    costs->pref_ecs_ = NULL;
+    return pref_ecs;
+  }
+  return cost_model_->GetTaskEquivClasses(task_node->td_ptr_->uid());
+}
+
+vector<ResourceID_t>* FlowGraphManager::PrefResourcesOfEquivClass(
+    FlowGraphNode* ec_node) {
+  NodeCosts* costs = PrecomputedCosts(ec_node);
+  if (costs && costs->has_pref_res_) {
+    costs->has_pref_res_ = false;
+    vector<ResourceID_t>* pref_res = costs->pref_res_;
+    costs->pref_res_ = NULL;
+    return pref_res;
   }
-  FlowGraphNode* task_node = NodeForTaskID(delta.first);
-  FlowGraphNode* res_node = NodeForResourceID(delta.second);
-  task_mappings->insert(pair<uint64_t, uint64_t>(task_node->id_, res_node->id_));
-  return task_mappings;
+  return cost_model_->GetOutgoingEquivClassPrefArcs(ec_node->ec_id_);
+}
+
+vector<ResourceID_t>* FlowGraphManager::PrefResourcesOfTask(
+    FlowGraphNode* task_node) {
+  NodeCosts* costs = PrecomputedCosts(task_node);
+  if (costs && costs->has_pref_res_) {
+    costs->has_pref_res_ = false;
+    vector<ResourceID_t>* pref_res = costs->pref_res_;
+    costs->pref_res_ = NULL;
+    return pref_res;
+  }
+  return cost_model_->GetTaskPreferenceArcs(task_node->td_ptr_->uid());
 }
 
 void FlowGraphManager::PurgeUnconnectedEquivClassNodes() {
@@ -558,13 +798,14 @@ void FlowGraphManager::RemoveResourceTopology(const ResourceDescriptor& rd,
   FlowGraphNode* res_node = NodeForResourceID(res_id);
   CHECK_NOTNULL(res_node);
   int64_t cap_delta = 0;
-  // Delete the children nodes. We use an iterator because we change the
-  // collection while we iterate over it.
-  for (unordered_map<uint64_t, FlowGraphArc*>::iterator
-         it = res_node->outgoing_arc_map_.begin();
-       it != res_node->outgoing_arc_map_.end();) {
-    FlowGraphArc* arc = it->second;
-    ++it;
+  // Delete the children nodes. We iterate over a copy of the arcs because we
+  // change the collection while we iterate over it.
+  vector<FlowGraphArc*> res_arcs;
+  res_arcs.reserve(res_node->outgoing_arc_map_.size());
+  for (auto& dst_arc : res_node->outgoing_arc_map_) {
+    res_arcs.push_back(dst_arc.second);
+  }
+  for (auto& arc : res_arcs) {
     cap_delta -=  arc->cap_upper_bound_;
     if (!arc->dst_node_->resource_id_.is_nil()) {
       TraverseAndRemoveTopology(arc->dst_node_, pus_removed);
@@ -602,19 +843,20 @@ void FlowGraphManager::RemoveResourceNode(FlowGraphNode* res_node) {
                                     "RemoveResourceNode");
 }
 
-void FlowGraphManager::RemoveTaskHelper(TaskID_t task_id) {
+uint64_t FlowGraphManager::RemoveTaskHelper(TaskID_t task_id) {
   FlowGraphNode* task_node = NodeForTaskID(task_id);
   // task_node may be NULL if the task already completed.
-  if (task_node) {
-    if (FLAGS_preemption) {
-      // We reduce the capacity from the unscheduled aggregator to the sink when
-      // we pin the task. Hence, we only have to reduce the capacity when we
-      // support preemption.
-      UpdateUnscheduledAggNode(UnschedAggNodeForJobID(task_node->job_id_), -1);
-    }
-    task_to_running_arc_.erase(task_id);
-    RemoveTaskNode(task_node);
+  if (!task_node) {
+    return 0;
+  }
+  if (FLAGS_preemption) {
+    // We reduce the capacity from the unscheduled aggregator to the sink when
+    // we pin the task. Hence, we only have to reduce the capacity when we
+    // support preemption.
+    UpdateUnscheduledAggNode(UnschedAggNodeForJobID(task_node->job_id_), -1);
   }
+  task_to_running_arc_.erase(task_id);
+  return RemoveTaskNode(task_node);
 }
 
 uint64_t FlowGraphManager::RemoveTaskNode(FlowGraphNode* task_node) {
@@ -652,7 +894,8 @@ uint64_t FlowGraphManager::TaskCompleted(TaskID_t task_id) {
   return task_node_id;
 }
 
-void FlowGraphManager::TaskEvicted(TaskID_t task_id, ResourceID_t res_id) {
+uint64_t FlowGraphManager::TaskEvicted(TaskID_t task_id,
+                                       ResourceID_t res_id) {
   FlowGraphNode* task_node = NodeForTaskID(task_id);
   CHECK_NOTNULL(task_node);
   task_node->type_ = FlowNodeType::UNSCHEDULED_TASK;
@@ -673,10 +916,11 @@ void FlowGraphManager::TaskEvicted(TaskID_t task_id, ResourceID_t res_id) {
     UpdateUnscheduledAggNode(unsched_agg_node, 1);
   }
   // The task's arcs will be updated just before the next solver run.
+  return task_node->id_;
 }
 
-void FlowGraphManager::TaskFailed(TaskID_t task_id) {
-  RemoveTaskHelper(task_id);
+uint64_t FlowGraphManager::TaskFailed(TaskID_t task_id) {
+  return RemoveTaskHelper(task_id);
 }
 
 void FlowGraphManager::TaskKilled(TaskID_t task_id) {
@@ -691,9 +935,10 @@ void FlowGraphManager::TaskMigrated(TaskID_t task_id,
   TaskScheduled(task_id, new_res_id);
 }
 
-void FlowGraphManager::TaskRemoved(TaskID_t task_id) {
-  RemoveTaskHelper(task_id);
+uint64_t FlowGraphManager::TaskRemoved(TaskID_t task_id) {
+  uint64_t task_node_id = RemoveTaskHelper(task_id);
   cost_model_->RemoveTask(task_id);
+  return task_node_id;
 }
 
 void FlowGraphManager::TaskScheduled(TaskID_t task_id, ResourceID_t res_id) {
@@ -706,13 +951,14 @@ void FlowGraphManager::TaskScheduled(TaskID_t task_id, ResourceID_t res_id) {
 
 void FlowGraphManager::TraverseAndRemoveTopology(FlowGraphNode* res_node,
                                                  set<uint64_t>* pus_removed) {
-  // We use an iterator because we change the collection while we iterate over
-  // it.
-  for (unordered_map<uint64_t, FlowGraphArc*>::iterator
-         it = res_node->outgoing_arc_map_.begin();
-       it != res_node->outgoing_arc_map_.end();) {
-    FlowGraphArc* arc = it->second;
-    ++it;
+  // We iterate over a copy of the arcs because we change the collection while
+  // we iterate over it.
+  vector<FlowGraphArc*> res_arcs;
+  res_arcs.reserve(res_node->outgoing_arc_map_.size());
+  for (auto& dst_arc : res_node->outgoing_arc_map_) {
+    res_arcs.push_back(dst_arc.second);
+  }
+  for (auto& arc : res_arcs) {
     if (!arc->dst_node_->resource_id_.is_nil()) {
       // The arc is pointing to a resource node.
       TraverseAndRemoveTopology(arc->dst_node_, pus_removed);
@@ -790,24 +1036,29 @@ void FlowGraphManager::UpdateChildrenTasks(
          task_iter = td_ptr->mutable_spawned()->pointer_begin();
        task_iter != td_ptr->mutable_spawned()->pointer_end();
        ++task_iter) {
-    TaskDescriptor* child_td_ptr = *task_iter;
-    FlowGraphNode* child_task_node = NodeForTaskID(child_td_ptr->uid());
-    if (!child_task_node) {
-      if (TaskMustHaveNode(*child_td_ptr)) {
-        JobID_t job_id = JobIDFromString(child_td_ptr->job_id());
-        child_task_node = AddTaskNode(job_id, child_td_ptr);
-        // Increment capacity from unsched agg node to sink.
-        UpdateUnscheduledAggNode(UnschedAggNodeForJobID(job_id), 1);
-        node_queue->push(new TDOrNodeWrapper(child_task_node, child_td_ptr));
-        marked_nodes->insert(child_task_node->id_);
-      } else {
-        node_queue->push(new TDOrNodeWrapper(child_td_ptr));
-      }
+    QueueChildTask(*task_iter, node_queue, marked_nodes);
+  }
+}
+
+void FlowGraphManager::QueueChildTask(TaskDescriptor* child_td_ptr,
+                                      queue<TDOrNodeWrapper*>* node_queue,
+                                      unordered_set<uint64_t>* marked_nodes) {
+  FlowGraphNode* child_task_node = NodeForTaskID(child_td_ptr->uid());
+  if (!child_task_node) {
+    if (TaskMustHaveNode(*child_td_ptr)) {
+      JobID_t job_id = JobIDFromString(child_td_ptr->job_id());
+      child_task_node = AddTaskNode(job_id, child_td_ptr);
+      // Increment capacity from unsched agg node to sink.
+      UpdateUnscheduledAggNode(UnschedAggNodeForJobID(job_id), 1);
+      node_queue->push(new TDOrNodeWrapper(child_task_node, child_td_ptr));
+      marked_nodes->insert(child_task_node->id_);
     } else {
-      if (marked_nodes->find(child_task_node->id_) == marked_nodes->end()) {
-        node_queue->push(new TDOrNodeWrapper(child_task_node, child_td_ptr));
-        marked_nodes->insert(child_task_node->id_);
-      }
+      node_queue->push(new TDOrNodeWrapper(child_td_ptr));
+    }
+  } else {
+    if (marked_nodes->find(child_task_node->id_) == marked_nodes->end()) {
+      node_queue->push(new TDOrNodeWrapper(child_task_node, child_td_ptr));
+      marked_nodes->insert(child_task_node->id_);
     }
   }
 }
@@ -830,8 +1081,7 @@ void FlowGraphManager::UpdateEquivToEquivArcs(
   CHECK_NOTNULL(ec_node);
   CHECK_NOTNULL(node_queue);
   CHECK_NOTNULL(marked_nodes);
-  vector<EquivClass_t>* pref_ec =
-    cost_model_->GetEquivClassToEquivClassesArcs(ec_node->ec_id_);
+  vector<EquivClass_t>* pref_ec = PrefECsOfEquivClass(ec_node);
   if (pref_ec) {
     for (auto& pref_ec_id : *pref_ec) {
       FlowGraphNode* pref_ec_node = NodeForEquivClass(pref_ec_id);
@@ -839,7 +1089,7 @@ void FlowGraphManager::UpdateEquivToEquivArcs(
         pref_ec_node = AddEquivClassNode(pref_ec_id);
       }
       ArcDescriptor arc_descriptor =
-        cost_model_->EquivClassToEquivClass(ec_node->ec_id_, pref_ec_id);
+        CostOfEquivClassToEquivClass(ec_node, pref_ec_id);
       FlowGraphArc* pref_ec_arc =
         graph_change_manager_->mutable_flow_graph()->GetArc(ec_node,
                                                             pref_ec_node);
@@ -876,8 +1126,7 @@ void FlowGraphManager::UpdateEquivToResArcs(
   CHECK_NOTNULL(ec_node);
   CHECK_NOTNULL(node_queue);
   CHECK_NOTNULL(marked_nodes);
-  vector<ResourceID_t>* pref_res =
-    cost_model_->GetOutgoingEquivClassPrefArcs(ec_node->ec_id_);
+  vector<ResourceID_t>* pref_res = PrefResourcesOfEquivClass(ec_node);
   if (pref_res) {
     for (auto& pref_res_id : *pref_res) {
       FlowGraphNode* pref_res_node = NodeForResourceID(pref_res_id);
@@ -885,7 +1134,7 @@ void FlowGraphManager::UpdateEquivToResArcs(
       // prefer a resource before it is added to the graph.
       CHECK_NOTNULL(pref_res_node);
       ArcDescriptor arc_descriptor =
-        cost_model_->EquivClassToResourceNode(ec_node->ec_id_, pref_res_id);
+        CostOfEquivClassToResource(ec_node, pref_res_id);
       FlowGraphArc* pref_res_arc =
         graph_change_manager_->mutable_flow_graph()->GetArc(ec_node,
                                                             pref_res_node);
@@ -921,27 +1170,83 @@ void FlowGraphManager::UpdateFlowGraph(
     unordered_set<uint64_t>* marked_nodes) {
   CHECK_NOTNULL(node_queue);
   CHECK_NOTNULL(marked_nodes);
+  if (update_thread_pool_ && cost_model_->IsThreadSafe()) {
+    UpdateFlowGraphInParallel(node_queue, marked_nodes);
+    return;
+  }
   while (!node_queue->empty()) {
     TDOrNodeWrapper* cur_node = node_queue->front();
     node_queue->pop();
-    if (!cur_node->node_) {
-      // We're handling a task that doesn't have an associated flow graph node.
-      UpdateChildrenTasks(cur_node->td_ptr_, node_queue, marked_nodes);
-      delete cur_node;
+    UpdateNode(cur_node, node_queue, marked_nodes);
+  }
+}
+
+void FlowGraphManager::UpdateFlowGraphInParallel(
+    queue<TDOrNodeWrapper*>* node_queue,
+    unordered_set<uint64_t>* marked_nodes) {
+  vector<TDOrNodeWrapper*> run;
+  vector<NodeCosts*> run_costs;
+  while (!node_queue->empty()) {
+    TDOrNodeWrapper* head = node_queue->front();
+    if (!head->node_) {
+      // Tasks without a node only add their children to the queue.
+      node_queue->pop();
+      UpdateNode(head, node_queue, marked_nodes);
       continue;
     }
-    if (cur_node->node_->IsTaskNode()) {
-      UpdateTaskNode(cur_node->node_, node_queue, marked_nodes);
-      UpdateChildrenTasks(cur_node->td_ptr_, node_queue, marked_nodes);
-    } else if (cur_node->node_->IsEquivalenceClassNode()) {
-      UpdateEquivClassNode(cur_node->node_, node_queue, marked_nodes);
-    } else if (cur_node->node_->IsResourceNode()) {
-      UpdateResourceNode(cur_node->node_, node_queue, marked_nodes);
-    } else {
-      LOG(FATAL) << "Unexpected node type: " << cur_node->node_->type_;
+    // The cost model only guarantees that queries for nodes of the same type
+    // are independent. Moreover, the queries for a node may depend on the
+    // updates of the nodes of other types that precede it in the queue
+    // (e.g., a task's EC is only known after the task has been updated).
+    // Hence, we only compute the costs of a run of nodes of the same type.
+    run.clear();
+    run_costs.clear();
+    while (!node_queue->empty()) {
+      TDOrNodeWrapper* cur_node = node_queue->front();
+      if (!cur_node->node_ ||
+          cur_node->node_->IsTaskNode() != head->node_->IsTaskNode() ||
+          cur_node->node_->IsEquivalenceClassNode() !=
+          head->node_->IsEquivalenceClassNode()) {
+        break;
+      }
+      node_queue->pop();
+      run.push_back(cur_node);
+      run_costs.push_back(
+          node_costs_arena_.New<NodeCosts>(cur_node->node_));
     }
+    update_thread_pool_->ParallelFor(
+        run_costs.size(), [this, &run_costs](uint64_t index) {
+          ComputeNodeCosts(run_costs[index]);
+        });
+    for (uint64_t index = 0; index < run.size(); ++index) {
+      precomputed_costs_ = run_costs[index];
+      UpdateNode(run[index], node_queue, marked_nodes);
+    }
+    precomputed_costs_ = NULL;
+    node_costs_arena_.Reset();
+  }
+}
+
+void FlowGraphManager::UpdateNode(TDOrNodeWrapper* cur_node,
+                                  queue<TDOrNodeWrapper*>* node_queue,
+                                  unordered_set<uint64_t>* marked_nodes) {
+  if (!cur_node->node_) {
+    // We're handling a task that doesn't have an associated flow graph node.
+    UpdateChildrenTasks(cur_node->td_ptr_, node_queue, marked_nodes);
     delete cur_node;
+    return;
   }
+  if (cur_node->node_->IsTaskNode()) {
+    UpdateTaskNode(cur_node->node_, node_queue, marked_nodes);
+    UpdateChildrenTasks(cur_node->td_ptr_, node_queue, marked_nodes);
+  } else if (cur_node->node_->IsEquivalenceClassNode()) {
+    UpdateEquivClassNode(cur_node->node_, node_queue, marked_nodes);
+  } else if (cur_node->node_->IsResourceNode()) {
+    UpdateResourceNode(cur_node->node_, node_queue, marked_nodes);
+  } else {
+    LOG(FATAL) << "Unexpected node type: " << cur_node->node_->type_;
+  }
+  delete cur_node;
 }
 
 void FlowGraphManager::UpdateResourceNode(
@@ -1064,15 +1369,11 @@ void FlowGraphManager::UpdateResOutgoingArcs(
   CHECK_NOTNULL(res_node);
   CHECK_NOTNULL(node_queue);
   CHECK_NOTNULL(marked_nodes);
-  for (unordered_map<uint64_t, FlowGraphArc*>::iterator it =
-         res_node->outgoing_arc_map_.begin();
-       it != res_node->outgoing_arc_map_.end(); ) {
-    FlowGraphArc* arc = it->second;
-    ++it;
+  for (auto& dst_arc : res_node->outgoing_arc_map_) {
+    FlowGraphArc* arc = dst_arc.second;
     if (!arc->dst_node_->resource_id_.is_nil()) {
       ArcDescriptor arc_descriptor =
-        cost_model_->ResourceNodeToResourceNode(*res_node->rd_ptr_,
-                                                *arc->dst_node_->rd_ptr_);
+        CostOfResourceToResource(res_node, arc->dst_node_);
       graph_change_manager_->ChangeArc(
           arc, arc_descriptor.min_flow_, arc_descriptor.capacity_,
           arc_descriptor.cost_, CHG_ARC_BETWEEN_RES,
@@ -1094,8 +1395,7 @@ void FlowGraphManager::UpdateResToSinkArc(FlowGraphNode* res_node) {
     CHECK_NOTNULL(sink_node_);
     FlowGraphArc* res_arc_sink =
       graph_change_manager_->mutable_flow_graph()->GetArc(res_node, sink_node_);
-    ArcDescriptor arc_descriptor =
-      cost_model_->LeafResourceNodeToSink(res_node->resource_id_);
+    ArcDescriptor arc_descriptor = CostOfResourceToSink(res_node);
     if (!res_arc_sink) {
       graph_change_manager_->AddArc(
           res_node, sink_node_, arc_descriptor.min_flow_,
@@ -1121,8 +1421,7 @@ void FlowGraphManager::UpdateRunningTaskNode(
   FlowGraphArc* running_arc = FindPtrOrNull(task_to_running_arc_,
                                             task_node->td_ptr_->uid());
   CHECK_NOTNULL(running_arc);
-  ArcDescriptor arc_descriptor =
-    cost_model_->TaskContinuation(task_node->td_ptr_->uid());
+  ArcDescriptor arc_descriptor = CostOfTaskContinuation(task_node);
   graph_change_manager_->ChangeArc(
       running_arc, arc_descriptor.min_flow_, arc_descriptor.capacity_,
       arc_descriptor.cost_, CHG_ARC_TASK_TO_RES,
@@ -1148,8 +1447,7 @@ void FlowGraphManager::UpdateRunningTaskToUnscheduledAggArc(
     graph_change_manager_->mutable_flow_graph()->GetArc(task_node,
                                                         unsched_agg_node);
   CHECK_NOTNULL(unsched_arc);
-  ArcDescriptor arc_descriptor =
-    cost_model_->TaskPreemption(task_node->td_ptr_->uid());
+  ArcDescriptor arc_descriptor = CostOfTaskPreemption(task_node);
   graph_change_manager_->ChangeArc(
       unsched_arc, arc_descriptor.min_flow_, arc_descriptor.capacity_,
       arc_descriptor.cost_, CHG_ARC_TO_UNSCHED,
@@ -1177,8 +1475,7 @@ void FlowGraphManager::UpdateTaskToEquivArcs(
   CHECK_NOTNULL(task_node);
   CHECK_NOTNULL(node_queue);
   CHECK_NOTNULL(marked_nodes);
-  vector<EquivClass_t>* pref_ec =
-    cost_model_->GetTaskEquivClasses(task_node->td_ptr_->uid());
+  vector<EquivClass_t>* pref_ec = PrefECsOfTask(task_node);
   if (pref_ec) {
     for (auto& pref_ec_id : *pref_ec) {
       FlowGraphNode* pref_ec_node = NodeForEquivClass(pref_ec_id);
@@ -1186,8 +1483,7 @@ void FlowGraphManager::UpdateTaskToEquivArcs(
         pref_ec_node = AddEquivClassNode(pref_ec_id);
       }
       ArcDescriptor arc_descriptor =
-        cost_model_->TaskToEquivClassAggregator(task_node->td_ptr_->uid(),
-                                                pref_ec_id);
+        CostOfTaskToEquivClass(task_node, pref_ec_id);
       FlowGraphArc* pref_ec_arc =
         graph_change_manager_->mutable_flow_graph()->GetArc(task_node,
                                                             pref_ec_node);
@@ -1226,8 +1522,7 @@ void FlowGraphManager::UpdateTaskToResArcs(
   CHECK_NOTNULL(task_node);
   CHECK_NOTNULL(node_queue);
   CHECK_NOTNULL(marked_nodes);
-  vector<ResourceID_t>* pref_res =
-    cost_model_->GetTaskPreferenceArcs(task_node->td_ptr_->uid());
+  vector<ResourceID_t>* pref_res = PrefResourcesOfTask(task_node);
   if (pref_res) {
     for (auto& pref_res_id : *pref_res) {
       FlowGraphNode* pref_res_node = NodeForResourceID(pref_res_id);
@@ -1235,7 +1530,7 @@ void FlowGraphManager::UpdateTaskToResArcs(
       // prefer a resource before it is added to the graph.
       CHECK_NOTNULL(pref_res_node);
       ArcDescriptor arc_descriptor =
-        cost_model_->TaskToResourceNode(task_node->td_ptr_->uid(), pref_res_id);
+        CostOfTaskToResource(task_node, pref_res_id);
       FlowGraphArc* pref_res_arc =
         graph_change_manager_->mutable_flow_graph()->GetArc(task_node,
                                                             pref_res_node);
@@ -1274,8 +1569,7 @@ FlowGraphNode* FlowGraphManager::UpdateTaskToUnscheduledAggArc(
   if (!unsched_agg_node) {
     unsched_agg_node = AddUnscheduledAggNode(task_node->job_id_);
   }
-  ArcDescriptor arc_descriptor =
-    cost_model_->TaskToUnscheduledAgg(task_node->td_ptr_->uid());
+  ArcDescriptor arc_descriptor = CostOfTaskToUnscheduledAgg(task_node);
   FlowGraphArc* to_unsched_arc =
     graph_change_manager_->mutable_flow_graph()->GetArc(task_node,
                                                         unsched_agg_node);
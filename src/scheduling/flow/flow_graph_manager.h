@@ -29,10 +29,13 @@
 #include "base/common.h"
 #include "base/types.h"
 #include "base/resource_topology_node_desc.pb.h"
+#include "misc/arena.h"
 #include "misc/map-util.h"
+#include "misc/thread_pool.h"
 #include "misc/time_interface.h"
 #include "misc/trace_generator.h"
 #include "scheduling/scheduling_delta.pb.h"
+#include "scheduling/task_store.h"
 #include "scheduling/flow/cost_model_interface.h"
 #include "scheduling/flow/dimacs_change.h"
 #include "scheduling/flow/dimacs_change_stats.h"
@@ -55,6 +58,43 @@ struct TDOrNodeWrapper {
   TaskDescriptor* td_ptr_;
 };
 
+// The cost model's answers for the arcs of a single node. They are computed
+// concurrently for many nodes before the changes are applied to the graph.
+// The fields that are set depend on the node's type: task nodes use the
+// unscheduled, continuation, preemption, EC and resource preference fields,
+// EC nodes use the EC and resource preference fields, and resource nodes use
+// dst_node_arcs_.
+struct NodeCosts {
+  explicit NodeCosts(FlowGraphNode* node)
+    : node_(node), has_to_unsched_(false), to_unsched_(0LL, 0ULL, 0ULL),
+      has_continuation_(false), continuation_(0LL, 0ULL, 0ULL),
+      has_preemption_(false), preemption_(0LL, 0ULL, 0ULL),
+      has_pref_ecs_(false), pref_ecs_(NULL),
+      has_pref_res_(false), pref_res_(NULL) {
+  }
+  ~NodeCosts() {
+    // Preferences that have been handed out are owned by the caller.
+    delete pref_ecs_;
+    delete pref_res_;
+  }
+  FlowGraphNode* node_;
+  bool has_to_unsched_;
+  ArcDescriptor to_unsched_;
+  bool has_continuation_;
+  ArcDescriptor continuation_;
+  bool has_preemption_;
+  ArcDescriptor preemption_;
+  bool has_pref_ecs_;
+  vector<EquivClass_t>* pref_ecs_;
+  unordered_map<EquivClass_t, ArcDescriptor> ec_arcs_;
+  bool has_pref_res_;
+  vector<ResourceID_t>* pref_res_;
+  unordered_map<ResourceID_t, ArcDescriptor,
+    boost::hash<boost::uuids::uuid>> res_arcs_;
+  // Arcs from a resource node, keyed by the id of their destination node.
+  unordered_map<uint64_t, ArcDescriptor> dst_node_arcs_;
+};
+
 class FlowGraphManager {
  public:
   explicit FlowGraphManager(CostModelInterface* cost_model,
@@ -86,9 +126,16 @@ class FlowGraphManager {
       unordered_map<TaskID_t, ResourceID_t>* task_bindings,
       vector<SchedulingDelta*>* deltas);
 
-  multimap<uint64_t, uint64_t>* PopulateTaskMappingsForSimpleSolver(
-       unordered_map<TaskID_t, ResourceID_t>* task_bindings,
-       pair<TaskID_t, ResourceID_t> delta);
+  /**
+   * Generates the scheduling deltas for a task that has been placed without
+   * running the flow solver.
+   * @param task_id the id of the placed task
+   * @param res_id the id of the PU on which the task has been placed
+   */
+  void TaskBindingToSchedulingDeltas(
+      TaskID_t task_id, ResourceID_t res_id,
+      unordered_map<TaskID_t, ResourceID_t>* task_bindings,
+      vector<SchedulingDelta*>* deltas);
   /**
    * As a result of task state change, preferences change or
    * resource removal we may end up with unconnected equivalence
@@ -111,14 +158,16 @@ class FlowGraphManager {
       const multimap<uint64_t, uint64_t>& task_mappings,
       shared_ptr<ResourceMap_t> resource_map,
       vector<SchedulingDelta*>* deltas);
+  // TaskCompleted, TaskEvicted, TaskFailed and TaskRemoved return the id of
+  // the task's node, or 0 if the task has no node (anymore).
   uint64_t TaskCompleted(TaskID_t task_id);
-  void TaskEvicted(TaskID_t task_id, ResourceID_t res_id);
-  void TaskFailed(TaskID_t task_id);
+  uint64_t TaskEvicted(TaskID_t task_id, ResourceID_t res_id);
+  uint64_t TaskFailed(TaskID_t task_id);
   void TaskKilled(TaskID_t task_id);
   void TaskMigrated(TaskID_t task_id,
                     ResourceID_t old_res_id,
                     ResourceID_t new_res_id);
-  void TaskRemoved(TaskID_t task_id);
+  uint64_t TaskRemoved(TaskID_t task_id);
   void TaskScheduled(TaskID_t task_id, ResourceID_t res_id);
 
   /**
@@ -146,6 +195,10 @@ class FlowGraphManager {
   inline const FlowGraphNode& node_for_node_id(uint64_t node_id) {
     return graph_change_manager_->Node(node_id);
   }
+  // Sets the store of the tasks that are not in their job's task tree.
+  inline void SetTaskStore(TaskStore* task_store) {
+    task_store_ = task_store;
+  }
  private:
   FRIEND_TEST(DIMACSExporterTest, LargeGraph);
   FRIEND_TEST(DIMACSExporterTest, ScalabilityTestGraphs);
@@ -171,6 +224,9 @@ class FlowGraphManager {
   FRIEND_TEST(FlowGraphManagerTest, UpdateEquivToEquivArcs);
   FRIEND_TEST(FlowGraphManagerTest, UpdateEquivToResArcs);
   FRIEND_TEST(FlowGraphManagerTest, UpdateFlowGraph);
+  FRIEND_TEST(FlowGraphManagerTest, UpdateFlowGraphInParallel);
+  FRIEND_TEST(FlowGraphManagerTest,
+              UpdateFlowGraphInParallelWithCpuCostModel);
   FRIEND_TEST(FlowGraphManagerTest, UpdateResourceStatsUpToRoot);
   FRIEND_TEST(FlowGraphManagerTest, UpdateResOutgoingArcs);
   FRIEND_TEST(FlowGraphManagerTest, UpdateResToSinkArc);
@@ -197,6 +253,14 @@ class FlowGraphManager {
 
   FlowGraphNode* AddTaskNode(JobID_t job_id, TaskDescriptor* td_ptr);
   FlowGraphNode* AddUnscheduledAggNode(JobID_t job_id);
+
+  /**
+   * Asks the cost model for the costs of all the arcs that the Update*Node
+   * methods will add or change for the node. The queries are issued in the
+   * same order as the Update*Node methods issue them.
+   * @param costs the costs to fill in; costs->node_ must be set
+   */
+  void ComputeNodeCosts(NodeCosts* costs);
   void PinTaskToNode(FlowGraphNode* task_node, FlowGraphNode* res_node);
   void RemoveEquivClassNode(FlowGraphNode* ec_node);
 
@@ -222,7 +286,7 @@ class FlowGraphManager {
                                 const vector<ResourceID_t>& pref_resources,
                                 DIMACSChangeType change_type);
   void RemoveResourceNode(FlowGraphNode* res_node);
-  void RemoveTaskHelper(TaskID_t task_id);
+  uint64_t RemoveTaskHelper(TaskID_t task_id);
   uint64_t RemoveTaskNode(FlowGraphNode* task_node);
   void RemoveUnscheduledAggNode(JobID_t job_id);
 
@@ -258,6 +322,14 @@ class FlowGraphManager {
                            queue<TDOrNodeWrapper*>* node_queue,
                            unordered_set<uint64_t>* marked_nodes);
 
+  /**
+   * Adds a child task to the node queue, and adds a graph node for it if it
+   * needs one. Tasks that have already been visited are skipped.
+   */
+  void QueueChildTask(TaskDescriptor* child_td_ptr,
+                      queue<TDOrNodeWrapper*>* node_queue,
+                      unordered_set<uint64_t>* marked_nodes);
+
   void UpdateEquivClassNode(FlowGraphNode* ec_node,
                             queue<TDOrNodeWrapper*>* node_queue,
                             unordered_set<uint64_t>* marked_nodes);
@@ -282,6 +354,18 @@ class FlowGraphManager {
   void UpdateFlowGraph(queue<TDOrNodeWrapper*>* node_queue,
                        unordered_set<uint64_t>* marked_nodes);
 
+  /**
+   * Same as UpdateFlowGraph, but computes the costs of the nodes in parallel.
+   * The method repeatedly takes the run of nodes of the same type at the
+   * front of the queue, computes their costs on the update thread pool, and
+   * then applies the changes to the graph serially, in queue order.
+   */
+  void UpdateFlowGraphInParallel(queue<TDOrNodeWrapper*>* node_queue,
+                                 unordered_set<uint64_t>* marked_nodes);
+  void UpdateNode(TDOrNodeWrapper* cur_node,
+                  queue<TDOrNodeWrapper*>* node_queue,
+                  unordered_set<uint64_t>* marked_nodes);
+
   void UpdateResourceNode(FlowGraphNode* res_node,
                           queue<TDOrNodeWrapper*>* node_queue,
                           unordered_set<uint64_t>* marked_nodes);
@@ -388,6 +472,34 @@ class FlowGraphManager {
     return FindPtrOrNull(job_unsched_to_node_, job_id);
   }
 
+  // Wrappers around the cost model queries made while updating the graph.
+  // They return the precomputed answer if there is one for the node, and
+  // query the cost model otherwise.
+  ArcDescriptor CostOfTaskToUnscheduledAgg(FlowGraphNode* task_node);
+  ArcDescriptor CostOfTaskContinuation(FlowGraphNode* task_node);
+  ArcDescriptor CostOfTaskPreemption(FlowGraphNode* task_node);
+  vector<EquivClass_t>* PrefECsOfTask(FlowGraphNode* task_node);
+  ArcDescriptor CostOfTaskToEquivClass(FlowGraphNode* task_node,
+                                       EquivClass_t ec);
+  vector<ResourceID_t>* PrefResourcesOfTask(FlowGraphNode* task_node);
+  ArcDescriptor CostOfTaskToResource(FlowGraphNode* task_node,
+                                     ResourceID_t res_id);
+  vector<EquivClass_t>* PrefECsOfEquivClass(FlowGraphNode* ec_node);
+  ArcDescriptor CostOfEquivClassToEquivClass(FlowGraphNode* ec_node,
+                                             EquivClass_t pref_ec);
+  vector<ResourceID_t>* PrefResourcesOfEquivClass(FlowGraphNode* ec_node);
+  ArcDescriptor CostOfEquivClassToResource(FlowGraphNode* ec_node,
+                                           ResourceID_t res_id);
+  ArcDescriptor CostOfResourceToResource(FlowGraphNode* res_node,
+                                         FlowGraphNode* dst_node);
+  ArcDescriptor CostOfResourceToSink(FlowGraphNode* res_node);
+  inline NodeCosts* PrecomputedCosts(FlowGraphNode* node) {
+    if (precomputed_costs_ && precomputed_costs_->node_ == node) {
+      return precomputed_costs_;
+    }
+    return NULL;
+  }
+
   // Resource and task mappings
   unordered_map<TaskID_t, FlowGraphNode*> task_to_node_map_;
   unordered_map<ResourceID_t, FlowGraphNode*,
@@ -413,6 +525,16 @@ class FlowGraphManager {
   // used as a marker in the resource topology traversal. It helps us to avoid
   // having to reset the visited state before each traversal.
   uint32_t cur_traversal_counter_;
+  // Threads used to compute costs in parallel; NULL if the graph is updated
+  // by a single thread.
+  scoped_ptr<ThreadPool> update_thread_pool_;
+  // Holds the NodeCosts of the nodes that are being updated.
+  Arena node_costs_arena_;
+  // The costs of the node whose changes are being applied, if they have been
+  // computed in advance.
+  NodeCosts* precomputed_costs_;
+  // Not owned; may be NULL.
+  TaskStore* task_store_;
 };
 
 }  // namespace firmament
@@ -25,19 +25,18 @@
 #include "misc/map-util.h"
 #include "misc/wall_time.h"
 #include "misc/utils.h"
-#include "scheduling/flow/dimacs_add_node.h"
-#include "scheduling/flow/dimacs_change_arc.h"
+#include "scheduling/flow/cpu_cost_model.h"
 #include "scheduling/flow/dimacs_change_stats.h"
-#include "scheduling/flow/dimacs_new_arc.h"
-#include "scheduling/flow/dimacs_remove_node.h"
 #include "scheduling/flow/flow_graph_arc.h"
 #include "scheduling/flow/flow_graph_manager.h"
 #include "scheduling/flow/flow_graph_node.h"
 #include "scheduling/flow/mock_cost_model.h"
 #include "scheduling/flow/trivial_cost_model.h"
 #include "scheduling/flow/void_cost_model.h"
+#include "scheduling/knowledge_base.h"
 
 DECLARE_string(flow_scheduling_solver);
+DECLARE_uint64(flow_graph_update_threads);
 DECLARE_uint64(num_pref_arcs_task_to_res);
 
 using ::testing::_;
@@ -964,6 +963,201 @@ TEST_F(FlowGraphManagerTest, UpdateEquivToResArcs) {
   EXPECT_EQ(ec_node->outgoing_arc_map_.size(), 0);
 }
 
+TEST_F(FlowGraphManagerTest, UpdateFlowGraphInParallel) {
+  // Create a coordinator with one machine that has four PUs.
+  ResourceTopologyNodeDescriptor rtnd;
+  ResourceID_t root_res_id = GenerateResourceID("test");
+  rtnd.mutable_resource_desc()->set_uuid(to_string(root_res_id));
+  rtnd.mutable_resource_desc()->set_type(
+      ResourceDescriptor::RESOURCE_COORDINATOR);
+  ResourceTopologyNodeDescriptor* rtn_machine = rtnd.add_children();
+  ResourceDescriptor* machine_rd_ptr = CreateMachine(rtn_machine, "machine");
+  rtn_machine->set_parent_id(to_string(root_res_id));
+  for (uint64_t pu = 0; pu < 4; ++pu) {
+    ResourceTopologyNodeDescriptor* rtn_pu = rtn_machine->add_children();
+    ResourceID_t pu_res_id = GenerateResourceID("pu" + to_string(pu));
+    rtn_pu->mutable_resource_desc()->set_uuid(to_string(pu_res_id));
+    rtn_pu->mutable_resource_desc()->set_type(ResourceDescriptor::RESOURCE_PU);
+    rtn_pu->set_parent_id(machine_rd_ptr->uuid());
+  }
+  ResourceStatus machine_status(machine_rd_ptr, rtn_machine, "machine", 0);
+  InsertIfNotPresent(resource_map_.get(),
+                     ResourceIDFromString(machine_rd_ptr->uuid()),
+                     &machine_status);
+  // Create jobs whose root tasks spawn children, with a few distinct
+  // binaries so that tasks share equivalence classes.
+  vector<JobDescriptor> jobs(20);
+  vector<JobDescriptor*> jd_ptrs;
+  for (uint64_t job = 0; job < jobs.size(); ++job) {
+    TaskDescriptor* td_ptr = CreateTask(&jobs[job], job);
+    td_ptr->set_state(TaskDescriptor::RUNNABLE);
+    td_ptr->set_binary("binary" + to_string(job % 3));
+    InsertIfNotPresent(task_map_.get(), td_ptr->uid(), td_ptr);
+    for (uint64_t child = 0; child < 3; ++child) {
+      TaskDescriptor* child_td_ptr = td_ptr->add_spawned();
+      child_td_ptr->set_uid(GenerateTaskID(*td_ptr, child));
+      child_td_ptr->set_job_id(td_ptr->job_id());
+      child_td_ptr->set_state(TaskDescriptor::RUNNABLE);
+      child_td_ptr->set_binary("binary" + to_string(child));
+      InsertIfNotPresent(task_map_.get(), child_td_ptr->uid(), child_td_ptr);
+    }
+    jd_ptrs.push_back(&jobs[job]);
+  }
+  // Build the same graph serially and in parallel, and check that both
+  // make the same changes in the same order.
+  vector<vector<string>> arcs;
+  for (uint64_t num_threads : {1, 4}) {
+    FLAGS_flow_graph_update_threads = num_threads;
+    VoidCostModel cost_model(resource_map_, task_map_);
+    FlowGraphManager graph_manager(&cost_model, leaf_res_ids_, &wall_time_,
+                                   tg_, &dimacs_stats_);
+    ResourceTopologyNodeDescriptor graph_rtnd;
+    graph_rtnd.CopyFrom(rtnd);
+    leaf_res_ids_->clear();
+    graph_manager.AddResourceTopology(&graph_rtnd);
+    graph_manager.AddOrUpdateJobNodes(jd_ptrs);
+    vector<string> graph_arcs;
+    for (auto& arc : graph_manager.graph_change_manager_->flow_graph().Arcs()) {
+      graph_arcs.push_back(to_string(arc->src_) + "->" + to_string(arc->dst_) +
+                           " " + to_string(arc->cap_upper_bound_) + " " +
+                           to_string(arc->cost_));
+    }
+    arcs.push_back(graph_arcs);
+  }
+  FLAGS_flow_graph_update_threads = 1;
+  // Every task has arcs to its unscheduled aggregator and to its two ECs.
+  EXPECT_GT(arcs[0].size(), jobs.size() * 4 * 3);
+  EXPECT_EQ(arcs[0], arcs[1]);
+  resource_map_->clear();
+}
+
+TEST_F(FlowGraphManagerTest, UpdateFlowGraphInParallelWithCpuCostModel) {
+  // Create a coordinator with four machines in two zones, of which one has
+  // a soft taint.
+  ResourceTopologyNodeDescriptor rtnd;
+  ResourceID_t root_res_id = GenerateResourceID("test");
+  rtnd.mutable_resource_desc()->set_uuid(to_string(root_res_id));
+  rtnd.mutable_resource_desc()->set_type(
+      ResourceDescriptor::RESOURCE_COORDINATOR);
+  vector<ResourceStatus*> resource_statuses;
+  for (uint64_t machine = 0; machine < 4; ++machine) {
+    string machine_name = "machine" + to_string(machine);
+    ResourceTopologyNodeDescriptor* rtn_machine = rtnd.add_children();
+    ResourceDescriptor* machine_rd_ptr =
+      CreateMachine(rtn_machine, machine_name);
+    machine_rd_ptr->set_friendly_name(machine_name);
+    machine_rd_ptr->set_max_pods(10);
+    machine_rd_ptr->mutable_resource_capacity()->set_cpu_cores(1000.0);
+    machine_rd_ptr->mutable_resource_capacity()->set_ram_cap(32000);
+    machine_rd_ptr->mutable_available_resources()->set_cpu_cores(
+        500.0 + 100.0 * machine);
+    machine_rd_ptr->mutable_available_resources()->set_ram_cap(16000);
+    machine_rd_ptr->mutable_available_resources()->set_ephemeral_storage(1000);
+    Label* label_ptr = machine_rd_ptr->add_labels();
+    label_ptr->set_key("zone");
+    label_ptr->set_value(machine % 2 == 0 ? "a" : "b");
+    if (machine == 3) {
+      Taint* taint_ptr = machine_rd_ptr->add_taints();
+      taint_ptr->set_key("spot");
+      taint_ptr->set_effect("PreferNoSchedule");
+    }
+    rtn_machine->set_parent_id(to_string(root_res_id));
+    for (uint64_t pu = 0; pu < 2; ++pu) {
+      ResourceTopologyNodeDescriptor* rtn_pu = rtn_machine->add_children();
+      ResourceID_t pu_res_id =
+        GenerateResourceID(machine_name + "pu" + to_string(pu));
+      rtn_pu->mutable_resource_desc()->set_uuid(to_string(pu_res_id));
+      rtn_pu->mutable_resource_desc()->set_type(
+          ResourceDescriptor::RESOURCE_PU);
+      rtn_pu->set_parent_id(machine_rd_ptr->uuid());
+      resource_statuses.push_back(
+          new ResourceStatus(rtn_pu->mutable_resource_desc(), rtn_pu, "", 0));
+      InsertIfNotPresent(resource_map_.get(), pu_res_id,
+                         resource_statuses.back());
+    }
+    resource_statuses.push_back(
+        new ResourceStatus(machine_rd_ptr, rtn_machine, machine_name, 0));
+    InsertIfNotPresent(resource_map_.get(),
+                       ResourceIDFromString(machine_rd_ptr->uuid()),
+                       resource_statuses.back());
+  }
+  // Create jobs whose root tasks either only request resources, select the
+  // machines of a zone, or prefer the machines of a zone. Their children
+  // only request resources.
+  vector<JobDescriptor> jobs(20);
+  vector<JobDescriptor*> jd_ptrs;
+  for (uint64_t job = 0; job < jobs.size(); ++job) {
+    TaskDescriptor* td_ptr = CreateTask(&jobs[job], job);
+    td_ptr->set_state(TaskDescriptor::RUNNABLE);
+    td_ptr->mutable_resource_request()->set_cpu_cores(10.0 * (job % 4 + 1));
+    td_ptr->mutable_resource_request()->set_ram_cap(1000);
+    if (job % 3 == 1) {
+      LabelSelector* selector = td_ptr->add_label_selectors();
+      selector->set_type(LabelSelector::IN_SET);
+      selector->set_key("zone");
+      selector->add_values("a");
+    } else if (job % 3 == 2) {
+      PreferredSchedulingTerm* term =
+        td_ptr->mutable_affinity()->mutable_node_affinity()
+        ->add_preferredduringschedulingignoredduringexecution();
+      term->set_weight(10);
+      NodeSelectorRequirement* requirement =
+        term->mutable_preference()->add_matchexpressions();
+      requirement->set_key("zone");
+      requirement->set_operator_("In");
+      requirement->add_values("b");
+    }
+    InsertIfNotPresent(task_map_.get(), td_ptr->uid(), td_ptr);
+    for (uint64_t child = 0; child < 3; ++child) {
+      TaskDescriptor* child_td_ptr = td_ptr->add_spawned();
+      child_td_ptr->set_uid(GenerateTaskID(*td_ptr, child));
+      child_td_ptr->set_job_id(td_ptr->job_id());
+      child_td_ptr->set_state(TaskDescriptor::RUNNABLE);
+      child_td_ptr->mutable_resource_request()->set_cpu_cores(
+          20.0 * (child + 1));
+      child_td_ptr->mutable_resource_request()->set_ram_cap(2000);
+      InsertIfNotPresent(task_map_.get(), child_td_ptr->uid(), child_td_ptr);
+    }
+    jd_ptrs.push_back(&jobs[job]);
+  }
+  // Build the same graph serially and in parallel, and check that both
+  // make the same changes in the same order.
+  vector<vector<string>> arcs;
+  uint64_t num_ec_to_ec_arcs = 0;
+  for (uint64_t num_threads : {1, 4}) {
+    FLAGS_flow_graph_update_threads = num_threads;
+    CpuCostModel cost_model(resource_map_, task_map_,
+                            shared_ptr<KnowledgeBase>(new KnowledgeBase),
+                            NULL);
+    FlowGraphManager graph_manager(&cost_model, leaf_res_ids_, &wall_time_,
+                                   tg_, &dimacs_stats_);
+    ResourceTopologyNodeDescriptor graph_rtnd;
+    graph_rtnd.CopyFrom(rtnd);
+    leaf_res_ids_->clear();
+    graph_manager.AddResourceTopology(&graph_rtnd);
+    graph_manager.AddOrUpdateJobNodes(jd_ptrs);
+    vector<string> graph_arcs;
+    for (auto& arc : graph_manager.graph_change_manager_->flow_graph().Arcs()) {
+      graph_arcs.push_back(to_string(arc->src_) + "->" + to_string(arc->dst_) +
+                           " " + to_string(arc->cap_upper_bound_) + " " +
+                           to_string(arc->cost_));
+      if (arc->src_node_->IsEquivalenceClassNode() &&
+          arc->dst_node_->IsEquivalenceClassNode()) {
+        num_ec_to_ec_arcs++;
+      }
+    }
+    arcs.push_back(graph_arcs);
+  }
+  FLAGS_flow_graph_update_threads = 1;
+  // Every task EC has arcs to the ECs of the machines it fits on.
+  EXPECT_GT(num_ec_to_ec_arcs, 0);
+  EXPECT_EQ(arcs[0], arcs[1]);
+  resource_map_->clear();
+  for (auto& resource_status : resource_statuses) {
+    delete resource_status;
+  }
+}
+
 TEST_F(FlowGraphManagerTest, UpdateResourceStatsUpToRoot) {
   FlowGraphManager* graph_manager = CreateGraphManagerUsingTrivialCost();
   ResourceTopologyNodeDescriptor rtnd;
@@ -28,20 +28,20 @@ namespace firmament {
   FlowGraphNode::FlowGraphNode(uint64_t id)
       : id_(id), excess_(0), job_id_(boost::uuids::nil_uuid()),
         resource_id_(boost::uuids::nil_uuid()), rd_ptr_(NULL), td_ptr_(NULL),
-        ec_id_(0), visited_(0) {
+        ec_id_(0), visited_(0), index_(0) {
   }
 
   FlowGraphNode::FlowGraphNode(uint64_t id, int64_t excess)
       : id_(id), excess_(excess), job_id_(boost::uuids::nil_uuid()),
         resource_id_(boost::uuids::nil_uuid()), rd_ptr_(NULL), td_ptr_(NULL),
-        ec_id_(0), visited_(0) {
+        ec_id_(0), visited_(0), index_(0) {
   }
 
   void FlowGraphNode::AddArc(FlowGraphArc* arc) {
     CHECK_EQ(arc->src_, id_);
-    CHECK(InsertIfNotPresent(&outgoing_arc_map_, arc->dst_, arc));
-    CHECK(InsertIfNotPresent(&(arc->dst_node_->incoming_arc_map_),
-                             arc->src_, arc));
+    arc->outgoing_index_ = outgoing_arc_map_.Append(arc->dst_, arc);
+    arc->incoming_index_ =
+      arc->dst_node_->incoming_arc_map_.Append(arc->src_, arc);
   }
 
   FlowNodeType FlowGraphNode::TransformToResourceNodeType(
@@ -32,6 +32,7 @@
 #include "base/resource_desc.pb.h"
 #include "base/task_desc.pb.h"
 #include "scheduling/flow/flow_graph_arc.h"
+#include "scheduling/flow/flow_graph_arc_map.h"
 
 namespace firmament {
 
@@ -97,11 +98,13 @@ struct FlowGraphNode {
   // Free-form comment for debugging purposes (used to label special nodes)
   string comment_;
   // Outgoing arcs from this node, keyed by destination node
-  unordered_map<uint64_t, FlowGraphArc*> outgoing_arc_map_;
+  FlowGraphArcMap outgoing_arc_map_;
   // Incoming arcs to this node, keyed by source node
-  unordered_map<uint64_t, FlowGraphArc*> incoming_arc_map_;
+  FlowGraphArcMap incoming_arc_map_;
   // Field use to mark if the node has been visited in a graph traversal.
   uint32_t visited_;
+  // Position of the node in FlowGraph::Nodes(). Maintained by the FlowGraph.
+  uint32_t index_;
 };
 
 }  // namespace firmament
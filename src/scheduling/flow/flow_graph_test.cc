@@ -69,7 +69,7 @@ TEST_F(FlowGraphTest, AddArcToNode) {
   FlowGraphArc* arc = graph.AddArc(n0->id_, n1->id_);
   CHECK_EQ(graph.NumNodes(), init_node_count + 2);
   CHECK_EQ(graph.NumArcs(), 1);
-  CHECK_EQ(n0->outgoing_arc_map_[n1->id_], arc);
+  CHECK_EQ(FindPtrOrNull(n0->outgoing_arc_map_, n1->id_), arc);
 }
 
 // Change an arc and check it gets added to changes.
@@ -133,6 +133,47 @@ TEST_F(FlowGraphTest, GetArc) {
   fgraph.DeleteNode(node1);
 }
 
+// Tests arc lookups between nodes with enough arcs for their arc maps to be
+// indexed, while arcs are removed and added.
+TEST_F(FlowGraphTest, GetArcHighDegree) {
+  FlowGraph fgraph;
+  uint64_t num_nodes = 2 * FlowGraphArcMap::kIndexThreshold;
+  vector<FlowGraphNode*> srcs;
+  vector<FlowGraphNode*> dsts;
+  for (uint64_t i = 0; i < num_nodes; ++i) {
+    srcs.push_back(fgraph.AddNode());
+    dsts.push_back(fgraph.AddNode());
+  }
+  for (auto& src : srcs) {
+    for (auto& dst : dsts) {
+      fgraph.AddArc(src, dst);
+    }
+  }
+  // Remove the arcs between every other pair of nodes.
+  for (uint64_t i = 0; i < num_nodes; ++i) {
+    for (uint64_t j = i % 2; j < num_nodes; j += 2) {
+      fgraph.DeleteArc(fgraph.GetArc(srcs[i], dsts[j]));
+    }
+  }
+  for (uint64_t i = 0; i < num_nodes; ++i) {
+    for (uint64_t j = 0; j < num_nodes; ++j) {
+      FlowGraphArc* arc = fgraph.GetArc(srcs[i], dsts[j]);
+      if ((i + j) % 2 == 0) {
+        EXPECT_TRUE(arc == NULL);
+      } else {
+        ASSERT_TRUE(arc != NULL);
+        EXPECT_EQ(arc->src_, srcs[i]->id_);
+        EXPECT_EQ(arc->dst_, dsts[j]->id_);
+      }
+    }
+  }
+  // Removing a node removes its arcs from the other nodes' maps.
+  uint64_t removed_id = dsts[1]->id_;
+  fgraph.DeleteNode(dsts[1]);
+  EXPECT_TRUE(fgraph.GetArc(srcs[0]->id_, removed_id) == NULL);
+  EXPECT_EQ(srcs[0]->outgoing_arc_map_.size(), num_nodes / 2 - 1);
+}
+
 }  // namespace firmament
 
 int main(int argc, char** argv) {
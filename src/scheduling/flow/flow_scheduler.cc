@@ -68,6 +68,9 @@ DEFINE_string(solver_runtime_accounting_mode, "algorithm",
               "scheduling duration in simulations");
 DEFINE_bool(reschedule_tasks_upon_node_failure, true, "True if tasks that were "
             "running on failed nodes should be rescheduled");
+DEFINE_bool(pipeline_solver_runs, false, "True if the solver should run while "
+            "the scheduler prepares the next round. The placements of a "
+            "solver run are applied in the next scheduling round.");
 
 DECLARE_string(flow_scheduling_solver);
 DECLARE_bool(flowlessly_flip_algorithms);
@@ -95,19 +98,21 @@ FlowScheduler::FlowScheduler(
     const string& coordinator_uri,
     TimeInterface* time_manager,
     TraceGenerator* trace_generator,
-    unordered_map<string, unordered_map<string, vector<TaskID_t>>>* labels_map,
-    vector<TaskID_t> *affinity_antiaffinity_tasks)
+    LabelIndex* label_index,
+    IndexedQueue<TaskID_t>* affinity_antiaffinity_tasks,
+    TaskStore* task_store)
     : EventDrivenScheduler(job_map, resource_map, resource_topology,
                            object_store, task_map, knowledge_base, topo_mgr,
                            m_adapter, event_notifier, coordinator_res_id,
                            coordinator_uri, time_manager, trace_generator,
-                           labels_map, affinity_antiaffinity_tasks),
+                           label_index, affinity_antiaffinity_tasks,
+                           task_store),
       topology_manager_(topo_mgr),
       last_updated_time_dependent_costs_(0ULL),
       leaf_res_ids_(new unordered_set<ResourceID_t,
                       boost::hash<boost::uuids::uuid>>),
       dimacs_stats_(new DIMACSChangeStats),
-      solver_run_cnt_(0) {
+      solver_run_cnt_(0), solver_start_timestamp_(0) {
   // Select the cost model to use
   VLOG(1) << "Set cost model to use in flow graph to \""
           << FLAGS_flow_scheduling_cost_model << "\"";
@@ -156,8 +161,8 @@ FlowScheduler::FlowScheduler(
       VLOG(1) << "Using the net cost model";
       break;
     case CostModelType::COST_MODEL_CPU:
-      cost_model_ = 
-          new CpuCostModel(resource_map, task_map, knowledge_base, labels_map);
+      cost_model_ =
+          new CpuCostModel(resource_map, task_map, knowledge_base, label_index);
       VLOG(1) << "Using the cpu cost model";
       break;
     case CostModelType::COST_MODEL_QUINCY_INTERFERENCE:
@@ -176,6 +181,7 @@ FlowScheduler::FlowScheduler(
       new FlowGraphManager(cost_model_, leaf_res_ids_, time_manager_,
                            trace_generator_, dimacs_stats_));
   cost_model_->SetFlowGraphManager(flow_graph_manager_);
+  flow_graph_manager_->SetTaskStore(task_store_);
 
   // Set up the initial flow graph
   flow_graph_manager_->AddResourceTopology(resource_topology);
@@ -395,20 +401,22 @@ void FlowScheduler::HandleTaskCompletion(TaskDescriptor* td_ptr,
   // Otherwise, we need to remove nodes, etc.
   if (td_ptr->delegated_from().empty() && task_in_graph) {
     uint64_t task_node_id = flow_graph_manager_->TaskCompleted(td_ptr->uid());
-    tasks_completed_during_solver_run_.insert(task_node_id);
+    tasks_changed_during_solver_run_.insert(task_node_id);
   }
 }
 
 void FlowScheduler::HandleTaskEviction(TaskDescriptor* td_ptr,
                                        ResourceDescriptor* rd_ptr) {
   boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
-  flow_graph_manager_->TaskEvicted(td_ptr->uid(),
-                                   ResourceIDFromString(rd_ptr->uuid()));
-  vector<TaskID_t>::iterator it =
-                    find(affinity_antiaffinity_tasks_->begin(),
-                    affinity_antiaffinity_tasks_->end(), td_ptr->uid());
-  if (it == affinity_antiaffinity_tasks_->end()) {
-     affinity_antiaffinity_tasks_->push_back(*it);
+  uint64_t task_node_id =
+    flow_graph_manager_->TaskEvicted(td_ptr->uid(),
+                                     ResourceIDFromString(rd_ptr->uuid()));
+  tasks_changed_during_solver_run_.insert(task_node_id);
+  // Evicted pod affinity/anti-affinity tasks go back to the queue.
+  if (affinity_antiaffinity_tasks_ && td_ptr->has_affinity() &&
+      (td_ptr->affinity().has_pod_affinity() ||
+       td_ptr->affinity().has_pod_anti_affinity())) {
+    affinity_antiaffinity_tasks_->PushBack(td_ptr->uid());
   }
   if (FLAGS_pod_affinity_antiaffinity_symmetry) {
     cost_model_->RemoveTaskFromTaskSymmetryMap(td_ptr);
@@ -418,7 +426,10 @@ void FlowScheduler::HandleTaskEviction(TaskDescriptor* td_ptr,
 
 void FlowScheduler::HandleTaskFailure(TaskDescriptor* td_ptr) {
   boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
-  flow_graph_manager_->TaskFailed(td_ptr->uid());
+  uint64_t task_node_id = flow_graph_manager_->TaskFailed(td_ptr->uid());
+  if (task_node_id) {
+    tasks_changed_during_solver_run_.insert(task_node_id);
+  }
   // pod affinity/anti-affinity symmetry
   if (FLAGS_pod_affinity_antiaffinity_symmetry) {
     cost_model_->RemoveTaskFromTaskSymmetryMap(td_ptr);
@@ -471,11 +482,8 @@ void FlowScheduler::HandleTaskPlacement(TaskDescriptor* td_ptr,
   // Pod affinity/anti-affinity
   if (td_ptr->has_affinity() && (td_ptr->affinity().has_pod_affinity() ||
                                  td_ptr->affinity().has_pod_anti_affinity())) {
-    vector<TaskID_t>::iterator it =
-        find(affinity_antiaffinity_tasks_->begin(),
-             affinity_antiaffinity_tasks_->end(), td_ptr->uid());
-    if (it != affinity_antiaffinity_tasks_->end()) {
-      affinity_antiaffinity_tasks_->erase(it);
+    if (affinity_antiaffinity_tasks_) {
+      affinity_antiaffinity_tasks_->Erase(td_ptr->uid());
     }
     // pod affinity/anti-affinity symmetry
     if (FLAGS_pod_affinity_antiaffinity_symmetry) {
@@ -487,7 +495,10 @@ void FlowScheduler::HandleTaskPlacement(TaskDescriptor* td_ptr,
 
 void FlowScheduler::HandleTaskRemoval(TaskDescriptor* td_ptr) {
   boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
-  flow_graph_manager_->TaskRemoved(td_ptr->uid());
+  uint64_t task_node_id = flow_graph_manager_->TaskRemoved(td_ptr->uid());
+  if (task_node_id) {
+    tasks_changed_during_solver_run_.insert(task_node_id);
+  }
   // pod affinity/anti-affinity symmetry
   if (FLAGS_pod_affinity_antiaffinity_symmetry) {
     cost_model_->RemoveTaskFromTaskSymmetryMap(td_ptr);
@@ -513,6 +524,23 @@ void FlowScheduler::LogDebugCostModel() {
   CHECK_EQ(fclose(csv_log_file), 0);
 }
 
+void FlowScheduler::NonRootTasksForJob(JobDescriptor* jd_ptr,
+                                       vector<TaskDescriptor*>* tasks) {
+  for (auto& td : *jd_ptr->mutable_root_task()->mutable_spawned()) {
+    tasks->push_back(&td);
+  }
+  if (task_store_) {
+    task_store_->TasksForJob(JobIDFromString(jd_ptr->uuid()), tasks);
+  }
+}
+
+uint64_t FlowScheduler::NumPendingGraphChanges() {
+  boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  return dimacs_stats_->nodes_added_ + dimacs_stats_->nodes_removed_ +
+    dimacs_stats_->arcs_added_ + dimacs_stats_->arcs_changed_ +
+    dimacs_stats_->arcs_removed_;
+}
+
 void FlowScheduler::PopulateSchedulerResourceUI(
     ResourceID_t res_id,
     TemplateDictionary* dict) const {
@@ -539,6 +567,7 @@ uint64_t FlowScheduler::ScheduleAllJobs(SchedulerStats* scheduler_stats) {
 uint64_t FlowScheduler::ScheduleAllQueueJobs(SchedulerStats* scheduler_stats,
                                              vector<SchedulingDelta>* deltas) {
   boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
+  affinity_task_batch_.clear();
   queue_based_schedule = true;
   uint64_t num_scheduled_tasks = ScheduleAllJobs(scheduler_stats, deltas);
   queue_based_schedule = false;
@@ -550,7 +579,7 @@ uint64_t FlowScheduler::ScheduleAllJobs(SchedulerStats* scheduler_stats,
   boost::lock_guard<boost::recursive_mutex> lock(scheduling_lock_);
   vector<JobDescriptor*> jobs;
   //Pod affinity/anti-affinity
-  one_task_runnable = false;
+  affinity_batch_released = false;
   for (auto& job_id_jd : jobs_to_schedule_) {
     const TaskDescriptor& td = job_id_jd.second->root_task();
     if (queue_based_schedule) {
@@ -570,7 +599,7 @@ uint64_t FlowScheduler::ScheduleAllJobs(SchedulerStats* scheduler_stats,
   }
   uint64_t num_scheduled_tasks = ScheduleJobs(jobs, scheduler_stats, deltas);
   //Pod affinity/anti-affinity
-  one_task_runnable = false;
+  affinity_batch_released = false;
   return num_scheduled_tasks;
 }
 
@@ -632,6 +661,10 @@ uint64_t FlowScheduler::ScheduleJobs(const vector<JobDescriptor*>& jd_ptr_vect,
       static_cast<uint64_t>(total_scheduler_timer.elapsed().wall) /
       NANOSECONDS_IN_MICROSECOND;
     trace_generator_->SchedulerRun(*scheduler_stats, current_run_dimacs_stats);
+  } else if (solver_dispatcher_->run_in_flight()) {
+    // There's nothing new to schedule, but the placements of the last
+    // pipelined solver run are still outstanding.
+    num_scheduled_tasks += FinishSolverRun(scheduler_stats, deltas);
   }
   return num_scheduled_tasks;
 }
@@ -702,26 +735,54 @@ uint64_t FlowScheduler::RunSchedulingIteration(
     // Periodically remove EC nodes without incoming arcs.
     flow_graph_manager_->PurgeUnconnectedEquivClassNodes();
   }
+  uint64_t num_scheduled = 0;
+  if (solver_dispatcher_->run_in_flight()) {
+    // Apply the placements of the run started in the previous round before
+    // the sets below are cleared and the graph is solved again.
+    num_scheduled += FinishSolverRun(scheduler_stats, deltas_output);
+  }
   pus_removed_during_solver_run_.clear();
-  tasks_completed_during_solver_run_.clear();
+  tasks_changed_during_solver_run_.clear();
   uint64_t scheduler_start_timestamp = time_manager_->GetCurrentTimestamp();
   // Run the flow solver! This is where all the juicy goodness happens :)
-  multimap<uint64_t, uint64_t>* task_mappings;
-  if (!queue_based_schedule) {
-    task_mappings = solver_dispatcher_->Run(scheduler_stats);
-  } else {
-      string id = ((*job_vector)[0])->uuid();
-      TaskID_t single_task_id = *(runnable_tasks_[JobIDFromString(id)].begin());
-      // Single task that needs to scheduled.
-      task_to_be_scheduled_ = single_task_id;
-      pair<TaskID_t, ResourceID_t> single_delta =
-        solver_dispatcher_->RunSimpleSolverForSingleTask(scheduler_stats,
-                                                         single_task_id);
-      task_mappings =
-        flow_graph_manager_->PopulateTaskMappingsForSimpleSolver(&task_bindings_,
-                                                                 single_delta);
+  if (queue_based_schedule) {
+    // Tasks with pod affinity/anti-affinity are placed without running the
+    // flow solver.
+    solver_run_cnt_++;
+    return num_scheduled + PlaceAffinityTaskBatch(scheduler_stats,
+                                                  deltas_output);
+  }
+  if (FLAGS_pipeline_solver_runs) {
+    // The solver runs while the scheduler handles events and builds up the
+    // graph for the next round; its placements are applied then.
+    solver_start_timestamp_ = scheduler_start_timestamp;
+    solver_dispatcher_->StartRun();
+    solver_run_cnt_++;
+    return num_scheduled;
   }
+  multimap<uint64_t, uint64_t>* task_mappings =
+    solver_dispatcher_->Run(scheduler_stats);
   solver_run_cnt_++;
+  return num_scheduled + ApplyTaskMappings(task_mappings,
+                                           scheduler_start_timestamp,
+                                           scheduler_stats, deltas_output);
+}
+
+uint64_t FlowScheduler::FinishSolverRun(
+    SchedulerStats* scheduler_stats,
+    vector<SchedulingDelta>* deltas_output) {
+  multimap<uint64_t, uint64_t>* task_mappings =
+    solver_dispatcher_->FinishRun(scheduler_stats);
+  return ApplyTaskMappings(task_mappings, solver_start_timestamp_,
+                           scheduler_stats, deltas_output);
+}
+
+uint64_t FlowScheduler::ApplyTaskMappings(
+    multimap<uint64_t, uint64_t>* task_mappings,
+    uint64_t scheduler_start_timestamp,
+    SchedulerStats* scheduler_stats,
+    vector<SchedulingDelta>* deltas_output) {
+  uint64_t current_timestamp = time_manager_->GetCurrentTimestamp();
   CHECK_LE(scheduler_stats->scheduler_runtime_, FLAGS_max_solver_runtime)
     << "Solver took longer than limit of "
     << scheduler_stats->scheduler_runtime_;
@@ -767,12 +828,12 @@ uint64_t FlowScheduler::RunSchedulingIteration(
                                                          resource_map_,
                                                          &deltas);
   for (it = task_mappings->begin(); it != task_mappings->end(); it++) {
-    if (tasks_completed_during_solver_run_.find(it->first) !=
-        tasks_completed_during_solver_run_.end()) {
-      // Ignore the task because it has already completed while the solver
-      // was running.
+    if (tasks_changed_during_solver_run_.find(it->first) !=
+        tasks_changed_during_solver_run_.end()) {
+      // Ignore the task because it has completed, failed, been removed or
+      // been evicted while the solver was running.
       VLOG(1) << "Task with node id: " << it->first
-              << " completed while the solver was running";
+              << " changed while the solver was running";
       continue;
     }
     if (pus_removed_during_solver_run_.find(it->second) !=
@@ -784,6 +845,13 @@ uint64_t FlowScheduler::RunSchedulingIteration(
               << " was removed while the solver was running";
       continue;
     }
+    if (!solver_dispatcher_->IsCurrentMapping(it->first, it->second)) {
+      // The graph has removed or re-used one of the nodes since the solver
+      // run started. The task is reconsidered in the next solver run.
+      VLOG(1) << "Mapping of node " << it->first << " to " << it->second
+              << " is stale";
+      continue;
+    }
     VLOG(2) << "Bind " << it->first << " to " << it->second << endl;
     flow_graph_manager_->NodeBindingToSchedulingDeltas(it->first, it->second,
                                                        &task_bindings_,
@@ -844,7 +912,73 @@ uint64_t FlowScheduler::RunSchedulingIteration(
   }
   // Makes sure the deltas get correctly freed.
   deltas.clear();
-  time_manager_->UpdateCurrentTimestamp(scheduler_start_timestamp);
+  time_manager_->UpdateCurrentTimestamp(current_timestamp);
+  if (FLAGS_update_resource_topology_capacities) {
+    for (auto& rtnd_ptr : resource_roots_) {
+      flow_graph_manager_->UpdateResourceTopology(rtnd_ptr);
+    }
+  }
+  return num_scheduled;
+}
+
+uint64_t FlowScheduler::PlaceAffinityTaskBatch(
+    SchedulerStats* scheduler_stats,
+    vector<SchedulingDelta>* deltas_output) {
+  // The batch consists of the affinity tasks that were made runnable for this
+  // round, in queue order. The queue is copied because placing a task
+  // removes it from the queue.
+  vector<TaskID_t> batch_tasks;
+  for (auto& task_id : *affinity_antiaffinity_tasks_) {
+    TaskDescriptor* td_ptr = FindPtrOrNull(*task_map_, task_id);
+    if (td_ptr && td_ptr->state() == TaskDescriptor::RUNNABLE) {
+      batch_tasks.push_back(task_id);
+    }
+  }
+  uint64_t num_scheduled = 0;
+  for (auto& task_id : batch_tasks) {
+    // Each task is placed before the next one is considered, so that the cost
+    // model checks the remaining tasks against the pods and the symmetry maps
+    // of the ones placed earlier in the batch.
+    pair<TaskID_t, ResourceID_t> mapping =
+      solver_dispatcher_->RunSimpleSolverForSingleTask(scheduler_stats,
+                                                       task_id);
+#ifdef __PLATFORM_HAS_BOOST__
+    if (mapping.second.is_nil()) {
+#else
+    if (mapping.second == 0) {
+#endif
+      affinity_task_batch_.push_back(pair<TaskID_t, bool>(task_id, false));
+      continue;
+    }
+    VLOG(2) << "Bind task " << task_id << " to " << mapping.second;
+    vector<SchedulingDelta*> deltas;
+    flow_graph_manager_->TaskBindingToSchedulingDeltas(task_id, mapping.second,
+                                                       &task_bindings_,
+                                                       &deltas);
+    TaskDescriptor* td_ptr = FindPtrOrNull(*task_map_, task_id);
+    CHECK_NOTNULL(td_ptr);
+    JobDescriptor* jd = FindOrNull(*job_map_,
+                                   JobIDFromString(td_ptr->job_id()));
+    CHECK_NOTNULL(jd);
+    if (jd->is_gang_scheduling_job()
+        && affinity_delta_tasks.find(td_ptr->uid())
+                                  == affinity_delta_tasks.end()) {
+      uint64_t scheduled_tasks_count = jd->scheduled_tasks_count();
+      jd->set_scheduled_tasks_count(++scheduled_tasks_count);
+    }
+    uint64_t num_placed = ApplySchedulingDeltas(deltas);
+    num_scheduled += num_placed;
+    affinity_task_batch_.push_back(pair<TaskID_t, bool>(task_id,
+                                                        num_placed > 0));
+    for (auto& delta : deltas) {
+      if (deltas_output && delta->type() != SchedulingDelta::NOOP) {
+        deltas_output->push_back(*delta);
+      }
+      delete delta;
+    }
+  }
+  VLOG(1) << "Placed " << num_scheduled << " out of " << batch_tasks.size()
+          << " pod affinity/anti-affinity tasks";
   if (FLAGS_update_resource_topology_capacities) {
     for (auto& rtnd_ptr : resource_roots_) {
       flow_graph_manager_->UpdateResourceTopology(rtnd_ptr);
@@ -903,13 +1037,15 @@ void FlowScheduler::UpdateGangSchedulingDeltas(
                     vector<uint64_t>* unscheduled_affinity_tasks) {
   // update batch schedule deltas
   for (auto job_ptr : delta_jobs) {
-    TaskDescriptor rtd = job_ptr->root_task();
-    for (auto td : rtd.spawned()) {
+    const TaskDescriptor& rtd = job_ptr->root_task();
+    vector<TaskDescriptor*> tasks;
+    NonRootTasksForJob(job_ptr, &tasks);
+    for (auto td_ptr : tasks) {
       vector<uint64_t>::iterator it = find(unscheduled_normal_tasks->begin(),
                                       unscheduled_normal_tasks->end(),
-                                      td.uid());
+                                      td_ptr->uid());
       if (it == unscheduled_normal_tasks->end()) {
-        unscheduled_normal_tasks->push_back(td.uid());
+        unscheduled_normal_tasks->push_back(td_ptr->uid());
       }
     }
     delta_jobs.clear();
@@ -926,12 +1062,14 @@ void FlowScheduler::UpdateGangSchedulingDeltas(
   for (auto it = affinity_job_to_deltas_.begin();
             it != affinity_job_to_deltas_.end(); ++it) {
     JobDescriptor* jd_ptr = it->first;
-    TaskDescriptor root_td = jd_ptr->root_task();
+    const TaskDescriptor& root_td = jd_ptr->root_task();
+    vector<TaskDescriptor*> tasks;
+    NonRootTasksForJob(jd_ptr, &tasks);
     if (!it->second.size()) {
-      for (auto td : root_td.spawned()) {
-        if (td.state() != TaskDescriptor::RUNNING) {
-          unscheduled_affinity_tasks_set->insert(td.uid());
-          unscheduled_affinity_tasks->push_back(td.uid());
+      for (auto td_ptr : tasks) {
+        if (td_ptr->state() != TaskDescriptor::RUNNING) {
+          unscheduled_affinity_tasks_set->insert(td_ptr->uid());
+          unscheduled_affinity_tasks->push_back(td_ptr->uid());
         }
       }
       if (root_td.state() != TaskDescriptor::RUNNING) {
@@ -966,17 +1104,17 @@ void FlowScheduler::UpdateGangSchedulingDeltas(
           deltas_output->erase(it);
         }
       }
-      for (auto td : root_td.spawned()) {
-        unscheduled_affinity_tasks_set->insert(td.uid());
-        unscheduled_affinity_tasks->push_back(td.uid());
+      for (auto td_ptr : tasks) {
+        unscheduled_affinity_tasks_set->insert(td_ptr->uid());
+        unscheduled_affinity_tasks->push_back(td_ptr->uid());
       }
       unscheduled_affinity_tasks_set->insert(root_td.uid());
       unscheduled_affinity_tasks->push_back(root_td.uid());
     } else {
-      for (auto td : root_td.spawned()) {
-        if (td.state() != TaskDescriptor::RUNNING) {
-          unscheduled_affinity_tasks_set->insert(td.uid());
-          unscheduled_affinity_tasks->push_back(td.uid());
+      for (auto td_ptr : tasks) {
+        if (td_ptr->state() != TaskDescriptor::RUNNING) {
+          unscheduled_affinity_tasks_set->insert(td_ptr->uid());
+          unscheduled_affinity_tasks->push_back(td_ptr->uid());
         }
       }
       if (root_td.state() != TaskDescriptor::RUNNING) {
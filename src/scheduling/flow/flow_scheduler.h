@@ -26,6 +26,7 @@
 #include <map>
 #include <set>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "base/common.h"
@@ -66,9 +67,9 @@ class FlowScheduler : public EventDrivenScheduler {
                 const string& coordinator_uri,
                 TimeInterface* time_manager,
                 TraceGenerator* trace_generator,
-                unordered_map<string, unordered_map<string, vector<TaskID_t>>>*
-                    labels_map,
-                vector<TaskID_t> *affinity_antiaffinity_tasks);
+                LabelIndex* label_index,
+                IndexedQueue<TaskID_t>* affinity_antiaffinity_tasks,
+                TaskStore* task_store);
   ~FlowScheduler();
   virtual void DeregisterResource(ResourceTopologyNodeDescriptor* rtnd_ptr);
   virtual void HandleJobCompletion(JobID_t job_id);
@@ -121,9 +122,20 @@ class FlowScheduler : public EventDrivenScheduler {
     return *solver_dispatcher_;
   }
 
-  TaskID_t GetSingleTaskTobeScheduled() {
-    return task_to_be_scheduled_;
+  /**
+   * Returns the pod affinity/anti-affinity tasks considered in the last queue
+   * based scheduling round, in the order in which they were placed, and
+   * whether each of them was placed.
+   */
+  const vector<pair<TaskID_t, bool>>& GetAffinityTaskBatch() const {
+    return affinity_task_batch_;
   }
+
+  /**
+   * Returns the number of flow graph changes (node and arc additions,
+   * removals and arc updates) made since the solver last ran.
+   */
+  uint64_t NumPendingGraphChanges();
  protected:
   virtual void HandleTaskMigration(TaskDescriptor* td_ptr,
                                    ResourceDescriptor* rd_ptr);
@@ -132,9 +144,29 @@ class FlowScheduler : public EventDrivenScheduler {
 
  private:
   uint64_t ApplySchedulingDeltas(const vector<SchedulingDelta*>& deltas);
+  /**
+   * Turns the task mappings of a solver run into scheduling deltas and
+   * applies them.
+   * @param task_mappings the mappings returned by the solver dispatcher; freed
+   * @param scheduler_start_timestamp the time at which the solver run started
+   * @return the number of tasks placed
+   */
+  uint64_t ApplyTaskMappings(multimap<uint64_t, uint64_t>* task_mappings,
+                             uint64_t scheduler_start_timestamp,
+                             SchedulerStats* scheduler_stats,
+                             vector<SchedulingDelta>* deltas_output);
+  // Waits for the pipelined solver run and applies its placements.
+  uint64_t FinishSolverRun(SchedulerStats* scheduler_stats,
+                           vector<SchedulingDelta>* deltas_output);
   void HandleTasksFromDeregisteredResource(
       ResourceTopologyNodeDescriptor* rtnd_ptr);
   void LogDebugCostModel();
+  // Appends the tasks that the job's root task spawned, and the job's tasks
+  // in the task store.
+  void NonRootTasksForJob(JobDescriptor* jd_ptr,
+                          vector<TaskDescriptor*>* tasks);
+  uint64_t PlaceAffinityTaskBatch(SchedulerStats* scheduler_stats,
+                                  vector<SchedulingDelta>* deltas_output);
   TaskDescriptor* ProducingTaskForDataObjectID(DataObjectID_t id);
   void RegisterLocalResource(ResourceID_t res_id);
   void RegisterRemoteResource(ResourceID_t res_id);
@@ -161,15 +193,19 @@ class FlowScheduler : public EventDrivenScheduler {
   // while the solver was running. This set is used to make sure we don't
   // place tasks on PUs that have been removed.
   set<uint64_t> pus_removed_during_solver_run_;
-  // Set of task node ids that have completed while the solver was running.
-  // We use this set to make sure we don't try to place again the completed
-  // tasks.
-  set<uint64_t> tasks_completed_during_solver_run_;
+  // Set of task node ids whose tasks have completed, failed, been removed or
+  // been evicted while the solver was running. We use this set to make sure
+  // we don't place these tasks based on the stale solver results.
+  set<uint64_t> tasks_changed_during_solver_run_;
   DIMACSChangeStats* dimacs_stats_;
   uint64_t solver_run_cnt_;
+  // Time at which the solver run in flight (with -pipeline_solver_runs)
+  // started.
+  uint64_t solver_start_timestamp_;
   unordered_set<ResourceTopologyNodeDescriptor*> resource_roots_;
-  // Single task that needs to scheduled in queue based scheduling round.
-  TaskID_t task_to_be_scheduled_;
+  // Tasks considered in the last queue based scheduling round, and whether
+  // they were placed.
+  vector<pair<TaskID_t, bool>> affinity_task_batch_;
 };
 
 }  // namespace scheduler
@@ -0,0 +1,196 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Tests for the flow scheduler.
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "base/common.h"
+#include "base/resource_status.h"
+#include "base/types.h"
+#include "misc/map-util.h"
+#include "misc/trace_generator.h"
+#include "misc/utils.h"
+#include "misc/wall_time.h"
+#include "scheduling/flow/flow_scheduler.h"
+#include "scheduling/knowledge_base.h"
+#include "storage/simple_object_store.h"
+
+DECLARE_string(flow_scheduling_solver);
+DECLARE_bool(pipeline_solver_runs);
+
+namespace firmament {
+namespace scheduler {
+
+// The fixture for testing the FlowScheduler class.
+class FlowSchedulerTest : public ::testing::Test {
+ protected:
+  FlowSchedulerTest()
+    : job_map_(new JobMap_t),
+      resource_map_(new ResourceMap_t),
+      task_map_(new TaskMap_t),
+      trace_generator_(&wall_time_) {
+    FLAGS_v = 2;
+    FLAGS_flow_scheduling_solver = "native";
+  }
+
+  virtual ~FlowSchedulerTest() {
+    FLAGS_flow_scheduling_solver = "cs2";
+    FLAGS_pipeline_solver_runs = false;
+  }
+
+  virtual void SetUp() {
+    ResourceID_t root_id = GenerateRootResourceID("flow_scheduler_test");
+    ResourceDescriptor* rd_ptr = rtn_root_.mutable_resource_desc();
+    rd_ptr->set_uuid(to_string(root_id));
+    rd_ptr->set_type(ResourceDescriptor::RESOURCE_COORDINATOR);
+    AddResourceStatus(&rtn_root_);
+    scheduler_.reset(new FlowScheduler(
+        job_map_, resource_map_, &rtn_root_,
+        shared_ptr<store::ObjectStoreInterface>(
+            new store::SimpleObjectStore(root_id)),
+        task_map_, shared_ptr<KnowledgeBase>(new KnowledgeBase),
+        shared_ptr<TopologyManager>(), NULL, NULL, root_id, "",
+        &wall_time_, &trace_generator_, NULL, NULL, NULL));
+    scheduler_->RegisterResource(&rtn_root_, false, true);
+  }
+
+  virtual void TearDown() {
+    // Waits for a solver run that is still in flight.
+    scheduler_.reset();
+  }
+
+  JobDescriptor* AddJob() {
+    JobID_t job_id = GenerateJobID();
+    CHECK(InsertIfNotPresent(job_map_.get(), job_id, JobDescriptor()));
+    JobDescriptor* jd_ptr = FindOrNull(*job_map_, job_id);
+    jd_ptr->set_uuid(to_string(job_id));
+    // The root task id is derived from the job name.
+    jd_ptr->set_name(jd_ptr->uuid());
+    TaskDescriptor* td_ptr = jd_ptr->mutable_root_task();
+    td_ptr->set_uid(GenerateRootTaskID(*jd_ptr));
+    td_ptr->set_state(TaskDescriptor::CREATED);
+    td_ptr->set_job_id(jd_ptr->uuid());
+    CHECK(InsertIfNotPresent(task_map_.get(), td_ptr->uid(), td_ptr));
+    scheduler_->AddJob(jd_ptr);
+    return jd_ptr;
+  }
+
+  // Adds a machine with num_pus PUs.
+  void AddMachine(uint64_t num_pus) {
+    ResourceTopologyNodeDescriptor* machine_rtnd = rtn_root_.add_children();
+    ResourceDescriptor* machine_rd = machine_rtnd->mutable_resource_desc();
+    machine_rd->set_uuid(to_string(GenerateResourceID()));
+    machine_rd->set_type(ResourceDescriptor::RESOURCE_MACHINE);
+    machine_rd->set_friendly_name(machine_rd->uuid());
+    machine_rtnd->set_parent_id(rtn_root_.resource_desc().uuid());
+    AddResourceStatus(machine_rtnd);
+    for (uint64_t i = 0; i < num_pus; ++i) {
+      ResourceTopologyNodeDescriptor* pu_rtnd = machine_rtnd->add_children();
+      ResourceDescriptor* pu_rd = pu_rtnd->mutable_resource_desc();
+      pu_rd->set_uuid(to_string(GenerateResourceID()));
+      pu_rd->set_type(ResourceDescriptor::RESOURCE_PU);
+      pu_rtnd->set_parent_id(machine_rd->uuid());
+      AddResourceStatus(pu_rtnd);
+    }
+    scheduler_->RegisterResource(machine_rtnd, false, true);
+  }
+
+  void AddResourceStatus(ResourceTopologyNodeDescriptor* rtnd_ptr) {
+    ResourceDescriptor* rd_ptr = rtnd_ptr->mutable_resource_desc();
+    CHECK(InsertIfNotPresent(
+        resource_map_.get(), ResourceIDFromString(rd_ptr->uuid()),
+        new ResourceStatus(rd_ptr, rtnd_ptr, "", 0)));
+  }
+
+  WallTime wall_time_;
+  shared_ptr<JobMap_t> job_map_;
+  shared_ptr<ResourceMap_t> resource_map_;
+  shared_ptr<TaskMap_t> task_map_;
+  ResourceTopologyNodeDescriptor rtn_root_;
+  TraceGenerator trace_generator_;
+  scoped_ptr<FlowScheduler> scheduler_;
+};
+
+// Checks that the placements of a pipelined solver run are applied in the
+// next round, except for the tasks that changed while the solver ran.
+TEST_F(FlowSchedulerTest, PipelinedSolverRuns) {
+  FLAGS_pipeline_solver_runs = true;
+  AddMachine(2);
+  JobDescriptor* removed_jd = AddJob();
+  TaskDescriptor* removed_td = removed_jd->mutable_root_task();
+  TaskDescriptor* td = AddJob()->mutable_root_task();
+  SchedulerStats stats;
+  vector<SchedulingDelta> deltas;
+  // The first round only starts the solver.
+  EXPECT_EQ(scheduler_->ScheduleAllJobs(&stats, &deltas), 0);
+  EXPECT_TRUE(deltas.empty());
+  // The solver placed removed_td, but it goes away during the run. Its node
+  // id may be re-used by the task that is added afterwards.
+  scheduler_->HandleTaskRemoval(removed_td);
+  scheduler_->HandleJobRemoval(JobIDFromString(removed_jd->uuid()));
+  TaskDescriptor* new_td = AddJob()->mutable_root_task();
+  // The second round applies the first run's placements and starts a run
+  // that includes the new task.
+  EXPECT_EQ(scheduler_->ScheduleAllJobs(&stats, &deltas), 1);
+  EXPECT_EQ(td->state(), TaskDescriptor::RUNNING);
+  EXPECT_EQ(removed_td->state(), TaskDescriptor::ABORTED);
+  EXPECT_NE(new_td->state(), TaskDescriptor::RUNNING);
+  EXPECT_EQ(deltas.size(), 1);
+  EXPECT_EQ(deltas[0].task_id(), td->uid());
+  deltas.clear();
+  EXPECT_EQ(scheduler_->ScheduleAllJobs(&stats, &deltas), 1);
+  EXPECT_EQ(new_td->state(), TaskDescriptor::RUNNING);
+  ASSERT_EQ(deltas.size(), 1);
+  EXPECT_EQ(deltas[0].task_id(), new_td->uid());
+}
+
+// Checks that a task that completes while the solver runs is not placed.
+TEST_F(FlowSchedulerTest, PipelinedSolverRunTaskCompletion) {
+  FLAGS_pipeline_solver_runs = true;
+  AddMachine(1);
+  TaskDescriptor* td = AddJob()->mutable_root_task();
+  SchedulerStats stats;
+  vector<SchedulingDelta> deltas;
+  EXPECT_EQ(scheduler_->ScheduleAllJobs(&stats, &deltas), 0);
+  EXPECT_EQ(scheduler_->ScheduleAllJobs(&stats, &deltas), 1);
+  ASSERT_EQ(td->state(), TaskDescriptor::RUNNING);
+  // The second round started a run in which td is still running; td
+  // completes before the run's placements are applied.
+  TaskFinalReport report;
+  scheduler_->HandleTaskCompletion(td, &report);
+  TaskDescriptor* new_td = AddJob()->mutable_root_task();
+  deltas.clear();
+  EXPECT_EQ(scheduler_->ScheduleAllJobs(&stats, &deltas), 0);
+  EXPECT_EQ(td->state(), TaskDescriptor::COMPLETED);
+  EXPECT_TRUE(deltas.empty());
+  EXPECT_EQ(scheduler_->ScheduleAllJobs(&stats, &deltas), 1);
+  EXPECT_EQ(new_td->state(), TaskDescriptor::RUNNING);
+}
+
+}  // namespace scheduler
+}  // namespace firmament
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
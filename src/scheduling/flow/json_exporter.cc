@@ -37,18 +37,18 @@ void JSONExporter::Export(const FlowGraph& graph, string* output) const {
   // Problem header
   *output += GenerateHeader(graph.NumNodes(), graph.NumArcs());
   *output += "\"nodes\": [";
-  for (unordered_map<uint64_t, FlowGraphNode*>::const_iterator n_iter =
+  for (vector<FlowGraphNode*>::const_iterator n_iter =
        graph.Nodes().begin();
        n_iter != graph.Nodes().end();
        ++n_iter) {
     if (n_iter != graph.Nodes().begin())
       *output += ",\n";
-    *output += GenerateNode(*n_iter->second);
+    *output += GenerateNode(**n_iter);
   }
   *output += "],\n";
 
   *output += "\"edges\": [";
-  for (unordered_set<FlowGraphArc*>::const_iterator a_iter =
+  for (vector<FlowGraphArc*>::const_iterator a_iter =
        graph.Arcs().begin();
        a_iter != graph.Arcs().end();
        ++a_iter) {
@@ -0,0 +1,485 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "scheduling/flow/native_solver.h"
+
+#include <algorithm>
+#include <limits>
+#include <boost/timer/timer.hpp>
+
+#include "base/units.h"
+
+DEFINE_int64(native_solver_alpha_factor, 9, "Factor by which the native "
+             "solver divides epsilon in every cost scaling iteration.");
+
+namespace firmament {
+
+NativeSolver::NativeSolver()
+  : num_node_slots_(0), cost_scaling_factor_(1), epsilon_(1),
+    initial_epsilon_(1),
+    potential_lower_bound_(numeric_limits<int64_t>::min() / 2) {
+}
+
+void NativeSolver::Prepare(const FlowGraph& graph) {
+  LoadGraph(graph);
+  // The initial flow is epsilon-optimal for epsilon equal to the largest arc
+  // cost.
+  initial_epsilon_ = 1;
+  for (auto& arc_cost : arc_cost_) {
+    initial_epsilon_ = max(initial_epsilon_, arc_cost);
+  }
+}
+
+void NativeSolver::PrepareIncremental(const FlowGraph& graph,
+                                      const vector<DIMACSChange>& changes) {
+  if (num_node_slots_ == 0 ||
+      graph.Nodes().size() >= static_cast<uint64_t>(cost_scaling_factor_)) {
+    // Either there is no previous solution, or the graph has grown so much
+    // that the costs are no longer scaled by more than the number of nodes.
+    VLOG(1) << "Native solver falls back to solving from scratch";
+    Prepare(graph);
+    return;
+  }
+  new_nodes_.clear();
+  for (auto& change : changes) {
+    ApplyChange(graph, change);
+  }
+  // Some supplies (e.g. the sink's) are not updated via graph changes.
+  UpdateSupplies(graph);
+  for (auto& node_id : new_nodes_) {
+    InitializePotential(node_id);
+  }
+  initial_epsilon_ = ComputeEpsilon();
+}
+
+void NativeSolver::Run(uint64_t* algorithm_runtime, FlowDecomposer* flow) {
+  boost::timer::cpu_timer algorithm_timer;
+  RunCostScaling(initial_epsilon_);
+  if (algorithm_runtime) {
+    *algorithm_runtime =
+      static_cast<uint64_t>(algorithm_timer.elapsed().wall) /
+      NANOSECONDS_IN_MICROSECOND;
+  }
+  ExtractFlow(flow);
+}
+
+void NativeSolver::Solve(const FlowGraph& graph,
+                         uint64_t* algorithm_runtime,
+                         FlowDecomposer* flow) {
+  Prepare(graph);
+  Run(algorithm_runtime, flow);
+}
+
+void NativeSolver::SolveIncremental(const FlowGraph& graph,
+                                    const vector<DIMACSChange>& changes,
+                                    uint64_t* algorithm_runtime,
+                                    FlowDecomposer* flow) {
+  PrepareIncremental(graph, changes);
+  Run(algorithm_runtime, flow);
+}
+
+void NativeSolver::AddArc(uint64_t src, uint64_t dst,
+                          uint64_t cap_lower_bound, uint64_t cap_upper_bound,
+                          int64_t cost) {
+  if (cap_upper_bound == 0) {
+    // Arcs without capacity can never carry flow.
+    return;
+  }
+  EnsureNodeSlot(src);
+  EnsureNodeSlot(dst);
+  uint64_t arc_index;
+  if (free_arcs_.empty()) {
+    arc_index = arc_head_.size();
+    arc_head_.resize(arc_index + 2);
+    arc_residual_cap_.resize(arc_index + 2, 0);
+    arc_cost_.resize(arc_index + 2);
+    arc_position_.resize(arc_index + 2);
+    arc_lower_bound_.push_back(0);
+  } else {
+    arc_index = free_arcs_.back();
+    free_arcs_.pop_back();
+  }
+  arc_head_[arc_index] = dst;
+  arc_head_[arc_index + 1] = src;
+  AddResidualArc(src, arc_index);
+  AddResidualArc(dst, arc_index + 1);
+  CHECK(InsertIfNotPresent(&arc_index_, make_pair(src, dst), arc_index))
+    << "Duplicate arc " << src << " -> " << dst;
+  // The new arc carries no flow, so ChangeArc routes its lower bound.
+  ChangeArc(arc_index, cap_lower_bound, cap_upper_bound, cost);
+}
+
+void NativeSolver::AddResidualArc(uint64_t node_id, uint64_t arc_index) {
+  arc_position_[arc_index] = adjacency_[node_id].size();
+  adjacency_[node_id].push_back(arc_index);
+}
+
+void NativeSolver::ApplyChange(const FlowGraph& graph,
+                               const DIMACSChange& change) {
+  switch (change.op_) {
+    case DIMACS_RECORD_NEW_ARC:
+    case DIMACS_RECORD_CHANGE_ARC:
+      RefreshArc(graph, change.src_, change.dst_);
+      break;
+    case DIMACS_RECORD_ADD_NODE:
+      EnsureNodeSlot(change.src_);
+      // The node id may be re-used, in which case its old state is dropped.
+      RemoveNode(change.src_);
+      potential_[change.src_] = 0;
+      new_nodes_.push_back(change.src_);
+      break;
+    case DIMACS_RECORD_REMOVE_NODE:
+      RemoveNode(change.src_);
+      break;
+    default:
+      LOG(FATAL) << "Unexpected graph change: "
+                 << static_cast<uint32_t>(change.op_);
+  }
+}
+
+void NativeSolver::ChangeArc(uint64_t arc_index, uint64_t cap_lower_bound,
+                             uint64_t cap_upper_bound, int64_t cost) {
+  if (cap_upper_bound == 0) {
+    RemoveArc(arc_index);
+    return;
+  }
+  CHECK_GE(cap_upper_bound, cap_lower_bound);
+  // Keep as much of the previous flow as the new bounds allow, and account
+  // for the difference in the excesses of the arc's endpoints.
+  int64_t flow = static_cast<int64_t>(arc_lower_bound_[arc_index / 2]) +
+    arc_residual_cap_[arc_index + 1];
+  int64_t new_flow = min(max(flow, static_cast<int64_t>(cap_lower_bound)),
+                         static_cast<int64_t>(cap_upper_bound));
+  excess_[arc_tail(arc_index)] -= new_flow - flow;
+  excess_[arc_head_[arc_index]] += new_flow - flow;
+  // The flow above the lower bound is the residual capacity of the reverse
+  // arc.
+  arc_lower_bound_[arc_index / 2] = cap_lower_bound;
+  arc_residual_cap_[arc_index] =
+    static_cast<int64_t>(cap_upper_bound) - new_flow;
+  arc_residual_cap_[arc_index + 1] =
+    new_flow - static_cast<int64_t>(cap_lower_bound);
+  int64_t scaled_cost = ScaleCost(cost);
+  arc_cost_[arc_index] = scaled_cost;
+  arc_cost_[arc_index + 1] = -scaled_cost;
+}
+
+int64_t NativeSolver::ComputeEpsilon() const {
+  // The previous flow is epsilon-optimal for the largest reduced cost
+  // violation among the residual arcs.
+  int64_t epsilon = 1;
+  for (uint64_t arc_index = 0; arc_index < arc_head_.size(); ++arc_index) {
+    if (arc_residual_cap_[arc_index] > 0) {
+      epsilon = max(epsilon, -ReducedCost(arc_index));
+    }
+  }
+  return epsilon;
+}
+
+void NativeSolver::Discharge(uint64_t node_id) {
+  while (excess_[node_id] > 0) {
+    const vector<uint64_t>& arcs = adjacency_[node_id];
+    for (; current_arc_[node_id] < arcs.size(); ++current_arc_[node_id]) {
+      uint64_t arc_index = arcs[current_arc_[node_id]];
+      if (arc_residual_cap_[arc_index] > 0 && ReducedCost(arc_index) < 0) {
+        uint64_t head = arc_head_[arc_index];
+        bool head_was_active = excess_[head] > 0;
+        PushFlow(arc_index,
+                 min(excess_[node_id], arc_residual_cap_[arc_index]));
+        if (!head_was_active && excess_[head] > 0) {
+          active_nodes_.push(head);
+        }
+        if (excess_[node_id] == 0) {
+          // The arc may still be admissible, so we don't advance past it.
+          return;
+        }
+      }
+    }
+    if (!Relabel(node_id)) {
+      LOG(FATAL) << "Flow graph is infeasible: node " << node_id
+                 << " has excess " << excess_[node_id]
+                 << " but no residual arcs";
+    }
+    if (potential_[node_id] < potential_lower_bound_) {
+      LOG(FATAL) << "Flow graph is infeasible: node " << node_id
+                 << " cannot route its excess of " << excess_[node_id];
+    }
+  }
+}
+
+void NativeSolver::EnsureNodeSlot(uint64_t node_id) {
+  if (node_id < num_node_slots_) {
+    return;
+  }
+  num_node_slots_ = node_id + 1;
+  supply_.resize(num_node_slots_, 0);
+  excess_.resize(num_node_slots_, 0);
+  potential_.resize(num_node_slots_, 0);
+  current_arc_.resize(num_node_slots_, 0);
+  adjacency_.resize(num_node_slots_);
+}
+
+void NativeSolver::ExtractFlow(FlowDecomposer* flow) const {
+  flow->Clear();
+  // Removed arcs have neither lower bound nor residual capacity, so they
+  // have no flow and are skipped by AddFlow.
+  for (uint64_t arc_index = 0; arc_index < arc_head_.size(); arc_index += 2) {
+    flow->AddFlow(arc_tail(arc_index), arc_head_[arc_index],
+                  static_cast<uint64_t>(arc_residual_cap_[arc_index + 1]) +
+                  arc_lower_bound_[arc_index / 2]);
+  }
+}
+
+void NativeSolver::InitializePotential(uint64_t node_id) {
+  // Pick a potential that makes the arcs of the new node as close to
+  // reduced cost optimal as possible, so that the new node does not inflate
+  // the initial epsilon of the incremental run.
+  bool has_incoming_arc = false;
+  int64_t potential = numeric_limits<int64_t>::max();
+  for (auto& arc_index : adjacency_[node_id]) {
+    // Odd residual arcs are the reverses of the node's incoming arcs.
+    uint64_t forward_arc = arc_index ^ 1;
+    if ((arc_index & 1) && arc_residual_cap_[forward_arc] > 0) {
+      has_incoming_arc = true;
+      potential = min(potential, arc_cost_[forward_arc] +
+                      potential_[arc_tail(forward_arc)]);
+    }
+  }
+  if (!has_incoming_arc) {
+    potential = numeric_limits<int64_t>::min();
+    for (auto& arc_index : adjacency_[node_id]) {
+      if (arc_residual_cap_[arc_index] > 0) {
+        potential = max(potential, potential_[arc_head_[arc_index]] -
+                        arc_cost_[arc_index]);
+      }
+    }
+    if (potential == numeric_limits<int64_t>::min()) {
+      potential = 0;
+    }
+  }
+  potential_[node_id] = potential;
+}
+
+void NativeSolver::LoadGraph(const FlowGraph& graph) {
+  num_node_slots_ = 0;
+  EnsureNodeSlot(graph.NumNodes());
+  for (const auto& node : graph.Nodes()) {
+    EnsureNodeSlot(node->id_);
+  }
+  // Leave room for the graph to grow before incremental runs have to fall
+  // back to solving from scratch.
+  cost_scaling_factor_ = 2 * static_cast<int64_t>(num_node_slots_);
+  supply_.assign(num_node_slots_, 0);
+  excess_.assign(num_node_slots_, 0);
+  potential_.assign(num_node_slots_, 0);
+  current_arc_.assign(num_node_slots_, 0);
+  // Keep the per-node vectors around to avoid re-allocating them on every run.
+  for (auto& arcs : adjacency_) {
+    arcs.clear();
+  }
+  arc_head_.clear();
+  arc_residual_cap_.clear();
+  arc_cost_.clear();
+  arc_position_.clear();
+  arc_lower_bound_.clear();
+  arc_index_.clear();
+  free_arcs_.clear();
+  arc_head_.reserve(2 * graph.NumArcs());
+  arc_residual_cap_.reserve(2 * graph.NumArcs());
+  arc_cost_.reserve(2 * graph.NumArcs());
+  arc_position_.reserve(2 * graph.NumArcs());
+  arc_lower_bound_.reserve(graph.NumArcs());
+  arc_index_.rehash(graph.NumArcs());
+  UpdateSupplies(graph);
+  for (const auto& arc : graph.Arcs()) {
+    AddArc(arc->src_, arc->dst_, arc->cap_lower_bound_, arc->cap_upper_bound_,
+           arc->cost_);
+  }
+}
+
+void NativeSolver::PushFlow(uint64_t arc_index, int64_t flow) {
+  arc_residual_cap_[arc_index] -= flow;
+  arc_residual_cap_[arc_index ^ 1] += flow;
+  excess_[arc_tail(arc_index)] -= flow;
+  excess_[arc_head_[arc_index]] += flow;
+}
+
+void NativeSolver::Refine() {
+  // Saturate every arc whose reduced cost is below -epsilon. The resulting
+  // pseudo-flow is epsilon-optimal, and we then restore flow conservation by
+  // pushing the excesses along admissible arcs. Arcs that are only slightly
+  // negative keep their flow, which matters for warm starts where most of
+  // the previous flow is still close to optimal.
+  int64_t max_arc_cost = 0;
+  for (uint64_t node_id = 0; node_id < num_node_slots_; ++node_id) {
+    for (auto& arc_index : adjacency_[node_id]) {
+      if (arc_residual_cap_[arc_index] > 0 &&
+          ReducedCost(arc_index) < -epsilon_) {
+        PushFlow(arc_index, arc_residual_cap_[arc_index]);
+      }
+      max_arc_cost = max(max_arc_cost, arc_cost_[arc_index]);
+    }
+    current_arc_[node_id] = 0;
+  }
+  // Nodes with a deficit are never relabeled, and every node with excess has
+  // a residual path of at most n arcs to one of them if the problem is
+  // feasible. Epsilon-optimality therefore bounds how far any potential can
+  // drop below the lowest initial one. Unlike the bound for cold starts, this
+  // also holds when the pseudo-flow comes from a warm start.
+  int64_t min_potential = numeric_limits<int64_t>::max();
+  for (uint64_t node_id = 0; node_id < num_node_slots_; ++node_id) {
+    if (excess_[node_id] > 0) {
+      active_nodes_.push(node_id);
+    }
+    min_potential = min(min_potential, potential_[node_id]);
+  }
+  long double lower_bound = static_cast<long double>(min_potential) -
+    static_cast<long double>(num_node_slots_) *
+    (static_cast<long double>(max_arc_cost) + epsilon_);
+  potential_lower_bound_ = numeric_limits<int64_t>::min() / 2;
+  if (lower_bound > potential_lower_bound_) {
+    potential_lower_bound_ = static_cast<int64_t>(lower_bound);
+  }
+  while (!active_nodes_.empty()) {
+    uint64_t node_id = active_nodes_.front();
+    active_nodes_.pop();
+    Discharge(node_id);
+  }
+}
+
+void NativeSolver::RefreshArc(const FlowGraph& graph, uint64_t src,
+                              uint64_t dst) {
+  // The changes only tell us which arcs to refresh. Their bounds and costs
+  // are read from the graph because the change log may have been compacted
+  // in a way that does not preserve the order of the changes to an arc.
+  FlowGraphArc* arc = graph.GetArc(src, dst);
+  uint64_t* arc_index = FindOrNull(arc_index_, make_pair(src, dst));
+  if (!arc) {
+    if (arc_index) {
+      RemoveArc(*arc_index);
+    }
+  } else if (arc_index) {
+    ChangeArc(*arc_index, arc->cap_lower_bound_, arc->cap_upper_bound_,
+              arc->cost_);
+  } else {
+    AddArc(src, dst, arc->cap_lower_bound_, arc->cap_upper_bound_,
+           arc->cost_);
+  }
+}
+
+bool NativeSolver::Relabel(uint64_t node_id) {
+  bool has_residual_arc = false;
+  int64_t max_potential = numeric_limits<int64_t>::min();
+  for (auto& arc_index : adjacency_[node_id]) {
+    if (arc_residual_cap_[arc_index] > 0) {
+      has_residual_arc = true;
+      max_potential = max(max_potential,
+                          potential_[arc_head_[arc_index]] -
+                          arc_cost_[arc_index]);
+    }
+  }
+  if (!has_residual_arc) {
+    return false;
+  }
+  // Lowering the potential by epsilon beyond the tightest residual arc makes
+  // that arc admissible and keeps the flow epsilon-optimal.
+  potential_[node_id] = max_potential - epsilon_;
+  current_arc_[node_id] = 0;
+  return true;
+}
+
+void NativeSolver::RemoveArc(uint64_t arc_index) {
+  // Return the arc's flow to its endpoints.
+  int64_t flow = static_cast<int64_t>(arc_lower_bound_[arc_index / 2]) +
+    arc_residual_cap_[arc_index + 1];
+  uint64_t src = arc_tail(arc_index);
+  uint64_t dst = arc_head_[arc_index];
+  excess_[src] += flow;
+  excess_[dst] -= flow;
+  arc_lower_bound_[arc_index / 2] = 0;
+  arc_residual_cap_[arc_index] = 0;
+  arc_residual_cap_[arc_index + 1] = 0;
+  RemoveResidualArc(arc_index);
+  RemoveResidualArc(arc_index + 1);
+  arc_index_.erase(make_pair(src, dst));
+  free_arcs_.push_back(arc_index);
+}
+
+void NativeSolver::RemoveNode(uint64_t node_id) {
+  if (node_id >= num_node_slots_) {
+    return;
+  }
+  while (!adjacency_[node_id].empty()) {
+    // Clear the lowest bit to get the forward arc of the pair.
+    RemoveArc(adjacency_[node_id].back() & ~1ULL);
+  }
+  excess_[node_id] -= supply_[node_id];
+  supply_[node_id] = 0;
+  CHECK_EQ(excess_[node_id], 0);
+  current_arc_[node_id] = 0;
+}
+
+void NativeSolver::RemoveResidualArc(uint64_t arc_index) {
+  // Move the last arc of the tail's adjacency vector into the removed arc's
+  // position, which makes the removal O(1).
+  vector<uint64_t>* arcs = &adjacency_[arc_tail(arc_index)];
+  uint64_t position = arc_position_[arc_index];
+  uint64_t last_arc_index = arcs->back();
+  (*arcs)[position] = last_arc_index;
+  arc_position_[last_arc_index] = position;
+  arcs->pop_back();
+}
+
+void NativeSolver::RunCostScaling(int64_t initial_epsilon) {
+  CHECK_GT(FLAGS_native_solver_alpha_factor, 1);
+  // Every Refine() reduces epsilon by the alpha factor until it reaches 1, at
+  // which point the flow is optimal because the costs are scaled by more than
+  // the number of nodes.
+  epsilon_ = initial_epsilon;
+  do {
+    epsilon_ = max(static_cast<int64_t>(1),
+                   epsilon_ / FLAGS_native_solver_alpha_factor);
+    VLOG(2) << "Native solver refine with epsilon " << epsilon_;
+    Refine();
+  } while (epsilon_ > 1);
+  for (uint64_t node_id = 0; node_id < num_node_slots_; ++node_id) {
+    CHECK_EQ(excess_[node_id], 0) << "Node " << node_id
+                                  << " still has excess after solving";
+  }
+}
+
+int64_t NativeSolver::ScaleCost(int64_t cost) const {
+  CHECK_LE(static_cast<uint64_t>(llabs(cost)),
+           static_cast<uint64_t>(numeric_limits<int64_t>::max() /
+                                 cost_scaling_factor_ / 4))
+    << "Cost " << cost << " is too large to be scaled";
+  return cost * cost_scaling_factor_;
+}
+
+void NativeSolver::UpdateSupplies(const FlowGraph& graph) {
+  for (const auto& node : graph.Nodes()) {
+    uint64_t node_id = node->id_;
+    EnsureNodeSlot(node_id);
+    excess_[node_id] += node->excess_ - supply_[node_id];
+    supply_[node_id] = node->excess_;
+  }
+}
+
+}  // namespace firmament
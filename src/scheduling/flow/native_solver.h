@@ -0,0 +1,154 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// In-process min-cost flow solver. It implements Goldberg's cost scaling
+// push-relabel algorithm and operates on a residual network that is built
+// straight from the FlowGraph, so no DIMACS is generated or parsed. The
+// residual network, flow and potentials are kept between runs, which allows
+// incremental runs to apply the graph changes and warm-start from the
+// previous solution.
+
+#ifndef FIRMAMENT_SCHEDULING_FLOW_NATIVE_SOLVER_H
+#define FIRMAMENT_SCHEDULING_FLOW_NATIVE_SOLVER_H
+
+#include <queue>
+#include <utility>
+#include <vector>
+#include <boost/functional/hash.hpp>
+
+#include "base/common.h"
+#include "base/types.h"
+#include "scheduling/flow/dimacs_change.h"
+#include "scheduling/flow/flow_decomposer.h"
+#include "scheduling/flow/flow_graph.h"
+
+namespace firmament {
+
+class NativeSolver {
+ public:
+  NativeSolver();
+  /**
+   * Computes a min-cost flow over the graph from scratch.
+   * @param graph the flow graph to solve
+   * @param algorithm_runtime set to the time (in u-sec) spent in the algorithm
+   * @param flow cleared and set to the arcs with positive flow
+   */
+  void Solve(const FlowGraph& graph,
+             uint64_t* algorithm_runtime,
+             FlowDecomposer* flow);
+  /**
+   * Re-optimizes the flow computed in the previous run after applying the
+   * graph changes made since. The previous flow and node potentials are used
+   * as the starting point, so the work done is proportional to how much the
+   * changes perturb the previous solution.
+   * @param graph the flow graph to solve (used to refresh node supplies)
+   * @param changes the optimized graph changes since the previous run
+   * @param algorithm_runtime set to the time (in u-sec) spent in the algorithm
+   * @param flow cleared and set to the arcs with positive flow
+   */
+  void SolveIncremental(const FlowGraph& graph,
+                        const vector<DIMACSChange>& changes,
+                        uint64_t* algorithm_runtime,
+                        FlowDecomposer* flow);
+  /**
+   * Solve() and SolveIncremental() split into the steps that read the graph
+   * and the step that does not, so that the graph can change while Run()
+   * computes the flow (e.g., on another thread).
+   */
+  void Prepare(const FlowGraph& graph);
+  void PrepareIncremental(const FlowGraph& graph,
+                          const vector<DIMACSChange>& changes);
+  void Run(uint64_t* algorithm_runtime, FlowDecomposer* flow);
+
+ private:
+  void AddArc(uint64_t src, uint64_t dst, uint64_t cap_lower_bound,
+              uint64_t cap_upper_bound, int64_t cost);
+  void AddResidualArc(uint64_t node_id, uint64_t arc_index);
+  void ApplyChange(const FlowGraph& graph, const DIMACSChange& change);
+  void ChangeArc(uint64_t arc_index, uint64_t cap_lower_bound,
+                 uint64_t cap_upper_bound, int64_t cost);
+  int64_t ComputeEpsilon() const;
+  void Discharge(uint64_t node_id);
+  void EnsureNodeSlot(uint64_t node_id);
+  void ExtractFlow(FlowDecomposer* flow) const;
+  void InitializePotential(uint64_t node_id);
+  void LoadGraph(const FlowGraph& graph);
+  void PushFlow(uint64_t arc_index, int64_t flow);
+  inline int64_t ReducedCost(uint64_t arc_index) const {
+    return arc_cost_[arc_index] + potential_[arc_tail(arc_index)] -
+      potential_[arc_head_[arc_index]];
+  }
+  void Refine();
+  void RefreshArc(const FlowGraph& graph, uint64_t src, uint64_t dst);
+  bool Relabel(uint64_t node_id);
+  void RemoveArc(uint64_t arc_index);
+  void RemoveNode(uint64_t node_id);
+  void RemoveResidualArc(uint64_t arc_index);
+  void RunCostScaling(int64_t initial_epsilon);
+  int64_t ScaleCost(int64_t cost) const;
+  void UpdateSupplies(const FlowGraph& graph);
+  inline uint64_t arc_tail(uint64_t arc_index) const {
+    // The tail of a residual arc is the head of its reverse arc.
+    return arc_head_[arc_index ^ 1];
+  }
+
+  // Number of node slots (i.e. the largest node id + 1).
+  uint64_t num_node_slots_;
+  // Factor by which the arc costs are multiplied. It is kept larger than the
+  // number of nodes, which makes an epsilon-optimal flow with epsilon = 1
+  // optimal for the original costs.
+  int64_t cost_scaling_factor_;
+  int64_t epsilon_;
+  // Epsilon with which the prepared run starts.
+  int64_t initial_epsilon_;
+  // Potentials below this value during a Refine() imply infeasibility.
+  int64_t potential_lower_bound_;
+  // Per-node state, indexed by flow graph node id.
+  vector<int64_t> supply_;
+  vector<int64_t> excess_;
+  vector<int64_t> potential_;
+  // Residual arcs leaving every node.
+  vector<vector<uint64_t>> adjacency_;
+  // Position in adjacency_ at which the next Discharge resumes its scan.
+  vector<uint64_t> current_arc_;
+  // Per residual arc state. Every flow graph arc is represented by two
+  // residual arcs: a forward arc at an even index and its reverse arc at the
+  // following odd index (i.e. the reverse of arc i is arc i ^ 1).
+  vector<uint64_t> arc_head_;
+  vector<int64_t> arc_residual_cap_;
+  vector<int64_t> arc_cost_;
+  // Index of every residual arc in its tail's adjacency_ vector.
+  vector<uint64_t> arc_position_;
+  // Lower bound of every flow graph arc, indexed by forward arc index / 2.
+  vector<uint64_t> arc_lower_bound_;
+  // Forward arc index of every flow graph arc, keyed by (src, dst).
+  unordered_map<pair<uint64_t, uint64_t>, uint64_t,
+                boost::hash<pair<uint64_t, uint64_t>>> arc_index_;
+  // Forward arc indices of removed arcs, available for re-use.
+  vector<uint64_t> free_arcs_;
+  // Nodes added by the changes applied in the current incremental run.
+  vector<uint64_t> new_nodes_;
+  // FIFO queue of the nodes that have positive excess.
+  queue<uint64_t> active_nodes_;
+};
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SCHEDULING_FLOW_NATIVE_SOLVER_H
@@ -0,0 +1,245 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Tests for the native min-cost flow solver.
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "base/common.h"
+#include "scheduling/flow/dimacs_change_stats.h"
+#include "scheduling/flow/flow_decomposer.h"
+#include "scheduling/flow/flow_graph.h"
+#include "scheduling/flow/flow_graph_change_manager.h"
+#include "scheduling/flow/native_solver.h"
+
+DECLARE_bool(incremental_flow);
+
+namespace firmament {
+
+class NativeSolverTest : public ::testing::Test {
+ protected:
+  NativeSolverTest() {
+    FLAGS_v = 2;
+  }
+
+  FlowGraphNode* AddNode(FlowGraph* graph, int64_t excess) {
+    FlowGraphNode* node = graph->AddNode();
+    node->excess_ = excess;
+    return node;
+  }
+
+  FlowGraphArc* AddArc(FlowGraph* graph, FlowGraphNode* src,
+                       FlowGraphNode* dst, uint64_t cap_lower_bound,
+                       uint64_t cap_upper_bound, int64_t cost) {
+    FlowGraphArc* arc = graph->AddArc(src, dst);
+    graph->ChangeArc(arc, cap_lower_bound, cap_upper_bound, cost);
+    return arc;
+  }
+
+  uint64_t FlowOnArc(const FlowDecomposer& flow, FlowGraphNode* src,
+                     FlowGraphNode* dst) {
+    return flow.Flow(src->id_, dst->id_);
+  }
+
+  int64_t FlowCost(const FlowGraph& graph, const FlowDecomposer& flow) {
+    int64_t cost = 0;
+    for (const auto& arc : graph.Arcs()) {
+      cost += arc->cost_ *
+        static_cast<int64_t>(FlowOnArc(flow, arc->src_node_, arc->dst_node_));
+    }
+    return cost;
+  }
+};
+
+// Two tasks competing for two PUs. The cheapest assignment is not the one
+// a greedy per-task choice would produce.
+TEST_F(NativeSolverTest, SimpleAssignment) {
+  FlowGraph graph;
+  FlowGraphNode* sink = AddNode(&graph, -2);
+  FlowGraphNode* task1 = AddNode(&graph, 1);
+  FlowGraphNode* task2 = AddNode(&graph, 1);
+  FlowGraphNode* pu1 = AddNode(&graph, 0);
+  FlowGraphNode* pu2 = AddNode(&graph, 0);
+  AddArc(&graph, task1, pu1, 0, 1, 1);
+  AddArc(&graph, task1, pu2, 0, 1, 5);
+  AddArc(&graph, task2, pu1, 0, 1, 2);
+  AddArc(&graph, task2, pu2, 0, 1, 10);
+  AddArc(&graph, pu1, sink, 0, 1, 0);
+  AddArc(&graph, pu2, sink, 0, 1, 0);
+  NativeSolver solver;
+  uint64_t algorithm_runtime = 0;
+  FlowDecomposer flow;
+  solver.Solve(graph, &algorithm_runtime, &flow);
+  EXPECT_EQ(FlowOnArc(flow, task1, pu2), 1);
+  EXPECT_EQ(FlowOnArc(flow, task2, pu1), 1);
+  EXPECT_EQ(FlowOnArc(flow, task1, pu1), 0);
+  EXPECT_EQ(FlowOnArc(flow, task2, pu2), 0);
+  EXPECT_EQ(FlowOnArc(flow, pu1, sink), 1);
+  EXPECT_EQ(FlowOnArc(flow, pu2, sink), 1);
+}
+
+// Tasks are left unscheduled if that is cheaper than running them.
+TEST_F(NativeSolverTest, UnscheduledAggregator) {
+  FlowGraph graph;
+  FlowGraphNode* sink = AddNode(&graph, -3);
+  FlowGraphNode* unsched_agg = AddNode(&graph, 0);
+  FlowGraphNode* pu = AddNode(&graph, 0);
+  vector<FlowGraphNode*> tasks;
+  for (uint32_t i = 0; i < 3; ++i) {
+    FlowGraphNode* task = AddNode(&graph, 1);
+    AddArc(&graph, task, unsched_agg, 0, 1, 100);
+    AddArc(&graph, task, pu, 0, 1, 10 + i * 100);
+    tasks.push_back(task);
+  }
+  AddArc(&graph, unsched_agg, sink, 0, 3, 0);
+  AddArc(&graph, pu, sink, 0, 2, 0);
+  NativeSolver solver;
+  FlowDecomposer flow;
+  solver.Solve(graph, NULL, &flow);
+  // Only the first task is cheaper to run than to leave unscheduled.
+  EXPECT_EQ(FlowOnArc(flow, tasks[0], pu), 1);
+  EXPECT_EQ(FlowOnArc(flow, tasks[1], unsched_agg), 1);
+  EXPECT_EQ(FlowOnArc(flow, tasks[2], unsched_agg), 1);
+  EXPECT_EQ(FlowOnArc(flow, unsched_agg, sink), 2);
+  EXPECT_EQ(FlowOnArc(flow, pu, sink), 1);
+}
+
+// Lower bounds must be honoured even if the arc is expensive.
+TEST_F(NativeSolverTest, ArcLowerBound) {
+  FlowGraph graph;
+  FlowGraphNode* sink = AddNode(&graph, -1);
+  FlowGraphNode* task = AddNode(&graph, 1);
+  FlowGraphNode* pu1 = AddNode(&graph, 0);
+  FlowGraphNode* pu2 = AddNode(&graph, 0);
+  AddArc(&graph, task, pu1, 0, 1, 1);
+  AddArc(&graph, task, pu2, 1, 1, 50);
+  AddArc(&graph, pu1, sink, 0, 1, 0);
+  AddArc(&graph, pu2, sink, 0, 1, 0);
+  NativeSolver solver;
+  FlowDecomposer flow;
+  solver.Solve(graph, NULL, &flow);
+  EXPECT_EQ(FlowOnArc(flow, task, pu2), 1);
+  EXPECT_EQ(FlowOnArc(flow, task, pu1), 0);
+  EXPECT_EQ(FlowOnArc(flow, pu2, sink), 1);
+}
+
+// Flow is routed through multi-level aggregators and respects capacities.
+TEST_F(NativeSolverTest, MultiLevelTopology) {
+  FlowGraph graph;
+  uint64_t num_tasks = 6;
+  FlowGraphNode* sink = AddNode(&graph, -static_cast<int64_t>(num_tasks));
+  FlowGraphNode* unsched_agg = AddNode(&graph, 0);
+  FlowGraphNode* ec = AddNode(&graph, 0);
+  FlowGraphNode* machine1 = AddNode(&graph, 0);
+  FlowGraphNode* machine2 = AddNode(&graph, 0);
+  AddArc(&graph, ec, machine1, 0, 2, 3);
+  AddArc(&graph, ec, machine2, 0, 4, 7);
+  AddArc(&graph, machine1, sink, 0, 2, 0);
+  AddArc(&graph, machine2, sink, 0, 2, 0);
+  AddArc(&graph, unsched_agg, sink, 0, num_tasks, 0);
+  for (uint64_t i = 0; i < num_tasks; ++i) {
+    FlowGraphNode* task = AddNode(&graph, 1);
+    AddArc(&graph, task, ec, 0, 1, 2);
+    AddArc(&graph, task, unsched_agg, 0, 1, 20);
+  }
+  NativeSolver solver;
+  FlowDecomposer flow;
+  solver.Solve(graph, NULL, &flow);
+  EXPECT_EQ(FlowOnArc(flow, ec, machine1), 2);
+  EXPECT_EQ(FlowOnArc(flow, ec, machine2), 2);
+  EXPECT_EQ(FlowOnArc(flow, unsched_agg, sink), 2);
+}
+
+// An incremental run that re-uses the previous flow reaches the same optimum
+// as solving the changed graph from scratch.
+TEST_F(NativeSolverTest, IncrementalWarmStart) {
+  FLAGS_incremental_flow = true;
+  DIMACSChangeStats dimacs_stats;
+  FlowGraphChangeManager change_manager(&dimacs_stats);
+  FlowGraphNode* sink = change_manager.AddNode(FlowNodeType::SINK, -3,
+                                               ADD_SINK_NODE, "sink");
+  FlowGraphNode* unsched_agg =
+    change_manager.AddNode(FlowNodeType::JOB_AGGREGATOR, 0,
+                           ADD_UNSCHED_JOB_NODE, "unsched_agg");
+  FlowGraphNode* pu1 = change_manager.AddNode(FlowNodeType::PU, 0,
+                                              ADD_RESOURCE_NODE, "pu1");
+  FlowGraphNode* pu2 = change_manager.AddNode(FlowNodeType::PU, 0,
+                                              ADD_RESOURCE_NODE, "pu2");
+  change_manager.AddArc(unsched_agg, sink, 0, 3, 0, FlowGraphArcType::OTHER,
+                        ADD_ARC_TO_UNSCHED, "unsched_agg_to_sink");
+  change_manager.AddArc(pu1, sink, 0, 1, 0, FlowGraphArcType::OTHER,
+                        ADD_ARC_RES_TO_SINK, "pu1_to_sink");
+  change_manager.AddArc(pu2, sink, 0, 1, 0, FlowGraphArcType::OTHER,
+                        ADD_ARC_RES_TO_SINK, "pu2_to_sink");
+  vector<FlowGraphNode*> tasks;
+  vector<FlowGraphArc*> task_to_pu1_arcs;
+  for (int64_t i = 0; i < 3; ++i) {
+    FlowGraphNode* task =
+      change_manager.AddNode(FlowNodeType::UNSCHEDULED_TASK, 1,
+                             ADD_TASK_NODE, "task");
+    change_manager.AddArc(task, unsched_agg, 0, 1, 50,
+                          FlowGraphArcType::OTHER, ADD_ARC_TO_UNSCHED,
+                          "task_to_unsched_agg");
+    task_to_pu1_arcs.push_back(
+        change_manager.AddArc(task, pu1, 0, 1, 10 + i, FlowGraphArcType::OTHER,
+                              ADD_ARC_TASK_TO_RES, "task_to_pu1"));
+    change_manager.AddArc(task, pu2, 0, 1, 20 + 2 * i,
+                          FlowGraphArcType::OTHER, ADD_ARC_TASK_TO_RES,
+                          "task_to_pu2");
+    tasks.push_back(task);
+  }
+  NativeSolver solver;
+  FlowDecomposer flow;
+  solver.Solve(change_manager.flow_graph(), NULL, &flow);
+  EXPECT_EQ(FlowOnArc(flow, tasks[0], pu2), 1);
+  EXPECT_EQ(FlowOnArc(flow, tasks[1], pu1), 1);
+  EXPECT_EQ(FlowOnArc(flow, tasks[2], unsched_agg), 1);
+  change_manager.ResetChanges();
+  // Remove the task running on the first PU, make the first PU expensive for
+  // another task and add a new task that can only run on the first PU.
+  change_manager.ChangeArcCost(task_to_pu1_arcs[0], 100, CHG_ARC_TASK_TO_RES,
+                               "task_to_pu1");
+  change_manager.DeleteNode(tasks[1], DEL_TASK_NODE, "task");
+  FlowGraphNode* new_task =
+    change_manager.AddNode(FlowNodeType::UNSCHEDULED_TASK, 1,
+                           ADD_TASK_NODE, "new_task");
+  change_manager.AddArc(new_task, unsched_agg, 0, 1, 50,
+                        FlowGraphArcType::OTHER, ADD_ARC_TO_UNSCHED,
+                        "task_to_unsched_agg");
+  change_manager.AddArc(new_task, pu1, 0, 1, 5, FlowGraphArcType::OTHER,
+                        ADD_ARC_TASK_TO_RES, "task_to_pu1");
+  solver.SolveIncremental(change_manager.flow_graph(),
+                          change_manager.GetOptimizedGraphChanges(), NULL,
+                          &flow);
+  EXPECT_EQ(FlowOnArc(flow, new_task, pu1), 1);
+  EXPECT_EQ(FlowOnArc(flow, tasks[0], pu2), 1);
+  EXPECT_EQ(FlowOnArc(flow, tasks[2], unsched_agg), 1);
+  NativeSolver cold_solver;
+  FlowDecomposer cold_flow;
+  cold_solver.Solve(change_manager.flow_graph(), NULL, &cold_flow);
+  EXPECT_EQ(FlowCost(change_manager.flow_graph(), flow),
+            FlowCost(change_manager.flow_graph(), cold_flow));
+  change_manager.ResetChanges();
+  FLAGS_incremental_flow = false;
+}
+
+}  // namespace firmament
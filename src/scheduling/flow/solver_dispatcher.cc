@@ -20,6 +20,9 @@
 
 #include "scheduling/flow/solver_dispatcher.h"
 
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
 #include <sys/stat.h>
 #include <pthread.h>
 #include <utility>
@@ -37,14 +40,28 @@ DEFINE_bool(debug_flow_graph, false, "Write out a debug copy of the scheduling"
 DEFINE_string(flow_scheduling_solver, "cs2",
               "Solver to use for flow network optimization. Possible values:"
               "\"cs2\": Goldberg solver, \"flowlessly\": local Flowlessly "
-              "solver reimplementation; \"custom\": specify custom solver. "
+              "solver reimplementation; \"native\": in-process cost scaling "
+              "solver; \"custom\": specify custom solver. "
               "with -flow_scheduling_binary and -flow_scheduling_args.");
 DEFINE_string(flow_scheduling_binary, "", "Path to flow solving executable. "
               "If specified, overrides default path. "
-              "Must be specified when using custom solver.");
+              "Must be specified when using custom solver. With "
+              "-solver_portfolio, it is only used for the custom entries "
+              "that don't name their own binary.");
 DEFINE_string(custom_flow_scheduling_args, "", "Arguments for custom solver. "
               "Defaults to no arguments.");
-DEFINE_bool(incremental_flow, false, "Generate incremental graph changes.");
+DEFINE_bool(incremental_flow, false, "Generate incremental graph changes. "
+            "The native solver then warm-starts from the previous flow.");
+DEFINE_bool(binary_solver_protocol, false, "Communicate with the solver using "
+            "the binary wire format rather than DIMACS text. Only set this "
+            "if the solver binary supports --binary_protocol, which is "
+            "passed to flowlessly and custom solvers. cs2 only understands "
+            "text, so it always uses the text format.");
+DEFINE_bool(solver_shared_memory, false, "Share the flow graph and the flow "
+            "with the solver via a memory region rather than sending them "
+            "through pipes. Requires -binary_solver_protocol. The region's "
+            "path is passed to flowlessly and custom solvers via "
+            "--shared_memory_path.");
 DEFINE_bool(only_read_assignment_changes, false, "Read only changes in task"
             " assignments.");
 DEFINE_string(flowlessly_binary,
@@ -69,6 +86,13 @@ DEFINE_bool(flowlessly_run_cost_scaling_and_relax, false, "True if Flowlessly "
             "should run both algorithms");
 DEFINE_int64(flowlessly_alpha_factor, 9, "Alpha factor to be used by "
              "Flowlessly's cost scaling");
+DEFINE_string(solver_portfolio, "", "Comma-separated solvers to race in every "
+              "scheduling round. The flow of the first one to finish is used "
+              "and the others are cancelled. Entries are cs2, custom or "
+              "flowlessly:<algorithm>, optionally followed by @<binary> to "
+              "run a different binary than the solver's default, e.g., "
+              "\"flowlessly:fast_cost_scaling,flowlessly:relax\". Overrides "
+              "-flow_scheduling_solver.");
 
 namespace firmament {
 namespace scheduler {
@@ -83,7 +107,10 @@ SolverDispatcher::SolverDispatcher(
   : flow_graph_manager_(flow_graph_manager),
     solver_ran_once_(solver_ran_once),
     debug_seq_num_(0), to_solver_(NULL), from_solver_(NULL),
-    from_solver_stderr_(NULL) {
+    from_solver_stderr_(NULL), max_result_records_(0), run_in_flight_(false),
+    task_mappings_(NULL),
+    algorithm_runtime_(numeric_limits<uint64_t>::max()), solver_runtime_(0),
+    solver_pid_(0), portfolio_winner_(-1) {
   // Set up debug directory if it doesn't exist
   struct stat st;
   if (!FLAGS_debug_output_dir.empty() &&
@@ -96,14 +123,71 @@ SolverDispatcher::SolverDispatcher(
     int64_t ret = system(cmd.c_str());
     CHECK(WIFEXITED(ret));
   }
+  if (!FLAGS_solver_portfolio.empty()) {
+    InitPortfolio();
+  }
+  if (UseSharedMemory()) {
+    solver_shared_memory_.reset(new SolverSharedMemory());
+  }
+}
+
+void SolverDispatcher::InitPortfolio() {
+  if (FLAGS_incremental_flow) {
+    // The cancelled solvers lose the graph, so they can't apply changes.
+    LOG(FATAL) << "-solver_portfolio can't be used with -incremental_flow";
+  }
+  if (FLAGS_solver_shared_memory) {
+    // The solvers would all write their flow into the same region.
+    LOG(FATAL) << "-solver_portfolio can't be used with -solver_shared_memory";
+  }
+  vector<string> entries;
+  boost::split(entries, FLAGS_solver_portfolio, is_any_of(","));
+  for (auto& entry : entries) {
+    PortfolioSolver racer;
+    string solver = entry;
+    size_t binary_separator = entry.find('@');
+    if (binary_separator != string::npos) {
+      solver = entry.substr(0, binary_separator);
+      racer.binary_ = entry.substr(binary_separator + 1);
+    }
+    size_t separator = solver.find(':');
+    racer.solver_ = solver.substr(0, separator);
+    if (separator != string::npos) {
+      racer.algorithm_ = solver.substr(separator + 1);
+    } else if (racer.solver_ == "flowlessly") {
+      racer.algorithm_ = FLAGS_flowlessly_algorithm;
+    }
+    if (racer.solver_ == "native") {
+      // The native solver runs in-process and can't be cancelled.
+      LOG(FATAL) << "The native solver can't be part of a solver portfolio";
+    }
+    if (racer.solver_ == "custom" && racer.binary_.empty()) {
+      // The other solvers have their own default binaries, so the flag
+      // only applies to the custom ones.
+      racer.binary_ = FLAGS_flow_scheduling_binary;
+    }
+    racer.pid_ = 0;
+    racer.lost_ = false;
+    racer.to_solver_ = NULL;
+    racer.from_solver_ = NULL;
+    racer.from_solver_stderr_ = NULL;
+    portfolio_.push_back(racer);
+  }
 }
 
 SolverDispatcher::~SolverDispatcher() {
+  if (run_in_flight_) {
+    delete FinishRun(NULL);
+  }
   if (to_solver_ != NULL) {
     // Print EOS to Make sure the solver closes gracefully when running
     // in daemon mode.
-    fprintf(to_solver_, "c EOS\n");
-    fflush(to_solver_);
+    if (UseBinaryProtocol()) {
+      dimacs_exporter_.ExportBinaryEndOfStream(to_solver_);
+    } else {
+      fprintf(to_solver_, "c EOS\n");
+      fflush(to_solver_);
+    }
     CHECK_EQ(fclose(to_solver_), 0);
   }
   if (from_solver_ != NULL) {
@@ -153,18 +237,147 @@ void SolverDispatcher::ExportGraph(FILE* stream) {
   FlowGraphChangeManager* change_manager =
     flow_graph_manager_->flow_graph_change_manager();
   if (solver_ran_once_ && FLAGS_incremental_flow) {
-    dimacs_exporter_.ExportIncremental(
-        change_manager->GetOptimizedGraphChanges(), stream);
+    if (UseSharedMemory()) {
+      // Only the slots that changed are sent through the pipe.
+      updated_slots_.clear();
+      solver_shared_memory_->ExportIncremental(
+          change_manager->flow_graph(),
+          change_manager->GetOptimizedGraphChanges(), &updated_slots_);
+      dimacs_exporter_.ExportSharedGraph(updated_slots_, stream);
+    } else if (UseBinaryProtocol()) {
+      dimacs_exporter_.ExportIncrementalBinary(
+          change_manager->GetOptimizedGraphChanges(), stream);
+    } else {
+      dimacs_exporter_.ExportIncremental(
+          change_manager->GetOptimizedGraphChanges(), stream);
+    }
   }
   if (!solver_ran_once_ || !FLAGS_incremental_flow) {
     // Always export full flow graph when running first time. If algorithm
     // is non-incremental, must do it for subsequent iterations too.
-    dimacs_exporter_.Export(change_manager->flow_graph(), stream);
+    if (UseSharedMemory()) {
+      solver_shared_memory_->Export(change_manager->flow_graph());
+      updated_slots_.clear();
+      dimacs_exporter_.ExportSharedGraph(updated_slots_, stream);
+    } else if (UseBinaryProtocol()) {
+      dimacs_exporter_.ExportBinary(change_manager->flow_graph(), stream);
+    } else {
+      dimacs_exporter_.Export(change_manager->flow_graph(), stream);
+    }
+  }
+}
+
+void *CollectSolverResult(void *x) {
+  SolverDispatcher* solver_dispatcher = reinterpret_cast<SolverDispatcher*>(x);
+  solver_dispatcher->CollectResult();
+  return NULL;
+}
+
+void SolverDispatcher::CollectResult() {
+  // This runs on the solver thread, so it must not access the flow graph,
+  // which the scheduler may change in the meantime. The task mappings are
+  // computed based on the snapshot the flow decomposer took in StartRun().
+  algorithm_runtime_ = numeric_limits<uint64_t>::max();
+  if (!portfolio_.empty()) {
+    task_mappings_ = ReadOutput(RacePortfolio(), &algorithm_runtime_);
+  } else if (FLAGS_flow_scheduling_solver == "native") {
+    native_solver_.Run(&algorithm_runtime_, &flow_decomposer_);
+    task_mappings_ = GetMappings();
+  } else {
+    task_mappings_ = ReadOutput(from_solver_, &algorithm_runtime_);
+  }
+  solver_runtime_ =
+    static_cast<uint64_t>(solver_timer_.elapsed().wall) /
+    NANOSECONDS_IN_MICROSECOND;
+}
+
+multimap<uint64_t, uint64_t>* SolverDispatcher::FinishRun(
+    SchedulerStats* scheduler_stats) {
+  CHECK(run_in_flight_) << "No solver run to finish";
+  if (pthread_join(solver_thread_, NULL)) {
+    PLOG(FATAL) << "Error joining thread";
+  }
+  run_in_flight_ = false;
+  solver_ran_once_ = true;
+
+  string solver_name = FLAGS_flow_scheduling_solver;
+  if (!portfolio_.empty()) {
+    solver_name = PortfolioSolverName(portfolio_[portfolio_winner_]);
+    VLOG(1) << "Solver " << solver_name << " won the portfolio race";
+    FinishPortfolio();
+  }
+  if (scheduler_stats != NULL) {
+    scheduler_stats->scheduler_runtime_ = solver_runtime_;
+    scheduler_stats->algorithm_runtime_ = algorithm_runtime_;
+    scheduler_stats->solver_ = solver_name;
+  }
+
+  if (portfolio_.empty() && FLAGS_flow_scheduling_solver != "native" &&
+      !FLAGS_incremental_flow) {
+    // We're done with the solver and can let it terminate here.
+    int status = WaitForFinish(solver_pid_);
+
+    CHECK_EQ(fclose(from_solver_), 0);
+    from_solver_ = NULL;
+    CHECK_EQ(fclose(from_solver_stderr_), 0);
+    from_solver_stderr_ = NULL;
+    // N.B.: we DON'T close to_solver_ here, as the export already does
+    // this (cs2 expects stdin to be closed before it terminates, so we can't do
+    // it here)
+
+    // wait for logger thread
+    if (pthread_join(logger_thread_, NULL)) {
+      PLOG(FATAL) << "Error joining thread";
+    }
+
+    if (!(WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
+      LOG(FATAL) << "Solver terminated abnormally";
+    }
   }
+  debug_seq_num_++;
+  multimap<uint64_t, uint64_t>* task_mappings = task_mappings_;
+  task_mappings_ = NULL;
+  return task_mappings;
+}
+
+bool SolverDispatcher::IsCurrentMapping(uint64_t task_node_id,
+                                        uint64_t pu_node_id) const {
+  return flow_decomposer_.IsCurrentMapping(
+      flow_graph_manager_->flow_graph_change_manager()->flow_graph(),
+      task_node_id, pu_node_id);
 }
 
 multimap<uint64_t, uint64_t>* SolverDispatcher::Run(
     SchedulerStats* scheduler_stats) {
+  StartRun();
+  return FinishRun(scheduler_stats);
+}
+
+pair<TaskID_t, ResourceID_t> SolverDispatcher::RunSimpleSolverForSingleTask(
+    SchedulerStats* scheduler_stats, TaskID_t single_task_id) {
+  pair<TaskID_t, ResourceID_t> delta =
+    flow_graph_manager_->cost_model()->GetTaskMappingForSingleTask(single_task_id);
+  return delta;
+}
+
+void SolverDispatcher::StartNativeSolver() {
+  FlowGraphChangeManager* change_manager =
+    flow_graph_manager_->flow_graph_change_manager();
+  // The native solver reads the flow graph directly, so there's nothing to
+  // export. In incremental mode, it applies the recorded changes to the
+  // residual network it kept from the previous run.
+  if (solver_ran_once_ && FLAGS_incremental_flow) {
+    native_solver_.PrepareIncremental(
+        change_manager->flow_graph(),
+        change_manager->GetOptimizedGraphChanges());
+  } else {
+    native_solver_.Prepare(change_manager->flow_graph());
+  }
+  change_manager->ResetChanges();
+}
+
+void SolverDispatcher::StartRun() {
+  CHECK(!run_in_flight_) << "The previous solver run has not finished";
   // Adjusts the costs on the arcs from tasks to unsched aggs.
   if (solver_ran_once_) {
     flow_graph_manager_->UpdateAllCostsToUnscheduledAggs();
@@ -198,10 +411,36 @@ multimap<uint64_t, uint64_t>* SolverDispatcher::Run(
     }
   }
 
+  // The task mappings are computed from a snapshot of the node types, as the
+  // graph may change before the solver finishes.
+  const FlowGraph& graph =
+    flow_graph_manager_->flow_graph_change_manager()->flow_graph();
+  flow_decomposer_.SetGraph(graph, flow_graph_manager_->leaf_node_ids(),
+                            flow_graph_manager_->sink_node()->id_);
+  max_result_records_ =
+    graph.NumArcs() + graph.NumNodes() + kNumResultStatsRecords;
+
+  if (!portfolio_.empty()) {
+    // StartPortfolio() starts the timer once the solvers are spawned.
+    StartPortfolio();
+    if (pthread_create(&solver_thread_, NULL, CollectSolverResult, this)) {
+      PLOG(FATAL) << "Error creating thread";
+    }
+    run_in_flight_ = true;
+    return;
+  }
+  if (FLAGS_flow_scheduling_solver == "native") {
+    solver_timer_.start();
+    StartNativeSolver();
+    if (pthread_create(&solver_thread_, NULL, CollectSolverResult, this)) {
+      PLOG(FATAL) << "Error creating thread";
+    }
+    run_in_flight_ = true;
+    return;
+  }
+
   // Now run the solver
   vector<string> args;
-  pid_t solver_pid = 0;
-  pthread_t logger_thread = static_cast<pthread_t>(-1);
   // If the solver hasn't executed or if we're not running in incremental mode.
   if (!solver_ran_once_ || !FLAGS_incremental_flow) {
     // Pipe setup
@@ -212,9 +451,11 @@ multimap<uint64_t, uint64_t>* SolverDispatcher::Run(
     // infd[0] == CHILD_READ
     // infd[1] == PARENT_WRITE
     string binary;
-    SolverConfiguration(FLAGS_flow_scheduling_solver, &binary, &args);
-    solver_pid = ExecCommandSync(binary, args, infd_, outfd_, errfd_);
-    VLOG(2) << "Solver running " << "(PID: " << solver_pid << ")"
+    SolverConfiguration(FLAGS_flow_scheduling_solver,
+                        FLAGS_flowlessly_algorithm,
+                        FLAGS_flow_scheduling_binary, &binary, &args);
+    solver_pid_ = ExecCommandSync(binary, args, infd_, outfd_, errfd_);
+    VLOG(2) << "Solver running " << "(PID: " << solver_pid_ << ")"
             << ", CHILD_READ: " << infd_[0]
             << ", CHILD_WRITE_STD: " << outfd_[1]
             << ", CHILD_WRITE_ERR: " << errfd_[1]
@@ -235,76 +476,229 @@ multimap<uint64_t, uint64_t>* SolverDispatcher::Run(
                  << infd_[1];
     }
 
-    if (pthread_create(&logger_thread, NULL,
+    if (pthread_create(&logger_thread_, NULL,
                        ProcessStderrJustlog, from_solver_stderr_)) {
       PLOG(FATAL) << "Error creating thread";
     }
   }
 
-  boost::timer::cpu_timer flowsolver_timer;
+  solver_timer_.start();
 
   // We must export graph and read from STDOUT/STDERR in parallel
   // Otherwise, the solver might block if STDOUT/STDERR buffer gets full.
   // (For example, if it outputs lots of warnings on STDERR.)
-
-  // Create thread to write the DIMACS
-  pthread_t exporter_thread;
-  if (pthread_create(&exporter_thread, NULL, ExportToSolver, this)) {
+  // The output is read on the solver thread, while the graph is exported on
+  // this thread, so that the graph is not accessed once StartRun() returns.
+  if (pthread_create(&solver_thread_, NULL, CollectSolverResult, this)) {
     PLOG(FATAL) << "Error creating thread";
   }
+  ExportToSolver(this);
+  run_in_flight_ = true;
+}
 
-  uint64_t algorithm_runtime = numeric_limits<uint64_t>::max();
-  multimap<uint64_t, uint64_t>* task_mappings =
-    ReadOutput(&algorithm_runtime);
-
-  // Wait for exporter to complete. (Should already have happened when we
-  // get here, given we've finished reading the output.)
-  if (pthread_join(exporter_thread, NULL)) {
-    PLOG(FATAL) << "Error joining thread";
+void SolverDispatcher::StartPortfolio() {
+  // The solvers run from scratch, so they're started for every run.
+  for (auto& racer : portfolio_) {
+    string binary;
+    vector<string> args;
+    SolverConfiguration(racer.solver_, racer.algorithm_, racer.binary_,
+                        &binary, &args);
+    int infd[2];
+    int outfd[2];
+    int errfd[2];
+    racer.pid_ = ExecCommandSync(binary, args, infd, outfd, errfd);
+    racer.lost_ = false;
+    VLOG(2) << "Solver " << PortfolioSolverName(racer) << " running (PID: "
+            << racer.pid_ << ")";
+    // Close the child's ends of the pipes, so that we notice if the solver
+    // exits without a result.
+    close(infd[0]);
+    close(outfd[1]);
+    close(errfd[1]);
+    if ((racer.from_solver_stderr_ = fdopen(errfd[0], "r")) == NULL) {
+      LOG(ERROR) << "Failed to open FD for reading solver's output. FD "
+                 << errfd[0];
+    }
+    if ((racer.from_solver_ = fdopen(outfd[0], "r")) == NULL) {
+      LOG(ERROR) << "Failed to open FD for reading solver's output. FD "
+                 << outfd[0];
+    }
+    if ((racer.to_solver_ = fdopen(infd[1], "w")) == NULL) {
+      LOG(ERROR) << "Failed to open FD to solver for writing. FD: "
+                 << infd[1];
+    }
+    if (pthread_create(&racer.logger_thread_, NULL,
+                       ProcessStderrJustlog, racer.from_solver_stderr_)) {
+      PLOG(FATAL) << "Error creating thread";
+    }
   }
 
-  solver_ran_once_ = true;
+  solver_timer_.start();
+
+  // Export the graph once and send the same input to every solver. The
+  // solvers only write their result once they've read all of their input, so
+  // we don't need to read from them in parallel.
+  char* graph_buffer = NULL;
+  size_t graph_size = 0;
+  FILE* graph_stream = open_memstream(&graph_buffer, &graph_size);
+  CHECK_NOTNULL(graph_stream);
+  ExportGraph(graph_stream);
+  CHECK_EQ(fclose(graph_stream), 0);
+  flow_graph_manager_->flow_graph_change_manager()->ResetChanges();
+  SendGraphToPortfolio(graph_buffer, graph_size);
+  free(graph_buffer);
+}
 
-  if (scheduler_stats != NULL) {
-    scheduler_stats->scheduler_runtime_ =
-      static_cast<uint64_t>(flowsolver_timer.elapsed().wall) /
-      NANOSECONDS_IN_MICROSECOND;
-    scheduler_stats->algorithm_runtime_ = algorithm_runtime;
+void SolverDispatcher::SendGraphToPortfolio(const char* graph,
+                                            size_t graph_size) {
+  // Writing to a solver that has exited raises SIGPIPE, which would kill the
+  // scheduler. We block it while writing, and get EPIPE instead.
+  sigset_t sigpipe_set;
+  sigset_t old_set;
+  sigemptyset(&sigpipe_set);
+  sigaddset(&sigpipe_set, SIGPIPE);
+  CHECK_EQ(pthread_sigmask(SIG_BLOCK, &sigpipe_set, &old_set), 0);
+  // The pipes are non-blocking, so that every solver gets its input as fast
+  // as it reads it, rather than after the solvers before it in the
+  // portfolio.
+  vector<struct pollfd> fds(portfolio_.size());
+  vector<size_t> bytes_sent(portfolio_.size(), 0);
+  uint64_t num_sending = portfolio_.size();
+  for (uint64_t i = 0; i < portfolio_.size(); ++i) {
+    fds[i].fd = fileno(portfolio_[i].to_solver_);
+    fds[i].events = POLLOUT;
+    int flags = fcntl(fds[i].fd, F_GETFL);
+    if (flags < 0 || fcntl(fds[i].fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+      PLOG(FATAL) << "Failed to make the pipe to solver "
+                  << PortfolioSolverName(portfolio_[i]) << " non-blocking";
+    }
   }
+  while (num_sending > 0) {
+    if (poll(&fds[0], fds.size(), -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      PLOG(FATAL) << "Error while waiting to send the graph to the solvers";
+    }
+    for (uint64_t i = 0; i < fds.size(); ++i) {
+      if (fds[i].fd < 0 || fds[i].revents == 0) {
+        continue;
+      }
+      PortfolioSolver& racer = portfolio_[i];
+      ssize_t num_written = write(fds[i].fd, graph + bytes_sent[i],
+                                  graph_size - bytes_sent[i]);
+      if (num_written >= 0) {
+        bytes_sent[i] += num_written;
+        if (bytes_sent[i] < graph_size) {
+          continue;
+        }
+      } else if (errno == EAGAIN || errno == EINTR) {
+        continue;
+      } else if (errno == EPIPE) {
+        // The solver's result would be for part of the graph, so it can't
+        // win the race.
+        LOG(ERROR) << "Solver " << PortfolioSolverName(racer)
+                   << " exited before reading the graph";
+        racer.lost_ = true;
+      } else {
+        PLOG(FATAL) << "Error while sending the graph to solver "
+                    << PortfolioSolverName(racer);
+      }
+      // cs2 expects stdin to be closed before it computes the flow.
+      CHECK_EQ(fclose(racer.to_solver_), 0);
+      racer.to_solver_ = NULL;
+      fds[i].fd = -1;
+      num_sending--;
+    }
+  }
+  if (!sigismember(&old_set, SIGPIPE)) {
+    // Discard the SIGPIPEs raised by the failed writes before unblocking it.
+    struct timespec no_wait = {0, 0};
+    while (sigtimedwait(&sigpipe_set, NULL, &no_wait) == SIGPIPE) {
+    }
+  }
+  CHECK_EQ(pthread_sigmask(SIG_SETMASK, &old_set, NULL), 0);
+}
 
-  if (!FLAGS_incremental_flow) {
-    // We're done with the solver and can let it terminate here.
-    int status = WaitForFinish(solver_pid);
-
-    CHECK_EQ(fclose(from_solver_), 0);
-    from_solver_ = NULL;
-    CHECK_EQ(fclose(from_solver_stderr_), 0);
-    from_solver_stderr_ = NULL;
-    // N.B.: we DON'T close to_solver_ here, as the export thread already does
-    // this (cs2 expects stdin to be closed before it terminates, so we can't do
-    // it here)
-
-    // wait for logger thread
-    if (pthread_join(logger_thread, NULL)) {
-      PLOG(FATAL) << "Error joining thread";
+FILE* SolverDispatcher::RacePortfolio() {
+  // A solver only writes to its output once it has computed the flow, so the
+  // first solver with readable output is the first one to finish.
+  vector<struct pollfd> fds(portfolio_.size());
+  for (uint64_t i = 0; i < portfolio_.size(); ++i) {
+    fds[i].fd = fileno(portfolio_[i].from_solver_);
+    fds[i].events = POLLIN;
+  }
+  uint64_t num_running = portfolio_.size();
+  for (uint64_t i = 0; i < portfolio_.size(); ++i) {
+    if (portfolio_[i].lost_) {
+      fds[i].fd = -1;
+      num_running--;
+    }
+  }
+  portfolio_winner_ = -1;
+  while (portfolio_winner_ < 0) {
+    CHECK_GT(num_running, 0) << "All the solvers in the portfolio failed";
+    if (poll(&fds[0], fds.size(), -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      PLOG(FATAL) << "Error while waiting for the solvers";
+    }
+    for (uint64_t i = 0; i < fds.size(); ++i) {
+      if (fds[i].revents & POLLIN) {
+        portfolio_winner_ = i;
+        break;
+      }
+      if (fds[i].revents & (POLLHUP | POLLERR)) {
+        // The solver exited without writing a result. Ignore it from now on.
+        LOG(ERROR) << "Solver " << PortfolioSolverName(portfolio_[i])
+                   << " exited without a result";
+        fds[i].fd = -1;
+        num_running--;
+      }
+    }
+  }
+  // Cancel the other solvers. They exit and their stderr loggers see EOF.
+  for (uint64_t i = 0; i < portfolio_.size(); ++i) {
+    if (static_cast<int64_t>(i) != portfolio_winner_) {
+      kill(portfolio_[i].pid_, SIGKILL);
+      WaitForFinish(portfolio_[i].pid_);
     }
+  }
+  return portfolio_[portfolio_winner_].from_solver_;
+}
 
-    if (!(WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
-      LOG(FATAL) << "Solver terminated abnormally";
+void SolverDispatcher::FinishPortfolio() {
+  int status = WaitForFinish(portfolio_[portfolio_winner_].pid_);
+  for (auto& racer : portfolio_) {
+    CHECK_EQ(fclose(racer.from_solver_), 0);
+    racer.from_solver_ = NULL;
+    if (pthread_join(racer.logger_thread_, NULL)) {
+      PLOG(FATAL) << "Error joining thread";
     }
+    CHECK_EQ(fclose(racer.from_solver_stderr_), 0);
+    racer.from_solver_stderr_ = NULL;
+    racer.pid_ = 0;
+  }
+  if (!(WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
+    LOG(FATAL) << "Solver terminated abnormally";
   }
-  debug_seq_num_++;
-  return task_mappings;
 }
 
-pair<TaskID_t, ResourceID_t> SolverDispatcher::RunSimpleSolverForSingleTask(
-    SchedulerStats* scheduler_stats, TaskID_t single_task_id) {
-  pair<TaskID_t, ResourceID_t> delta =
-    flow_graph_manager_->cost_model()->GetTaskMappingForSingleTask(single_task_id);
-  return delta;
+string SolverDispatcher::PortfolioSolverName(const PortfolioSolver& racer) {
+  string name = racer.solver_;
+  if (!racer.algorithm_.empty()) {
+    name += ":" + racer.algorithm_;
+  }
+  if (!racer.binary_.empty()) {
+    name += "@" + racer.binary_;
+  }
+  return name;
 }
 
 void SolverDispatcher::SolverConfiguration(const string& solver,
+                                           const string& algorithm,
+                                           const string& binary_override,
                                            string* binary,
                                            vector<string> *args) {
   // New solvers need to have their binary registered here.
@@ -319,18 +713,28 @@ void SolverDispatcher::SolverConfiguration(const string& solver,
     LOG(FATAL) << "Non-existed flow network solver specified: " << solver;
   }
 
-  if (!FLAGS_flow_scheduling_binary.empty()) {
-    *binary = FLAGS_flow_scheduling_binary;
+  if (!binary_override.empty()) {
+    *binary = binary_override;
   } else {
     if (solver == "custom") {
-      LOG(FATAL) << "Must specify -flow_scheduling_binary "
-                 << "in conjunction with custom solver.";
+      LOG(FATAL) << "Must specify -flow_scheduling_binary (or a binary in "
+                 << "the -solver_portfolio entry) in conjunction with custom "
+                 << "solver.";
     }
   }
 
   if (solver == "custom") {
     boost::split(*args, FLAGS_custom_flow_scheduling_args,
                  boost::is_any_of(" "));
+    if (UseBinaryProtocol()) {
+      args->push_back("--binary_protocol=true");
+    }
+    if (UseSharedMemory()) {
+      // The region is created at runtime, so its path can't be part of
+      // -custom_flow_scheduling_args.
+      args->push_back("--shared_memory_path=" +
+                      solver_shared_memory_->path());
+    }
   } else {
     if (!FLAGS_custom_flow_scheduling_args.empty()) {
       LOG(FATAL) << "Error: cannot specify custom arguments with solver "
@@ -339,7 +743,14 @@ void SolverDispatcher::SolverConfiguration(const string& solver,
 
     if (solver == "flowlessly") {
       args->push_back("--graph_has_node_types=true");
-      args->push_back("--algorithm=" + FLAGS_flowlessly_algorithm);
+      if (UseBinaryProtocol()) {
+        args->push_back("--binary_protocol=true");
+      }
+      if (UseSharedMemory()) {
+        args->push_back("--shared_memory_path=" +
+                        solver_shared_memory_->path());
+      }
+      args->push_back("--algorithm=" + algorithm);
       if (FLAGS_only_read_assignment_changes) {
         args->push_back("--print_assignments=true");
       } else {
@@ -373,79 +784,32 @@ void SolverDispatcher::SolverConfiguration(const string& solver,
   }
 }
 
-// Maps worker|root tasks to leaves. It expects a extracted_flow containing
-// only the arcs with positive flow (i.e. what ReadFlowGraph returns).
-multimap<uint64_t, uint64_t>* SolverDispatcher::GetMappings(
-    vector<unordered_map<uint64_t, uint64_t>>* extracted_flow,
-    unordered_set<uint64_t> leaves, uint64_t sink) {
-  CHECK_NOTNULL(extracted_flow);
-  multimap<uint64_t, uint64_t>* task_to_pu =
-    new multimap<uint64_t, uint64_t>();
-  const FlowGraph& flow_graph =
-    flow_graph_manager_->flow_graph_change_manager()->flow_graph();
-  vector<vector<uint64_t>> pu_ids(flow_graph.NumNodes() + 1);
-  vector<bool> visited(flow_graph.NumNodes() + 1, false);
-  queue<uint64_t> to_visit;
-  for (auto& leaf_node : leaves) {
-    visited[leaf_node]= true;
-    uint64_t* flow = FindOrNull((*extracted_flow)[sink], leaf_node);
-    if (flow != NULL) {
-      // Exists flow from node to sink.
-      for (uint64_t index = 0; index < *flow; ++index) {
-        pu_ids[leaf_node].push_back(leaf_node);
-      }
-      to_visit.push(leaf_node);
-    }
-  }
-  while (!to_visit.empty()) {
-    uint64_t node_id = to_visit.front();
-    to_visit.pop();
-    visited[node_id] = true;
-    if (flow_graph_manager_->flow_graph_change_manager()->CheckNodeType(
-            node_id, FlowNodeType::ROOT_TASK) ||
-        flow_graph_manager_->flow_graph_change_manager()->CheckNodeType(
-            node_id, FlowNodeType::UNSCHEDULED_TASK) ||
-        flow_graph_manager_->flow_graph_change_manager()->CheckNodeType(
-            node_id, FlowNodeType::SCHEDULED_TASK)) {
-      // It's a task node.
-      for (auto& pu_node_id : pu_ids[node_id]) {
-        task_to_pu->insert(pair<uint64_t, uint64_t>(node_id, pu_node_id));
-      }
-    } else {
-      vector<uint64_t>::iterator pu_it = pu_ids[node_id].begin();
-      for (auto& src_flow : (*extracted_flow)[node_id]) {
-        bool assigned_all_pus = false;
-        // Populate the PUs vector at the source of the arc with as many PU
-        // entries from the incoming set of PU IDs as there's flow on the arc.
-        while (src_flow.second > 0) {
-          // It's an incoming arc with flow on it.
-          if (pu_it == pu_ids[node_id].end()) {
-            assigned_all_pus = true;
-            // No more PUs left to assign
-            break;
-          }
-          // Add the PU to the PUs vector of the source node.
-          pu_ids[src_flow.first].push_back(*pu_it);
-          pu_it++;
-          src_flow.second--;
-        }
-        if (!visited[src_flow.first]) {
-          to_visit.push(src_flow.first);
-          visited[src_flow.first] = true;
-        }
-        if (assigned_all_pus) {
-          break;
-        }
+bool SolverDispatcher::UseBinaryProtocol() const {
+  if (!portfolio_.empty()) {
+    // All the solvers in the portfolio are sent the same input, so they all
+    // use the text format if one of them is cs2.
+    for (auto& racer : portfolio_) {
+      if (racer.solver_ == "cs2") {
+        return false;
       }
     }
+    return FLAGS_binary_solver_protocol;
   }
-  return task_to_pu;
+  return FLAGS_binary_solver_protocol && FLAGS_flow_scheduling_solver != "cs2";
+}
+
+bool SolverDispatcher::UseSharedMemory() const {
+  return FLAGS_solver_shared_memory && UseBinaryProtocol();
 }
 
-// Returns a vector containing a nodes arcs with flow > 0.
-// In the returned graph the arcs are the inverse of the arcs in the file.
-// If there is (i,j) with flow 1 then in the graph we will have (j,i).
+// Maps worker|root tasks to leaves, based on the flow in flow_decomposer_.
+multimap<uint64_t, uint64_t>* SolverDispatcher::GetMappings() {
+  return flow_decomposer_.GetMappings();
+}
+
+// Reads the solver's result and returns the task mappings it implies.
 multimap<uint64_t, uint64_t>* SolverDispatcher::ReadOutput(
+    FILE* from_solver,
     uint64_t* algorithm_runtime) {
   multimap<uint64_t, uint64_t>* task_mappings;
   // If we read from stdout and stderr, then we must process both
@@ -454,25 +818,118 @@ multimap<uint64_t, uint64_t>* SolverDispatcher::ReadOutput(
 
   // Process stdout in main thread
   if (FLAGS_only_read_assignment_changes) {
-    task_mappings = ReadTaskMappingChanges(from_solver_, algorithm_runtime);
+    if (UseBinaryProtocol()) {
+      task_mappings =
+        ReadBinaryTaskMappingChanges(from_solver, algorithm_runtime);
+    } else {
+      task_mappings = ReadTaskMappingChanges(from_solver, algorithm_runtime);
+    }
   } else {
     // Parse and process the result
-    uint64_t num_nodes =
-      flow_graph_manager_->flow_graph_change_manager()->flow_graph().NumNodes();
-    vector<unordered_map<uint64_t, uint64_t> >* extracted_flow =
-      ReadFlowGraph(from_solver_, algorithm_runtime, num_nodes);
-    task_mappings = GetMappings(extracted_flow,
-                                flow_graph_manager_->leaf_node_ids(),
-                                flow_graph_manager_->sink_node()->id_);
-    delete extracted_flow;
+    if (UseBinaryProtocol()) {
+      ReadBinaryFlowGraph(from_solver, algorithm_runtime);
+    } else {
+      ReadFlowGraph(from_solver, algorithm_runtime);
+    }
+    task_mappings = GetMappings();
   }
   return task_mappings;
 }
 
-vector<unordered_map<uint64_t, uint64_t>>* SolverDispatcher::ReadFlowGraph(
-    FILE* fptr, uint64_t* algorithm_runtime, uint64_t num_vertices) {
-  vector<unordered_map<uint64_t, uint64_t>>* adj_list =
-    new vector<unordered_map<uint64_t, uint64_t> >(num_vertices + 1);
+uint64_t SolverDispatcher::ReadBinaryResult(FILE* fptr) {
+  DIMACSBinaryHeader header;
+  if (fread(&header, sizeof(header), 1, fptr) != 1) {
+    LOG(FATAL) << "Failed to read the solver's result header";
+  }
+  CHECK_EQ(header.magic, DIMACS_BINARY_MAGIC)
+    << "Unexpected data from the solver";
+  CHECK_EQ(header.version, DIMACS_BINARY_VERSION)
+    << "Solver uses an unsupported version of the binary protocol";
+  CHECK_EQ(header.message_type, DIMACS_MESSAGE_RESULT);
+  // A result has at most a flow record per arc, a task mapping per node and
+  // the statistics records. Check this before allocating the buffer, so that
+  // a broken solver can't make us allocate an arbitrary amount of memory.
+  CHECK_LE(header.num_records, max_result_records_)
+    << "Solver sent more result records than the graph allows";
+  // Read the whole result with a single call and parse it from the buffer.
+  result_buffer_.resize(header.num_records);
+  if (header.num_records > 0 &&
+      fread(&result_buffer_[0], sizeof(DIMACSBinaryResultRecord),
+            header.num_records, fptr) != header.num_records) {
+    LOG(FATAL) << "Failed to read " << header.num_records
+               << " result records from the solver";
+  }
+  if (FLAGS_debug_flow_graph) {
+    // Write the text equivalent of the result to ease debugging.
+    string out_file_name;
+    spf(&out_file_name, "%s/debug-flow_%ju.dm",
+        FLAGS_debug_output_dir.c_str(), debug_seq_num_);
+    FILE* dbg_fptr;
+    CHECK((dbg_fptr = fopen(out_file_name.c_str(), "w")) != NULL);
+    for (auto& record : result_buffer_) {
+      if (record.record_type == DIMACS_RECORD_FLOW) {
+        fprintf(dbg_fptr, "f %ju %ju %ju\n", record.src, record.dst,
+                record.value);
+      } else if (record.record_type == DIMACS_RECORD_TASK_MAPPING) {
+        fprintf(dbg_fptr, "m %ju %ju\n", record.src, record.dst);
+      } else if (record.record_type == DIMACS_RECORD_SOLUTION_COST) {
+        fprintf(dbg_fptr, "s %ju\n", record.value);
+      } else if (record.record_type == DIMACS_RECORD_ALGORITHM_TIME) {
+        fprintf(dbg_fptr, "c ALGORITHM TIME %ju\n", record.value);
+      }
+    }
+    fprintf(dbg_fptr, "c EOI\n");
+    CHECK_EQ(fclose(dbg_fptr), 0);
+  }
+  return header.num_records;
+}
+
+void SolverDispatcher::ReadBinaryFlowGraph(FILE* fptr,
+                                           uint64_t* algorithm_runtime) {
+  uint64_t num_records = ReadBinaryResult(fptr);
+  flow_decomposer_.Clear();
+  if (UseSharedMemory()) {
+    // The solver has written the flow into the shared memory region, and the
+    // result message only carries the statistics.
+    solver_shared_memory_->ReadFlow(&flow_decomposer_);
+  }
+  for (uint64_t index = 0; index < num_records; ++index) {
+    const DIMACSBinaryResultRecord& record = result_buffer_[index];
+    if (record.record_type == DIMACS_RECORD_FLOW) {
+      flow_decomposer_.AddFlow(record.src, record.dst, record.value);
+    } else if (record.record_type == DIMACS_RECORD_ALGORITHM_TIME) {
+      *algorithm_runtime = record.value;
+    } else if (record.record_type != DIMACS_RECORD_SOLUTION_COST) {
+      LOG(ERROR) << "Unexpected record in flow graph: "
+                 << static_cast<char>(record.record_type);
+    }
+  }
+}
+
+multimap<uint64_t, uint64_t>* SolverDispatcher::ReadBinaryTaskMappingChanges(
+    FILE* fptr, uint64_t* algorithm_runtime) {
+  multimap<uint64_t, uint64_t>* task_node =
+    new multimap<uint64_t, uint64_t>();
+  uint64_t num_records = ReadBinaryResult(fptr);
+  for (uint64_t index = 0; index < num_records; ++index) {
+    const DIMACSBinaryResultRecord& record = result_buffer_[index];
+    if (record.record_type == DIMACS_RECORD_TASK_MAPPING) {
+      VLOG(2) << "Assigning task node " << record.src << " to PU node "
+              << record.dst;
+      task_node->insert(pair<uint64_t, uint64_t>(record.src, record.dst));
+    } else if (record.record_type == DIMACS_RECORD_ALGORITHM_TIME) {
+      *algorithm_runtime = record.value;
+    } else if (record.record_type != DIMACS_RECORD_SOLUTION_COST) {
+      LOG(ERROR) << "Unknown type of record in task mappings: "
+                 << static_cast<char>(record.record_type);
+    }
+  }
+  return task_node;
+}
+
+void SolverDispatcher::ReadFlowGraph(FILE* fptr,
+                                     uint64_t* algorithm_runtime) {
+  flow_decomposer_.Clear();
   // The cost is not returned.
   int64_t cost;
   char line[100];
@@ -495,10 +952,7 @@ vector<unordered_map<uint64_t, uint64_t>>* SolverDispatcher::ReadFlowGraph(
       uint64_t dst;
       uint64_t flow;
       CHECK_EQ(sscanf(line, "%*c %ju %ju %ju", &src, &dst, &flow), 3);
-      // Only add it to the adjacency list if flow > 0
-      if (flow > 0) {
-        (*adj_list)[dst].insert(make_pair(src, flow));
-      }
+      flow_decomposer_.AddFlow(src, dst, flow);
     } else if (line[0] == 'c') {
       if (!strcmp(line, "c EOI\n")) {
         break;
@@ -513,7 +967,6 @@ vector<unordered_map<uint64_t, uint64_t>>* SolverDispatcher::ReadFlowGraph(
   }
   if (FLAGS_debug_flow_graph)
     CHECK_EQ(fclose(dbg_fptr), 0);
-  return adj_list;
 }
 
 multimap<uint64_t, uint64_t>* SolverDispatcher::ReadTaskMappingChanges(
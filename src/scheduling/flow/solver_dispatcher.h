@@ -21,27 +21,56 @@
 #ifndef FIRMAMENT_SCHEDULING_FLOW_SOLVER_DISPATCHER_H
 #define FIRMAMENT_SCHEDULING_FLOW_SOLVER_DISPATCHER_H
 
+#include <pthread.h>
 #include <map>
 #include <string>
 #include <vector>
 
+#include <boost/timer/timer.hpp>
+
 #include "base/common.h"
 #include "scheduling/scheduler_interface.h"
+#include "scheduling/flow/dimacs_binary_format.h"
 #include "scheduling/flow/dimacs_exporter.h"
 #include "scheduling/flow/json_exporter.h"
+#include "scheduling/flow/flow_decomposer.h"
 #include "scheduling/flow/flow_graph_manager.h"
+#include "scheduling/flow/native_solver.h"
+#include "scheduling/flow/solver_shared_memory.h"
 
 namespace firmament {
 namespace scheduler {
 
 class SolverDispatcher {
  public:
+  // Number of records in a result that aren't flows or task mappings: the
+  // solution cost and the algorithm runtime.
+  static const uint64_t kNumResultStatsRecords = 2;
+
   SolverDispatcher(shared_ptr<FlowGraphManager> flow_graph_manager,
                    bool solver_ran_once);
   ~SolverDispatcher();
 
   void ExportJSON(string* output) const;
   multimap<uint64_t, uint64_t>* Run(SchedulerStats* scheduler_stats);
+  /**
+   * Starts a solver run on the current flow graph. The graph is exported (or
+   * handed to the native solver) before the method returns, so the caller may
+   * change the graph while the solver runs.
+   */
+  void StartRun();
+  /**
+   * Waits for the run started by StartRun() to finish.
+   * @param scheduler_stats set to the run's statistics, unless NULL
+   * @return the task mappings the solver's flow implies; owned by the caller
+   */
+  multimap<uint64_t, uint64_t>* FinishRun(SchedulerStats* scheduler_stats);
+  /**
+   * Checks if a mapping returned by FinishRun() still refers to the nodes the
+   * solver saw, i.e., the graph hasn't removed or re-used them since the run
+   * was started.
+   */
+  bool IsCurrentMapping(uint64_t task_node_id, uint64_t pu_node_id) const;
 
   pair<TaskID_t, ResourceID_t> RunSimpleSolverForSingleTask(
      SchedulerStats* scheduler_stats,
@@ -49,22 +78,82 @@ class SolverDispatcher {
   uint64_t seq_num() const {
     return debug_seq_num_;
   }
+  bool run_in_flight() const {
+    return run_in_flight_;
+  }
 
  private:
+  /**
+   * Waits for the solver's result and computes the task mappings. Runs on
+   * solver_thread_.
+   */
+  void CollectResult();
+  // A solver configuration raced against the others with -solver_portfolio.
+  struct PortfolioSolver {
+    string solver_;
+    // Flowlessly's algorithm; empty for the other solvers.
+    string algorithm_;
+    // Binary to run instead of the solver's default; empty for the default.
+    string binary_;
+    pid_t pid_;
+    // True if the solver exited before it read all of the graph.
+    bool lost_;
+    FILE* to_solver_;
+    FILE* from_solver_;
+    FILE* from_solver_stderr_;
+    pthread_t logger_thread_;
+  };
+
   void ExportGraph(FILE* stream);
-  multimap<uint64_t, uint64_t>* GetMappings(
-      vector<unordered_map<uint64_t, uint64_t>>* extracted_flow,
-      unordered_set<uint64_t> leaves, uint64_t sink);
-  multimap<uint64_t, uint64_t>* ReadOutput(uint64_t* algorithm_runtime);
-  vector<unordered_map<uint64_t, uint64_t>>* ReadFlowGraph(
+  /**
+   * Waits for the first solver in the portfolio to finish and cancels the
+   * others. Sets portfolio_winner_.
+   * @return the winner's output stream
+   */
+  FILE* RacePortfolio();
+  // Waits for the winner to exit and releases the solvers' streams.
+  void FinishPortfolio();
+  multimap<uint64_t, uint64_t>* GetMappings();
+  void InitPortfolio();
+  static string PortfolioSolverName(const PortfolioSolver& racer);
+  multimap<uint64_t, uint64_t>* ReadOutput(FILE* from_solver,
+                                           uint64_t* algorithm_runtime);
+  /**
+   * Reads a binary result message from the solver into result_buffer_.
+   * @return the number of records read
+   */
+  uint64_t ReadBinaryResult(FILE* fptr);
+  /**
+   * Reads the flow from a binary result message into flow_decomposer_.
+   */
+  void ReadBinaryFlowGraph(FILE* fptr, uint64_t* algorithm_runtime);
+  multimap<uint64_t, uint64_t>* ReadBinaryTaskMappingChanges(
       FILE* fptr,
-      uint64_t* algorithm_runtime,
-      uint64_t num_vertices);
+      uint64_t* algorithm_runtime);
+  /**
+   * Reads the flow from a DIMACS text result into flow_decomposer_.
+   */
+  void ReadFlowGraph(FILE* fptr, uint64_t* algorithm_runtime);
   multimap<uint64_t, uint64_t>* ReadTaskMappingChanges(
       FILE* fptr,
       uint64_t* algorithm_runtime);
-  void SolverConfiguration(const string& solver, string* binary,
+  void StartNativeSolver();
+  // Spawns the solvers in the portfolio and sends the graph to all of them.
+  void StartPortfolio();
+  // Writes the graph to the solvers in the portfolio in parallel, and marks
+  // the solvers that exit before reading all of it as lost.
+  void SendGraphToPortfolio(const char* graph, size_t graph_size);
+  /**
+   * Computes the binary and the arguments to run a solver with.
+   * @param binary_override binary to run instead of the solver's default, or
+   * empty
+   */
+  void SolverConfiguration(const string& solver, const string& algorithm,
+                           const string& binary_override, string* binary,
                            vector<string> *args);
+  bool UseBinaryProtocol() const;
+  bool UseSharedMemory() const;
+  friend void *CollectSolverResult(void *x);
   friend void *ExportToSolver(void *x);
 
   shared_ptr<FlowGraphManager> flow_graph_manager_;
@@ -72,6 +161,10 @@ class SolverDispatcher {
   DIMACSExporter dimacs_exporter_;
   // JSON exporter for debug and visualisation
   JSONExporter json_exporter_;
+  // In-process solver used when -flow_scheduling_solver=native
+  NativeSolver native_solver_;
+  // Flow of the last solver run; kept across runs to re-use its buffers.
+  FlowDecomposer flow_decomposer_;
   // Boolean that indicates if the solver has knowledge of the flow graph (i.e.
   // it is set after the initial from scratch run of the solver).
   bool solver_ran_once_;
@@ -85,6 +178,32 @@ class SolverDispatcher {
   FILE* to_solver_;
   FILE* from_solver_;
   FILE* from_solver_stderr_;
+  // Records of the last binary result read from the solver.
+  vector<DIMACSBinaryResultRecord> result_buffer_;
+  // Upper bound on the number of records in a result for the graph of the
+  // current run.
+  uint64_t max_result_records_;
+  // Memory region holding the graph and the flow when
+  // -solver_shared_memory is set.
+  scoped_ptr<SolverSharedMemory> solver_shared_memory_;
+  // Slots of the shared memory region updated by the last export.
+  vector<DIMACSBinarySlotRecord> updated_slots_;
+
+  // State of the solver run started by StartRun(). The result is collected on
+  // solver_thread_, which doesn't access the flow graph.
+  pthread_t solver_thread_;
+  bool run_in_flight_;
+  multimap<uint64_t, uint64_t>* task_mappings_;
+  uint64_t algorithm_runtime_;
+  uint64_t solver_runtime_;
+  boost::timer::cpu_timer solver_timer_;
+  // External solver process and the thread logging its stderr.
+  pid_t solver_pid_;
+  pthread_t logger_thread_;
+  // Solvers raced in every run when -solver_portfolio is set, and the index
+  // of the one that finished first in the last run.
+  vector<PortfolioSolver> portfolio_;
+  int64_t portfolio_winner_;
 };
 
 } // namespace scheduler
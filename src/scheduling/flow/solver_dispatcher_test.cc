@@ -0,0 +1,197 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Tests for the solver dispatcher's solver portfolio. The solvers are shell
+// scripts that stand in for real solver binaries.
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "base/common.h"
+#include "base/units.h"
+#include "misc/wall_time.h"
+#include "scheduling/flow/dimacs_change_stats.h"
+#include "scheduling/flow/flow_graph_manager.h"
+#include "scheduling/flow/solver_dispatcher.h"
+#include "scheduling/flow/void_cost_model.h"
+
+DECLARE_string(cs2_binary);
+DECLARE_string(flow_scheduling_binary);
+DECLARE_string(solver_portfolio);
+
+namespace firmament {
+namespace scheduler {
+
+class SolverDispatcherTest : public ::testing::Test {
+ protected:
+  SolverDispatcherTest()
+    : resource_map_(new ResourceMap_t),
+      task_map_(new TaskMap_t),
+      leaf_res_ids_(new unordered_set<ResourceID_t,
+                    boost::hash<boost::uuids::uuid>>),
+      trace_generator_(&wall_time_) {
+    FLAGS_v = 2;
+    char dir_template[] = "/tmp/solver_dispatcher_test_XXXXXX";
+    CHECK_NOTNULL(mkdtemp(dir_template));
+    script_dir_ = dir_template;
+    // A solver that reads the graph and returns an empty flow straight away.
+    fast_solver_ = WriteSolverScript(
+        "fast", "cat > /dev/null\n"
+        "echo 'c ALGORITHM TIME 7'\n"
+        "echo 'c EOI'\n");
+    // A solver that takes much longer than the test. It execs sleep so that
+    // cancelling it doesn't leave a child holding its output streams open.
+    slow_solver_ = WriteSolverScript(
+        "slow", "echo $$ > " + script_dir_ + "/slow.pid\n"
+        "cat > /dev/null\n"
+        "exec sleep 60\n");
+    // A solver that exits without a result.
+    failing_solver_ = WriteSolverScript("fail", "cat > /dev/null\nexit 1\n");
+    // A solver that exits without reading its input.
+    quitting_solver_ = WriteSolverScript("quit", "exit 1\n");
+    // A solver that closes its input without reading it, and returns a result
+    // straight away.
+    eager_solver_ = WriteSolverScript(
+        "eager", "exec 0<&-\n"
+        "echo 'c ALGORITHM TIME 1'\n"
+        "echo 'c EOI'\n"
+        "exec sleep 60\n");
+  }
+
+  virtual ~SolverDispatcherTest() {
+    FLAGS_solver_portfolio = "";
+    FLAGS_flow_scheduling_binary = "";
+    FLAGS_cs2_binary = "build/third_party/cs2/src/cs2/cs2.exe";
+    string cmd = "rm -rf " + script_dir_;
+    CHECK_EQ(system(cmd.c_str()), 0);
+    delete leaf_res_ids_;
+  }
+
+  SolverDispatcher* CreateSolverDispatcher() {
+    flow_graph_manager_.reset(
+        new FlowGraphManager(new VoidCostModel(resource_map_, task_map_),
+                             leaf_res_ids_, &wall_time_, &trace_generator_,
+                             &dimacs_stats_));
+    return new SolverDispatcher(flow_graph_manager_, false);
+  }
+
+  string WriteSolverScript(const string& name, const string& body) {
+    string path = script_dir_ + "/" + name;
+    FILE* script = fopen(path.c_str(), "w");
+    CHECK_NOTNULL(script);
+    fprintf(script, "#!/bin/sh\n%s", body.c_str());
+    CHECK_EQ(fclose(script), 0);
+    CHECK_EQ(chmod(path.c_str(), 0755), 0);
+    return path;
+  }
+
+  shared_ptr<ResourceMap_t> resource_map_;
+  shared_ptr<TaskMap_t> task_map_;
+  unordered_set<ResourceID_t, boost::hash<boost::uuids::uuid>>* leaf_res_ids_;
+  DIMACSChangeStats dimacs_stats_;
+  WallTime wall_time_;
+  TraceGenerator trace_generator_;
+  shared_ptr<FlowGraphManager> flow_graph_manager_;
+  string script_dir_;
+  string fast_solver_;
+  string slow_solver_;
+  string failing_solver_;
+  string quitting_solver_;
+  string eager_solver_;
+};
+
+// Checks that the first solver to finish wins the race, that the others are
+// cancelled, and that solvers exiting without a result are ignored.
+TEST_F(SolverDispatcherTest, PortfolioRace) {
+  FLAGS_solver_portfolio = "custom@" + slow_solver_ + ",custom@" +
+    failing_solver_ + ",custom@" + fast_solver_;
+  scoped_ptr<SolverDispatcher> solver_dispatcher(CreateSolverDispatcher());
+  SchedulerStats stats;
+  boost::timer::cpu_timer timer;
+  multimap<uint64_t, uint64_t>* task_mappings = solver_dispatcher->Run(&stats);
+  ASSERT_TRUE(task_mappings != NULL);
+  EXPECT_TRUE(task_mappings->empty());
+  delete task_mappings;
+  EXPECT_EQ(stats.solver_, "custom@" + fast_solver_);
+  EXPECT_EQ(stats.algorithm_runtime_, 7);
+  // The run did not wait for the slow solver, which has been killed and
+  // reaped.
+  EXPECT_LT(timer.elapsed().wall / NANOSECONDS_IN_SECOND, 30);
+  FILE* pid_file = fopen((script_dir_ + "/slow.pid").c_str(), "r");
+  ASSERT_TRUE(pid_file != NULL);
+  pid_t slow_pid = 0;
+  ASSERT_EQ(fscanf(pid_file, "%d", &slow_pid), 1);
+  fclose(pid_file);
+  EXPECT_EQ(kill(slow_pid, 0), -1);
+  EXPECT_EQ(errno, ESRCH);
+  // The solvers are started afresh for every run.
+  task_mappings = solver_dispatcher->Run(&stats);
+  delete task_mappings;
+  EXPECT_EQ(stats.solver_, "custom@" + fast_solver_);
+}
+
+// Checks that solvers that exit or close their input before reading all of
+// the graph lose the race, rather than killing the scheduler with SIGPIPE.
+TEST_F(SolverDispatcherTest, PortfolioSolverDoesNotReadGraph) {
+  FLAGS_solver_portfolio = "custom@" + quitting_solver_ + ",custom@" +
+    eager_solver_ + ",custom@" + fast_solver_;
+  scoped_ptr<SolverDispatcher> solver_dispatcher(CreateSolverDispatcher());
+  // Make the graph larger than a pipe's buffer, so that the writes to the
+  // solvers that don't read it fail.
+  FlowGraphChangeManager* change_manager =
+    flow_graph_manager_->flow_graph_change_manager();
+  for (uint64_t i = 0; i < 20000; ++i) {
+    change_manager->AddNode(FlowNodeType::EQUIVALENCE_CLASS, 0,
+                            ADD_EQUIV_CLASS_NODE, "EC");
+  }
+  SchedulerStats stats;
+  delete solver_dispatcher->Run(&stats);
+  EXPECT_EQ(stats.solver_, "custom@" + fast_solver_);
+  EXPECT_EQ(stats.algorithm_runtime_, 7);
+}
+
+// Checks that -flow_scheduling_binary only replaces the binary of the custom
+// entries in a portfolio.
+TEST_F(SolverDispatcherTest, PortfolioFlowSchedulingBinary) {
+  FLAGS_cs2_binary = fast_solver_;
+  FLAGS_flow_scheduling_binary = failing_solver_;
+  FLAGS_solver_portfolio = "cs2,custom";
+  scoped_ptr<SolverDispatcher> solver_dispatcher(CreateSolverDispatcher());
+  SchedulerStats stats;
+  delete solver_dispatcher->Run(&stats);
+  EXPECT_EQ(stats.solver_, "cs2");
+  EXPECT_EQ(stats.algorithm_runtime_, 7);
+}
+
+}  // namespace scheduler
+}  // namespace firmament
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,319 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "scheduling/flow/solver_shared_memory.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "misc/map-util.h"
+#include "misc/string_utils.h"
+#include "scheduling/flow/dimacs_exporter.h"
+
+namespace firmament {
+
+SolverSharedMemory::SolverSharedMemory()
+  : fd_(-1), region_(NULL), region_size_(0) {
+#ifdef __linux__
+  fd_ = static_cast<int>(syscall(SYS_memfd_create, "firmament_flow_graph", 0));
+#endif
+  if (fd_ < 0) {
+    PLOG(FATAL) << "Failed to create the memory region shared with the solver";
+  }
+  spf(&path_, "/proc/%d/fd/%d", getpid(), fd_);
+  EnsureCapacity(1, 1);
+  SolverSharedMemoryHeader* shared_header = header();
+  shared_header->magic = DIMACS_BINARY_MAGIC;
+  shared_header->version = DIMACS_BINARY_VERSION;
+}
+
+SolverSharedMemory::~SolverSharedMemory() {
+  if (region_ != NULL) {
+    CHECK_EQ(munmap(region_, region_size_), 0);
+  }
+  if (fd_ >= 0) {
+    CHECK_EQ(close(fd_), 0);
+  }
+}
+
+void SolverSharedMemory::Export(const FlowGraph& graph) {
+  uint64_t node_capacity = graph.NumNodes() + 1;
+  for (const auto& node : graph.Nodes()) {
+    node_capacity = max(node_capacity, node->id_ + 1);
+  }
+  EnsureCapacity(node_capacity, graph.NumArcs());
+  SolverSharedMemoryHeader* shared_header = header();
+  memset(nodes(), 0, shared_header->node_capacity * sizeof(SolverSharedNode));
+  arc_slots_.clear();
+  arc_slots_.rehash(graph.NumArcs());
+  node_arc_slots_.resize(shared_header->node_capacity);
+  for (auto& arc_slots : node_arc_slots_) {
+    arc_slots.clear();
+  }
+  arc_slot_positions_.clear();
+  free_arc_slots_.clear();
+  shared_header->num_arc_slots = 0;
+  for (const auto& node : graph.Nodes()) {
+    SolverSharedNode* shared_node = &nodes()[node->id_];
+    shared_node->excess = node->excess_;
+    shared_node->type = DIMACSExporter::GetNodeType(*node);
+    shared_node->in_use = 1;
+  }
+  for (const auto& arc : graph.Arcs()) {
+    AddArc(*arc);
+  }
+  shared_header->num_nodes = graph.NumNodes();
+  shared_header->num_arcs = graph.NumArcs();
+  shared_header->generation++;
+}
+
+void SolverSharedMemory::ExportIncremental(
+    const FlowGraph& graph,
+    const vector<DIMACSChange>& changes,
+    vector<DIMACSBinarySlotRecord>* updated_slots) {
+  CHECK_NOTNULL(updated_slots);
+  uint64_t node_capacity = graph.NumNodes() + 1;
+  for (const auto& node : graph.Nodes()) {
+    node_capacity = max(node_capacity, node->id_ + 1);
+  }
+  EnsureCapacity(node_capacity, graph.NumArcs());
+  for (const auto& change : changes) {
+    switch (change.op_) {
+      case DIMACS_RECORD_NEW_ARC:
+      case DIMACS_RECORD_CHANGE_ARC:
+        RefreshArc(graph, change.src_, change.dst_, updated_slots);
+        break;
+      case DIMACS_RECORD_ADD_NODE:
+        // The node id may be re-used, in which case its old arcs are dropped.
+        RemoveNode(change.src_, updated_slots);
+        break;
+      case DIMACS_RECORD_REMOVE_NODE:
+        RemoveNode(change.src_, updated_slots);
+        break;
+      default:
+        LOG(FATAL) << "Unexpected graph change: "
+                   << static_cast<uint32_t>(change.op_);
+    }
+  }
+  // Some node excesses (e.g. the sink's) are not updated via graph changes,
+  // so we compare all of them.
+  SolverSharedNode* shared_nodes = nodes();
+  for (const auto& node : graph.Nodes()) {
+    SolverSharedNode* shared_node = &shared_nodes[node->id_];
+    uint32_t type = DIMACSExporter::GetNodeType(*node);
+    if (!shared_node->in_use || shared_node->excess != node->excess_ ||
+        shared_node->type != type) {
+      shared_node->excess = node->excess_;
+      shared_node->type = type;
+      shared_node->in_use = 1;
+      DIMACSBinarySlotRecord record;
+      memset(&record, 0, sizeof(record));
+      record.record_type = DIMACS_RECORD_NODE_SLOT;
+      record.index = node->id_;
+      updated_slots->push_back(record);
+    }
+  }
+  SolverSharedMemoryHeader* shared_header = header();
+  shared_header->num_nodes = graph.NumNodes();
+  shared_header->num_arcs = graph.NumArcs();
+  shared_header->generation++;
+}
+
+void SolverSharedMemory::ReadFlow(FlowDecomposer* flow) const {
+  const SolverSharedArc* shared_arcs = arcs();
+  const uint64_t* shared_flows = flows();
+  uint64_t num_arc_slots = header()->num_arc_slots;
+  for (uint64_t arc_slot = 0; arc_slot < num_arc_slots; ++arc_slot) {
+    const SolverSharedArc& arc = shared_arcs[arc_slot];
+    if (arc.in_use) {
+      flow->AddFlow(arc.src, arc.dst, shared_flows[arc_slot]);
+    }
+  }
+}
+
+uint64_t SolverSharedMemory::AddArc(const FlowGraphArc& arc) {
+  SolverSharedMemoryHeader* shared_header = header();
+  uint64_t arc_slot;
+  if (free_arc_slots_.empty()) {
+    arc_slot = shared_header->num_arc_slots++;
+    arc_slot_positions_.resize(shared_header->num_arc_slots);
+  } else {
+    arc_slot = free_arc_slots_.back();
+    free_arc_slots_.pop_back();
+  }
+  CHECK(InsertIfNotPresent(&arc_slots_, make_pair(arc.src_, arc.dst_),
+                           arc_slot))
+    << "Duplicate arc " << arc.src_ << " -> " << arc.dst_;
+  arc_slot_positions_[arc_slot] =
+    make_pair(node_arc_slots_[arc.src_].size(),
+              node_arc_slots_[arc.dst_].size());
+  node_arc_slots_[arc.src_].push_back(arc_slot);
+  node_arc_slots_[arc.dst_].push_back(arc_slot);
+  WriteArc(arc_slot, arc);
+  return arc_slot;
+}
+
+void SolverSharedMemory::EnsureCapacity(uint64_t node_capacity,
+                                        uint64_t arc_capacity) {
+  SolverSharedMemoryHeader old_header;
+  if (region_ != NULL) {
+    old_header = *header();
+    if (node_capacity <= old_header.node_capacity &&
+        arc_capacity <= old_header.arc_capacity) {
+      return;
+    }
+    // Grow geometrically so that the region is only re-mapped a few times.
+    node_capacity = max(node_capacity, 2 * old_header.node_capacity);
+    arc_capacity = max(arc_capacity, 2 * old_header.arc_capacity);
+  } else {
+    memset(&old_header, 0, sizeof(old_header));
+  }
+  uint64_t nodes_offset = sizeof(SolverSharedMemoryHeader);
+  uint64_t arcs_offset =
+    nodes_offset + node_capacity * sizeof(SolverSharedNode);
+  uint64_t flows_offset = arcs_offset + arc_capacity * sizeof(SolverSharedArc);
+  uint64_t region_size = flows_offset + arc_capacity * sizeof(uint64_t);
+  if (ftruncate(fd_, static_cast<off_t>(region_size)) != 0) {
+    PLOG(FATAL) << "Failed to resize the memory region shared with the solver";
+  }
+  void* region;
+  if (region_ == NULL) {
+    region = mmap(NULL, region_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_,
+                  0);
+  } else {
+    region = mremap(region_, region_size_, region_size, MREMAP_MAYMOVE);
+  }
+  if (region == MAP_FAILED) {
+    PLOG(FATAL) << "Failed to map the memory region shared with the solver";
+  }
+  region_ = static_cast<char*>(region);
+  region_size_ = region_size;
+  if (old_header.magic != 0) {
+    // Move the sections to their new offsets, starting with the last one so
+    // that no section overwrites another before it has been moved.
+    memmove(region_ + flows_offset, region_ + old_header.flows_offset,
+            old_header.arc_capacity * sizeof(uint64_t));
+    memmove(region_ + arcs_offset, region_ + old_header.arcs_offset,
+            old_header.arc_capacity * sizeof(SolverSharedArc));
+    // The nodes section does not move, but the new node slots are unused.
+    memset(region_ + nodes_offset +
+           old_header.node_capacity * sizeof(SolverSharedNode), 0,
+           (node_capacity - old_header.node_capacity) *
+           sizeof(SolverSharedNode));
+  }
+  SolverSharedMemoryHeader* shared_header = header();
+  shared_header->node_capacity = node_capacity;
+  shared_header->arc_capacity = arc_capacity;
+  shared_header->nodes_offset = nodes_offset;
+  shared_header->arcs_offset = arcs_offset;
+  shared_header->flows_offset = flows_offset;
+  node_arc_slots_.resize(node_capacity);
+}
+
+void SolverSharedMemory::RefreshArc(
+    const FlowGraph& graph, uint64_t src, uint64_t dst,
+    vector<DIMACSBinarySlotRecord>* updated_slots) {
+  // The changes only tell us which arcs to refresh. Their bounds and costs
+  // are read from the graph because the change log may have been compacted
+  // in a way that does not preserve the order of the changes to an arc.
+  FlowGraphArc* arc = graph.GetArc(src, dst);
+  uint64_t* arc_slot_ptr = FindOrNull(arc_slots_, make_pair(src, dst));
+  uint64_t arc_slot;
+  if (!arc) {
+    if (!arc_slot_ptr) {
+      return;
+    }
+    arc_slot = *arc_slot_ptr;
+    RemoveArc(arc_slot);
+  } else if (arc_slot_ptr) {
+    arc_slot = *arc_slot_ptr;
+    WriteArc(arc_slot, *arc);
+  } else {
+    arc_slot = AddArc(*arc);
+  }
+  DIMACSBinarySlotRecord record;
+  memset(&record, 0, sizeof(record));
+  record.record_type = DIMACS_RECORD_ARC_SLOT;
+  record.index = arc_slot;
+  updated_slots->push_back(record);
+}
+
+void SolverSharedMemory::RemoveArc(uint64_t arc_slot) {
+  SolverSharedArc* arc = &arcs()[arc_slot];
+  uint64_t endpoints[2] = {arc->src, arc->dst};
+  uint64_t positions[2] = {arc_slot_positions_[arc_slot].first,
+                           arc_slot_positions_[arc_slot].second};
+  for (uint32_t i = 0; i < 2; ++i) {
+    // Move the last arc slot of the node into the removed arc's position,
+    // which makes the removal O(1).
+    vector<uint64_t>* arc_slots = &node_arc_slots_[endpoints[i]];
+    uint64_t last_arc_slot = arc_slots->back();
+    (*arc_slots)[positions[i]] = last_arc_slot;
+    if (arcs()[last_arc_slot].src == endpoints[i]) {
+      arc_slot_positions_[last_arc_slot].first = positions[i];
+    } else {
+      arc_slot_positions_[last_arc_slot].second = positions[i];
+    }
+    arc_slots->pop_back();
+  }
+  arc_slots_.erase(make_pair(arc->src, arc->dst));
+  memset(arc, 0, sizeof(SolverSharedArc));
+  flows()[arc_slot] = 0;
+  free_arc_slots_.push_back(arc_slot);
+}
+
+void SolverSharedMemory::RemoveNode(
+    uint64_t node_id, vector<DIMACSBinarySlotRecord>* updated_slots) {
+  if (node_id >= header()->node_capacity) {
+    return;
+  }
+  DIMACSBinarySlotRecord record;
+  memset(&record, 0, sizeof(record));
+  while (!node_arc_slots_[node_id].empty()) {
+    record.record_type = DIMACS_RECORD_ARC_SLOT;
+    record.index = node_arc_slots_[node_id].back();
+    RemoveArc(record.index);
+    updated_slots->push_back(record);
+  }
+  SolverSharedNode* node = &nodes()[node_id];
+  if (node->in_use) {
+    memset(node, 0, sizeof(SolverSharedNode));
+    record.record_type = DIMACS_RECORD_NODE_SLOT;
+    record.index = node_id;
+    updated_slots->push_back(record);
+  }
+}
+
+void SolverSharedMemory::WriteArc(uint64_t arc_slot, const FlowGraphArc& arc) {
+  SolverSharedArc* shared_arc = &arcs()[arc_slot];
+  shared_arc->src = arc.src_;
+  shared_arc->dst = arc.dst_;
+  shared_arc->cap_lower_bound = arc.cap_lower_bound_;
+  shared_arc->cap_upper_bound = arc.cap_upper_bound_;
+  shared_arc->cost = arc.cost_;
+  shared_arc->type = arc.type_;
+  shared_arc->in_use = 1;
+}
+
+}  // namespace firmament
@@ -0,0 +1,120 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Memory region that holds the flow graph and the solver's flow results, and
+// that is shared with the solver process. The region is backed by a memfd,
+// which the solver opens via its /proc path. The layout of the region is
+// described in dimacs_binary_format.h.
+// Nodes occupy the slot given by their id, and every arc keeps its slot until
+// it is removed, so incremental updates only rewrite the slots that changed.
+// The solver writes the flow on every in-use arc into the flow slot with the
+// same index as the arc.
+
+#ifndef FIRMAMENT_SCHEDULING_FLOW_SOLVER_SHARED_MEMORY_H
+#define FIRMAMENT_SCHEDULING_FLOW_SOLVER_SHARED_MEMORY_H
+
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/functional/hash.hpp>
+
+#include "base/common.h"
+#include "base/types.h"
+#include "scheduling/flow/dimacs_binary_format.h"
+#include "scheduling/flow/dimacs_change.h"
+#include "scheduling/flow/flow_decomposer.h"
+#include "scheduling/flow/flow_graph.h"
+
+namespace firmament {
+
+class SolverSharedMemory {
+ public:
+  SolverSharedMemory();
+  ~SolverSharedMemory();
+  /**
+   * Writes the whole graph into the region, replacing its previous contents.
+   */
+  void Export(const FlowGraph& graph);
+  /**
+   * Updates the slots of the nodes and arcs touched by the changes.
+   * @param graph the flow graph after the changes
+   * @param changes the optimized graph changes since the previous export
+   * @param updated_slots set to the node and arc slots that were rewritten
+   */
+  void ExportIncremental(const FlowGraph& graph,
+                         const vector<DIMACSChange>& changes,
+                         vector<DIMACSBinarySlotRecord>* updated_slots);
+  /**
+   * Reads the flow the solver wrote into the region.
+   * @param flow to which the arcs with positive flow are added
+   */
+  void ReadFlow(FlowDecomposer* flow) const;
+  /**
+   * Path under which the solver process can open the region.
+   */
+  inline const string& path() const {
+    return path_;
+  }
+
+ private:
+  friend class SolverSharedMemoryTest;
+  FRIEND_TEST(SolverSharedMemoryTest, ExportAndReadFlow);
+  FRIEND_TEST(SolverSharedMemoryTest, IncrementalUpdates);
+
+  uint64_t AddArc(const FlowGraphArc& arc);
+  inline SolverSharedArc* arcs() const {
+    return reinterpret_cast<SolverSharedArc*>(region_ + header()->arcs_offset);
+  }
+  void EnsureCapacity(uint64_t node_capacity, uint64_t arc_capacity);
+  inline uint64_t* flows() const {
+    return reinterpret_cast<uint64_t*>(region_ + header()->flows_offset);
+  }
+  inline SolverSharedMemoryHeader* header() const {
+    return reinterpret_cast<SolverSharedMemoryHeader*>(region_);
+  }
+  inline SolverSharedNode* nodes() const {
+    return reinterpret_cast<SolverSharedNode*>(region_ +
+                                               header()->nodes_offset);
+  }
+  void RefreshArc(const FlowGraph& graph, uint64_t src, uint64_t dst,
+                  vector<DIMACSBinarySlotRecord>* updated_slots);
+  void RemoveArc(uint64_t arc_slot);
+  void RemoveNode(uint64_t node_id,
+                  vector<DIMACSBinarySlotRecord>* updated_slots);
+  void WriteArc(uint64_t arc_slot, const FlowGraphArc& arc);
+
+  int fd_;
+  string path_;
+  char* region_;
+  uint64_t region_size_;
+  // Arc slot of every in-use arc, keyed by (src, dst).
+  unordered_map<pair<uint64_t, uint64_t>, uint64_t,
+                boost::hash<pair<uint64_t, uint64_t>>> arc_slots_;
+  // Arc slots of the arcs incident to every node, and the position of every
+  // arc slot in its source's and destination's vectors.
+  vector<vector<uint64_t>> node_arc_slots_;
+  vector<pair<uint64_t, uint64_t>> arc_slot_positions_;
+  // Arc slots of removed arcs, available for re-use.
+  vector<uint64_t> free_arc_slots_;
+};
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SCHEDULING_FLOW_SOLVER_SHARED_MEMORY_H
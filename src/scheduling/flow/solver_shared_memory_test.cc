@@ -0,0 +1,193 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Tests for the memory region shared with the solver.
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "base/common.h"
+#include "scheduling/flow/dimacs_change_stats.h"
+#include "scheduling/flow/dimacs_exporter.h"
+#include "scheduling/flow/flow_graph_change_manager.h"
+#include "scheduling/flow/solver_shared_memory.h"
+
+DECLARE_bool(incremental_flow);
+
+namespace firmament {
+
+class SolverSharedMemoryTest : public ::testing::Test {
+ protected:
+  SolverSharedMemoryTest() {
+    FLAGS_v = 2;
+  }
+
+  // Checks that the region holds exactly the nodes and arcs of the graph.
+  void CheckRegionMatchesGraph(const FlowGraph& graph,
+                               const SolverSharedMemory& shared_memory) {
+    const SolverSharedMemoryHeader* header = shared_memory.header();
+    EXPECT_EQ(header->magic, DIMACS_BINARY_MAGIC);
+    EXPECT_EQ(header->num_nodes, graph.NumNodes());
+    EXPECT_EQ(header->num_arcs, graph.NumArcs());
+    uint64_t num_nodes_in_use = 0;
+    for (uint64_t node_id = 0; node_id < header->node_capacity; ++node_id) {
+      const SolverSharedNode& shared_node = shared_memory.nodes()[node_id];
+      if (!shared_node.in_use) {
+        continue;
+      }
+      num_nodes_in_use++;
+      FlowGraphNode* node = graph.GetNode(node_id);
+      ASSERT_TRUE(node != NULL);
+      EXPECT_EQ(shared_node.excess, node->excess_);
+    }
+    EXPECT_EQ(num_nodes_in_use, graph.Nodes().size());
+    uint64_t num_arcs_in_use = 0;
+    for (uint64_t arc_slot = 0; arc_slot < header->num_arc_slots;
+         ++arc_slot) {
+      const SolverSharedArc& shared_arc = shared_memory.arcs()[arc_slot];
+      if (!shared_arc.in_use) {
+        continue;
+      }
+      num_arcs_in_use++;
+      FlowGraphArc* arc = graph.GetArc(shared_arc.src, shared_arc.dst);
+      ASSERT_TRUE(arc != NULL);
+      EXPECT_EQ(shared_arc.cap_lower_bound, arc->cap_lower_bound_);
+      EXPECT_EQ(shared_arc.cap_upper_bound, arc->cap_upper_bound_);
+      EXPECT_EQ(shared_arc.cost, arc->cost_);
+    }
+    EXPECT_EQ(num_arcs_in_use, graph.NumArcs());
+  }
+};
+
+// Exports a small graph, writes flow into the region as a solver would, and
+// reads it back.
+TEST_F(SolverSharedMemoryTest, ExportAndReadFlow) {
+  FlowGraph graph;
+  FlowGraphNode* sink = graph.AddNode();
+  sink->excess_ = -1;
+  sink->type_ = FlowNodeType::SINK;
+  FlowGraphNode* task = graph.AddNode();
+  task->excess_ = 1;
+  task->type_ = FlowNodeType::UNSCHEDULED_TASK;
+  FlowGraphNode* pu = graph.AddNode();
+  pu->type_ = FlowNodeType::PU;
+  FlowGraphArc* task_to_pu = graph.AddArc(task, pu);
+  graph.ChangeArc(task_to_pu, 0, 1, 5);
+  FlowGraphArc* pu_to_sink = graph.AddArc(pu, sink);
+  graph.ChangeArc(pu_to_sink, 0, 1, 0);
+  SolverSharedMemory shared_memory;
+  EXPECT_EQ(shared_memory.path().find("/proc/"), 0);
+  shared_memory.Export(graph);
+  CheckRegionMatchesGraph(graph, shared_memory);
+  EXPECT_EQ(shared_memory.header()->generation, 1);
+  EXPECT_EQ(shared_memory.nodes()[sink->id_].type,
+            DIMACSExporter::GetNodeType(*sink));
+  // Route the task's unit of flow via the PU.
+  for (uint64_t arc_slot = 0;
+       arc_slot < shared_memory.header()->num_arc_slots; ++arc_slot) {
+    shared_memory.flows()[arc_slot] = 1;
+  }
+  FlowDecomposer flow;
+  shared_memory.ReadFlow(&flow);
+  EXPECT_EQ(flow.Flow(task->id_, pu->id_), 1);
+  EXPECT_EQ(flow.Flow(pu->id_, sink->id_), 1);
+  EXPECT_EQ(flow.num_arcs(), 2);
+}
+
+// Applies incremental changes, including enough new nodes and arcs to force
+// the region to grow, and checks that the region still matches the graph.
+TEST_F(SolverSharedMemoryTest, IncrementalUpdates) {
+  FLAGS_incremental_flow = true;
+  DIMACSChangeStats dimacs_stats;
+  FlowGraphChangeManager change_manager(&dimacs_stats);
+  FlowGraphNode* sink = change_manager.AddNode(FlowNodeType::SINK, -2,
+                                               ADD_SINK_NODE, "sink");
+  FlowGraphNode* pu = change_manager.AddNode(FlowNodeType::PU, 0,
+                                             ADD_RESOURCE_NODE, "pu");
+  change_manager.AddArc(pu, sink, 0, 2, 0, FlowGraphArcType::OTHER,
+                        ADD_ARC_RES_TO_SINK, "pu_to_sink");
+  vector<FlowGraphNode*> tasks;
+  vector<FlowGraphArc*> task_to_pu_arcs;
+  for (int64_t i = 0; i < 2; ++i) {
+    FlowGraphNode* task =
+      change_manager.AddNode(FlowNodeType::UNSCHEDULED_TASK, 1,
+                             ADD_TASK_NODE, "task");
+    task_to_pu_arcs.push_back(
+        change_manager.AddArc(task, pu, 0, 1, 10 + i, FlowGraphArcType::OTHER,
+                              ADD_ARC_TASK_TO_RES, "task_to_pu"));
+    tasks.push_back(task);
+  }
+  SolverSharedMemory shared_memory;
+  shared_memory.Export(change_manager.flow_graph());
+  CheckRegionMatchesGraph(change_manager.flow_graph(), shared_memory);
+  change_manager.ResetChanges();
+  // Change an arc's cost and remove a task.
+  change_manager.ChangeArcCost(task_to_pu_arcs[0], 100, CHG_ARC_TASK_TO_RES,
+                               "task_to_pu");
+  uint64_t removed_task_id = tasks[1]->id_;
+  change_manager.DeleteNode(tasks[1], DEL_TASK_NODE, "task");
+  // The sink's excess is updated directly, without a graph change.
+  sink->excess_ = -1;
+  vector<DIMACSBinarySlotRecord> updated_slots;
+  shared_memory.ExportIncremental(change_manager.flow_graph(),
+                                  change_manager.GetOptimizedGraphChanges(),
+                                  &updated_slots);
+  CheckRegionMatchesGraph(change_manager.flow_graph(), shared_memory);
+  EXPECT_EQ(shared_memory.header()->generation, 2);
+  EXPECT_FALSE(shared_memory.nodes()[removed_task_id].in_use);
+  uint64_t num_node_slots = 0;
+  uint64_t num_arc_slots = 0;
+  for (auto& record : updated_slots) {
+    if (record.record_type == DIMACS_RECORD_NODE_SLOT) {
+      num_node_slots++;
+    } else {
+      EXPECT_EQ(record.record_type, DIMACS_RECORD_ARC_SLOT);
+      num_arc_slots++;
+    }
+  }
+  // The removed task and the sink's excess.
+  EXPECT_EQ(num_node_slots, 2);
+  // The changed arc and the removed task's arc.
+  EXPECT_EQ(num_arc_slots, 2);
+  change_manager.ResetChanges();
+  // Add enough tasks for the region to be re-mapped. The removed task's arc
+  // slot is re-used.
+  uint64_t old_arc_capacity = shared_memory.header()->arc_capacity;
+  for (int64_t i = 0; i < 64; ++i) {
+    FlowGraphNode* task =
+      change_manager.AddNode(FlowNodeType::UNSCHEDULED_TASK, 1,
+                             ADD_TASK_NODE, "task");
+    change_manager.AddArc(task, pu, 0, 1, i, FlowGraphArcType::OTHER,
+                          ADD_ARC_TASK_TO_RES, "task_to_pu");
+  }
+  updated_slots.clear();
+  shared_memory.ExportIncremental(change_manager.flow_graph(),
+                                  change_manager.GetOptimizedGraphChanges(),
+                                  &updated_slots);
+  EXPECT_GT(shared_memory.header()->arc_capacity, old_arc_capacity);
+  EXPECT_EQ(shared_memory.header()->num_arc_slots,
+            change_manager.flow_graph().NumArcs());
+  CheckRegionMatchesGraph(change_manager.flow_graph(), shared_memory);
+  change_manager.ResetChanges();
+  FLAGS_incremental_flow = false;
+}
+
+}  // namespace firmament
@@ -67,6 +67,10 @@ class VoidCostModel : public CostModelInterface {
   FlowGraphNode* GatherStats(FlowGraphNode* accumulator, FlowGraphNode* other);
   void PrepareStats(FlowGraphNode* accumulator);
   FlowGraphNode* UpdateStats(FlowGraphNode* accumulator, FlowGraphNode* other);
+  // The queries don't modify any state.
+  bool IsThreadSafe() const {
+    return true;
+  }
 
  private:
   Cost_t TaskToClusterAggCost(TaskID_t task_id);
@@ -83,97 +83,326 @@ KnowledgeBase::~KnowledgeBase() {
     delete raw_task_output_;
     serial_task_samples_.close();
   }
+  for (auto& id_samples : machine_map_) {
+    delete id_samples.second;
+  }
+  for (auto& id_samples : task_map_) {
+    delete id_samples.second;
+  }
   // We don't have to delete data_layer_manager because it's not owned by
   // the KnowledgeBase.
 }
 
 void KnowledgeBase::AddMachineSample(const ResourceStats& sample) {
-  boost::lock_guard<boost::upgrade_mutex> lock(kb_lock_);
   ResourceID_t rid = ResourceIDFromString(sample.resource_id());
-  // Check if we already have a record for this machine
-  deque<ResourceStats>* q = FindOrNull(machine_map_, rid);
-  if (!q) {
-    // Add a blank queue for this machine
-    CHECK(InsertOrUpdate(&machine_map_, rid, deque<ResourceStats>()));
-    q = FindOrNull(machine_map_, rid);
-    CHECK_NOTNULL(q);
+  MachineSamples* samples =
+    FindOrAddMachineSamples(rid, max(sample.cpus_stats_size(), 1));
+  {
+    boost::lock_guard<boost::mutex> lock(samples->writer_lock_);
+    MachineSample machine_sample;
+    machine_sample.timestamp_ = sample.timestamp();
+    machine_sample.mem_allocatable_ = sample.mem_allocatable();
+    machine_sample.mem_capacity_ = sample.mem_capacity();
+    machine_sample.mem_reservation_ = sample.mem_reservation();
+    machine_sample.mem_utilization_ = sample.mem_utilization();
+    machine_sample.disk_bw_ = sample.disk_bw();
+    machine_sample.net_rx_bw_ = sample.net_rx_bw();
+    machine_sample.net_tx_bw_ = sample.net_tx_bw();
+    machine_sample.ephemeral_storage_allocatable_ =
+      sample.ephemeral_storage_allocatable();
+    machine_sample.ephemeral_storage_capacity_ =
+      sample.ephemeral_storage_capacity();
+    machine_sample.ephemeral_storage_reservation_ =
+      sample.ephemeral_storage_reservation();
+    machine_sample.ephemeral_storage_utilization_ =
+      sample.ephemeral_storage_utilization();
+    machine_sample.first_cpu_ = samples->cpu_samples_.num_pushed();
+    machine_sample.num_cpus_ = sample.cpus_stats_size();
+    // The CPU stats go first, so that readers who see the machine sample can
+    // find them.
+    for (const auto& cpu_stats : sample.cpus_stats()) {
+      CpuSample cpu_sample;
+      cpu_sample.cpu_allocatable_ = cpu_stats.cpu_allocatable();
+      cpu_sample.cpu_capacity_ = cpu_stats.cpu_capacity();
+      cpu_sample.cpu_reservation_ = cpu_stats.cpu_reservation();
+      cpu_sample.cpu_utilization_ = cpu_stats.cpu_utilization();
+      samples->cpu_samples_.Push(cpu_sample);
+    }
+    samples->samples_.Push(machine_sample);
   }
-  if (q->size() * sizeof(sample) >= FLAGS_max_sample_queue_size * KB_TO_BYTES)
-    q->pop_front();  // drop from the front
-  q->push_back(sample);
   if (FLAGS_serialize_knowledge_base) {
     string message_string;
     sample.SerializeToString(&message_string);
+    boost::lock_guard<boost::upgrade_mutex> lock(kb_lock_);
     coded_machine_output_->WriteVarint32(message_string.size());
     coded_machine_output_->WriteRaw(message_string.data(),
                                     message_string.size());
   }
 }
 
+void KnowledgeBase::AddMachineSamples(
+    const vector<const ResourceStats*>& samples) {
+  for (auto& sample : samples) {
+    AddMachineSample(*sample);
+  }
+}
+
 void KnowledgeBase::AddTaskStatsSample(const TaskStats& sample) {
-  TaskID_t tid = sample.task_id();
-  boost::lock_guard<boost::upgrade_mutex> lock(kb_lock_);
-  // Check if we already have a record for this task
-  deque<TaskStats>* q = FindOrNull(task_map_, tid);
-  if (!q) {
-    // Add a blank queue for this task
-    CHECK(InsertOrUpdate(&task_map_, tid, deque<TaskStats>()));
-    q = FindOrNull(task_map_, tid);
-    CHECK_NOTNULL(q);
+  TaskSample task_sample;
+  task_sample.timestamp_ = sample.timestamp();
+  task_sample.hostname_ = StringInterner::Global()->Intern(sample.hostname());
+  task_sample.cpu_limit_ = sample.cpu_limit();
+  task_sample.cpu_request_ = sample.cpu_request();
+  task_sample.cpu_usage_ = sample.cpu_usage();
+  task_sample.mem_limit_ = sample.mem_limit();
+  task_sample.mem_request_ = sample.mem_request();
+  task_sample.mem_usage_ = sample.mem_usage();
+  task_sample.mem_rss_ = sample.mem_rss();
+  task_sample.mem_cache_ = sample.mem_cache();
+  task_sample.mem_working_set_ = sample.mem_working_set();
+  task_sample.mem_page_faults_ = sample.mem_page_faults();
+  task_sample.mem_page_faults_rate_ = sample.mem_page_faults_rate();
+  task_sample.major_page_faults_ = sample.major_page_faults();
+  task_sample.major_page_faults_rate_ = sample.major_page_faults_rate();
+  task_sample.net_rx_ = sample.net_rx();
+  task_sample.net_rx_errors_ = sample.net_rx_errors();
+  task_sample.net_rx_errors_rate_ = sample.net_rx_errors_rate();
+  task_sample.net_rx_rate_ = sample.net_rx_rate();
+  task_sample.net_tx_ = sample.net_tx();
+  task_sample.net_tx_errors_ = sample.net_tx_errors();
+  task_sample.net_tx_errors_rate_ = sample.net_tx_errors_rate();
+  task_sample.net_tx_rate_ = sample.net_tx_rate();
+  task_sample.ephemeral_storage_limit_ = sample.ephemeral_storage_limit();
+  task_sample.ephemeral_storage_request_ = sample.ephemeral_storage_request();
+  task_sample.ephemeral_storage_usage_ = sample.ephemeral_storage_usage();
+  // The sample is pushed while the task's shard is locked, so that
+  // RemoveTaskSamples cannot release the ring under us.
+  auto push_sample = [&task_sample](TaskSamples* samples) {
+    boost::lock_guard<boost::mutex> lock(samples->writer_lock_);
+    samples->samples_.Push(task_sample);
+  };
+  if (!task_map_.Visit(sample.task_id(), push_sample)) {
+    AddTaskSamples(sample.task_id());
+    // Drops the sample if the task has been removed in the meantime.
+    task_map_.Visit(sample.task_id(), push_sample);
   }
-  if (q->size() * sizeof(sample) >= FLAGS_max_sample_queue_size * KB_TO_BYTES)
-    q->pop_front();  // drop from the front
-  q->push_back(sample);
   if (FLAGS_serialize_knowledge_base) {
     string message_string;
     sample.SerializeToString(&message_string);
+    boost::lock_guard<boost::upgrade_mutex> lock(kb_lock_);
     coded_task_output_->WriteVarint32(message_string.size());
     coded_task_output_->WriteRaw(message_string.data(), message_string.size());
   }
 }
 
+void KnowledgeBase::AddTaskStatsSamples(
+    const vector<const TaskStats*>& samples) {
+  for (auto& sample : samples) {
+    AddTaskStatsSample(*sample);
+  }
+}
+
+KnowledgeBase::MachineSamples* KnowledgeBase::FindOrAddMachineSamples(
+    ResourceID_t id, uint64_t cpus_per_sample) {
+  MachineSamples* samples = FindPtrOrNull(machine_map_, id);
+  if (samples) {
+    return samples;
+  }
+  // Size the rings so that they take at most max_sample_queue_size KB. A
+  // machine whose later samples have more CPUs than the first one just
+  // keeps fewer of them.
+  uint64_t sample_size = SampleRing<MachineSample>::slot_size() +
+    cpus_per_sample * SampleRing<CpuSample>::slot_size();
+  uint64_t capacity =
+    max<uint64_t>(FLAGS_max_sample_queue_size * KB_TO_BYTES / sample_size, 1);
+  samples = new MachineSamples(capacity, cpus_per_sample);
+  if (!InsertIfNotPresent(&machine_map_, id, samples)) {
+    // Another thread has added the machine concurrently.
+    delete samples;
+    samples = FindPtrOrNull(machine_map_, id);
+  }
+  return samples;
+}
+
+void KnowledgeBase::AddTaskSamples(TaskID_t id) {
+  // The ring only allocates its slots as samples arrive, so short-lived
+  // tasks do not take max_sample_queue_size KB each.
+  uint64_t capacity =
+    max<uint64_t>(FLAGS_max_sample_queue_size * KB_TO_BYTES /
+                  SampleRing<TaskSample>::slot_size(), 1);
+  TaskSamples* samples = new TaskSamples(capacity);
+  if (!InsertIfNotPresent(&task_map_, id, samples)) {
+    // Another thread has added the task concurrently.
+    delete samples;
+  }
+}
+
+bool KnowledgeBase::MachineSampleToStats(ResourceID_t id,
+                                         const MachineSamples& samples,
+                                         const MachineSample& sample,
+                                         ResourceStats* stats) const {
+  // Clear() keeps the cleared CpuStats objects around for reuse, so that
+  // pointers that callers hold into stats->cpus_stats stay valid.
+  stats->Clear();
+  stats->set_resource_id(to_string(id));
+  stats->set_timestamp(sample.timestamp_);
+  stats->set_mem_allocatable(sample.mem_allocatable_);
+  stats->set_mem_capacity(sample.mem_capacity_);
+  stats->set_mem_reservation(sample.mem_reservation_);
+  stats->set_mem_utilization(sample.mem_utilization_);
+  stats->set_disk_bw(sample.disk_bw_);
+  stats->set_net_rx_bw(sample.net_rx_bw_);
+  stats->set_net_tx_bw(sample.net_tx_bw_);
+  stats->set_ephemeral_storage_allocatable(
+      sample.ephemeral_storage_allocatable_);
+  stats->set_ephemeral_storage_capacity(sample.ephemeral_storage_capacity_);
+  stats->set_ephemeral_storage_reservation(
+      sample.ephemeral_storage_reservation_);
+  stats->set_ephemeral_storage_utilization(
+      sample.ephemeral_storage_utilization_);
+  CpuSample cpu_sample;
+  for (uint64_t cpu = 0; cpu < sample.num_cpus_; ++cpu) {
+    if (!samples.cpu_samples_.Get(sample.first_cpu_ + cpu, &cpu_sample)) {
+      return false;
+    }
+    CpuStats* cpu_stats = stats->add_cpus_stats();
+    cpu_stats->set_cpu_allocatable(cpu_sample.cpu_allocatable_);
+    cpu_stats->set_cpu_capacity(cpu_sample.cpu_capacity_);
+    cpu_stats->set_cpu_reservation(cpu_sample.cpu_reservation_);
+    cpu_stats->set_cpu_utilization(cpu_sample.cpu_utilization_);
+  }
+  return true;
+}
+
+void KnowledgeBase::TaskSampleToStats(TaskID_t id, const TaskSample& sample,
+                                      TaskStats* stats) const {
+  stats->Clear();
+  stats->set_task_id(id);
+  stats->set_hostname(StringInterner::Global()->String(sample.hostname_));
+  stats->set_timestamp(sample.timestamp_);
+  stats->set_cpu_limit(sample.cpu_limit_);
+  stats->set_cpu_request(sample.cpu_request_);
+  stats->set_cpu_usage(sample.cpu_usage_);
+  stats->set_mem_limit(sample.mem_limit_);
+  stats->set_mem_request(sample.mem_request_);
+  stats->set_mem_usage(sample.mem_usage_);
+  stats->set_mem_rss(sample.mem_rss_);
+  stats->set_mem_cache(sample.mem_cache_);
+  stats->set_mem_working_set(sample.mem_working_set_);
+  stats->set_mem_page_faults(sample.mem_page_faults_);
+  stats->set_mem_page_faults_rate(sample.mem_page_faults_rate_);
+  stats->set_major_page_faults(sample.major_page_faults_);
+  stats->set_major_page_faults_rate(sample.major_page_faults_rate_);
+  stats->set_net_rx(sample.net_rx_);
+  stats->set_net_rx_errors(sample.net_rx_errors_);
+  stats->set_net_rx_errors_rate(sample.net_rx_errors_rate_);
+  stats->set_net_rx_rate(sample.net_rx_rate_);
+  stats->set_net_tx(sample.net_tx_);
+  stats->set_net_tx_errors(sample.net_tx_errors_);
+  stats->set_net_tx_errors_rate(sample.net_tx_errors_rate_);
+  stats->set_net_tx_rate(sample.net_tx_rate_);
+  stats->set_ephemeral_storage_limit(sample.ephemeral_storage_limit_);
+  stats->set_ephemeral_storage_request(sample.ephemeral_storage_request_);
+  stats->set_ephemeral_storage_usage(sample.ephemeral_storage_usage_);
+}
+
 void KnowledgeBase::DumpMachineStats(const ResourceID_t& res_id) const {
   // Sanity checks
-  const deque<ResourceStats>* q = FindOrNull(machine_map_, res_id);
-  if (!q)
+  const MachineSamples* samples = FindPtrOrNull(machine_map_, res_id);
+  if (!samples)
     return;
   // Dump
   LOG(INFO) << "STATS FOR " << res_id << ": ";
-  LOG(INFO) << "Have " << q->size() << " samples.";
-  for (deque<ResourceStats>::const_iterator it = q->begin();
-      it != q->end();
-      ++it) {
-    LOG(INFO) << it->mem_capacity() * (1.0 - it->mem_utilization());
-  }
+  uint64_t num_samples = samples->samples_.Visit(
+      samples->samples_.capacity(),
+      [](uint64_t index, const MachineSample& sample) {
+        LOG(INFO) << sample.mem_capacity_ * (1.0 - sample.mem_utilization_);
+      });
+  LOG(INFO) << "Had " << num_samples << " samples.";
 }
 
 bool KnowledgeBase::GetLatestStatsForMachine(
-    ResourceID_t id, ResourceStats* sample) {
-  boost::lock_guard<boost::upgrade_mutex> lock_shared(kb_lock_);
-  const deque<ResourceStats>* res = FindOrNull(machine_map_, id);
-  if (!res)
+    ResourceID_t id, ResourceStats* sample) const {
+  const MachineSamples* samples = FindPtrOrNull(machine_map_, id);
+  if (!samples)
     return false;
-  // We make a copy here, as we lose the lock when returning
-  sample->CopyFrom(res->back());
+  MachineSample machine_sample;
+  do {
+    if (!samples->samples_.Latest(&machine_sample))
+      return false;
+    // Only fails if the writer has overwritten the sample's CPU stats since
+    // we copied it, in which case there is a newer sample.
+  } while (!MachineSampleToStats(id, *samples, machine_sample, sample));
   return true;
 }
 
-const deque<ResourceStats> KnowledgeBase::GetStatsForMachine(
-      ResourceID_t id) {
-  boost::lock_guard<boost::upgrade_mutex> lock_shared(kb_lock_);
-  const deque<ResourceStats>* res = FindOrNull(machine_map_, id);
-  if (!res) {
-    const deque<ResourceStats> empty;
-    return empty;
-  }
-  // We make a copy here, as we lose the lock when returning
-  const deque<ResourceStats> copy(*res);
-  return copy;
+bool KnowledgeBase::GetMachineStatsWindow(ResourceID_t id,
+                                          uint64_t num_samples,
+                                          MachineStatsWindow* window) const {
+  const MachineSamples* samples = FindPtrOrNull(machine_map_, id);
+  if (!samples)
+    return false;
+  window->num_samples_ = 0;
+  window->avg_cpu_utilization_ = 0;
+  window->max_cpu_utilization_ = 0;
+  window->avg_mem_utilization_ = 0;
+  window->max_mem_utilization_ = 0;
+  samples->samples_.Visit(
+      num_samples, [samples, window](uint64_t index,
+                                     const MachineSample& sample) {
+        double cpu_utilization = 0;
+        CpuSample cpu_sample;
+        for (uint64_t cpu = 0; cpu < sample.num_cpus_; ++cpu) {
+          if (!samples->cpu_samples_.Get(sample.first_cpu_ + cpu,
+                                         &cpu_sample)) {
+            return;
+          }
+          cpu_utilization += cpu_sample.cpu_utilization_;
+        }
+        if (sample.num_cpus_ > 0) {
+          cpu_utilization /= sample.num_cpus_;
+        }
+        window->num_samples_++;
+        window->avg_cpu_utilization_ += cpu_utilization;
+        window->max_cpu_utilization_ =
+          max(window->max_cpu_utilization_, cpu_utilization);
+        window->avg_mem_utilization_ += sample.mem_utilization_;
+        window->max_mem_utilization_ =
+          max(window->max_mem_utilization_, sample.mem_utilization_);
+      });
+  if (window->num_samples_ == 0)
+    return false;
+  window->avg_cpu_utilization_ /= window->num_samples_;
+  window->avg_mem_utilization_ /= window->num_samples_;
+  return true;
 }
 
-const deque<TaskStats>* KnowledgeBase::GetStatsForTask(TaskID_t id) const {
-  const deque<TaskStats>* res = FindOrNull(task_map_, id);
-  return res;
+void KnowledgeBase::GetStatsForMachine(ResourceID_t id, uint64_t max_samples,
+                                       vector<ResourceStats>* stats) const {
+  const MachineSamples* samples = FindPtrOrNull(machine_map_, id);
+  if (!samples)
+    return;
+  samples->samples_.Visit(
+      max_samples, [this, id, samples, stats](uint64_t index,
+                                              const MachineSample& sample) {
+        stats->push_back(ResourceStats());
+        if (!MachineSampleToStats(id, *samples, sample, &stats->back())) {
+          stats->pop_back();
+        }
+      });
+}
+
+void KnowledgeBase::GetStatsForTask(TaskID_t id, uint64_t max_samples,
+                                    vector<TaskStats>* stats) const {
+  task_map_.Visit(id, [this, id, max_samples, stats](
+      const TaskSamples* samples) {
+    samples->samples_.Visit(
+        max_samples,
+        [this, id, stats](uint64_t index, const TaskSample& sample) {
+          stats->push_back(TaskStats());
+          TaskSampleToStats(id, sample, &stats->back());
+        });
+  });
 }
 
 const deque<TaskFinalReport>* KnowledgeBase::GetFinalReportForTask(
@@ -343,6 +572,14 @@ void KnowledgeBase::ProcessTaskFinalReport(
   }
 }
 
+void KnowledgeBase::RemoveTaskSamples(TaskID_t id) {
+  TaskSamples* samples = NULL;
+  // Waits for readers and the writer of the task's samples to finish.
+  if (task_map_.erase(id, &samples)) {
+    delete samples;
+  }
+}
+
 void KnowledgeBase::UpdateResourceNonFirmamentTaskCount(ResourceID_t res_id, bool add) {
   uint64_t* tasks_count = FindOrNull(resource_tasks_count_, res_id);
   if (tasks_count) {
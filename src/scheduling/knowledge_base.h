@@ -40,21 +40,100 @@
 #include "base/resource_stats.pb.h"
 #include "base/task_final_report.pb.h"
 #include "base/task_stats.pb.h"
+#include "misc/sample_ring.h"
+#include "misc/sharded_map.h"
+#include "misc/string_interner.h"
 #include "scheduling/data_layer_manager_interface.h"
 
 namespace firmament {
 
+// Compact forms of the ResourceStats, CpuStats and TaskStats samples, which
+// the knowledge base stores in fixed-capacity rings.
+struct CpuSample {
+  int64_t cpu_allocatable_;
+  int64_t cpu_capacity_;
+  double cpu_reservation_;
+  double cpu_utilization_;
+};
+
+struct MachineSample {
+  uint64_t timestamp_;
+  int64_t mem_allocatable_;
+  int64_t mem_capacity_;
+  double mem_reservation_;
+  double mem_utilization_;
+  int64_t disk_bw_;
+  int64_t net_rx_bw_;
+  int64_t net_tx_bw_;
+  int64_t ephemeral_storage_allocatable_;
+  int64_t ephemeral_storage_capacity_;
+  double ephemeral_storage_reservation_;
+  double ephemeral_storage_utilization_;
+  // The sample's CPU stats are at [first_cpu_, first_cpu_ + num_cpus_) in the
+  // machine's CPU sample ring.
+  uint64_t first_cpu_;
+  uint32_t num_cpus_;
+};
+
+struct TaskSample {
+  uint64_t timestamp_;
+  StringID_t hostname_;
+  int64_t cpu_limit_;
+  int64_t cpu_request_;
+  int64_t cpu_usage_;
+  int64_t mem_limit_;
+  int64_t mem_request_;
+  int64_t mem_usage_;
+  int64_t mem_rss_;
+  int64_t mem_cache_;
+  int64_t mem_working_set_;
+  int64_t mem_page_faults_;
+  double mem_page_faults_rate_;
+  int64_t major_page_faults_;
+  double major_page_faults_rate_;
+  int64_t net_rx_;
+  int64_t net_rx_errors_;
+  double net_rx_errors_rate_;
+  double net_rx_rate_;
+  int64_t net_tx_;
+  int64_t net_tx_errors_;
+  double net_tx_errors_rate_;
+  double net_tx_rate_;
+  int64_t ephemeral_storage_limit_;
+  int64_t ephemeral_storage_request_;
+  int64_t ephemeral_storage_usage_;
+};
+
+// Averages and maxima over a window of a machine's most recent samples. CPU
+// utilizations are averaged over the machine's CPUs first.
+struct MachineStatsWindow {
+  uint64_t num_samples_;
+  double avg_cpu_utilization_;
+  double max_cpu_utilization_;
+  double avg_mem_utilization_;
+  double max_mem_utilization_;
+};
+
 class KnowledgeBase {
  public:
   KnowledgeBase();
   KnowledgeBase(DataLayerManagerInterface* data_layer_manager);
   virtual ~KnowledgeBase();
   void AddMachineSample(const ResourceStats& sample);
+  // Adds several samples while holding the knowledge base lock only once.
+  void AddMachineSamples(const vector<const ResourceStats*>& samples);
   void AddTaskStatsSample(const TaskStats& stats_sample);
+  void AddTaskStatsSamples(const vector<const TaskStats*>& samples);
   void DumpMachineStats(const ResourceID_t& res_id) const;
-  bool GetLatestStatsForMachine(ResourceID_t id, ResourceStats* sample);
-  const deque<ResourceStats> GetStatsForMachine(ResourceID_t id);
-  const deque<TaskStats>* GetStatsForTask(TaskID_t id) const;
+  bool GetLatestStatsForMachine(ResourceID_t id, ResourceStats* sample) const;
+  bool GetMachineStatsWindow(ResourceID_t id, uint64_t num_samples,
+                             MachineStatsWindow* window) const;
+  // Appends the machine's (task's) most recent samples, oldest first, to
+  // *samples.
+  void GetStatsForMachine(ResourceID_t id, uint64_t max_samples,
+                          vector<ResourceStats>* samples) const;
+  void GetStatsForTask(TaskID_t id, uint64_t max_samples,
+                       vector<TaskStats>* samples) const;
   virtual double GetAvgCPIForTEC(EquivClass_t id);
   virtual double GetAvgIPMAForTEC(EquivClass_t id);
   virtual double GetAvgPsPIForTEC(EquivClass_t id);
@@ -65,6 +144,8 @@ class KnowledgeBase {
   void LoadKnowledgeBaseFromFile();
   void ProcessTaskFinalReport(const vector<EquivClass_t>& equiv_classes,
                               const TaskFinalReport& report);
+  // Drops the samples of a task that has completed or has been removed.
+  void RemoveTaskSamples(TaskID_t id);
   void UpdateResourceNonFirmamentTaskCount(ResourceID_t res_id, bool add);
   uint64_t GetResourceNonFirmamentTaskCount(ResourceID_t res_id);
   inline const DataLayerManagerInterface& data_layer_manager() {
@@ -77,17 +158,50 @@ class KnowledgeBase {
   }
 
  protected:
-  unordered_map<ResourceID_t, deque<ResourceStats>,
+  // The samples of a machine or task. Samples are added and read without
+  // taking kb_lock_: the rings let readers copy samples out while the writer
+  // appends, and writer_lock_ makes sure that there is only one writer.
+  struct MachineSamples {
+    MachineSamples(uint64_t capacity, uint64_t cpus_per_sample)
+      : samples_(capacity), cpu_samples_(capacity * cpus_per_sample) {
+    }
+    boost::mutex writer_lock_;
+    SampleRing<MachineSample> samples_;
+    SampleRing<CpuSample> cpu_samples_;
+  };
+  struct TaskSamples {
+    explicit TaskSamples(uint64_t capacity) : samples_(capacity) {
+    }
+    boost::mutex writer_lock_;
+    SampleRing<TaskSample> samples_;
+  };
+
+  // Entries are never removed, so the pointers stay valid until the knowledge
+  // base is destroyed.
+  ShardedMap<ResourceID_t, MachineSamples*,
       boost::hash<boost::uuids::uuid> > machine_map_;
   // TODO(malte): note that below sample queue has no awareness of time within a
   // task, i.e. it mixes samples from all phases
-  unordered_map<TaskID_t, deque<TaskStats> > task_map_;
+  // Entries are removed when their task finishes, so the samples must only be
+  // used from within task_map_.Visit().
+  ShardedMap<TaskID_t, TaskSamples*> task_map_;
   unordered_map<TaskID_t, deque<TaskFinalReport> > task_exec_reports_;
   boost::upgrade_mutex kb_lock_;
   unordered_map<ResourceID_t, uint64_t,
       boost::hash<boost::uuids::uuid>> resource_tasks_count_;
 
  private:
+  MachineSamples* FindOrAddMachineSamples(ResourceID_t id,
+                                          uint64_t cpus_per_sample);
+  void AddTaskSamples(TaskID_t id);
+  // Converts a machine sample back into a ResourceStats. Returns false if
+  // the sample's CPU stats have been overwritten.
+  bool MachineSampleToStats(ResourceID_t id, const MachineSamples& samples,
+                            const MachineSample& sample,
+                            ResourceStats* stats) const;
+  void TaskSampleToStats(TaskID_t id, const TaskSample& sample,
+                         TaskStats* stats) const;
+
   fstream serial_machine_samples_;
   fstream serial_task_samples_;
   ::google::protobuf::io::ZeroCopyOutputStream* raw_machine_output_;
@@ -0,0 +1,161 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Knowledge base unit tests.
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "base/common.h"
+#include "base/units.h"
+#include "misc/utils.h"
+#include "scheduling/knowledge_base.h"
+
+DECLARE_uint64(max_sample_queue_size);
+
+namespace firmament {
+
+class KnowledgeBaseTest : public ::testing::Test {
+ protected:
+  KnowledgeBaseTest() {
+    FLAGS_v = 2;
+  }
+
+  ResourceStats MachineStats(ResourceID_t res_id, uint64_t timestamp,
+                             uint64_t num_cpus, double utilization) {
+    ResourceStats stats;
+    stats.set_resource_id(to_string(res_id));
+    stats.set_timestamp(timestamp);
+    stats.set_mem_capacity(1024);
+    stats.set_mem_allocatable(512);
+    stats.set_mem_utilization(utilization);
+    stats.set_net_rx_bw(10);
+    stats.set_ephemeral_storage_capacity(100);
+    for (uint64_t cpu = 0; cpu < num_cpus; ++cpu) {
+      CpuStats* cpu_stats = stats.add_cpus_stats();
+      cpu_stats->set_cpu_capacity(1000);
+      cpu_stats->set_cpu_allocatable(1000 - cpu);
+      cpu_stats->set_cpu_utilization(utilization);
+    }
+    return stats;
+  }
+};
+
+TEST_F(KnowledgeBaseTest, MachineSamples) {
+  KnowledgeBase knowledge_base;
+  ResourceID_t res_id = GenerateResourceID();
+  ResourceStats latest;
+  EXPECT_FALSE(knowledge_base.GetLatestStatsForMachine(res_id, &latest));
+  for (uint64_t timestamp = 1; timestamp <= 4; ++timestamp) {
+    knowledge_base.AddMachineSample(
+        MachineStats(res_id, timestamp, 2, 0.1 * timestamp));
+  }
+  ASSERT_TRUE(knowledge_base.GetLatestStatsForMachine(res_id, &latest));
+  ResourceStats expected = MachineStats(res_id, 4, 2, 0.4);
+  EXPECT_EQ(latest.SerializeAsString(), expected.SerializeAsString());
+  vector<ResourceStats> samples;
+  knowledge_base.GetStatsForMachine(res_id, 3, &samples);
+  ASSERT_EQ(samples.size(), 3);
+  EXPECT_EQ(samples[0].timestamp(), 2);
+  EXPECT_EQ(samples[2].timestamp(), 4);
+  EXPECT_EQ(samples[1].cpus_stats_size(), 2);
+  EXPECT_EQ(samples[1].cpus_stats(1).cpu_allocatable(), 999);
+  MachineStatsWindow window;
+  ASSERT_TRUE(knowledge_base.GetMachineStatsWindow(res_id, 2, &window));
+  EXPECT_EQ(window.num_samples_, 2);
+  EXPECT_DOUBLE_EQ(window.avg_cpu_utilization_, 0.35);
+  EXPECT_DOUBLE_EQ(window.max_mem_utilization_, 0.4);
+}
+
+// Checks that a machine keeps at most max_sample_queue_size KB of samples,
+// including when its samples have more CPUs than the first one.
+TEST_F(KnowledgeBaseTest, MachineSampleCapacity) {
+  FLAGS_max_sample_queue_size = 1;
+  KnowledgeBase knowledge_base;
+  ResourceID_t res_id = GenerateResourceID();
+  for (uint64_t timestamp = 1; timestamp <= 1000; ++timestamp) {
+    knowledge_base.AddMachineSample(
+        MachineStats(res_id, timestamp, timestamp < 500 ? 1 : 4, 0.5));
+  }
+  vector<ResourceStats> samples;
+  knowledge_base.GetStatsForMachine(res_id, 1000, &samples);
+  ASSERT_FALSE(samples.empty());
+  EXPECT_LT(samples.size() * (sizeof(MachineSample) + sizeof(CpuSample)),
+            KB_TO_BYTES);
+  EXPECT_EQ(samples.back().timestamp(), 1000);
+  for (const auto& sample : samples) {
+    EXPECT_EQ(sample.cpus_stats_size(), 4);
+  }
+  FLAGS_max_sample_queue_size = 100;
+}
+
+TEST_F(KnowledgeBaseTest, TaskSamples) {
+  KnowledgeBase knowledge_base;
+  vector<TaskStats> samples;
+  knowledge_base.GetStatsForTask(42, 10, &samples);
+  EXPECT_TRUE(samples.empty());
+  TaskStats stats;
+  stats.set_task_id(42);
+  stats.set_hostname("node-1");
+  stats.set_timestamp(7);
+  stats.set_cpu_usage(250);
+  stats.set_mem_rss(4096);
+  stats.set_net_tx_rate(1.5);
+  stats.set_ephemeral_storage_usage(3);
+  knowledge_base.AddTaskStatsSample(stats);
+  knowledge_base.GetStatsForTask(42, 10, &samples);
+  ASSERT_EQ(samples.size(), 1);
+  EXPECT_EQ(samples[0].SerializeAsString(), stats.SerializeAsString());
+}
+
+TEST_F(KnowledgeBaseTest, RemoveTaskSamples) {
+  KnowledgeBase knowledge_base;
+  TaskStats stats;
+  stats.set_task_id(42);
+  stats.set_timestamp(7);
+  knowledge_base.AddTaskStatsSample(stats);
+  stats.set_task_id(43);
+  knowledge_base.AddTaskStatsSample(stats);
+  knowledge_base.RemoveTaskSamples(42);
+  // Removing a task twice, or a task without samples, is harmless.
+  knowledge_base.RemoveTaskSamples(42);
+  knowledge_base.RemoveTaskSamples(44);
+  vector<TaskStats> samples;
+  knowledge_base.GetStatsForTask(42, 10, &samples);
+  EXPECT_TRUE(samples.empty());
+  knowledge_base.GetStatsForTask(43, 10, &samples);
+  EXPECT_EQ(samples.size(), 1);
+  // A sample that arrives after the removal starts a new ring.
+  stats.set_task_id(42);
+  stats.set_timestamp(8);
+  knowledge_base.AddTaskStatsSample(stats);
+  samples.clear();
+  knowledge_base.GetStatsForTask(42, 10, &samples);
+  ASSERT_EQ(samples.size(), 1);
+  EXPECT_EQ(samples[0].timestamp(), 8);
+}
+
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,231 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "scheduling/label_index.h"
+
+#include "misc/map-util.h"
+
+namespace firmament {
+
+LabelIndex::LabelIndex() {
+}
+
+void LabelIndex::AddTask(const TaskDescriptor& td) {
+  IndexedTask task;
+  task.namespace_ = Intern(td.task_namespace());
+  task.placed_ = false;
+  for (const auto& label : td.labels()) {
+    Symbol_t key = Intern(label.key());
+    task.postings_keys_.push_back(PostingsKey(key, Intern(label.value())));
+    uint64_t key_postings_key = PostingsKey(key, kNoSymbol);
+    // A task is only counted once per label key, even if it has several
+    // labels with the same key.
+    if (find(task.postings_keys_.begin(), task.postings_keys_.end(),
+             key_postings_key) == task.postings_keys_.end()) {
+      task.postings_keys_.push_back(key_postings_key);
+    }
+  }
+  CHECK(InsertIfNotPresent(&tasks_, td.uid(), task));
+  for (auto postings_key : task.postings_keys_) {
+    Postings& postings = postings_[postings_key];
+    postings.tasks_[task.namespace_]++;
+    postings.num_tasks_++;
+  }
+}
+
+void LabelIndex::RemoveTask(TaskID_t task_id) {
+  IndexedTask* task = FindOrNull(tasks_, task_id);
+  if (!task) {
+    return;
+  }
+  UnplaceTask(task_id);
+  for (auto postings_key : task->postings_keys_) {
+    auto it = postings_.find(postings_key);
+    CHECK(it != postings_.end());
+    Decrement(task->namespace_, &it->second.tasks_);
+    if (--it->second.num_tasks_ == 0) {
+      postings_.erase(it);
+    }
+  }
+  tasks_.erase(task_id);
+}
+
+void LabelIndex::PlaceTask(TaskID_t task_id, ResourceID_t machine_res_id) {
+  IndexedTask* task = FindOrNull(tasks_, task_id);
+  if (!task) {
+    return;
+  }
+  UnplaceTask(task_id);
+  for (auto postings_key : task->postings_keys_) {
+    Postings* postings = FindOrNull(postings_, postings_key);
+    CHECK_NOTNULL(postings);
+    postings->placed_tasks_[machine_res_id][task->namespace_]++;
+  }
+  task->placed_ = true;
+  task->machine_res_id_ = machine_res_id;
+}
+
+void LabelIndex::UnplaceTask(TaskID_t task_id) {
+  IndexedTask* task = FindOrNull(tasks_, task_id);
+  if (!task || !task->placed_) {
+    return;
+  }
+  for (auto postings_key : task->postings_keys_) {
+    Postings* postings = FindOrNull(postings_, postings_key);
+    CHECK_NOTNULL(postings);
+    auto it = postings->placed_tasks_.find(task->machine_res_id_);
+    CHECK(it != postings->placed_tasks_.end());
+    if (Decrement(task->namespace_, &it->second)) {
+      postings->placed_tasks_.erase(it);
+    }
+  }
+  task->placed_ = false;
+}
+
+bool LabelIndex::HasTaskWithLabel(
+    const string& key, const RepeatedPtrField<string>& values,
+    const unordered_set<string>* namespaces) const {
+  Symbol_t key_symbol = Lookup(key);
+  if (key_symbol == kNoSymbol) {
+    return false;
+  }
+  for (const auto& value : values) {
+    Symbol_t value_symbol = Lookup(value);
+    if (value_symbol != kNoSymbol &&
+        HasTask(PostingsKey(key_symbol, value_symbol), namespaces)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool LabelIndex::HasTaskWithLabelKey(
+    const string& key, const unordered_set<string>* namespaces) const {
+  Symbol_t key_symbol = Lookup(key);
+  if (key_symbol == kNoSymbol) {
+    return false;
+  }
+  return HasTask(PostingsKey(key_symbol, kNoSymbol), namespaces);
+}
+
+bool LabelIndex::HasPlacedTaskWithLabel(
+    ResourceID_t machine_res_id, const string& key,
+    const RepeatedPtrField<string>& values,
+    const unordered_set<string>* namespaces) const {
+  Symbol_t key_symbol = Lookup(key);
+  if (key_symbol == kNoSymbol) {
+    return false;
+  }
+  for (const auto& value : values) {
+    Symbol_t value_symbol = Lookup(value);
+    if (value_symbol != kNoSymbol &&
+        HasPlacedTask(PostingsKey(key_symbol, value_symbol), machine_res_id,
+                      namespaces)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool LabelIndex::HasPlacedTaskWithLabelKey(
+    ResourceID_t machine_res_id, const string& key,
+    const unordered_set<string>* namespaces) const {
+  Symbol_t key_symbol = Lookup(key);
+  if (key_symbol == kNoSymbol) {
+    return false;
+  }
+  return HasPlacedTask(PostingsKey(key_symbol, kNoSymbol), machine_res_id,
+                       namespaces);
+}
+
+// Returns true if the count of the symbol dropped to zero and was removed.
+bool LabelIndex::Decrement(Symbol_t symbol, NamespaceCounts_t* counts) {
+  auto it = counts->find(symbol);
+  CHECK(it != counts->end());
+  if (--it->second == 0) {
+    counts->erase(it);
+  }
+  return counts->empty();
+}
+
+bool LabelIndex::InNamespaces(const NamespaceCounts_t& counts,
+                              const vector<Symbol_t>& namespaces) {
+  for (auto namespace_symbol : namespaces) {
+    if (counts.find(namespace_symbol) != counts.end()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+LabelIndex::Symbol_t LabelIndex::Intern(const string& str) {
+  return StringInterner::Global()->Intern(str);
+}
+
+LabelIndex::Symbol_t LabelIndex::Lookup(const string& str) {
+  return StringInterner::Global()->Lookup(str);
+}
+
+bool LabelIndex::NamespaceSymbols(const unordered_set<string>& namespaces,
+                                  vector<Symbol_t>* namespace_symbols) const {
+  for (const auto& name : namespaces) {
+    Symbol_t symbol = Lookup(name);
+    if (symbol != kNoSymbol) {
+      namespace_symbols->push_back(symbol);
+    }
+  }
+  return !namespace_symbols->empty();
+}
+
+bool LabelIndex::HasTask(uint64_t postings_key,
+                         const unordered_set<string>* namespaces) const {
+  const Postings* postings = FindOrNull(postings_, postings_key);
+  if (!postings) {
+    return false;
+  }
+  if (!namespaces) {
+    return true;
+  }
+  vector<Symbol_t> namespace_symbols;
+  return NamespaceSymbols(*namespaces, &namespace_symbols) &&
+    InNamespaces(postings->tasks_, namespace_symbols);
+}
+
+bool LabelIndex::HasPlacedTask(uint64_t postings_key,
+                               ResourceID_t machine_res_id,
+                               const unordered_set<string>* namespaces) const {
+  const Postings* postings = FindOrNull(postings_, postings_key);
+  if (!postings) {
+    return false;
+  }
+  const NamespaceCounts_t* placed_tasks =
+    FindOrNull(postings->placed_tasks_, machine_res_id);
+  if (!placed_tasks) {
+    return false;
+  }
+  if (!namespaces) {
+    return true;
+  }
+  vector<Symbol_t> namespace_symbols;
+  return NamespaceSymbols(*namespaces, &namespace_symbols) &&
+    InNamespaces(*placed_tasks, namespace_symbols);
+}
+
+}  // namespace firmament
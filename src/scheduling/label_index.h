@@ -0,0 +1,144 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Inverted index from task labels to tasks, used to evaluate pod affinity and
+// anti-affinity terms. For every label (key and value) and every label key,
+// it counts the tasks that have it, per namespace, and the placed tasks that
+// have it, per machine and namespace. All updates take constant time per
+// label of the task.
+
+#ifndef FIRMAMENT_SCHEDULING_LABEL_INDEX_H
+#define FIRMAMENT_SCHEDULING_LABEL_INDEX_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/common.h"
+#include "base/task_desc.pb.h"
+#include "base/types.h"
+#include "misc/string_interner.h"
+
+namespace firmament {
+
+class LabelIndex {
+ public:
+  LabelIndex();
+
+  /**
+   * Indexes the labels of a task. The task is not placed.
+   * @param td the task descriptor; its labels and namespace must not change
+   * until the task is removed
+   */
+  void AddTask(const TaskDescriptor& td);
+  void RemoveTask(TaskID_t task_id);
+
+  /**
+   * Records that a task runs on a machine. A task can only be placed on one
+   * machine at a time; placing it again moves it.
+   * @param task_id the id of an indexed task
+   * @param machine_res_id the resource id of the machine
+   */
+  void PlaceTask(TaskID_t task_id, ResourceID_t machine_res_id);
+  void UnplaceTask(TaskID_t task_id);
+
+  /**
+   * Checks if an indexed task has one of the labels key=value (for the given
+   * values).
+   * @param namespaces the namespaces to consider, or NULL for all namespaces
+   */
+  bool HasTaskWithLabel(const string& key,
+                        const RepeatedPtrField<string>& values,
+                        const unordered_set<string>* namespaces) const;
+  bool HasTaskWithLabelKey(const string& key,
+                           const unordered_set<string>* namespaces) const;
+
+  /**
+   * Checks if a task placed on a machine has one of the labels key=value
+   * (for the given values).
+   * @param namespaces the namespaces to consider, or NULL for all namespaces
+   */
+  bool HasPlacedTaskWithLabel(ResourceID_t machine_res_id, const string& key,
+                              const RepeatedPtrField<string>& values,
+                              const unordered_set<string>* namespaces) const;
+  bool HasPlacedTaskWithLabelKey(
+      ResourceID_t machine_res_id, const string& key,
+      const unordered_set<string>* namespaces) const;
+
+  inline bool HasTask(TaskID_t task_id) const {
+    return tasks_.find(task_id) != tasks_.end();
+  }
+
+  inline uint64_t num_tasks() const {
+    return tasks_.size();
+  }
+
+ private:
+  // Label keys, label values and namespaces are interned in the global
+  // StringInterner.
+  typedef StringID_t Symbol_t;
+  // Task counts per namespace.
+  typedef unordered_map<Symbol_t, uint64_t> NamespaceCounts_t;
+
+  struct Postings {
+    NamespaceCounts_t tasks_;
+    uint64_t num_tasks_;
+    unordered_map<ResourceID_t, NamespaceCounts_t,
+                  boost::hash<boost::uuids::uuid>> placed_tasks_;
+    Postings() : num_tasks_(0) {}
+  };
+
+  struct IndexedTask {
+    // Keys into postings_ of the task's labels and label keys.
+    vector<uint64_t> postings_keys_;
+    Symbol_t namespace_;
+    bool placed_;
+    ResourceID_t machine_res_id_;
+  };
+
+  static const Symbol_t kNoSymbol = StringInterner::kNoStringID;
+
+  // Returns the key into postings_ for a label, or for a label key if value
+  // is kNoSymbol.
+  static inline uint64_t PostingsKey(Symbol_t key, Symbol_t value) {
+    return (static_cast<uint64_t>(key) << 32) | value;
+  }
+  static bool Decrement(Symbol_t symbol, NamespaceCounts_t* counts);
+  static bool InNamespaces(const NamespaceCounts_t& counts,
+                           const vector<Symbol_t>& namespaces);
+
+  static Symbol_t Intern(const string& str);
+  static Symbol_t Lookup(const string& str);
+  // Sets namespace_symbols to the symbols of the namespaces. Returns false if
+  // none of the namespaces has a symbol, i.e., no task can be in them.
+  bool NamespaceSymbols(const unordered_set<string>& namespaces,
+                        vector<Symbol_t>* namespace_symbols) const;
+  bool HasTask(uint64_t postings_key,
+               const unordered_set<string>* namespaces) const;
+  bool HasPlacedTask(uint64_t postings_key, ResourceID_t machine_res_id,
+                     const unordered_set<string>* namespaces) const;
+
+  unordered_map<uint64_t, Postings> postings_;
+  unordered_map<TaskID_t, IndexedTask> tasks_;
+};
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SCHEDULING_LABEL_INDEX_H
@@ -0,0 +1,139 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Label index unit tests.
+
+#include <gtest/gtest.h>
+
+#include "misc/utils.h"
+#include "scheduling/label_index.h"
+
+namespace firmament {
+
+class LabelIndexTest : public ::testing::Test {
+ protected:
+  LabelIndexTest() {
+    FLAGS_v = 2;
+  }
+
+  void CreateTask(TaskDescriptor* td_ptr, TaskID_t task_id,
+                  const string& task_namespace, const string& key,
+                  const string& value) {
+    td_ptr->set_uid(task_id);
+    td_ptr->set_task_namespace(task_namespace);
+    Label* label = td_ptr->add_labels();
+    label->set_key(key);
+    label->set_value(value);
+  }
+
+  RepeatedPtrField<string> Values(const string& value) {
+    RepeatedPtrField<string> values;
+    values.Add()->assign(value);
+    return values;
+  }
+};
+
+// Checks that tasks can be found by label and label key until they are
+// removed.
+TEST_F(LabelIndexTest, AddRemoveTask) {
+  LabelIndex label_index;
+  TaskDescriptor td1;
+  CreateTask(&td1, 1, "default", "app", "web");
+  TaskDescriptor td2;
+  CreateTask(&td2, 2, "default", "app", "db");
+  label_index.AddTask(td1);
+  label_index.AddTask(td2);
+  EXPECT_EQ(label_index.num_tasks(), 2);
+  EXPECT_TRUE(label_index.HasTask(1));
+  EXPECT_TRUE(label_index.HasTaskWithLabel("app", Values("web"), NULL));
+  EXPECT_TRUE(label_index.HasTaskWithLabel("app", Values("db"), NULL));
+  EXPECT_FALSE(label_index.HasTaskWithLabel("app", Values("cache"), NULL));
+  EXPECT_FALSE(label_index.HasTaskWithLabel("tier", Values("web"), NULL));
+  EXPECT_TRUE(label_index.HasTaskWithLabelKey("app", NULL));
+  label_index.RemoveTask(1);
+  EXPECT_FALSE(label_index.HasTask(1));
+  EXPECT_FALSE(label_index.HasTaskWithLabel("app", Values("web"), NULL));
+  EXPECT_TRUE(label_index.HasTaskWithLabelKey("app", NULL));
+  label_index.RemoveTask(2);
+  EXPECT_FALSE(label_index.HasTaskWithLabelKey("app", NULL));
+  EXPECT_EQ(label_index.num_tasks(), 0);
+  // Removing a task that is not indexed is a no-op.
+  label_index.RemoveTask(2);
+}
+
+// Checks that queries only match the tasks in the given namespaces.
+TEST_F(LabelIndexTest, Namespaces) {
+  LabelIndex label_index;
+  TaskDescriptor td;
+  CreateTask(&td, 1, "prod", "app", "web");
+  label_index.AddTask(td);
+  unordered_set<string> prod;
+  prod.insert("prod");
+  unordered_set<string> dev;
+  dev.insert("dev");
+  unordered_set<string> prod_and_dev;
+  prod_and_dev.insert("dev");
+  prod_and_dev.insert("prod");
+  EXPECT_TRUE(label_index.HasTaskWithLabel("app", Values("web"), &prod));
+  EXPECT_FALSE(label_index.HasTaskWithLabel("app", Values("web"), &dev));
+  EXPECT_TRUE(label_index.HasTaskWithLabel("app", Values("web"),
+                                           &prod_and_dev));
+  EXPECT_TRUE(label_index.HasTaskWithLabelKey("app", &prod));
+  EXPECT_FALSE(label_index.HasTaskWithLabelKey("app", &dev));
+}
+
+// Checks that placed tasks are tracked per machine, and that placing a task
+// again moves it.
+TEST_F(LabelIndexTest, PlaceUnplaceTask) {
+  LabelIndex label_index;
+  ResourceID_t machine1 = GenerateResourceID("machine1");
+  ResourceID_t machine2 = GenerateResourceID("machine2");
+  TaskDescriptor td;
+  CreateTask(&td, 1, "default", "app", "web");
+  label_index.AddTask(td);
+  unordered_set<string> namespaces;
+  namespaces.insert("default");
+  EXPECT_FALSE(label_index.HasPlacedTaskWithLabel(machine1, "app",
+                                                  Values("web"), NULL));
+  label_index.PlaceTask(1, machine1);
+  EXPECT_TRUE(label_index.HasPlacedTaskWithLabel(machine1, "app",
+                                                 Values("web"), &namespaces));
+  EXPECT_TRUE(label_index.HasPlacedTaskWithLabelKey(machine1, "app", NULL));
+  EXPECT_FALSE(label_index.HasPlacedTaskWithLabelKey(machine2, "app", NULL));
+  label_index.PlaceTask(1, machine2);
+  EXPECT_FALSE(label_index.HasPlacedTaskWithLabelKey(machine1, "app", NULL));
+  EXPECT_TRUE(label_index.HasPlacedTaskWithLabel(machine2, "app",
+                                                 Values("web"), NULL));
+  label_index.UnplaceTask(1);
+  EXPECT_FALSE(label_index.HasPlacedTaskWithLabelKey(machine2, "app", NULL));
+  // The task is still indexed after it is unplaced.
+  EXPECT_TRUE(label_index.HasTaskWithLabel("app", Values("web"), NULL));
+  // Removing a placed task also unplaces it.
+  label_index.PlaceTask(1, machine1);
+  label_index.RemoveTask(1);
+  EXPECT_FALSE(label_index.HasPlacedTaskWithLabelKey(machine1, "app", NULL));
+}
+
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
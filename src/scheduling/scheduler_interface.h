@@ -25,6 +25,7 @@
 
 #include <limits>
 #include <set>
+#include <string>
 #include <vector>
 
 #include <ctemplate/template.h>
@@ -34,10 +35,13 @@
 #include "base/job_desc.pb.h"
 #include "base/types.h"
 #include "base/task_final_report.pb.h"
+#include "misc/indexed_queue.h"
 #include "misc/printable_interface.h"
 #include "engine/executors/executor_interface.h"
 #include "engine/executors/topology_manager.h"
 #include "scheduling/knowledge_base.h"
+#include "scheduling/label_index.h"
+#include "scheduling/task_store.h"
 #include "scheduling/scheduling_delta.pb.h"
 #include "storage/object_store_interface.h"
 
@@ -62,6 +66,9 @@ struct SchedulerStats {
   // writing it, running the solver, reading the output and updating again
   // the graph.
   uint64_t total_runtime_;
+  // Solver that computed the flow. With -solver_portfolio, this is the solver
+  // that finished first.
+  string solver_;
 };
 
 class SchedulerInterface : public PrintableInterface {
@@ -73,14 +80,15 @@ class SchedulerInterface : public PrintableInterface {
                      ResourceTopologyNodeDescriptor* resource_topology,
                      shared_ptr<ObjectStoreInterface> object_store,
                      shared_ptr<TaskMap_t> task_map,
-                     unordered_map<string, unordered_map<string, vector<TaskID_t>>>*
-                         labels_map,
-                     vector<TaskID_t> *affinity_antiaffinity_tasks)
+                     LabelIndex* label_index,
+                     IndexedQueue<TaskID_t>* affinity_antiaffinity_tasks,
+                     TaskStore* task_store)
     : job_map_(job_map), knowledge_base_(knowledge_base),
     resource_map_(resource_map), task_map_(task_map),
     object_store_(object_store), resource_topology_(resource_topology),
-    labels_map_(labels_map),
-    affinity_antiaffinity_tasks_(affinity_antiaffinity_tasks) {}
+    label_index_(label_index),
+    affinity_antiaffinity_tasks_(affinity_antiaffinity_tasks),
+    task_store_(task_store) {}
 
   /**
    * Adds a new job. The job will be scheduled on the next run of the scheduler
@@ -323,8 +331,13 @@ class SchedulerInterface : public PrintableInterface {
   // Resource topology (including any registered remote resources)
   ResourceTopologyNodeDescriptor* resource_topology_;
   //Pod affinity/anti-affinity 
-  unordered_map<string, unordered_map<string, vector<TaskID_t>>>* labels_map_;
-  vector<TaskID_t> *affinity_antiaffinity_tasks_;
+  // Index of the task labels; may be NULL.
+  LabelIndex* label_index_;
+  // Queue of the tasks with pod affinity/anti-affinity that wait to be
+  // placed; may be NULL.
+  IndexedQueue<TaskID_t>* affinity_antiaffinity_tasks_;
+  // Store of the tasks that are not in their job's task tree; may be NULL.
+  TaskStore* task_store_;
 };
 
 }  // namespace scheduler
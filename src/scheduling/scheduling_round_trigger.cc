@@ -0,0 +1,101 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "scheduling/scheduling_round_trigger.h"
+
+#include "misc/map-util.h"
+
+namespace firmament {
+
+SchedulingRoundTrigger::SchedulingRoundTrigger(
+    uint64_t max_pending_task_age, uint64_t graph_changes_threshold)
+  : max_pending_task_age_(max_pending_task_age),
+    graph_changes_threshold_(graph_changes_threshold),
+    oldest_runnable_task_time_(0),
+    capacity_freed_(false),
+    graph_changes_after_last_round_(0) {
+}
+
+void SchedulingRoundTrigger::TaskRunnable(TaskID_t task_id, uint64_t time) {
+  boost::lock_guard<boost::mutex> lock(lock_);
+  if (!InsertIfNotPresent(&runnable_task_times_, task_id, time)) {
+    return;
+  }
+  if (oldest_runnable_task_time_ == 0 || time < oldest_runnable_task_time_) {
+    oldest_runnable_task_time_ = time;
+  }
+}
+
+void SchedulingRoundTrigger::TaskNotRunnable(TaskID_t task_id) {
+  boost::lock_guard<boost::mutex> lock(lock_);
+  runnable_task_times_.erase(task_id);
+  if (runnable_task_times_.empty()) {
+    oldest_runnable_task_time_ = 0;
+  }
+}
+
+void SchedulingRoundTrigger::CapacityFreed() {
+  boost::lock_guard<boost::mutex> lock(lock_);
+  capacity_freed_ = true;
+}
+
+void SchedulingRoundTrigger::RoundStarted() {
+  boost::lock_guard<boost::mutex> lock(lock_);
+  capacity_freed_ = false;
+}
+
+void SchedulingRoundTrigger::RoundFinished(uint64_t num_graph_changes) {
+  boost::lock_guard<boost::mutex> lock(lock_);
+  // The tasks that the round did not place keep the time at which they
+  // became runnable.
+  oldest_runnable_task_time_ = 0;
+  for (const auto& task_time : runnable_task_times_) {
+    if (oldest_runnable_task_time_ == 0 ||
+        task_time.second < oldest_runnable_task_time_) {
+      oldest_runnable_task_time_ = task_time.second;
+    }
+  }
+  graph_changes_after_last_round_ = num_graph_changes;
+}
+
+bool SchedulingRoundTrigger::ShouldRunRound(uint64_t now,
+                                            uint64_t num_graph_changes) {
+  boost::lock_guard<boost::mutex> lock(lock_);
+  if (oldest_runnable_task_time_ > 0) {
+    if (capacity_freed_ ||
+        now >= oldest_runnable_task_time_ + max_pending_task_age_) {
+      return true;
+    }
+  }
+  return num_graph_changes >=
+    graph_changes_after_last_round_ + graph_changes_threshold_;
+}
+
+uint64_t SchedulingRoundTrigger::oldest_runnable_task_time() {
+  boost::lock_guard<boost::mutex> lock(lock_);
+  return oldest_runnable_task_time_;
+}
+
+uint64_t SchedulingRoundTrigger::num_runnable_tasks() {
+  boost::lock_guard<boost::mutex> lock(lock_);
+  return runnable_task_times_.size();
+}
+
+}  // namespace firmament
@@ -0,0 +1,120 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Decides when the scheduler service's scheduling loop runs a round. A round
+// is due once the oldest runnable task has waited for long enough, as soon as
+// capacity is freed while tasks are waiting, or once many flow graph changes
+// have accumulated.
+//
+// The trigger keeps the time at which every task that is waiting for a
+// placement became runnable (i.e., was submitted, failed or was evicted).
+// Tasks that a round leaves unplaced keep their times, so they still count
+// towards the age of the oldest task in the next round. It is thread-safe,
+// since the service's handlers report events with and without the
+// scheduling lock held.
+
+#ifndef FIRMAMENT_SCHEDULING_SCHEDULING_ROUND_TRIGGER_H
+#define FIRMAMENT_SCHEDULING_SCHEDULING_ROUND_TRIGGER_H
+
+#include <boost/thread/mutex.hpp>
+
+#include "base/common.h"
+#include "base/types.h"
+
+namespace firmament {
+
+class SchedulingRoundTrigger {
+ public:
+  /**
+   * @param max_pending_task_age the age in microseconds of the oldest runnable
+   * task at which a round is due
+   * @param graph_changes_threshold the number of flow graph changes since the
+   * last round at which a round is due
+   */
+  SchedulingRoundTrigger(uint64_t max_pending_task_age,
+                         uint64_t graph_changes_threshold);
+
+  /**
+   * Records that a task became runnable. A task that is already waiting keeps
+   * the time at which it first became runnable.
+   * @param time the time in microseconds at which the task became runnable
+   */
+  void TaskRunnable(TaskID_t task_id, uint64_t time);
+
+  /**
+   * Records that a task no longer waits for a placement, because it was
+   * placed, completed or removed.
+   */
+  void TaskNotRunnable(TaskID_t task_id);
+
+  /**
+   * Records that resources were freed or added (e.g., a task completed or a
+   * node was added), which may allow waiting tasks to be placed.
+   */
+  void CapacityFreed();
+
+  /**
+   * Called at the start of a round. The events reported so far are
+   * considered in the round.
+   */
+  void RoundStarted();
+
+  /**
+   * Called at the end of a round, once the tasks the round placed have been
+   * reported as not runnable.
+   * @param num_graph_changes the number of pending flow graph changes
+   */
+  void RoundFinished(uint64_t num_graph_changes);
+
+  /**
+   * Returns true if a round is due.
+   * @param now the current time in microseconds
+   * @param num_graph_changes the number of pending flow graph changes
+   */
+  bool ShouldRunRound(uint64_t now, uint64_t num_graph_changes);
+
+  /**
+   * Returns the time at which the oldest waiting task became runnable, or 0
+   * if no task is waiting.
+   */
+  uint64_t oldest_runnable_task_time();
+
+  uint64_t num_runnable_tasks();
+
+ private:
+  uint64_t max_pending_task_age_;
+  uint64_t graph_changes_threshold_;
+  boost::mutex lock_;
+  // Time at which each waiting task became runnable.
+  unordered_map<TaskID_t, uint64_t> runnable_task_times_;
+  // Lower bound on the times in runnable_task_times_, or 0 if it is empty.
+  // It is only recomputed at the end of a round, so it may be older than
+  // the oldest waiting task if that task was placed by other means.
+  uint64_t oldest_runnable_task_time_;
+  // True if capacity was freed since the start of the last round.
+  bool capacity_freed_;
+  // Number of pending flow graph changes at the end of the last round. The
+  // change count is only reset when the solver runs.
+  uint64_t graph_changes_after_last_round_;
+};
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SCHEDULING_SCHEDULING_ROUND_TRIGGER_H
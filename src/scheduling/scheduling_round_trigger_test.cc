@@ -0,0 +1,203 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Scheduling round trigger unit tests.
+
+#include <gtest/gtest.h>
+
+#include <deque>
+
+#include "scheduling/scheduling_round_trigger.h"
+
+namespace firmament {
+
+// All times are in microseconds.
+static const uint64_t kMaxPendingTaskAge = 500000;
+static const uint64_t kGraphChangesThreshold = 100;
+static const uint64_t kCheckInterval = 10000;
+static const uint64_t kMinRoundGap = 100000;
+
+class SchedulingRoundTriggerTest : public ::testing::Test {
+ protected:
+  SchedulingRoundTriggerTest()
+    : trigger_(kMaxPendingTaskAge, kGraphChangesThreshold),
+      num_free_slots_(0), last_round_end_time_(0) {
+    FLAGS_v = 2;
+  }
+
+  // Mirrors the service's scheduling loop: checks the trigger every
+  // kCheckInterval until `end`, and runs a round if one is due and the last
+  // round ended at least kMinRoundGap ago. A round places waiting tasks, in
+  // submission order, while there are free slots. Returns the times of the
+  // rounds.
+  vector<uint64_t> RunLoop(uint64_t start, uint64_t end) {
+    vector<uint64_t> round_times;
+    for (uint64_t now = start; now < end; now += kCheckInterval) {
+      if (now < last_round_end_time_ + kMinRoundGap ||
+          !trigger_.ShouldRunRound(now, 0)) {
+        continue;
+      }
+      trigger_.RoundStarted();
+      while (num_free_slots_ > 0 && !waiting_tasks_.empty()) {
+        trigger_.TaskNotRunnable(waiting_tasks_.front());
+        waiting_tasks_.pop_front();
+        num_free_slots_--;
+      }
+      trigger_.RoundFinished(0);
+      last_round_end_time_ = now;
+      round_times.push_back(now);
+    }
+    return round_times;
+  }
+
+  void SubmitTask(TaskID_t task_id, uint64_t now) {
+    waiting_tasks_.push_back(task_id);
+    trigger_.TaskRunnable(task_id, now);
+  }
+
+  void CompleteTask(TaskID_t task_id) {
+    num_free_slots_++;
+    trigger_.TaskNotRunnable(task_id);
+    trigger_.CapacityFreed();
+  }
+
+  SchedulingRoundTrigger trigger_;
+  std::deque<TaskID_t> waiting_tasks_;
+  uint64_t num_free_slots_;
+  uint64_t last_round_end_time_;
+};
+
+TEST_F(SchedulingRoundTriggerTest, NoRoundWithoutWork) {
+  EXPECT_FALSE(trigger_.ShouldRunRound(10 * kMaxPendingTaskAge, 0));
+  // Freed capacity alone does not start a round.
+  trigger_.CapacityFreed();
+  EXPECT_FALSE(trigger_.ShouldRunRound(10 * kMaxPendingTaskAge, 0));
+}
+
+TEST_F(SchedulingRoundTriggerTest, PendingTaskAge) {
+  trigger_.TaskRunnable(1, 1000);
+  trigger_.TaskRunnable(2, 2000);
+  // A task that becomes runnable again keeps its first time.
+  trigger_.TaskRunnable(1, 3000);
+  EXPECT_EQ(trigger_.oldest_runnable_task_time(), 1000);
+  EXPECT_EQ(trigger_.num_runnable_tasks(), 2);
+  EXPECT_FALSE(trigger_.ShouldRunRound(1000 + kMaxPendingTaskAge - 1, 0));
+  EXPECT_TRUE(trigger_.ShouldRunRound(1000 + kMaxPendingTaskAge, 0));
+}
+
+// Checks that the tasks that a round leaves unplaced still count towards the
+// age of the oldest task, with the time at which they became runnable.
+TEST_F(SchedulingRoundTriggerTest, UnplacedTasksKeepTheirAge) {
+  trigger_.TaskRunnable(1, 1000);
+  trigger_.TaskRunnable(2, 2000);
+  trigger_.TaskRunnable(3, 3000);
+  trigger_.RoundStarted();
+  trigger_.TaskNotRunnable(1);
+  trigger_.RoundFinished(0);
+  EXPECT_EQ(trigger_.oldest_runnable_task_time(), 2000);
+  EXPECT_FALSE(trigger_.ShouldRunRound(2000 + kMaxPendingTaskAge - 1, 0));
+  EXPECT_TRUE(trigger_.ShouldRunRound(2000 + kMaxPendingTaskAge, 0));
+  // Once all tasks are placed, no round is due.
+  trigger_.RoundStarted();
+  trigger_.TaskNotRunnable(2);
+  trigger_.TaskNotRunnable(3);
+  trigger_.RoundFinished(0);
+  EXPECT_EQ(trigger_.oldest_runnable_task_time(), 0);
+  EXPECT_FALSE(trigger_.ShouldRunRound(10 * kMaxPendingTaskAge, 0));
+}
+
+TEST_F(SchedulingRoundTriggerTest, CapacityFreedWhileTasksWait) {
+  trigger_.TaskRunnable(1, 1000);
+  EXPECT_FALSE(trigger_.ShouldRunRound(2000, 0));
+  trigger_.CapacityFreed();
+  EXPECT_TRUE(trigger_.ShouldRunRound(2000, 0));
+  // The round considers the freed capacity.
+  trigger_.RoundStarted();
+  trigger_.RoundFinished(0);
+  EXPECT_FALSE(trigger_.ShouldRunRound(2000, 0));
+  // Capacity that is freed while the round runs starts another round.
+  trigger_.RoundStarted();
+  trigger_.CapacityFreed();
+  trigger_.RoundFinished(0);
+  EXPECT_TRUE(trigger_.ShouldRunRound(2000, 0));
+}
+
+TEST_F(SchedulingRoundTriggerTest, GraphChangesThreshold) {
+  EXPECT_FALSE(trigger_.ShouldRunRound(0, kGraphChangesThreshold - 1));
+  EXPECT_TRUE(trigger_.ShouldRunRound(0, kGraphChangesThreshold));
+  // The changes that were pending at the end of the last round do not count.
+  trigger_.RoundStarted();
+  trigger_.RoundFinished(50);
+  EXPECT_FALSE(trigger_.ShouldRunRound(0, 50 + kGraphChangesThreshold - 1));
+  EXPECT_TRUE(trigger_.ShouldRunRound(0, 50 + kGraphChangesThreshold));
+}
+
+// Runs the loop with a single slot: the first task is placed once it is old
+// enough, the second task waits for the slot and is placed as soon as the
+// first task completes, and the loop then stays idle.
+TEST_F(SchedulingRoundTriggerTest, SchedulingLoop) {
+  num_free_slots_ = 1;
+  // The loop starts after the minimum round gap.
+  uint64_t submit_time = kMinRoundGap;
+  SubmitTask(1, submit_time);
+  SubmitTask(2, submit_time);
+  uint64_t start = submit_time;
+  vector<uint64_t> round_times =
+    RunLoop(start, submit_time + kMaxPendingTaskAge);
+  EXPECT_TRUE(round_times.empty());
+  start = submit_time + kMaxPendingTaskAge;
+  round_times = RunLoop(start, start + kCheckInterval);
+  ASSERT_EQ(round_times.size(), 1);
+  EXPECT_EQ(waiting_tasks_.size(), 1);
+  // The unplaced task is older than the maximum age, so the loop keeps
+  // running rounds for it, kMinRoundGap apart.
+  start = round_times[0] + kCheckInterval;
+  round_times = RunLoop(start, start + 2 * kMinRoundGap);
+  ASSERT_EQ(round_times.size(), 2);
+  EXPECT_EQ(round_times[1] - round_times[0], kMinRoundGap);
+  EXPECT_EQ(waiting_tasks_.size(), 1);
+  // A completion places the waiting task in the next round that the gap
+  // allows.
+  start = round_times[1] + kCheckInterval;
+  CompleteTask(1);
+  round_times = RunLoop(start, start + kMinRoundGap);
+  ASSERT_EQ(round_times.size(), 1);
+  EXPECT_TRUE(waiting_tasks_.empty());
+  EXPECT_EQ(trigger_.num_runnable_tasks(), 0);
+  // A task submitted after a completion is placed straight away, without
+  // waiting for it to age.
+  start = round_times[0] + kMinRoundGap;
+  CompleteTask(2);
+  SubmitTask(3, start);
+  round_times = RunLoop(start, start + kCheckInterval);
+  ASSERT_EQ(round_times.size(), 1);
+  EXPECT_TRUE(waiting_tasks_.empty());
+  // Nothing is waiting, so no more rounds run.
+  start += kCheckInterval;
+  round_times = RunLoop(start, start + 10 * kMaxPendingTaskAge);
+  EXPECT_TRUE(round_times.empty());
+}
+
+}  // namespace firmament
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
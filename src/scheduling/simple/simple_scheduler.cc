@@ -55,12 +55,13 @@ SimpleScheduler::SimpleScheduler(
     ResourceID_t coordinator_res_id,
     const string& coordinator_uri,
     TimeInterface* time_manager,
-    TraceGenerator* trace_generator)
+    TraceGenerator* trace_generator,
+    TaskStore* task_store)
     : EventDrivenScheduler(job_map, resource_map, resource_topology,
                            object_store, task_map, knowledge_base, topo_mgr,
                            m_adapter, event_notifier, coordinator_res_id,
                            coordinator_uri, time_manager, trace_generator, NULL,
-                           NULL) {
+                           NULL, task_store) {
   VLOG(1) << "SimpleScheduler initiated.";
 }
 
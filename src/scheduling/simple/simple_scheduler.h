@@ -55,7 +55,8 @@ class SimpleScheduler : public EventDrivenScheduler {
                   ResourceID_t coordinator_res_id,
                   const string& coordinator_uri,
                   TimeInterface* time_manager,
-                  TraceGenerator* trace_generator);
+                  TraceGenerator* trace_generator,
+                  TaskStore* task_store);
   ~SimpleScheduler();
   void HandleTaskCompletion(TaskDescriptor* td_ptr,
                             TaskFinalReport* report);
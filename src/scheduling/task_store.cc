@@ -0,0 +1,136 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "scheduling/task_store.h"
+
+#include "misc/map-util.h"
+#include "misc/utils.h"
+
+namespace firmament {
+
+const TaskHandle_t TaskStore::kInvalidTaskHandle;
+const uint32_t TaskStore::kNoSlot;
+
+TaskStore::TaskStore(shared_ptr<TaskMap_t> task_map)
+  : task_map_(task_map) {
+}
+
+TaskDescriptor* TaskStore::AddTask(const TaskDescriptor& td) {
+  if (free_slots_.empty()) {
+    CHECK_LT(slots_.size(), kNoSlot) << "Too many tasks";
+    free_slots_.push_back(static_cast<uint32_t>(slots_.size()));
+    slots_.push_back(Slot());
+  }
+  uint32_t slot_index = free_slots_.back();
+  Slot* slot = &slots_[slot_index];
+  slot->td_.CopyFrom(td);
+  CHECK(InsertIfNotPresent(task_map_.get(), td.uid(), &slot->td_));
+  CHECK(InsertIfNotPresent(&slot_for_task_, td.uid(), slot_index));
+  free_slots_.pop_back();
+  slot->job_id_ = JobIDFromString(td.job_id());
+  slot->used_ = true;
+  // Append the task to the job's list.
+  JobTasks* job_tasks = FindOrNull(tasks_for_job_, slot->job_id_);
+  if (job_tasks) {
+    slot->prev_ = job_tasks->last_;
+    slots_[job_tasks->last_].next_ = slot_index;
+    job_tasks->last_ = slot_index;
+  } else {
+    slot->prev_ = kNoSlot;
+    JobTasks new_job_tasks;
+    new_job_tasks.first_ = slot_index;
+    new_job_tasks.last_ = slot_index;
+    CHECK(InsertIfNotPresent(&tasks_for_job_, slot->job_id_, new_job_tasks));
+  }
+  slot->next_ = kNoSlot;
+  return &slot->td_;
+}
+
+bool TaskStore::RemoveTask(TaskID_t task_id) {
+  uint32_t* slot_index_ptr = FindOrNull(slot_for_task_, task_id);
+  if (!slot_index_ptr) {
+    return false;
+  }
+  uint32_t slot_index = *slot_index_ptr;
+  Slot* slot = &slots_[slot_index];
+  // Unlink the task from the job's list.
+  JobTasks* job_tasks = FindOrNull(tasks_for_job_, slot->job_id_);
+  CHECK_NOTNULL(job_tasks);
+  if (slot->prev_ == kNoSlot) {
+    job_tasks->first_ = slot->next_;
+  } else {
+    slots_[slot->prev_].next_ = slot->next_;
+  }
+  if (slot->next_ == kNoSlot) {
+    job_tasks->last_ = slot->prev_;
+  } else {
+    slots_[slot->next_].prev_ = slot->prev_;
+  }
+  if (job_tasks->first_ == kNoSlot) {
+    tasks_for_job_.erase(slot->job_id_);
+  }
+  task_map_->erase(task_id);
+  slot_for_task_.erase(task_id);
+  // Swap with an empty descriptor rather than calling Clear(), which would
+  // keep the memory of the descriptor's fields around.
+  TaskDescriptor().Swap(&slot->td_);
+  slot->used_ = false;
+  // Generation 0 is skipped so that no handle equals kInvalidTaskHandle.
+  if (++slot->generation_ == 0) {
+    slot->generation_ = 1;
+  }
+  free_slots_.push_back(slot_index);
+  return true;
+}
+
+TaskHandle_t TaskStore::HandleForTask(TaskID_t task_id) const {
+  const uint32_t* slot_index = FindOrNull(slot_for_task_, task_id);
+  if (!slot_index) {
+    return kInvalidTaskHandle;
+  }
+  return MakeHandle(*slot_index, slots_[*slot_index].generation_);
+}
+
+TaskDescriptor* TaskStore::FindTask(TaskHandle_t handle) {
+  uint64_t slot_index = handle & 0xFFFFFFFFULL;
+  uint32_t generation = static_cast<uint32_t>(handle >> 32);
+  if (slot_index >= slots_.size()) {
+    return NULL;
+  }
+  Slot* slot = &slots_[slot_index];
+  if (!slot->used_ || slot->generation_ != generation) {
+    return NULL;
+  }
+  return &slot->td_;
+}
+
+void TaskStore::TasksForJob(JobID_t job_id, vector<TaskDescriptor*>* tasks) {
+  CHECK_NOTNULL(tasks);
+  JobTasks* job_tasks = FindOrNull(tasks_for_job_, job_id);
+  if (!job_tasks) {
+    return;
+  }
+  for (uint32_t slot_index = job_tasks->first_; slot_index != kNoSlot;
+       slot_index = slots_[slot_index].next_) {
+    tasks->push_back(&slots_[slot_index].td_);
+  }
+}
+
+}  // namespace firmament
@@ -0,0 +1,127 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Compact store for the descriptors of the tasks that the scheduler service
+// adds to existing jobs. The descriptors live in a slot table outside the
+// JobDescriptor tree, so removing a task frees its descriptor and its slot
+// is reused, rather than it being kept in the root task's spawned list
+// forever. Every task gets a generation-tagged handle; the handle of a
+// removed task stays invalid even after its slot is reused.
+//
+// The store registers the descriptors in the task map, and keeps a list of
+// the tasks of every job, which schedulers visit alongside the root task's
+// spawned tasks. It is not thread-safe; callers hold the scheduling lock.
+
+#ifndef FIRMAMENT_SCHEDULING_TASK_STORE_H
+#define FIRMAMENT_SCHEDULING_TASK_STORE_H
+
+#include <deque>
+#include <vector>
+
+#include "base/common.h"
+#include "base/task_desc.pb.h"
+#include "base/types.h"
+
+namespace firmament {
+
+// The slot of the task in the low 32 bits, and the generation of the slot
+// in the high 32 bits.
+typedef uint64_t TaskHandle_t;
+
+class TaskStore {
+ public:
+  static const TaskHandle_t kInvalidTaskHandle = 0;
+
+  explicit TaskStore(shared_ptr<TaskMap_t> task_map);
+
+  /**
+   * Copies a task descriptor into the store and adds it to the task map.
+   * @param td the descriptor of a task that is not in the task map
+   * @return the stored descriptor, which remains valid until the task is
+   * removed
+   */
+  TaskDescriptor* AddTask(const TaskDescriptor& td);
+
+  /**
+   * Removes a task from the task map and frees its descriptor.
+   * @return false if the task is not in the store
+   */
+  bool RemoveTask(TaskID_t task_id);
+
+  /**
+   * Returns the handle of a stored task, or kInvalidTaskHandle.
+   */
+  TaskHandle_t HandleForTask(TaskID_t task_id) const;
+
+  /**
+   * Returns the descriptor of the task with the given handle, or NULL if the
+   * task has been removed.
+   */
+  TaskDescriptor* FindTask(TaskHandle_t handle);
+
+  /**
+   * Appends the stored tasks of a job to a vector, in the order in which they
+   * were added.
+   */
+  void TasksForJob(JobID_t job_id, vector<TaskDescriptor*>* tasks);
+
+  inline uint64_t num_tasks() const {
+    return slot_for_task_.size();
+  }
+
+  inline uint64_t num_slots() const {
+    return slots_.size();
+  }
+
+ private:
+  static const uint32_t kNoSlot = UINT32_MAX;
+
+  struct Slot {
+    TaskDescriptor td_;
+    JobID_t job_id_;
+    // Incremented when the slot is freed.
+    uint32_t generation_;
+    bool used_;
+    // Neighbours in the list of the job's tasks.
+    uint32_t prev_;
+    uint32_t next_;
+    Slot() : generation_(1), used_(false), prev_(kNoSlot), next_(kNoSlot) {}
+  };
+
+  struct JobTasks {
+    uint32_t first_;
+    uint32_t last_;
+  };
+
+  static inline TaskHandle_t MakeHandle(uint32_t slot, uint32_t generation) {
+    return (static_cast<uint64_t>(generation) << 32) | slot;
+  }
+
+  shared_ptr<TaskMap_t> task_map_;
+  // A deque, so that growing it does not move the descriptors.
+  std::deque<Slot> slots_;
+  vector<uint32_t> free_slots_;
+  unordered_map<TaskID_t, uint32_t> slot_for_task_;
+  unordered_map<JobID_t, JobTasks, boost::hash<JobID_t>> tasks_for_job_;
+};
+
+}  // namespace firmament
+
+#endif  // FIRMAMENT_SCHEDULING_TASK_STORE_H
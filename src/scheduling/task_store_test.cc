@@ -0,0 +1,128 @@
+/*
+ * Firmament
+ * Copyright (c) The Firmament Authors.
+ * All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * THIS CODE IS PROVIDED ON AN *AS IS* BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING WITHOUT
+ * LIMITATION ANY IMPLIED WARRANTIES OR CONDITIONS OF TITLE, FITNESS FOR
+ * A PARTICULAR PURPOSE, MERCHANTABLITY OR NON-INFRINGEMENT.
+ *
+ * See the Apache Version 2.0 License for specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Task store unit tests.
+
+#include <gtest/gtest.h>
+
+#include "misc/map-util.h"
+#include "misc/utils.h"
+#include "scheduling/task_store.h"
+
+namespace firmament {
+
+class TaskStoreTest : public ::testing::Test {
+ protected:
+  TaskStoreTest()
+    : task_map_(new TaskMap_t), task_store_(task_map_),
+      job1_(GenerateJobID()), job2_(GenerateJobID()) {
+    FLAGS_v = 2;
+  }
+
+  TaskDescriptor* AddTask(TaskID_t task_id, JobID_t job_id) {
+    TaskDescriptor td;
+    td.set_uid(task_id);
+    td.set_job_id(to_string(job_id));
+    td.set_name("task_" + to_string(task_id));
+    return task_store_.AddTask(td);
+  }
+
+  vector<TaskID_t> TaskIDsForJob(JobID_t job_id) {
+    vector<TaskDescriptor*> tasks;
+    task_store_.TasksForJob(job_id, &tasks);
+    vector<TaskID_t> task_ids;
+    for (const auto& td_ptr : tasks) {
+      task_ids.push_back(td_ptr->uid());
+    }
+    return task_ids;
+  }
+
+  shared_ptr<TaskMap_t> task_map_;
+  TaskStore task_store_;
+  JobID_t job1_;
+  JobID_t job2_;
+};
+
+// Checks that stored tasks are in the task map until they are removed.
+TEST_F(TaskStoreTest, AddRemoveTask) {
+  TaskDescriptor* td_ptr = AddTask(1, job1_);
+  EXPECT_EQ(td_ptr->uid(), 1);
+  EXPECT_EQ(td_ptr->name(), "task_1");
+  EXPECT_EQ(FindPtrOrNull(*task_map_, 1), td_ptr);
+  EXPECT_EQ(task_store_.num_tasks(), 1);
+  EXPECT_TRUE(task_store_.RemoveTask(1));
+  EXPECT_TRUE(FindPtrOrNull(*task_map_, 1) == NULL);
+  EXPECT_EQ(task_store_.num_tasks(), 0);
+  EXPECT_FALSE(task_store_.RemoveTask(1));
+}
+
+// Checks that slots are reused and that the handles of removed tasks stay
+// invalid.
+TEST_F(TaskStoreTest, HandleGenerations) {
+  AddTask(1, job1_);
+  TaskHandle_t handle1 = task_store_.HandleForTask(1);
+  EXPECT_NE(handle1, TaskStore::kInvalidTaskHandle);
+  EXPECT_EQ(task_store_.FindTask(handle1)->uid(), 1);
+  EXPECT_TRUE(task_store_.RemoveTask(1));
+  EXPECT_EQ(task_store_.HandleForTask(1), TaskStore::kInvalidTaskHandle);
+  EXPECT_TRUE(task_store_.FindTask(handle1) == NULL);
+  AddTask(2, job1_);
+  TaskHandle_t handle2 = task_store_.HandleForTask(2);
+  EXPECT_NE(handle2, handle1);
+  EXPECT_TRUE(task_store_.FindTask(handle1) == NULL);
+  EXPECT_EQ(task_store_.FindTask(handle2)->uid(), 2);
+  EXPECT_EQ(task_store_.num_slots(), 1);
+  // Many adds and removes do not grow the store.
+  for (TaskID_t task_id = 3; task_id < 1000; ++task_id) {
+    AddTask(task_id, job2_);
+    EXPECT_TRUE(task_store_.RemoveTask(task_id));
+  }
+  EXPECT_EQ(task_store_.num_slots(), 2);
+  EXPECT_EQ(task_store_.num_tasks(), 1);
+}
+
+// Checks that the tasks of a job are listed in order of addition.
+TEST_F(TaskStoreTest, TasksForJob) {
+  for (TaskID_t task_id = 1; task_id <= 5; ++task_id) {
+    AddTask(task_id, task_id % 2 ? job1_ : job2_);
+  }
+  EXPECT_EQ(TaskIDsForJob(job1_), vector<TaskID_t>({1, 3, 5}));
+  EXPECT_EQ(TaskIDsForJob(job2_), vector<TaskID_t>({2, 4}));
+  // Remove the first, a middle and the last task.
+  EXPECT_TRUE(task_store_.RemoveTask(3));
+  EXPECT_EQ(TaskIDsForJob(job1_), vector<TaskID_t>({1, 5}));
+  EXPECT_TRUE(task_store_.RemoveTask(1));
+  EXPECT_TRUE(task_store_.RemoveTask(4));
+  EXPECT_EQ(TaskIDsForJob(job1_), vector<TaskID_t>({5}));
+  EXPECT_EQ(TaskIDsForJob(job2_), vector<TaskID_t>({2}));
+  EXPECT_TRUE(task_store_.RemoveTask(5));
+  EXPECT_TRUE(TaskIDsForJob(job1_).empty());
+  // The freed slot goes to the new task, which is appended to the job.
+  AddTask(6, job2_);
+  EXPECT_EQ(TaskIDsForJob(job2_), vector<TaskID_t>({2, 6}));
+  EXPECT_EQ(task_store_.num_slots(), 5);
+}
+
+}  // namespace firmament
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}